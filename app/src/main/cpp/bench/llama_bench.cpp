@@ -0,0 +1,1508 @@
+/**
+ * llama_bench.cpp - Micro-benchmarks for the native generate path
+ *
+ * Measures llamacore::generateAction (everything LlamaNative_generate does
+ * minus the JNI string conversions) for each stub intent branch across
+ * prompt sizes, and reports latency percentiles plus heap allocations per
+ * call.
+ *
+ * Prompts mirror PromptTemplates.buildSimplePrompt: an instruction block,
+ * a context section that grows with the number of goals and tasks, and the
+ * user message.
+ *
+ * Streaming cases report time to first chunk (TTFC), the latency a user
+ * watching the reply appear actually feels.
+ *
+ * Speculative cases attach a draft model or enable prompt lookup and check
+ * the output is unchanged. A stub draft always guesses what the stub target
+ * picks, so acceptance is near 100% and the time shows verification
+ * overhead, not a real speedup. The stub cuts text into 3-byte tokens from
+ * wherever it starts, so a title echoed from the prompt only tokenizes the
+ * same one time in three; prompt lookup matches far less than on a BPE
+ * vocabulary.
+ *
+ * Async cases submit every request from one thread and wait for the
+ * completions, then submit a second round and cancel it at once.
+ *
+ * Thread cases compare decode step jitter (p99 - p50 step time, from the
+ * model info) with default placement and with the decode threads on the
+ * performance cores at high priority, idle and with every core kept busy
+ * by spinning threads.
+ *
+ * Autotune cases time a load that probes thread counts and batch sizes
+ * against one that reads the stored result back, and check both pick the
+ * same configuration.
+ *
+ * Memory cases load the stub model, whose shape is a notional 64 MB model,
+ * under shrinking budgets and show the plan chosen for each; the smallest
+ * budget must be refused. The weights count as mmap'd, so the budgets only
+ * cover the KV cache, compute buffers and overhead.
+ *
+ * KV cases load the model with each KV cache type and run the command
+ * corpus of DeterministicParserTest, reporting cache memory saved against
+ * f16, decode tokens/s, the share of replies naming the action the command
+ * asks for, and the share identical to the f16 reply. The stub ignores the
+ * cache type, so only the memory column moves here; on a real model the
+ * last two columns show what quantization costs.
+ *
+ * Shift cases hold a conversation that outgrows a 512-token context with
+ * the instruction block pinned; prompt tokens evaluated per turn should
+ * stay flat once older turns start being shifted out.
+ *
+ * Token cases time the template prompts with the whole prompt tokenized
+ * per call and with the instruction head and response tail taken from the
+ * template token cache, then check that a token file written next to a
+ * model is picked up when it loads. The stub tokenizer is a byte loop, so
+ * only the tokenized bytes column shows the full effect; a BPE tokenizer
+ * pays per byte several times over.
+ *
+ * Assembly cases prepare the template prompts from goal and task fields
+ * (prompt_assembly.h) against building the prompt string and tokenizing
+ * it with the templates cached, which is what the Kotlin path costs minus
+ * the JNI copy. Both must give the same text and the same reply. Against
+ * the stub's byte-loop tokenizer the times only show the cache overhead;
+ * what a BPE tokenizer would be spared is in the tokenized bytes column
+ * (the assembled path tokenizes the user message and span misses only).
+ *
+ * Record cases parse each intent's reply into an action record
+ * (action_record.h), the work pollAction adds to a request, and check the
+ * record names the action of the reply to every command of the corpus,
+ * carries four-byte characters (escaped or not) as
+ * plain UTF-8, and keeps an unparsable reply whole.
+ *
+ * Scan cases time scanAction (json_scan.h), the SIMD structural index and
+ * schema walk, against parseAction, which decodes the object after it, on
+ * the intent replies and on a truncated, an off-schema, a wrapped and a
+ * long reply, and check the status each gets.
+ *
+ * The response cache is disabled for every series but its own, which
+ * compares a decoded reply with a cached one and checks that a changed
+ * goal/task context invalidates the entry.
+ *
+ * Usage:
+ *   llama_bench [--iterations N] [--filter SUBSTRING]
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "action_record.h"
+#include "autotune.h"
+#include "intent_detector.h"
+#include "json_scan.h"
+#include "llama_core.h"
+#include "memory_plan.h"
+#include "model_weights.h"
+#include "prompt_assembly.h"
+#include "response_builder.h"
+#include "response_cache.h"
+#include "template_tokens.h"
+
+// ============================================================================
+// Allocation Counting
+// ============================================================================
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// ============================================================================
+// Prompt Construction (mirrors PromptTemplates.kt)
+// ============================================================================
+
+namespace {
+
+const char* const kInstructionCompact =
+        "Reply in JSON only. Format: {\"action\":\"<type>\",\"message\":\"<text>\",\"data\":{...}}\n"
+        "Actions: reply, create_goal, create_task, complete_task, show_progress\n"
+        "create_goal data: goalTitle, durationMonths, dailyMinutes\n"
+        "create_task data: taskTitle, dueDate, minutes\n"
+        "Output JSON only, no other text.";
+
+// Context item titles deliberately avoid intent keywords
+const char* const kGoalTitles[] = {
+        "Learn Spanish", "Guitar practice", "Run a marathon", "Read classics", "Sketch daily"};
+const char* const kTaskTitles[] = {
+        "Review notes", "Practice scales", "Morning run", "Vocabulary drill", "Reading hour"};
+
+std::string buildContext(int items) {
+    std::string sb;
+    if (items > 0) {
+        sb += "\nContext - Goals: ";
+        for (int i = 0; i < items; ++i) {
+            if (i > 0) sb += "; ";
+            sb += kGoalTitles[i % 5];
+            sb += " " + std::to_string(i) + "|30min|ends:2026-06-01";
+        }
+        sb += "\nContext - Today's Tasks: ";
+        for (int i = 0; i < items; ++i) {
+            if (i > 0) sb += "; ";
+            sb += (i % 2 == 0) ? "\xE2\x9C\x93" : "\xE2\x97\x8B";  // ✓ / ○
+            sb += kTaskTitles[i % 5];
+            sb += " " + std::to_string(i) + "|20min";
+        }
+    } else {
+        sb += "\nContext: No active goals or tasks yet.";
+    }
+    return sb;
+}
+
+/**
+ * @param withInstruction Include the compact instruction block. Note that it
+ *        lists every action name, so such prompts always classify as
+ *        create_goal; branch cases are measured without it.
+ */
+std::string buildPrompt(const std::string& userMessage, int items, bool withInstruction) {
+    std::string prompt = "### Instruction:\n";
+    if (withInstruction) {
+        prompt += kInstructionCompact;
+    }
+    prompt += buildContext(items);
+    prompt += "\n\n### Input:\n";
+    prompt += userMessage;
+    prompt += "\n\n### Response (JSON only):\n";
+    return prompt;
+}
+
+struct IntentCase {
+    const char* name;
+    const char* userMessage;
+    llamacore::Intent expected;
+};
+
+const IntentCase kIntentCases[] = {
+        {"create_goal", "Create a goal \"Learn Python\" in 6 months at 60 minutes per day",
+         llamacore::Intent::CreateGoal},
+        {"add_task", "Add task \"Watch OOP video\" tomorrow for 30 minutes",
+         llamacore::Intent::AddTask},
+        {"complete", "I finished the \"Review notes\" one", llamacore::Intent::Complete},
+        {"progress", "How am I doing today?", llamacore::Intent::Progress},
+        {"default", "Tell me something motivating", llamacore::Intent::Default},
+};
+
+struct CommandCase {
+    const char* userMessage;
+    const char* action;  // what the reply should name, per JsonResponseParser
+};
+
+// The commands of DeterministicParserTest and the actions they parse to
+const CommandCase kCommandCorpus[] = {
+        {"create goal Learn Python", "create_goal"},
+        {"create goal Learn Kotlin in 6 months", "create_goal"},
+        {"create goal Practice piano 45 minutes daily", "create_goal"},
+        {"create goal Master chess in 12 months 60 minutes per day", "create_goal"},
+        {"new goal Exercise regularly", "create_goal"},
+        {"add goal Read 50 books", "create_goal"},
+        {"start goal Meditation practice in 2 months 15 minutes per day", "create_goal"},
+        {"add task Review notes", "create_task"},
+        {"add task Submit report tomorrow", "create_task"},
+        {"create task Call mom today", "create_task"},
+        {"add task Study algorithms 45 minutes", "create_task"},
+        {"add task Practice scales for Piano goal", "create_task"},
+        {"new task Go grocery shopping", "create_task"},
+        {"complete task Review notes", "complete_task"},
+        {"done task Submit homework", "complete_task"},
+        {"finish task Code review", "complete_task"},
+        {"finished with task Morning run", "complete_task"},
+        {"delete goal Learn Spanish", "delete_goal"},
+        {"remove goal Exercise routine", "delete_goal"},
+        {"delete task Buy groceries", "delete_task"},
+        {"remove task Clean room", "delete_task"},
+        {"show progress", "show_progress"},
+        {"show my progress", "show_progress"},
+        {"what's my progress", "show_progress"},
+        {"how am i doing", "show_progress"},
+        {"my status", "show_progress"},
+        {"Hello, how are you?", "reply"},
+        {"CREATE GOAL Test Goal", "create_goal"},
+        {"create   goal    Learn   Python", "create_goal"},
+        {"create goal Complete 100 pushups challenge", "create_goal"},
+        {"add task Practice chords tomorrow 30 minutes for Guitar goal", "create_task"},
+};
+
+// Number of goals and tasks in the context section; 50 items is ~3.5 KB,
+// about 1200 stub tokens, which still fits the default 2048-token context
+const int kContextSizes[] = {0, 5, 25, 50};
+
+// ============================================================================
+// Harness
+// ============================================================================
+
+struct Benchmark {
+    std::string name;
+    size_t promptBytes;
+    std::function<void()> body;
+};
+
+struct Options {
+    int iterations = 2000;
+    const char* filter = nullptr;
+};
+
+double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void runBenchmark(const Benchmark& bench, const Options& options) {
+    // Warm up caches and lazily initialized state
+    for (int i = 0; i < std::max(1, options.iterations / 10); ++i) {
+        bench.body();
+    }
+
+    std::vector<double> samples;
+    samples.reserve(options.iterations);
+
+    uint64_t allocsBefore = g_allocations.load(std::memory_order_relaxed);
+    for (int i = 0; i < options.iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        bench.body();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    uint64_t allocsAfter = g_allocations.load(std::memory_order_relaxed);
+
+    // The samples vector itself was reserved up front, so every counted
+    // allocation belongs to the measured body
+    double allocsPerCall = static_cast<double>(allocsAfter - allocsBefore) / options.iterations;
+
+    std::sort(samples.begin(), samples.end());
+    double mean = 0.0;
+    for (double s : samples) mean += s;
+    mean /= samples.size();
+
+    std::printf("%-36s %9zu %10.0f %10.0f %10.0f %10.0f %10.2f\n",
+                bench.name.c_str(), bench.promptBytes, mean,
+                percentile(samples, 0.50), percentile(samples, 0.90),
+                percentile(samples, 0.99), allocsPerCall);
+}
+
+/**
+ * Time to first streamed chunk versus time to the full response. Returns
+ * false if the streamed chunks do not add up to the returned text.
+ */
+bool runStreamingLatency(int64_t handle, const std::string& name, const std::string& prompt,
+                         const Options& options) {
+    std::vector<double> firstChunk;
+    std::vector<double> total;
+    firstChunk.reserve(options.iterations);
+    total.reserve(options.iterations);
+
+    std::string streamed;
+    int chunks = 0;
+    std::chrono::steady_clock::time_point start;
+    llamacore::GenerateParams params;
+    params.onChunk = [&](std::string_view chunk) {
+        if (chunks++ == 0) {
+            auto now = std::chrono::steady_clock::now();
+            firstChunk.push_back(std::chrono::duration<double, std::nano>(now - start).count());
+        }
+        streamed.append(chunk);
+        return true;
+    };
+
+    for (int i = 0; i < options.iterations; ++i) {
+        streamed.clear();
+        chunks = 0;
+        start = std::chrono::steady_clock::now();
+        std::string response = llamacore::generate(handle, prompt, params);
+        auto end = std::chrono::steady_clock::now();
+        total.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        if (streamed != response) {
+            std::fprintf(stderr, "%s: streamed chunks differ from the response\n", name.c_str());
+            return false;
+        }
+    }
+
+    std::sort(firstChunk.begin(), firstChunk.end());
+    std::sort(total.begin(), total.end());
+    std::printf("%-36s %9d %14.0f %14.0f %14.0f\n", name.c_str(), chunks,
+                percentile(firstChunk, 0.50), percentile(firstChunk, 0.99),
+                percentile(total, 0.50));
+    return true;
+}
+
+struct ExpectedReply {
+    const std::string* prompt;
+    std::string reply;
+};
+
+/**
+ * Aggregate throughput of `threads` threads calling generate, each on its
+ * own handle or all on one shared handle. Own handles measure registry
+ * contention; a shared handle measures the batch scheduler, where calls in
+ * flight together share decode passes. Thread t sends cases[t % size] and
+ * every reply is checked, so interleaved requests must not mix up output.
+ *
+ * @param sharedHandle Handle all threads use, 0 to give each its own
+ * @return false if any call returned another request's reply
+ */
+bool runConcurrentGenerate(int threads, int64_t sharedHandle,
+                           const std::vector<ExpectedReply>& cases, const Options& options) {
+    bool shared = sharedHandle != 0;
+    std::vector<int64_t> handles;
+    if (shared) {
+        handles.push_back(sharedHandle);
+    } else {
+        for (int t = 0; t < threads; ++t) {
+            handles.push_back(llamacore::initModel("/bench/stub-model-" + std::to_string(t) + ".gguf"));
+        }
+    }
+
+    std::atomic<bool> go{false};
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            int64_t handle = handles[shared ? 0 : t];
+            const ExpectedReply& expected = cases[t % cases.size()];
+            while (!go.load(std::memory_order_acquire)) {
+            }
+            for (int i = 0; i < options.iterations; ++i) {
+                if (llamacore::generateAction(handle, *expected.prompt, 256) != expected.reply) {
+                    wrong.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double calls = static_cast<double>(threads) * options.iterations;
+    std::printf("%-36s %9d %14.0f %14.0f\n",
+                (std::string(shared ? "concurrent/shared" : "concurrent/generate") +
+                 "/threads:" + std::to_string(threads)).c_str(),
+                threads, calls / seconds, seconds * 1e9 / calls);
+
+    if (!shared) {
+        for (int64_t handle : handles) {
+            llamacore::freeModel(handle);
+        }
+    }
+    if (wrong.load() > 0) {
+        std::fprintf(stderr, "%d concurrent calls returned the wrong reply\n", wrong.load());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Throughput of submitGenerateAction with every request queued up front by
+ * one thread, then how many of a second round stop early when cancelled
+ * right after submission. Returns false if a reply is wrong or a request
+ * is lost.
+ */
+bool runAsyncGenerate(int64_t handle, const std::vector<ExpectedReply>& cases, const Options& options) {
+    std::mutex mutex;
+    std::condition_variable doneChanged;
+    int done = 0;
+    auto onDone = [&](int64_t) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++done;
+        doneChanged.notify_all();
+    };
+    auto waitFor = [&](int count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        doneChanged.wait(lock, [&] { return done == count; });
+    };
+
+    std::vector<int64_t> ids(static_cast<size_t>(options.iterations));
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.iterations; ++i) {
+        ids[i] = llamacore::submitGenerateAction(handle, *cases[i % cases.size()].prompt, 256, onDone);
+    }
+    waitFor(options.iterations);
+    auto end = std::chrono::steady_clock::now();
+
+    int wrong = 0;
+    std::string reply;
+    for (int i = 0; i < options.iterations; ++i) {
+        if (llamacore::pollGenerate(ids[i], reply) != llamacore::RequestStatus::Done ||
+            reply != cases[i % cases.size()].reply) {
+            ++wrong;
+        }
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::printf("%-36s %9d %14.0f %14.0f %14s\n", "async/submit", options.iterations,
+                options.iterations / seconds, seconds * 1e9 / options.iterations, "-");
+
+    done = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.iterations; ++i) {
+        ids[i] = llamacore::submitGenerateAction(handle, *cases[i % cases.size()].prompt, 256, onDone);
+        llamacore::cancelGenerate(ids[i]);
+    }
+    waitFor(options.iterations);
+    end = std::chrono::steady_clock::now();
+
+    int cancelled = 0;
+    for (int i = 0; i < options.iterations; ++i) {
+        llamacore::RequestStatus status = llamacore::pollGenerate(ids[i], reply);
+        if (status == llamacore::RequestStatus::Cancelled) {
+            ++cancelled;
+        } else if (status != llamacore::RequestStatus::Done) {
+            ++wrong;
+        }
+    }
+    seconds = std::chrono::duration<double>(end - start).count();
+    std::printf("%-36s %9d %14.0f %14.0f %14d\n", "async/cancel", options.iterations,
+                options.iterations / seconds, seconds * 1e9 / options.iterations, cancelled);
+
+    if (wrong > 0) {
+        std::fprintf(stderr, "%d async requests returned the wrong reply or status\n", wrong);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * generateAction on the same prompt without speculation, with a draft
+ * model and with prompt lookup. Returns false if speculation changed the
+ * output.
+ */
+bool runSpeculative(const int64_t (&handles)[3], const std::string& name, const std::string& prompt,
+                    const Options& options) {
+    std::string expected = llamacore::generateAction(handles[0], prompt, 256);
+    for (int h = 1; h < 3; ++h) {
+        if (llamacore::generateAction(handles[h], prompt, 256) != expected) {
+            std::fprintf(stderr, "%s: output changed with speculation\n", name.c_str());
+            return false;
+        }
+    }
+
+    double nanos[3];
+    for (int h = 0; h < 3; ++h) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; ++i) {
+            llamacore::generateAction(handles[h], prompt, 256);
+        }
+        auto end = std::chrono::steady_clock::now();
+        nanos[h] = std::chrono::duration<double, std::nano>(end - start).count() / options.iterations;
+    }
+    std::printf("%-36s %9zu %14.0f %14.0f %14.0f\n", name.c_str(), prompt.size(), nanos[0], nanos[1],
+                nanos[2]);
+    return true;
+}
+
+/**
+ * Numeric field of the model info JSON, 0 if absent
+ */
+double infoField(const std::string& info, const char* name) {
+    std::string key = std::string("\"") + name + "\":";
+    size_t at = info.find(key);
+    return at == std::string::npos ? 0.0 : std::atof(info.c_str() + at + key.size());
+}
+
+/**
+ * Decode step times of generateAction on a fresh handle placed per
+ * cpuSet/priority, with busyThreads spinning meanwhile. Returns false if
+ * the reply is wrong.
+ */
+bool runThreadPlacement(const std::string& name, const char* cpuSet, llamacore::ThreadPriority priority,
+                        int busyThreads, const ExpectedReply& expected, const Options& options) {
+    llamacore::ContextParams params;
+    params.numThreads = 0;
+    params.placement.cpus = llamacore::parseCpuSet(cpuSet);
+    params.placement.priority = priority;
+    int64_t handle = llamacore::initModel("/bench/stub-placement.gguf", params);
+    if (handle == 0) {
+        std::fprintf(stderr, "%s: initModel failed\n", name.c_str());
+        return false;
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> busy;
+    for (int t = 0; t < busyThreads; ++t) {
+        busy.emplace_back([&stop] {
+            volatile uint64_t spin = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                spin = spin + 1;
+            }
+        });
+    }
+    bool ok = true;
+    for (int i = 0; i < options.iterations && ok; ++i) {
+        ok = llamacore::generateAction(handle, *expected.prompt, 256) == expected.reply;
+    }
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& thread : busy) thread.join();
+
+    std::string info = llamacore::modelInfo(handle);
+    llamacore::freeModel(handle);
+    if (!ok) {
+        std::fprintf(stderr, "%s: wrong reply\n", name.c_str());
+        return false;
+    }
+    std::printf("%-36s %9.0f %10.1f %10.1f %10.1f %9s\n", name.c_str(), infoField(info, "decodeSteps"),
+                infoField(info, "stepP50Micros"), infoField(info, "stepP99Micros"),
+                infoField(info, "jitterMicros"),
+                info.find("\"applied\":true") != std::string::npos ? "yes" : "no");
+    return true;
+}
+
+/**
+ * String field of the model info JSON, "" if absent
+ */
+std::string infoString(const std::string& info, const char* name) {
+    std::string key = std::string("\"") + name + "\":\"";
+    size_t at = info.find(key);
+    if (at == std::string::npos) {
+        return std::string();
+    }
+    at += key.size();
+    return info.substr(at, info.find('"', at) - at);
+}
+
+/**
+ * initModel with autotuning into an empty directory, then again with the
+ * tune file in place. Returns false if the second load measured again or
+ * chose differently.
+ */
+bool runAutotune() {
+    char directory[] = "/tmp/llama_bench_tune_XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::fprintf(stderr, "autotune: cannot create a directory\n");
+        return false;
+    }
+    const std::string modelPath = "/bench/stub-tuned.gguf";
+
+    std::string infos[2];
+    double millis[2];
+    for (int load = 0; load < 2; ++load) {
+        auto start = std::chrono::steady_clock::now();
+        llamacore::LoadOptions loadOptions;
+        loadOptions.tuneDirectory = directory;
+        int64_t handle = llamacore::initModel(modelPath, llamacore::ContextParams(), loadOptions);
+        millis[load] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        infos[load] = handle != 0 ? llamacore::modelInfo(handle) : std::string();
+        llamacore::freeModel(handle);
+    }
+    std::remove(llamacore::tunePath(directory, modelPath).c_str());
+    rmdir(directory);
+
+    const char* expected[2] = {"measured", "cached"};
+    for (int load = 0; load < 2; ++load) {
+        std::string source = infoString(infos[load], "source");
+        if (source != expected[load]) {
+            std::fprintf(stderr, "autotune: load %d was %s, expected %s\n", load + 1, source.c_str(),
+                         expected[load]);
+            return false;
+        }
+        std::printf("%-36s %9.0f %10.0f %14.2f\n", (std::string("autotune/") + expected[load]).c_str(),
+                    infoField(infos[load], "threads"), infoField(infos[load], "batchSize"), millis[load]);
+    }
+    if (infoField(infos[0], "threads") != infoField(infos[1], "threads") ||
+        infoField(infos[0], "batchSize") != infoField(infos[1], "batchSize")) {
+        std::fprintf(stderr, "autotune: the stored configuration was not used\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * initModel under a memory budget; prints the plan and checks the handle
+ * still replies. Returns false if the load was refused but expected to fit,
+ * or the other way round.
+ */
+bool runMemoryBudget(uint64_t budgetMb, bool expectFit, const ExpectedReply& expected) {
+    llamacore::LoadOptions load;
+    load.memoryBudgetBytes = budgetMb << 20;
+    int64_t handle = llamacore::initModel("/bench/stub-budget.gguf", llamacore::ContextParams(), load);
+    std::string name = "memory/budget:" + (budgetMb == 0 ? std::string("none") : std::to_string(budgetMb) + "MB");
+    if ((handle != 0) != expectFit) {
+        std::fprintf(stderr, "%s: load %s\n", name.c_str(), handle != 0 ? "fit unexpectedly" : "was refused");
+        if (handle != 0) {
+            llamacore::freeModel(handle);
+        }
+        return false;
+    }
+    if (handle == 0) {
+        std::printf("%-36s %9s\n", name.c_str(), "refused");
+        return true;
+    }
+
+    bool replied = llamacore::generateAction(handle, *expected.prompt, 256) == expected.reply;
+    std::string info = llamacore::modelInfo(handle);
+    llamacore::freeModel(handle);
+    if (!replied) {
+        std::fprintf(stderr, "%s: wrong reply\n", name.c_str());
+        return false;
+    }
+    std::string memory = info.substr(info.find("\"memory\":"));
+    std::printf("%-36s %9.0f %10s %10.0f %14.1f\n", name.c_str(), infoField(memory, "contextSize"),
+                infoString(memory, "kvType").c_str(), infoField(memory, "batchSize"),
+                infoField(memory, "budgetedBytes") / (1 << 20));
+    return true;
+}
+
+/**
+ * attachDraftModel on a handle loaded under a memory budget. Returns false
+ * if the draft was refused but expected to fit, or the other way round.
+ */
+bool runDraftBudget(uint64_t budgetMb, bool expectFit) {
+    llamacore::LoadOptions load;
+    load.memoryBudgetBytes = budgetMb << 20;
+    int64_t handle = llamacore::initModel("/bench/stub-budget.gguf", llamacore::ContextParams(), load);
+    std::string name = "memory/draft:" + (budgetMb == 0 ? std::string("none") : std::to_string(budgetMb) + "MB");
+    if (handle == 0) {
+        std::fprintf(stderr, "%s: load was refused\n", name.c_str());
+        return false;
+    }
+    bool attached = llamacore::attachDraftModel(handle, "/bench/stub-draft.gguf");
+    llamacore::freeModel(handle);
+    if (attached != expectFit) {
+        std::fprintf(stderr, "%s: draft %s\n", name.c_str(), attached ? "fit unexpectedly" : "was refused");
+        return false;
+    }
+    std::printf("%-36s %9s\n", name.c_str(), attached ? "attached" : "refused");
+    return true;
+}
+
+/**
+ * The command corpus on a fresh handle with the given KV cache type.
+ * Returns false if the load fails; fills replies when it is empty (the f16
+ * baseline) and compares against it otherwise.
+ */
+bool runKvCache(llamacore::KvCacheType kvType, const std::vector<std::string>& prompts,
+                std::vector<std::string>& replies, double& baselineKvBytes, const Options& options) {
+    llamacore::ContextParams params;
+    params.kvType = kvType;
+    int64_t handle = llamacore::initModel("/bench/stub-kv.gguf", params);
+    std::string name = std::string("kv/") + llamacore::kvCacheTypeName(kvType);
+    if (handle == 0) {
+        std::fprintf(stderr, "%s: load failed\n", name.c_str());
+        return false;
+    }
+
+    bool baseline = replies.empty();
+    int correct = 0;
+    int agreeing = 0;
+    for (size_t i = 0; i < prompts.size(); ++i) {
+        std::string reply = llamacore::generateAction(handle, prompts[i], 256);
+        if (infoString(reply, "action") == kCommandCorpus[i].action) {
+            ++correct;
+        }
+        if (baseline) {
+            replies.push_back(reply);
+        } else if (reply == replies[i]) {
+            ++agreeing;
+        }
+    }
+    if (baseline) {
+        agreeing = static_cast<int>(prompts.size());
+    }
+
+    // Decode speed over repeated passes; steps count from the fresh handle
+    int passes = std::max(1, options.iterations / static_cast<int>(prompts.size()));
+    double stepsBefore = infoField(llamacore::modelInfo(handle), "decodeSteps");
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (const std::string& prompt : prompts) {
+            llamacore::generateAction(handle, prompt, 256);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::string info = llamacore::modelInfo(handle);
+    llamacore::freeModel(handle);
+    double steps = infoField(info, "decodeSteps") - stepsBefore;
+
+    double kvBytes = infoField(info.substr(info.find("\"memory\":")), "kvBytes");
+    if (baseline) {
+        baselineKvBytes = kvBytes;
+    }
+    double total = static_cast<double>(prompts.size());
+    std::printf("%-36s %9.1f %10.1f %12.0f %10.1f%% %10.1f%%\n", name.c_str(), kvBytes / (1 << 20),
+                (baselineKvBytes - kvBytes) / (1 << 20), steps / seconds, 100.0 * correct / total,
+                100.0 * agreeing / total);
+    return true;
+}
+
+/**
+ * A conversation that keeps growing on a 512-token context: every turn
+ * sends the pinned instruction block, all earlier turns with their replies
+ * and a new message. Prints, per group of turns, the prompt size reached,
+ * prompt tokens evaluated and latency per turn, and the context shifts.
+ * Returns false if a turn gets no action reply or nothing was shifted.
+ */
+bool runContextShift() {
+    llamacore::ContextParams params;
+    params.contextSize = 512;
+    int64_t handle = llamacore::initModel("/bench/stub-shift.gguf", params);
+    if (handle == 0) {
+        std::fprintf(stderr, "shift: load failed\n");
+        return false;
+    }
+    std::string prefix = std::string("### Instruction:\n") + kInstructionCompact + "\n";
+    llamacore::setPinnedPrefix(handle, prefix);
+
+    constexpr int kTurns = 48;
+    constexpr int kGroup = 8;
+    std::string history;
+    double evaluated = 0.0;
+    double micros = 0.0;
+    double shifts = 0.0;
+    bool ok = true;
+    for (int turn = 1; turn <= kTurns && ok; ++turn) {
+        std::string prompt = prefix + history + "\n\n### Input:\nTurn " + std::to_string(turn) +
+                             ": tell me something motivating\n\n### Response (JSON only):\n";
+        std::string before = llamacore::modelInfo(handle);
+        auto start = std::chrono::steady_clock::now();
+        std::string reply = llamacore::generateAction(handle, prompt, 256);
+        micros += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        std::string after = llamacore::modelInfo(handle);
+        if (infoString(reply, "action").empty() || reply == llamacore::kResponsePromptTooLong) {
+            std::fprintf(stderr, "shift: turn %d failed: %s\n", turn, reply.c_str());
+            ok = false;
+            break;
+        }
+        evaluated += infoField(after, "evaluatedTokens") - infoField(before, "evaluatedTokens");
+        shifts += infoField(after, "contextShifts") - infoField(before, "contextShifts");
+        history = prompt.substr(prefix.size()) + reply;
+
+        if (turn % kGroup == 0) {
+            std::string name = "shift/turns:" + std::to_string(turn - kGroup + 1) + "-" + std::to_string(turn);
+            std::printf("%-36s %9zu %14.1f %14.1f %14.0f\n", name.c_str(), prompt.size(), evaluated / kGroup,
+                        micros / kGroup, shifts);
+            evaluated = micros = shifts = 0.0;
+        }
+    }
+
+    std::string info = llamacore::modelInfo(handle);
+    llamacore::freeModel(handle);
+    if (ok && (infoField(info, "truncatedPrompts") == 0 || infoField(info, "contextShifts") == 0)) {
+        std::fprintf(stderr, "shift: the conversation never outgrew the context\n");
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * generateAction on a template prompt without and with the instruction
+ * head and response tail registered. Returns false if the replies differ
+ * or the second run still tokenized the templates.
+ */
+bool runTemplateTokens(int64_t handle, const std::string& name, const std::string& prompt, const std::string& head,
+                       const std::string& tail, const Options& options) {
+    std::string replies[2];
+    double nanos[2];
+    double tokenizedBytes[2];
+    for (int registered = 0; registered < 2; ++registered) {
+        llamacore::templateTokens().clear();
+        if (registered == 1) {
+            llamacore::registerTemplate(handle, head, true);
+            llamacore::registerTemplate(handle, tail, false);
+        }
+        replies[registered] = llamacore::generateAction(handle, prompt, 256);
+        uint64_t bytesBefore = llamacore::templateTokens().stats().tokenizedBytes;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; ++i) {
+            llamacore::generateAction(handle, prompt, 256);
+        }
+        auto end = std::chrono::steady_clock::now();
+        nanos[registered] = std::chrono::duration<double, std::nano>(end - start).count() / options.iterations;
+        tokenizedBytes[registered] =
+                static_cast<double>(llamacore::templateTokens().stats().tokenizedBytes - bytesBefore) /
+                options.iterations;
+    }
+
+    if (replies[0] != replies[1]) {
+        std::fprintf(stderr, "%s: reply changed with templates\n", name.c_str());
+        return false;
+    }
+    // Templates are reused up to their last (head) or from their first
+    // (tail) token boundary in the prompt
+    size_t headReused = head.size();
+    while (headReused > 0 && !llamacore::isTokenBoundary(prompt, headReused)) {
+        --headReused;
+    }
+    size_t tailReused = tail.size();
+    while (tailReused > 0 && !llamacore::isTokenBoundary(prompt, prompt.size() - tailReused)) {
+        --tailReused;
+    }
+    if (tokenizedBytes[1] + headReused + tailReused > prompt.size()) {
+        std::fprintf(stderr, "%s: templates were tokenized again\n", name.c_str());
+        return false;
+    }
+    std::printf("%-36s %9zu %14.0f %14.0f %14.0f %9.0f\n", name.c_str(), prompt.size(), nanos[0], nanos[1],
+                tokenizedBytes[0], tokenizedBytes[1]);
+    return true;
+}
+
+/**
+ * Register templates on one handle, write their token file next to a
+ * model, forget them, and load that model. Returns false if the load did
+ * not bring the templates back.
+ */
+bool runTemplateTokenFile(int64_t handle, const std::string& prompt, const std::string& head,
+                          const std::string& tail) {
+    char directory[] = "/tmp/llama_bench_tokens_XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::fprintf(stderr, "tokens: cannot create a directory\n");
+        return false;
+    }
+    const std::string modelPath = std::string(directory) + "/stub-tokens.gguf";
+    const std::string tokenPath = llamacore::templateTokensPath(modelPath);
+
+    llamacore::templateTokens().clear();
+    bool ok = llamacore::registerTemplate(handle, head, true) && llamacore::registerTemplate(handle, tail, false) &&
+              llamacore::saveTemplateTokens(handle, tokenPath);
+    llamacore::templateTokens().clear();
+
+    int64_t loaded = ok ? llamacore::initModel(modelPath) : 0;
+    llamacore::TemplateTokenStats before = llamacore::templateTokens().stats();
+    ok = loaded != 0 && before.templates == 2 && !llamacore::generateAction(loaded, prompt, 256).empty();
+    llamacore::TemplateTokenStats after = llamacore::templateTokens().stats();
+    ok = ok && after.templated > before.templated;
+    llamacore::freeModel(loaded);
+    std::remove(tokenPath.c_str());
+    rmdir(directory);
+
+    if (!ok) {
+        std::fprintf(stderr, "tokens: the token file was not used\n");
+        return false;
+    }
+    std::printf("%-36s %9zu %14s %14s %14s %9.0f\n", "tokens/file", prompt.size(), "-", "-", "-",
+                static_cast<double>(after.tokenizedBytes - before.tokenizedBytes));
+    return true;
+}
+
+/**
+ * Fields behind buildContext(items), backed by storage
+ */
+llamacore::PromptContext contextFields(int items, const std::string& userMessage, std::vector<std::string>& storage) {
+    storage.clear();
+    storage.reserve(2 * items);
+    llamacore::PromptContext context;
+    context.userMessage = userMessage;
+    for (int i = 0; i < items; ++i) {
+        storage.push_back(std::string(kGoalTitles[i % 5]) + " " + std::to_string(i));
+        context.goals.push_back({storage.back(), 30, "2026-06-01"});
+    }
+    for (int i = 0; i < items; ++i) {
+        storage.push_back(std::string(kTaskTitles[i % 5]) + " " + std::to_string(i));
+        context.tasks.push_back({storage.back(), i % 2 == 0, 20});
+    }
+    return context;
+}
+
+/**
+ * Prompt preparation from fields against string building plus
+ * tokenization, then generateActionFromContext against generateAction.
+ * Returns false if the texts or replies differ.
+ */
+bool runPromptAssembly(int64_t handle, llamacore::BackendModel* model, int items, const Options& options) {
+    const std::string userMessage = "How am I doing today?";
+    std::string name = "assembly/template/items:" + std::to_string(items);
+    std::vector<std::string> storage;
+    llamacore::PromptContext context = contextFields(items, userMessage, storage);
+    // buildPrompt puts the context right after the instruction block
+    llamacore::PromptFormat format{std::string("### Instruction:\n") + kInstructionCompact, "\n\n### Input:\n",
+                                   "\n\n### Response (JSON only):\n"};
+    uint64_t vocab = llamacore::vocabularyKey(model);
+    llamacore::setPromptFormat(handle, format);
+
+    std::string text = buildPrompt(userMessage, items, true);
+    if (llamacore::assemblePrompt(format, context, vocab, model).text != text) {
+        std::fprintf(stderr, "%s: assembled text differs from buildPrompt\n", name.c_str());
+        return false;
+    }
+    if (llamacore::generateActionFromContext(handle, context, 256) != llamacore::generateAction(handle, text, 256)) {
+        std::fprintf(stderr, "%s: reply differs\n", name.c_str());
+        return false;
+    }
+
+    auto timeCalls = [&](const std::function<size_t()>& body) {
+        body();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; ++i) {
+            body();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / options.iterations;
+    };
+    uint64_t bytesBefore = llamacore::templateTokens().stats().tokenizedBytes;
+    auto built = timeCalls([&] {
+        return llamacore::templateTokens().tokenize(vocab, model, buildPrompt(userMessage, items, true)).size();
+    });
+    double tokenizedBytes = static_cast<double>(llamacore::templateTokens().stats().tokenizedBytes - bytesBefore) /
+                            (options.iterations + 1);
+    uint64_t missesBefore = llamacore::tokenSpans().stats().misses;
+    auto assembled = timeCalls([&] { return llamacore::assemblePrompt(format, context, vocab, model).tokens->size(); });
+    double misses = static_cast<double>(llamacore::tokenSpans().stats().misses - missesBefore);
+
+    std::printf("%-36s %9zu %14.0f %14.0f %14.0f %9.0f\n", name.c_str(), text.size(), built, assembled,
+                tokenizedBytes, misses);
+    return true;
+}
+
+// Indexed by llamacore::ActionType
+const char* const kActionNames[] = {"reply",       "create_goal", "create_task",  "complete_task",
+                                    "delete_goal", "delete_task", "show_progress"};
+
+/**
+ * Header and message of a record written for reply
+ */
+bool readActionRecord(const std::string& reply, llamacore::ActionRecordHeader& header, std::string& message) {
+    uint8_t record[4096];
+    size_t size = llamacore::writeActionRecord(reply, record, sizeof(record));
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, record, sizeof(header));
+    message.assign(reinterpret_cast<const char*>(record) + sizeof(header), header.messageBytes);
+    return header.action < std::size(kActionNames);
+}
+
+/**
+ * Time writeActionRecord on a reply. Returns false if the record does not
+ * name the expected action.
+ */
+bool runActionRecord(const std::string& name, const std::string& reply, const char* action, const Options& options) {
+    llamacore::ActionRecordHeader header;
+    std::string message;
+    if (!readActionRecord(reply, header, message) || header.status != llamacore::kRecordAction ||
+        std::strcmp(kActionNames[header.action], action) != 0) {
+        std::fprintf(stderr, "%s: record does not hold a %s action\n", name.c_str(), action);
+        return false;
+    }
+
+    uint8_t record[4096];
+    size_t size = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.iterations; ++i) {
+        size = llamacore::writeActionRecord(reply, record, sizeof(record));
+    }
+    auto end = std::chrono::steady_clock::now();
+    double nanos = std::chrono::duration<double, std::nano>(end - start).count() / options.iterations;
+
+    std::printf("%-36s %9zu %14zu %14.0f\n", name.c_str(), reply.size(), size, nanos);
+    return true;
+}
+
+/**
+ * Records of the command corpus replies and of hand-written edge cases.
+ * Returns false on the first record that differs from what
+ * JsonResponseParser would make of the reply.
+ */
+bool checkActionRecords(int64_t handle) {
+    llamacore::ActionRecordHeader header;
+    std::string message;
+    for (const CommandCase& command : kCommandCorpus) {
+        std::string reply = llamacore::generateAction(handle, buildPrompt(command.userMessage, 5, false), 256);
+        std::string action = infoString(reply, "action");
+        if (!readActionRecord(reply, header, message) || header.status != llamacore::kRecordAction ||
+            action != kActionNames[header.action]) {
+            std::fprintf(stderr, "record/corpus: \"%s\" does not record %s\n", command.userMessage,
+                         action.c_str());
+            return false;
+        }
+    }
+
+    // U+1F3AF escaped as a surrogate pair, U+1F389 as is
+    const std::string emoji = "{\"action\": \"reply\", \"message\": \"Nice \\ud83c\\udfaf \xF0\x9F\x8E\x89\", \"data\": {}}";
+    if (!readActionRecord(emoji, header, message) || message != "Nice \xF0\x9F\x8E\xAF \xF0\x9F\x8E\x89") {
+        std::fprintf(stderr, "record/emoji: message not carried as UTF-8\n");
+        return false;
+    }
+
+    // Aliases and defaults, a brace in a string, text around the object
+    const std::string aliased = "Sure! {\"action\": \"CREATE_TASK\", \"message\": \"Added :}\", "
+                                "\"data\": {\"title\": \"Stretch\", \"duration\": \"15\"}} Anything else?";
+    if (!readActionRecord(aliased, header, message) || header.action != 2 || message != "Added :}" ||
+        header.minutes != 15 || header.dueDateBytes != 5 || (header.flags & llamacore::kRecordHasGoalTitle) != 0) {
+        std::fprintf(stderr, "record/aliases: fields differ from JsonResponseParser\n");
+        return false;
+    }
+
+    const std::string prose = "I'm not sure what you mean.";
+    if (!readActionRecord(prose, header, message) || header.status != llamacore::kRecordInvalid ||
+        message != prose) {
+        std::fprintf(stderr, "record/invalid: unparsable reply not kept whole\n");
+        return false;
+    }
+    return true;
+}
+
+const char* const kScanStatusNames[] = {"no-object", "malformed", "off-schema", "valid"};
+
+/**
+ * Time scanAction and parseAction on a reply. Returns false if the scan
+ * status is not the expected one.
+ */
+bool runActionScan(const std::string& name, const std::string& reply, llamacore::ScanStatus expected,
+                   const Options& options) {
+    llamacore::ActionScan scan = llamacore::scanAction(reply);
+    if (scan.status != expected) {
+        std::fprintf(stderr, "%s: scanned as %s, expected %s\n", name.c_str(),
+                     kScanStatusNames[static_cast<int>(scan.status)], kScanStatusNames[static_cast<int>(expected)]);
+        return false;
+    }
+
+    auto timeCalls = [&](const std::function<void()>& body) {
+        body();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; ++i) {
+            body();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / options.iterations;
+    };
+    double scanNanos = timeCalls([&] { llamacore::scanAction(reply); });
+    llamacore::ParsedAction action;
+    double parseNanos = timeCalls([&] { llamacore::parseAction(reply, action); });
+
+    std::printf("%-36s %9zu %14.0f %14.0f %14s\n", name.c_str(), reply.size(), scanNanos, parseNanos,
+                kScanStatusNames[static_cast<int>(scan.status)]);
+    return true;
+}
+
+/**
+ * generateAction with the response cache off and with a warm entry, then
+ * the same user message under a different context. Returns false if a
+ * cached reply differs from the decoded one or the context change does not
+ * invalidate the entry.
+ */
+bool runResponseCache(int64_t handle, const std::string& name, const std::string& prompt,
+                      const std::string& otherContextPrompt, const Options& options) {
+    llamacore::setResponseCacheCapacity(0);
+    std::string expected = llamacore::generateAction(handle, prompt, 256);
+
+    auto timeCalls = [&] {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; ++i) {
+            llamacore::generateAction(handle, prompt, 256);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / options.iterations;
+    };
+    double decodedNanos = timeCalls();
+
+    llamacore::setResponseCacheCapacity(llamacore::kResponseCacheBytes);
+    llamacore::generateAction(handle, prompt, 256);
+    if (llamacore::generateAction(handle, prompt, 256) != expected) {
+        std::fprintf(stderr, "%s: cached reply differs\n", name.c_str());
+        return false;
+    }
+    double cachedNanos = timeCalls();
+
+    uint64_t invalidated = llamacore::responseCache().stats().invalidated;
+    llamacore::generateAction(handle, otherContextPrompt, 256);
+    if (llamacore::responseCache().stats().invalidated == invalidated) {
+        std::fprintf(stderr, "%s: context change kept the stale entry\n", name.c_str());
+        return false;
+    }
+
+    std::printf("%-36s %9zu %14.0f %14.0f %13.0fx\n", name.c_str(), prompt.size(), decodedNanos,
+                cachedNanos, decodedNanos / cachedNanos);
+    return true;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else {
+            std::fprintf(stderr, "Usage: %s [--iterations N] [--filter SUBSTRING]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    int64_t handle = llamacore::initModel("/bench/stub-model.gguf");
+    if (handle == 0) {
+        std::fprintf(stderr, "initModel failed\n");
+        return 1;
+    }
+
+    // Every repeated prompt would otherwise be a cache hit; the cache series
+    // turns it back on
+    llamacore::setResponseCacheCapacity(0);
+
+    // A second handle on the same file must share the loaded weights
+    int64_t secondHandle = llamacore::initModel("/bench/stub-model.gguf");
+    if (secondHandle == 0 || llamacore::weightsCache().loadedCount() != 1) {
+        std::fprintf(stderr, "Handles on one model file did not share weights\n");
+        return 1;
+    }
+    llamacore::freeModel(secondHandle);
+
+    // Prompts are built once up front and captured by reference so prompt
+    // construction never shows up in the measurements
+    std::vector<std::string> prompts;
+    prompts.reserve((2 * std::size(kIntentCases) + 1) * std::size(kContextSizes));
+    std::vector<Benchmark> benchmarks;
+
+    for (const IntentCase& intentCase : kIntentCases) {
+        for (int items : kContextSizes) {
+            prompts.push_back(buildPrompt(intentCase.userMessage, items, false));
+            const std::string& prompt = prompts.back();
+
+            llamacore::Intent detected = llamacore::detectIntent(prompt);
+            if (detected != intentCase.expected) {
+                std::fprintf(stderr, "Case %s/%d classified as %s\n",
+                             intentCase.name, items, llamacore::intentName(detected));
+                return 1;
+            }
+
+            // The stub backend must reproduce the canned reply token by token
+            std::string expected = llamacore::buildResponse(detected, prompt);
+            if (llamacore::generateAction(handle, prompt, 256) != expected) {
+                std::fprintf(stderr, "Case %s/%d did not produce the stub reply\n",
+                             intentCase.name, items);
+                return 1;
+            }
+
+            benchmarks.push_back({
+                    std::string("generate/") + intentCase.name + "/items:" + std::to_string(items),
+                    prompt.size(),
+                    [handle, &prompt] { llamacore::generateAction(handle, prompt, 256); }});
+        }
+    }
+
+    // Full buildSimplePrompt shape, instruction block included
+    for (int items : kContextSizes) {
+        prompts.push_back(buildPrompt("How am I doing today?", items, true));
+        const std::string& prompt = prompts.back();
+        benchmarks.push_back({
+                "generate/template/items:" + std::to_string(items),
+                prompt.size(),
+                [handle, &prompt] { llamacore::generateAction(handle, prompt, 256); }});
+    }
+
+    // Assistant turns: same instruction and context, a different user message
+    // each call, so only the tail of the prompt misses the KV prefix cache
+    for (int items : kContextSizes) {
+        size_t first = prompts.size();
+        for (const IntentCase& intentCase : kIntentCases) {
+            prompts.push_back(buildPrompt(intentCase.userMessage, items, true));
+        }
+        auto turn = std::make_shared<size_t>(0);
+        benchmarks.push_back({
+                "generate/turns/items:" + std::to_string(items),
+                prompts[first].size(),
+                [handle, &prompts, first, turn] {
+                    size_t index = first + (*turn)++ % std::size(kIntentCases);
+                    llamacore::generateAction(handle, prompts[index], 256);
+                }});
+    }
+
+    std::printf("%-36s %9s %10s %10s %10s %10s %10s\n",
+                "Benchmark", "Bytes", "Mean(ns)", "p50(ns)", "p90(ns)", "p99(ns)", "Allocs");
+    std::printf("%s\n", std::string(100, '-').c_str());
+
+    for (const Benchmark& bench : benchmarks) {
+        if (options.filter != nullptr && bench.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        runBenchmark(bench, options);
+    }
+    std::printf("\nModel info: %s\n", llamacore::modelInfo().c_str());
+
+    if (options.filter == nullptr || std::strstr("stream", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s\n",
+                    "Benchmark", "Chunks", "TTFC p50(ns)", "TTFC p99(ns)", "Total p50(ns)");
+        std::printf("%s\n", std::string(91, '-').c_str());
+        // The first intent case's prompts, one per context size
+        for (size_t i = 0; i < std::size(kContextSizes); ++i) {
+            std::string name = std::string("stream/") + kIntentCases[0].name +
+                               "/items:" + std::to_string(kContextSizes[i]);
+            if (!runStreamingLatency(handle, name, prompts[i], options)) {
+                return 1;
+            }
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("speculative", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s\n", "Benchmark", "Bytes", "Plain(ns)", "Draft(ns)",
+                    "Lookup(ns)");
+        std::printf("%s\n", std::string(91, '-').c_str());
+        int64_t draftHandle = llamacore::initModel("/bench/stub-target.gguf");
+        int64_t lookupHandle = llamacore::initModel("/bench/stub-lookup.gguf");
+        if (!llamacore::attachDraftModel(draftHandle, "/bench/stub-draft.gguf") ||
+            !llamacore::setPromptLookup(lookupHandle, llamacore::kDefaultLookupTokens)) {
+            std::fprintf(stderr, "Enabling speculation failed\n");
+            return 1;
+        }
+        const int64_t handles[3] = {handle, draftHandle, lookupHandle};
+        // Every intent at 5 items, then the template prompts
+        for (size_t c = 0; c < std::size(kIntentCases); ++c) {
+            std::string name = std::string("speculative/") + kIntentCases[c].name + "/items:5";
+            if (!runSpeculative(handles, name, prompts[c * std::size(kContextSizes) + 1], options)) {
+                return 1;
+            }
+        }
+        size_t first = std::size(kIntentCases) * std::size(kContextSizes);
+        for (size_t i = 0; i < std::size(kContextSizes); ++i) {
+            std::string name = "speculative/template/items:" + std::to_string(kContextSizes[i]);
+            if (!runSpeculative(handles, name, prompts[first + i], options)) {
+                return 1;
+            }
+        }
+        std::printf("\nDraft model info: %s\n", llamacore::modelInfo(draftHandle).c_str());
+        std::printf("Prompt lookup info: %s\n", llamacore::modelInfo(lookupHandle).c_str());
+        llamacore::freeModel(draftHandle);
+        llamacore::freeModel(lookupHandle);
+    }
+
+    if (options.filter == nullptr || std::strstr("concurrent", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s\n", "Benchmark", "Threads", "Calls/s", "ns/call");
+        std::printf("%s\n", std::string(76, '-').c_str());
+        // One items:0 prompt per intent, so concurrent replies all differ
+        std::vector<ExpectedReply> cases;
+        for (size_t i = 0; i < std::size(kIntentCases); ++i) {
+            const std::string& prompt = prompts[i * std::size(kContextSizes)];
+            cases.push_back({&prompt, llamacore::buildResponse(llamacore::detectIntent(prompt), prompt)});
+        }
+        int maxThreads = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+        for (int64_t sharedHandle : {int64_t{0}, handle}) {
+            for (int threads = 1; threads <= maxThreads; threads *= 2) {
+                if (!runConcurrentGenerate(threads, sharedHandle, cases, options)) {
+                    return 1;
+                }
+            }
+        }
+        std::printf("\nModel info: %s\n", llamacore::modelInfo().c_str());
+    }
+
+    if (options.filter == nullptr || std::strstr("async", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s\n", "Benchmark", "Requests", "Calls/s", "ns/call",
+                    "Cancelled");
+        std::printf("%s\n", std::string(91, '-').c_str());
+        std::vector<ExpectedReply> cases;
+        for (size_t i = 0; i < std::size(kIntentCases); ++i) {
+            const std::string& prompt = prompts[i * std::size(kContextSizes)];
+            cases.push_back({&prompt, llamacore::buildResponse(llamacore::detectIntent(prompt), prompt)});
+        }
+        if (!runAsyncGenerate(handle, cases, options)) {
+            return 1;
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("threads", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %10s %10s %10s %9s\n", "Benchmark", "Steps", "p50(us)", "p99(us)",
+                    "Jitter(us)", "Applied");
+        std::printf("%s\n", std::string(90, '-').c_str());
+        const std::string& prompt = prompts[0];
+        ExpectedReply expected{&prompt, llamacore::buildResponse(llamacore::detectIntent(prompt), prompt)};
+        int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int busyThreads : {0, cores}) {
+            std::string load = busyThreads == 0 ? "/idle" : "/loaded";
+            if (!runThreadPlacement("threads/default" + load, "", llamacore::ThreadPriority::Normal,
+                                    busyThreads, expected, options) ||
+                !runThreadPlacement("threads/performance-high" + load, "performance",
+                                    llamacore::ThreadPriority::High, busyThreads, expected, options)) {
+                return 1;
+            }
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("autotune", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %10s %14s\n", "Benchmark", "Threads", "Batch", "Load(ms)");
+        std::printf("%s\n", std::string(72, '-').c_str());
+        if (!runAutotune()) {
+            return 1;
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("memory", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %10s %10s %14s\n", "Benchmark", "Context", "KV", "Batch", "Budgeted(MB)");
+        std::printf("%s\n", std::string(83, '-').c_str());
+        const std::string& prompt = prompts[0];
+        ExpectedReply expected{&prompt, llamacore::buildResponse(llamacore::detectIntent(prompt), prompt)};
+        // Runtime overhead alone takes 48 MB; the mapped weights are not charged
+        const std::pair<uint64_t, bool> budgets[] = {{0, true}, {128, true}, {96, true}, {64, true},
+                                                     {56, true}, {48, false}};
+        for (const auto& [budgetMb, expectFit] : budgets) {
+            if (!runMemoryBudget(budgetMb, expectFit, expected)) {
+                return 1;
+            }
+        }
+        // The draft's context and compute buffers come out of the same budget
+        const std::pair<uint64_t, bool> draftBudgets[] = {{0, true}, {256, true}, {160, false}, {128, false}};
+        for (const auto& [budgetMb, expectFit] : draftBudgets) {
+            if (!runDraftBudget(budgetMb, expectFit)) {
+                return 1;
+            }
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("kv", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %10s %12s %11s %11s\n", "Benchmark", "KV(MB)", "Saved(MB)", "Decode(t/s)",
+                    "Accuracy", "Agreement");
+        std::printf("%s\n", std::string(94, '-').c_str());
+        std::vector<std::string> corpusPrompts;
+        for (const CommandCase& command : kCommandCorpus) {
+            corpusPrompts.push_back(buildPrompt(command.userMessage, 5, false));
+        }
+        std::vector<std::string> baselineReplies;
+        double baselineKvBytes = 0.0;
+        for (llamacore::KvCacheType kvType :
+             {llamacore::KvCacheType::F16, llamacore::KvCacheType::Q8_0, llamacore::KvCacheType::Q4_0}) {
+            if (!runKvCache(kvType, corpusPrompts, baselineReplies, baselineKvBytes, options)) {
+                return 1;
+            }
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("shift", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s\n", "Benchmark", "Bytes", "Evaluated", "Latency(us)",
+                    "Shifts");
+        std::printf("%s\n", std::string(91, '-').c_str());
+        if (!runContextShift()) {
+            return 1;
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("tokens", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s %9s\n", "Benchmark", "Bytes", "Whole(ns)", "Templated(ns)",
+                    "Tokenized", "After");
+        std::printf("%s\n", std::string(101, '-').c_str());
+        const std::string head = std::string("### Instruction:\n") + kInstructionCompact + "\n";
+        const std::string tail = "\n\n### Response (JSON only):\n";
+        size_t first = std::size(kIntentCases) * std::size(kContextSizes);
+        for (size_t i = 0; i < std::size(kContextSizes); ++i) {
+            std::string name = "tokens/template/items:" + std::to_string(kContextSizes[i]);
+            if (!runTemplateTokens(handle, name, prompts[first + i], head, tail, options)) {
+                return 1;
+            }
+        }
+        if (!runTemplateTokenFile(handle, prompts[first + 1], head, tail)) {
+            return 1;
+        }
+        llamacore::templateTokens().clear();
+    }
+
+    if (options.filter == nullptr || std::strstr("assembly", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s %9s\n", "Benchmark", "Bytes", "String(ns)", "Assembled(ns)",
+                    "Tokenized", "Misses");
+        std::printf("%s\n", std::string(101, '-').c_str());
+        llamacore::WeightsRef weights =
+                llamacore::weightsCache().acquire("/bench/stub-model.gguf", llamacore::ModelParams());
+        for (int items : kContextSizes) {
+            if (!runPromptAssembly(handle, weights->model, items, options)) {
+                return 1;
+            }
+        }
+        llamacore::templateTokens().clear();
+    }
+
+    if (options.filter == nullptr || std::strstr("record", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s\n", "Benchmark", "Bytes", "Record", "Write(ns)");
+        std::printf("%s\n", std::string(76, '-').c_str());
+        if (!checkActionRecords(handle)) {
+            return 1;
+        }
+        const char* const actions[] = {"create_goal", "create_task", "complete_task", "show_progress", "reply"};
+        for (size_t c = 0; c < std::size(kIntentCases); ++c) {
+            std::string name = std::string("record/") + kIntentCases[c].name + "/items:5";
+            std::string reply = llamacore::generateAction(handle, prompts[c * std::size(kContextSizes) + 1], 256);
+            if (!runActionRecord(name, reply, actions[c], options)) {
+                return 1;
+            }
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("scan", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s\n", "Benchmark", "Bytes", "Scan(ns)", "Parse(ns)", "Status");
+        std::printf("%s\n", std::string(91, '-').c_str());
+        using llamacore::ScanStatus;
+        std::string reply;
+        for (size_t c = 0; c < std::size(kIntentCases); ++c) {
+            std::string name = std::string("scan/") + kIntentCases[c].name + "/items:5";
+            reply = llamacore::generateAction(handle, prompts[c * std::size(kContextSizes) + 1], 256);
+            if (!runActionScan(name, reply, ScanStatus::Valid, options)) {
+                return 1;
+            }
+        }
+        // reply is the default intent's: {"action": "reply", ...}
+        std::string longReply = reply;
+        std::string filler;
+        while (filler.size() < 2048) {
+            filler += "Keep going, \\\"step\\\" by {step}: ";
+        }
+        longReply.insert(longReply.find("\"message\"") + std::strlen("\"message\": \""), filler);
+        const std::string aliased =
+                "{\"action\": \"create_task\", \"message\": \"Added\", \"data\": {\"title\": \"Stretch\"}}";
+        if (!runActionScan("scan/truncated", reply.substr(0, reply.size() - 2), ScanStatus::Malformed, options) ||
+            !runActionScan("scan/aliased", aliased, ScanStatus::OffSchema, options) ||
+            !runActionScan("scan/wrapped", "```json\n" + reply + "\n```", ScanStatus::Valid, options) ||
+            !runActionScan("scan/long", longReply, ScanStatus::Valid, options)) {
+            return 1;
+        }
+    }
+
+    if (options.filter == nullptr || std::strstr("cache", options.filter) != nullptr) {
+        std::printf("\n%-36s %9s %14s %14s %14s\n", "Benchmark", "Bytes", "Decoded(ns)", "Cached(ns)",
+                    "Speedup");
+        std::printf("%s\n", std::string(91, '-').c_str());
+        // Every intent at 5 items; the invalidation check moves it to 25
+        for (size_t c = 0; c < std::size(kIntentCases); ++c) {
+            std::string name = std::string("cache/") + kIntentCases[c].name + "/items:5";
+            const std::string& prompt = prompts[c * std::size(kContextSizes) + 1];
+            const std::string& otherContextPrompt = prompts[c * std::size(kContextSizes) + 2];
+            if (!runResponseCache(handle, name, prompt, otherContextPrompt, options)) {
+                return 1;
+            }
+        }
+        std::printf("\nModel info: %s\n", llamacore::modelInfo().c_str());
+    }
+
+    llamacore::freeModel(handle);
+    return 0;
+}
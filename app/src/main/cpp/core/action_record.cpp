@@ -0,0 +1,500 @@
+/**
+ * action_record.cpp - Model replies as binary action records
+ */
+
+#include "action_record.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "json_scan.h"
+
+namespace llamacore {
+
+namespace {
+
+// Deeper nesting than any action object has; bounds the recursion
+constexpr int kMaxDepth = 16;
+
+struct JsonValue {
+    enum class Kind { String, Number, Bool, Null, Object, Array };
+    Kind kind = Kind::Null;
+    std::string_view raw;  // source text of the value
+    std::string text;      // decoded, for strings
+};
+
+using JsonFields = std::vector<std::pair<std::string, JsonValue>>;
+
+/**
+ * Recursive descent over strict JSON. Values nested in the object being
+ * read are only skipped; their source text is kept for a second pass.
+ */
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : text_(text) {}
+
+    /**
+     * Read an object, with nothing but whitespace after it
+     */
+    bool document(JsonFields& fields) {
+        space();
+        if (!object(&fields, 0)) {
+            return false;
+        }
+        space();
+        return pos_ == text_.size();
+    }
+
+private:
+    void space() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    bool consume(char c) {
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(std::string_view word) {
+        if (text_.compare(pos_, word.size(), word) != 0) {
+            return false;
+        }
+        pos_ += word.size();
+        return true;
+    }
+
+    bool object(JsonFields* fields, int depth) {
+        if (!consume('{') || depth >= kMaxDepth) {
+            return false;
+        }
+        space();
+        if (consume('}')) {
+            return true;
+        }
+        std::string key;
+        do {
+            space();
+            if (!string(fields ? &key : nullptr)) {
+                return false;
+            }
+            space();
+            if (!consume(':')) {
+                return false;
+            }
+            space();
+            JsonValue entry;
+            if (!value(fields ? &entry : nullptr, depth)) {
+                return false;
+            }
+            if (fields) {
+                fields->emplace_back(std::move(key), std::move(entry));
+            }
+            space();
+        } while (consume(','));
+        return consume('}');
+    }
+
+    bool array(int depth) {
+        if (!consume('[') || depth >= kMaxDepth) {
+            return false;
+        }
+        space();
+        if (consume(']')) {
+            return true;
+        }
+        do {
+            space();
+            if (!value(nullptr, depth)) {
+                return false;
+            }
+            space();
+        } while (consume(','));
+        return consume(']');
+    }
+
+    bool value(JsonValue* out, int depth) {
+        if (pos_ >= text_.size()) {
+            return false;
+        }
+        size_t start = pos_;
+        JsonValue::Kind kind;
+        bool ok;
+        switch (text_[pos_]) {
+            case '"':
+                kind = JsonValue::Kind::String;
+                ok = string(out ? &out->text : nullptr);
+                break;
+            case '{':
+                kind = JsonValue::Kind::Object;
+                ok = object(nullptr, depth + 1);
+                break;
+            case '[':
+                kind = JsonValue::Kind::Array;
+                ok = array(depth + 1);
+                break;
+            case 't':
+                kind = JsonValue::Kind::Bool;
+                ok = literal("true");
+                break;
+            case 'f':
+                kind = JsonValue::Kind::Bool;
+                ok = literal("false");
+                break;
+            case 'n':
+                kind = JsonValue::Kind::Null;
+                ok = literal("null");
+                break;
+            default:
+                kind = JsonValue::Kind::Number;
+                ok = number();
+                break;
+        }
+        if (ok && out) {
+            out->kind = kind;
+            out->raw = text_.substr(start, pos_ - start);
+        }
+        return ok;
+    }
+
+    bool digits() {
+        size_t start = pos_;
+        while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+            ++pos_;
+        }
+        return pos_ > start;
+    }
+
+    bool number() {
+        consume('-');
+        if (!digits()) {
+            return false;
+        }
+        if (consume('.') && !digits()) {
+            return false;
+        }
+        if (consume('e') || consume('E')) {
+            if (!consume('+')) {
+                consume('-');
+            }
+            return digits();
+        }
+        return true;
+    }
+
+    int hex4() {
+        if (text_.size() - pos_ < 4) {
+            return -1;
+        }
+        int code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            int digit = c >= '0' && c <= '9' ? c - '0'
+                      : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                      : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                      : -1;
+            if (digit < 0) {
+                return -1;
+            }
+            code = code * 16 + digit;
+        }
+        return code;
+    }
+
+    static void appendUtf8(uint32_t code, std::string& out) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    /**
+     * Read a string, decoding it into out if set. Raw control characters
+     * are let through, as org.json does.
+     */
+    bool string(std::string* out) {
+        if (!consume('"')) {
+            return false;
+        }
+        if (out) {
+            out->clear();
+        }
+        while (pos_ < text_.size()) {
+            // Copy the run up to the next quote or escape in one go
+            size_t run = pos_;
+            while (run < text_.size() && text_[run] != '"' && text_[run] != '\\') {
+                ++run;
+            }
+            if (out) {
+                out->append(text_.data() + pos_, run - pos_);
+            }
+            pos_ = run;
+            if (pos_ >= text_.size()) {
+                break;
+            }
+            if (text_[pos_++] == '"') {
+                return true;
+            }
+            if (pos_ >= text_.size()) {
+                break;
+            }
+            char escape = text_[pos_++];
+            char plain;
+            switch (escape) {
+                case '"': plain = '"'; break;
+                case '\\': plain = '\\'; break;
+                case '/': plain = '/'; break;
+                case 'b': plain = '\b'; break;
+                case 'f': plain = '\f'; break;
+                case 'n': plain = '\n'; break;
+                case 'r': plain = '\r'; break;
+                case 't': plain = '\t'; break;
+                case 'u': {
+                    int code = hex4();
+                    if (code < 0) {
+                        return false;
+                    }
+                    uint32_t point = static_cast<uint32_t>(code);
+                    if (point >= 0xD800 && point < 0xDC00 && text_.compare(pos_, 2, "\\u") == 0) {
+                        size_t low = pos_;
+                        pos_ += 2;
+                        int second = hex4();
+                        if (second >= 0xDC00 && second < 0xE000) {
+                            point = 0x10000 + ((point - 0xD800) << 10) + (static_cast<uint32_t>(second) - 0xDC00);
+                        } else {
+                            pos_ = low;  // read as a character of its own
+                        }
+                    }
+                    if (point >= 0xD800 && point < 0xE000) {
+                        point = 0xFFFD;  // unpaired surrogate
+                    }
+                    if (out) {
+                        appendUtf8(point, *out);
+                    }
+                    continue;
+                }
+                default:
+                    return false;
+            }
+            if (out) {
+                *out += plain;
+            }
+        }
+        return false;
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+/**
+ * Last value under any of the keys that is not null (later duplicates
+ * replace earlier ones in org.json)
+ */
+const JsonValue* field(const JsonFields& fields, std::initializer_list<std::string_view> keys) {
+    for (std::string_view key : keys) {
+        for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+            if (it->first == key) {
+                if (it->second.kind == JsonValue::Kind::Null) {
+                    break;
+                }
+                return &it->second;
+            }
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * JSONObject.getString: strings as decoded, anything else as written
+ */
+bool stringField(const JsonFields& fields, std::initializer_list<std::string_view> keys, std::string& out) {
+    const JsonValue* value = field(fields, keys);
+    if (value == nullptr) {
+        return false;
+    }
+    out = value->kind == JsonValue::Kind::String ? value->text : std::string(value->raw);
+    return true;
+}
+
+/**
+ * JSONObject.optInt: numbers and numeric strings truncated toward zero,
+ * anything else 0
+ */
+bool intField(const JsonFields& fields, std::initializer_list<std::string_view> keys, int& out) {
+    const JsonValue* value = field(fields, keys);
+    if (value == nullptr) {
+        return false;
+    }
+    out = 0;
+    if (value->kind == JsonValue::Kind::Number || value->kind == JsonValue::Kind::String) {
+        std::string digits = value->kind == JsonValue::Kind::String ? value->text : std::string(value->raw);
+        char* end = nullptr;
+        double number = std::strtod(digits.c_str(), &end);
+        if (end != digits.c_str() && *end == '\0' && !std::isnan(number)) {
+            // Java's double to int conversion saturates
+            constexpr double kMin = std::numeric_limits<int>::min();
+            constexpr double kMax = std::numeric_limits<int>::max();
+            out = number <= kMin ? std::numeric_limits<int>::min()
+                : number >= kMax ? std::numeric_limits<int>::max()
+                : static_cast<int>(number);
+        }
+    }
+    return true;
+}
+
+size_t fitUtf8(std::string_view text, size_t room) {
+    if (text.size() <= room) {
+        return text.size();
+    }
+    size_t size = room;
+    while (size > 0 && (static_cast<unsigned char>(text[size]) & 0xC0) == 0x80) {
+        --size;
+    }
+    return size;
+}
+
+} // namespace
+
+bool parseAction(std::string_view reply, ParsedAction& action) {
+    // Malformed replies are turned away by the structural scan alone
+    ActionScan scan = scanAction(reply);
+    if (scan.status == ScanStatus::NoObject || scan.status == ScanStatus::Malformed) {
+        return false;
+    }
+    JsonFields fields;
+    if (!JsonReader(reply.substr(scan.begin, scan.end - scan.begin)).document(fields)) {
+        return false;
+    }
+
+    std::string type = "reply";
+    stringField(fields, {"action"}, type);
+    for (char& c : type) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    action = ParsedAction();
+    stringField(fields, {"message"}, action.message);
+
+    // A data value that is not an object counts as empty
+    JsonFields data;
+    const JsonValue* dataValue = field(fields, {"data"});
+    if (dataValue != nullptr && dataValue->kind == JsonValue::Kind::Object &&
+        !JsonReader(dataValue->raw).document(data)) {
+        return false;
+    }
+
+    if (type == "create_goal") {
+        action.type = ActionType::CreateGoal;
+        if (!stringField(data, {"goalTitle", "goal_title", "title"}, action.title)) {
+            action.title = "New Goal";
+        }
+        if (!intField(data, {"durationMonths", "duration_months"}, action.durationMonths)) {
+            action.durationMonths = 3;
+        }
+        if (!intField(data, {"dailyMinutes", "daily_minutes"}, action.dailyMinutes)) {
+            action.dailyMinutes = 30;
+        }
+    } else if (type == "create_task") {
+        action.type = ActionType::CreateTask;
+        if (!stringField(data, {"taskTitle", "task_title", "title"}, action.title)) {
+            action.title = "New Task";
+        }
+        if (!stringField(data, {"dueDate", "due_date"}, action.dueDate)) {
+            action.dueDate = "today";
+        }
+        if (!intField(data, {"minutes", "duration"}, action.minutes)) {
+            action.minutes = 30;
+        }
+        action.hasGoalTitle = stringField(data, {"goalTitle", "goal_title"}, action.goalTitle);
+    } else if (type == "complete_task") {
+        action.type = ActionType::CompleteTask;
+        stringField(data, {"taskTitle", "task_title", "title"}, action.title);
+    } else if (type == "delete_goal") {
+        action.type = ActionType::DeleteGoal;
+        stringField(data, {"goalTitle", "goal_title", "title"}, action.title);
+    } else if (type == "delete_task") {
+        action.type = ActionType::DeleteTask;
+        stringField(data, {"taskTitle", "task_title", "title"}, action.title);
+    } else if (type == "show_progress") {
+        action.type = ActionType::ShowProgress;
+    } else if (type != "reply" && action.message.empty()) {
+        // Unknown actions reply with the message, or the whole reply
+        action.message = std::string(reply);
+    }
+    return true;
+}
+
+size_t writeActionRecord(std::string_view reply, uint8_t* out, size_t capacity) {
+    if (capacity < kActionRecordHeaderBytes) {
+        return 0;
+    }
+
+    ActionRecordHeader header{};
+    ParsedAction action;
+    std::string_view strings[4];
+    if (parseAction(reply, action)) {
+        header.status = kRecordAction;
+        header.action = static_cast<uint8_t>(action.type);
+        header.flags = action.hasGoalTitle ? kRecordHasGoalTitle : 0;
+        header.durationMonths = action.durationMonths;
+        header.dailyMinutes = action.dailyMinutes;
+        header.minutes = action.minutes;
+        strings[0] = action.message;
+        strings[1] = action.title;
+        strings[2] = action.dueDate;
+        strings[3] = action.goalTitle;
+    } else {
+        header.status = kRecordInvalid;
+        strings[0] = reply;
+    }
+
+    // The titles and date say what to do, so the message gives way first
+    size_t room = capacity - kActionRecordHeaderBytes;
+    size_t sizes[4];
+    for (int i : {1, 2, 3, 0}) {
+        sizes[i] = fitUtf8(strings[i], room);
+        if (sizes[i] < strings[i].size()) {
+            header.flags |= kRecordTruncated;
+        }
+        room -= sizes[i];
+    }
+    header.messageBytes = static_cast<uint32_t>(sizes[0]);
+    header.titleBytes = static_cast<uint32_t>(sizes[1]);
+    header.dueDateBytes = static_cast<uint32_t>(sizes[2]);
+    header.goalTitleBytes = static_cast<uint32_t>(sizes[3]);
+
+    std::memcpy(out, &header, sizeof(header));
+    size_t size = sizeof(header);
+    for (int i = 0; i < 4; ++i) {
+        if (sizes[i] > 0) {
+            std::memcpy(out + size, strings[i].data(), sizes[i]);
+            size += sizes[i];
+        }
+    }
+    return size;
+}
+
+} // namespace llamacore
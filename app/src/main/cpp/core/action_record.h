@@ -0,0 +1,109 @@
+/**
+ * action_record.h - Model replies as binary action records
+ *
+ * The string path hands the reply to Kotlin through NewStringUTF and
+ * JsonResponseParser parses it again with org.json. NewStringUTF expects
+ * modified UTF-8, so four-byte characters (emoji) in a reply arrive
+ * mangled. Here the reply is parsed natively, by JsonResponseParser.parse's
+ * rules (key aliases, defaults, unknown actions as replies), and written
+ * as a flat record that ActionRecord.kt maps straight to an
+ * AssistantAction; its strings are plain UTF-8 and decoded as such.
+ *
+ * Record layout (host order, little-endian on every Android ABI):
+ *
+ *   ActionRecordHeader
+ *   char[messageBytes]     UTF-8, the raw reply if status is kRecordInvalid
+ *   char[titleBytes]       goal title (create/delete goal) or task title
+ *   char[dueDateBytes]     create_task only
+ *   char[goalTitleBytes]   create_task only, see kRecordHasGoalTitle
+ */
+
+#ifndef LLAMACORE_ACTION_RECORD_H
+#define LLAMACORE_ACTION_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace llamacore {
+
+// AssistantAction subclasses, as numbered in ActionRecord.kt
+enum class ActionType : uint8_t {
+    Reply = 0,
+    CreateGoal = 1,
+    CreateTask = 2,
+    CompleteTask = 3,
+    DeleteGoal = 4,
+    DeleteTask = 5,
+    ShowProgress = 6,
+};
+
+// ActionRecordHeader::status
+constexpr uint8_t kRecordInvalid = 0;  // no action object; JsonResponseParser.parse returns null
+constexpr uint8_t kRecordAction = 1;
+
+// ActionRecordHeader::flags
+constexpr uint8_t kRecordHasGoalTitle = 1;  // CreateTask.goalTitle is set
+constexpr uint8_t kRecordTruncated = 2;     // strings were cut to fit the buffer
+
+struct ActionRecordHeader {
+    uint8_t status;
+    uint8_t action;  // ActionType
+    uint8_t flags;
+    uint8_t reserved;
+    int32_t durationMonths;
+    int32_t dailyMinutes;
+    int32_t minutes;
+    uint32_t messageBytes;
+    uint32_t titleBytes;
+    uint32_t dueDateBytes;
+    uint32_t goalTitleBytes;
+};
+
+static_assert(sizeof(ActionRecordHeader) == 32, "ActionRecord.kt reads a 32 byte header");
+
+// Smallest buffer a record can be written to
+constexpr size_t kActionRecordHeaderBytes = sizeof(ActionRecordHeader);
+
+/**
+ * An AssistantAction, with the defaults of JsonResponseParser applied
+ */
+struct ParsedAction {
+    ActionType type = ActionType::Reply;
+    std::string message;
+    std::string title;      // goalTitle or taskTitle, by type
+    std::string dueDate;
+    std::string goalTitle;  // create_task only
+    bool hasGoalTitle = false;
+    int durationMonths = 0;
+    int dailyMinutes = 0;
+    int minutes = 0;
+};
+
+/**
+ * Parse a model reply as JsonResponseParser.parse does
+ *
+ * The action object is the first one in the reply, located and checked
+ * by scanAction (json_scan.h). Values must be strict JSON, which the
+ * action grammar guarantees; org.json's lenient forms (single quotes, bare
+ * words) are rejected.
+ *
+ * @return false where JsonResponseParser.parse returns null
+ */
+bool parseAction(std::string_view reply, ParsedAction& action);
+
+/**
+ * Parse a reply and write its record to out
+ *
+ * When the strings do not fit, they are cut at a character boundary, the
+ * message first, and kRecordTruncated is set.
+ *
+ * @param capacity Bytes at out, at least kActionRecordHeaderBytes
+ * @return Record bytes written, 0 if capacity is too small
+ */
+size_t writeActionRecord(std::string_view reply, uint8_t* out, size_t capacity);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_ACTION_RECORD_H
@@ -0,0 +1,64 @@
+/**
+ * action_schema.cpp - Decoding constraints for the JSON action schema
+ */
+
+#include "action_schema.h"
+
+namespace llamacore {
+
+// Keys come in the order the prompt's format line shows, with at most one
+// space around separators, so no tokens are spent on layout. Counts are
+// bounded to four digits and strings to valid JSON escapes.
+const char* const kActionSchemaGrammar = R"gbnf(
+root          ::= "{" ws action ws "}"
+action        ::= create-goal | create-task | complete-task | delete-goal | delete-task | show-progress | reply
+
+create-goal   ::= action-key "\"create_goal\"" sep message sep data-key "{" ws "\"goalTitle\"" colon string sep "\"durationMonths\"" colon count sep "\"dailyMinutes\"" colon count ws "}"
+create-task   ::= action-key "\"create_task\"" sep message sep data-key "{" ws "\"taskTitle\"" colon string sep "\"dueDate\"" colon due-date sep "\"minutes\"" colon count (sep "\"goalTitle\"" colon string)? ws "}"
+complete-task ::= action-key "\"complete_task\"" sep message sep data-key "{" ws "\"taskTitle\"" colon string ws "}"
+delete-goal   ::= action-key "\"delete_goal\"" sep message sep data-key "{" ws "\"goalTitle\"" colon string ws "}"
+delete-task   ::= action-key "\"delete_task\"" sep message sep data-key "{" ws "\"taskTitle\"" colon string ws "}"
+show-progress ::= action-key "\"show_progress\"" sep message sep data-key "{" ws "}"
+reply         ::= action-key "\"reply\"" sep message sep data-key "{" ws "}"
+
+action-key    ::= "\"action\"" colon
+data-key      ::= "\"data\"" colon
+message       ::= "\"message\"" colon string
+due-date      ::= "\"today\"" | "\"tomorrow\"" | "\"" [0-9]{4} "-" [0-9]{2} "-" [0-9]{2} "\""
+count         ::= [0-9]{1,4}
+string        ::= "\"" char* "\""
+char          ::= [^"\\\x7F\x00-\x1F] | "\\" (["\\/bfnrt] | "u" [0-9a-fA-F]{4})
+colon         ::= ws ":" ws
+sep           ::= ws "," ws
+ws            ::= " "?
+)gbnf";
+
+size_t JsonObjectEnd::feed(std::string_view text) {
+    if (closed_) {
+        return 0;
+    }
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (inString_) {
+            if (escaped_) {
+                escaped_ = false;
+            } else if (c == '\\') {
+                escaped_ = true;
+            } else if (c == '"') {
+                inString_ = false;
+            }
+        } else if (c == '{') {
+            ++depth_;
+        } else if (depth_ > 0) {
+            if (c == '"') {
+                inString_ = true;
+            } else if (c == '}' && --depth_ == 0) {
+                closed_ = true;
+                return i + 1;
+            }
+        }
+    }
+    return std::string_view::npos;
+}
+
+} // namespace llamacore
@@ -0,0 +1,50 @@
+/**
+ * action_schema.h - Decoding constraints for the JSON action schema
+ *
+ * The grammar pins generation to the object described in
+ * PromptTemplates.SYSTEM_INSTRUCTION: "action" limited to its enum, then
+ * "message", then a fixed "data" shape per action. JsonObjectEnd spots the
+ * byte that closes the top-level object so decoding can stop right there.
+ */
+
+#ifndef LLAMACORE_ACTION_SCHEMA_H
+#define LLAMACORE_ACTION_SCHEMA_H
+
+#include <cstddef>
+#include <string_view>
+
+namespace llamacore {
+
+/**
+ * GBNF grammar (root rule "root") for one action object
+ */
+extern const char* const kActionSchemaGrammar;
+
+/**
+ * Incremental scanner for the end of the first top-level JSON object
+ *
+ * Text before the opening brace is skipped; braces inside strings are
+ * ignored.
+ */
+class JsonObjectEnd {
+public:
+    /**
+     * Scan the next piece of output
+     *
+     * @return Offset within text just past the closing brace, or npos if the
+     *         object is still open
+     */
+    size_t feed(std::string_view text);
+
+    bool closed() const { return closed_; }
+
+private:
+    int depth_ = 0;
+    bool inString_ = false;
+    bool escaped_ = false;
+    bool closed_ = false;
+};
+
+} // namespace llamacore
+
+#endif // LLAMACORE_ACTION_SCHEMA_H
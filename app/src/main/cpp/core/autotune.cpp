@@ -0,0 +1,325 @@
+/**
+ * autotune.cpp - Load-time choice of decode threads and batch size
+ *
+ * Tune file layout (native byte order, the file never leaves the device):
+ *
+ *   TuneHeader
+ */
+
+#include "autotune.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "hash.h"
+#include "native_log.h"
+
+namespace llamacore {
+
+namespace {
+
+constexpr char kMagic[8] = {'L', 'C', 'T', 'U', 'N', 'E', '\0', '\0'};
+constexpr uint32_t kFormatVersion = 1;
+
+// Probe sizes: long enough to amortize a pass's fixed cost, short enough
+// that the whole tune stays within a few seconds on a phone
+constexpr int kProbePromptTokens = 128;
+constexpr int kProbeDecodeTokens = 16;
+
+// Workload the probes are weighed for: a context-heavy assistant prompt
+// (prefix reuse covers the instruction block) and a short JSON reply
+constexpr double kWorkloadPromptTokens = 256.0;
+constexpr double kWorkloadDecodeTokens = 64.0;
+
+constexpr int kBatchCandidates[] = {16, 32, 64, 128};
+
+constexpr const char* kProbeText =
+        "Context - Goals: Learn Spanish (in progress), Run a marathon (planning). "
+        "Tasks: Review vocabulary, Book the long run, Buy running shoes. ";
+
+struct TuneHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t modelKey;  // modelIdentity
+    uint64_t cpuKey;    // cpuSignature and the placement and KV type tuned for
+    int32_t numThreads;
+    int32_t batchSize;
+    double promptTokensPerSecond;
+    double decodeTokensPerSecond;
+};
+
+struct ProbeTiming {
+    double promptSeconds = 0.0;
+    double decodeSeconds = 0.0;
+
+    // Seconds the weighted workload would take
+    double cost() const {
+        return promptSeconds / kProbePromptTokens * kWorkloadPromptTokens +
+               decodeSeconds / kProbeDecodeTokens * kWorkloadDecodeTokens;
+    }
+};
+
+/**
+ * Evaluate the probe prompt in batchSize chunks, then decode single tokens,
+ * on a scratch context with its own thread pool
+ *
+ * @return false if the context could not be created or a pass failed
+ */
+bool probe(BackendModel* model, const ContextParams& params, const std::vector<Token>& tokens,
+           ProbeTiming& timing) {
+    ContextParams probeParams = params;
+    probeParams.contextSize = kProbePromptTokens + kProbeDecodeTokens;
+    probeParams.maxSequences = 1;
+    probeParams.threadPool = backend::newThreadPool(probeParams);
+    BackendContext* ctx = backend::newContext(model, probeParams);
+    if (ctx == nullptr) {
+        backend::freeThreadPool(probeParams.threadPool);
+        return false;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<BatchToken> batch;
+    bool ok = true;
+    auto start = Clock::now();
+    for (int pos = 0; pos < kProbePromptTokens && ok; pos += params.batchSize) {
+        int count = std::min(params.batchSize, kProbePromptTokens - pos);
+        batch.clear();
+        for (int i = 0; i < count; ++i) {
+            batch.push_back({tokens[pos + i], pos + i, 0, pos + i == kProbePromptTokens - 1});
+        }
+        ok = backend::decodeBatch(ctx, batch.data(), count);
+    }
+    auto prompted = Clock::now();
+    for (int i = 0; i < kProbeDecodeTokens && ok; ++i) {
+        int pos = kProbePromptTokens + i;
+        BatchToken token{tokens[pos], pos, 0, true};
+        ok = backend::decodeBatch(ctx, &token, 1);
+    }
+    auto decoded = Clock::now();
+
+    backend::freeContext(ctx);
+    backend::freeThreadPool(probeParams.threadPool);
+    timing.promptSeconds = std::chrono::duration<double>(prompted - start).count();
+    timing.decodeSeconds = std::chrono::duration<double>(decoded - prompted).count();
+    return ok;
+}
+
+/**
+ * 1, 2, then every even count up to maxThreads, and maxThreads itself
+ */
+std::vector<int> threadCandidates(int maxThreads) {
+    std::vector<int> counts;
+    for (int threads = 1; threads <= maxThreads; threads = threads < 2 ? 2 : threads + 2) {
+        counts.push_back(threads);
+    }
+    if (counts.back() != maxThreads) {
+        counts.push_back(maxThreads);
+    }
+    return counts;
+}
+
+uint64_t placementKey(const ContextParams& params) {
+    std::string cpus = formatCpuSet(params.placement.cpus);
+    auto priority = static_cast<int>(params.placement.priority);
+    uint64_t hash = fnv1a(cpus.data(), cpus.size());
+    hash = fnv1a(&priority, sizeof(priority), hash);
+    // Quantized KV caches run attention through other kernels
+    auto kvType = static_cast<int>(params.kvType);
+    hash = fnv1a(&kvType, sizeof(kvType), hash);
+    return fnv1a(&params.batchSize, sizeof(params.batchSize), hash);
+}
+
+bool readTuneFile(const std::string& path, uint64_t modelKey, uint64_t cpuKey, TuneResult& result) {
+    FILE* in = std::fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        return false;
+    }
+    TuneHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, in) == 1;
+    std::fclose(in);
+    if (!ok || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kFormatVersion) {
+        LOGI("Tune file %s has an unknown format", path.c_str());
+        return false;
+    }
+    if (header.modelKey != modelKey || header.cpuKey != cpuKey) {
+        LOGI("Tune file %s is stale (model, CPU or placement changed)", path.c_str());
+        return false;
+    }
+    if (header.numThreads <= 0 || header.batchSize <= 0) {
+        return false;
+    }
+    result.numThreads = header.numThreads;
+    result.batchSize = header.batchSize;
+    result.promptTokensPerSecond = header.promptTokensPerSecond;
+    result.decodeTokensPerSecond = header.decodeTokensPerSecond;
+    return true;
+}
+
+/**
+ * Write the result, atomically replacing any old tune file
+ */
+bool writeTuneFile(const std::string& path, uint64_t modelKey, uint64_t cpuKey, const TuneResult& result) {
+    TuneHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFormatVersion;
+    header.numThreads = result.numThreads;
+    header.modelKey = modelKey;
+    header.cpuKey = cpuKey;
+    header.batchSize = result.batchSize;
+    header.promptTokensPerSecond = result.promptTokensPerSecond;
+    header.decodeTokensPerSecond = result.decodeTokensPerSecond;
+
+    std::string tempPath = path + ".tmp";
+    FILE* out = std::fopen(tempPath.c_str(), "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Probe thread counts at the largest batch, then batch sizes at the best
+ * thread count
+ */
+bool measure(BackendModel* model, const ContextParams& params, TuneResult& result) {
+    std::vector<Token> tokens;
+    while (static_cast<int>(tokens.size()) < kProbePromptTokens + kProbeDecodeTokens) {
+        std::vector<Token> chunk = backend::tokenize(model, kProbeText, false);
+        if (chunk.empty()) {
+            return false;
+        }
+        tokens.insert(tokens.end(), chunk.begin(), chunk.end());
+    }
+
+    int maxThreads = params.placement.cpus.empty()
+            ? static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))
+            : static_cast<int>(params.placement.cpus.size());
+    ContextParams probeParams = params;
+    probeParams.batchSize = std::min(params.batchSize, kProbePromptTokens);
+
+    // Page the weights in first; the first pass over an mmap'd model would
+    // otherwise make whichever count goes first look slow
+    ProbeTiming timing;
+    probeParams.numThreads = maxThreads;
+    if (!probe(model, probeParams, tokens, timing)) {
+        return false;
+    }
+
+    ProbeTiming best;
+    for (int threads : threadCandidates(maxThreads)) {
+        probeParams.numThreads = threads;
+        if (!probe(model, probeParams, tokens, timing)) {
+            return false;
+        }
+        LOGD("Autotune threads=%d: prompt %.1f ms, decode %.1f ms", threads, timing.promptSeconds * 1e3,
+             timing.decodeSeconds * 1e3);
+        if (result.numThreads == 0 || timing.cost() < best.cost()) {
+            result.numThreads = threads;
+            best = timing;
+        }
+    }
+
+    // Decode passes carry one token per request, so only prompt evaluation
+    // tells batch sizes apart
+    probeParams.numThreads = result.numThreads;
+    int bestBatch = probeParams.batchSize;
+    for (int batchSize : kBatchCandidates) {
+        if (batchSize >= probeParams.batchSize) {
+            break;
+        }
+        ContextParams batchParams = probeParams;
+        batchParams.batchSize = batchSize;
+        if (probe(model, batchParams, tokens, timing) && timing.promptSeconds < best.promptSeconds) {
+            bestBatch = batchSize;
+            best.promptSeconds = timing.promptSeconds;
+        }
+    }
+    // A probe prompt cannot tell batches above its length apart; keep the
+    // requested size then, which long prompts benefit from
+    result.batchSize = bestBatch == probeParams.batchSize ? params.batchSize : bestBatch;
+
+    result.promptTokensPerSecond = best.promptSeconds > 0.0 ? kProbePromptTokens / best.promptSeconds : 0.0;
+    result.decodeTokensPerSecond = best.decodeSeconds > 0.0 ? kProbeDecodeTokens / best.decodeSeconds : 0.0;
+    return true;
+}
+
+} // namespace
+
+const char* tuneSourceName(TuneSource source) {
+    switch (source) {
+        case TuneSource::Off: return "off";
+        case TuneSource::Measured: return "measured";
+        case TuneSource::Cached: return "cached";
+        case TuneSource::Failed: return "failed";
+    }
+    return "off";
+}
+
+std::string tunePath(const std::string& directory, const std::string& modelPath) {
+    size_t slash = modelPath.find_last_of('/');
+    std::string name = slash == std::string::npos ? modelPath : modelPath.substr(slash + 1);
+    return directory + "/" + name + ".tune";
+}
+
+uint64_t cpuSignature() {
+    uint64_t hash = fnv1a(backend::name(), std::strlen(backend::name()));
+    unsigned cores = std::thread::hardware_concurrency();
+    hash = fnv1a(&cores, sizeof(cores), hash);
+    std::string fast = formatCpuSet(performanceCores());
+    hash = fnv1a(fast.data(), fast.size(), hash);
+
+    // Lines naming the cores: "model name" on x86, "CPU part"/"Hardware"
+    // on ARM; per-core counters such as BogoMIPS or MHz are left out
+    FILE* in = std::fopen("/proc/cpuinfo", "r");
+    if (in != nullptr) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), in) != nullptr) {
+            if (std::strncmp(line, "model name", 10) == 0 || std::strncmp(line, "CPU part", 8) == 0 ||
+                std::strncmp(line, "CPU implementer", 15) == 0 || std::strncmp(line, "Hardware", 8) == 0) {
+                hash = fnv1a(line, std::strlen(line), hash);
+            }
+        }
+        std::fclose(in);
+    }
+    return hash;
+}
+
+TuneSource autotune(const ModelWeights& weights, const ContextParams& params, const std::string& directory,
+                    TuneResult& result) {
+    std::string path = tunePath(directory, weights.path);
+    uint64_t cpuKey = cpuSignature() ^ placementKey(params);
+
+    TuneResult tuned;
+    if (readTuneFile(path, weights.identity, cpuKey, tuned)) {
+        LOGI("Autotune from %s: %d threads, batch %d", path.c_str(), tuned.numThreads, tuned.batchSize);
+        result = tuned;
+        return TuneSource::Cached;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!measure(weights.model, params, tuned)) {
+        LOGE("Autotune probes failed for %s", weights.path.c_str());
+        return TuneSource::Failed;
+    }
+    LOGI("Autotune measured %d threads, batch %d (prompt %.1f tok/s, decode %.1f tok/s) in %.0f ms",
+         tuned.numThreads, tuned.batchSize, tuned.promptTokensPerSecond, tuned.decodeTokensPerSecond,
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    if (!writeTuneFile(path, weights.identity, cpuKey, tuned)) {
+        LOGE("Cannot write tune file %s", path.c_str());
+    }
+    result = tuned;
+    return TuneSource::Measured;
+}
+
+} // namespace llamacore
@@ -0,0 +1,70 @@
+/**
+ * autotune.h - Load-time choice of decode threads and batch size
+ *
+ * The fastest thread count depends on the SoC (how many big cores, how
+ * much memory bandwidth) and on the model (bandwidth-bound decode saturates
+ * with fewer threads than compute-bound prompt evaluation), so a fixed
+ * default is wrong somewhere. Autotuning runs short prompt and decode
+ * probes on a scratch context at several thread counts, then at several
+ * batch sizes with the winner, and keeps the fastest configuration.
+ *
+ * Probing costs a few seconds, so the result is written next to the model
+ * (ModelManager.getModelsDirectory) keyed by the model file and a CPU
+ * signature; later loads on the same device read it back, and a new model
+ * file, a different SoC, another thread placement or KV cache type
+ * measures again.
+ */
+
+#ifndef LLAMACORE_AUTOTUNE_H
+#define LLAMACORE_AUTOTUNE_H
+
+#include <string>
+
+#include "backend.h"
+#include "model_weights.h"
+
+namespace llamacore {
+
+struct TuneResult {
+    int numThreads = 0;
+    int batchSize = 0;
+    double promptTokensPerSecond = 0.0;  // probe prompt evaluation
+    double decodeTokensPerSecond = 0.0;  // probe single-token decode
+};
+
+enum class TuneSource {
+    Off,       // not requested, the caller's settings were used
+    Measured,  // probed at this load and stored
+    Cached,    // read back from the tune file
+    Failed,    // probes failed, the caller's settings were used
+};
+
+const char* tuneSourceName(TuneSource source);
+
+/**
+ * Tune file used for a model inside a directory
+ */
+std::string tunePath(const std::string& directory, const std::string& modelPath);
+
+/**
+ * Hash of what makes one device run a model differently from another: the
+ * CPU models and core count, their maximum frequencies, and the backend
+ */
+uint64_t cpuSignature();
+
+/**
+ * Find the fastest thread count and batch size for a model, from the tune
+ * file in directory if it matches the model, CPU and placement, otherwise
+ * by probing and storing the result there
+ *
+ * @param params Settings to tune: threads from 1 up to one per core of
+ *        params.placement and batch sizes up to params.batchSize are
+ *        tried; the other settings are kept
+ * @param result Receives the configuration (unchanged on Failed)
+ */
+TuneSource autotune(const ModelWeights& weights, const ContextParams& params, const std::string& directory,
+                    TuneResult& result);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_AUTOTUNE_H
@@ -0,0 +1,253 @@
+/**
+ * backend.h - Inference backend interface
+ *
+ * The token-level primitives the generation engine needs: model loading,
+ * tokenization, batched decode into a KV cache, and sampling. Exactly one
+ * implementation is compiled in, chosen by CMake:
+ *
+ * - backend_llama.cpp: llama.cpp (LLAMACORE_WITH_LLAMA), mmap'd GGUF weights
+ * - backend_stub.cpp:  compile-time fallback used when llama.cpp is not
+ *   available. It simulates a tiny model whose "prediction" is the canned
+ *   JSON reply for the prompt's intent, so the whole engine (KV bookkeeping,
+ *   sampling loop, caches) runs and can be benchmarked on any host.
+ *
+ * A context holds up to ContextParams::maxSequences independent sequences
+ * in one unified KV cache, so requests can share a decode batch.
+ *
+ * tokenize/appendPiece/isEndOfGeneration only read the vocabulary and may
+ * be called from any thread. Everything taking a BackendContext is called
+ * with the owning ModelContext locked; contexts are not thread-safe on
+ * their own.
+ */
+
+#ifndef LLAMACORE_BACKEND_H
+#define LLAMACORE_BACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "thread_placement.h"
+
+namespace llamacore {
+
+using Token = int32_t;
+
+// Opaque backend objects, defined by the selected implementation
+struct BackendModel;
+struct BackendContext;
+struct BackendSampler;
+struct BackendThreadPool;
+
+// Element type of the K and V caches. Quantized types shrink the cache
+// (the largest allocation after the weights) at a small accuracy cost.
+enum class KvCacheType {
+    F16 = 0,   // 2 bytes per element
+    Q8_0 = 1,  // 34 bytes per 32 elements
+    Q4_0 = 2,  // 18 bytes per 32 elements
+};
+
+/**
+ * Sizes the memory planner (memory_plan.h) estimates a context from
+ */
+struct ModelShape {
+    uint64_t weightBytes = 0;  // tensor data
+    int layers = 0;
+    int embedding = 0;         // n_embd
+    int kvEmbedding = 0;       // K (and V) width per layer, smaller with GQA
+    int vocabSize = 0;
+    int trainContext = 0;      // n_ctx_train, 0 if unknown
+};
+
+struct ModelParams {
+    bool useMmap = true;     // map GGUF weights instead of reading them
+    bool useMlock = false;
+};
+
+struct ContextParams {
+    int contextSize = 2048;  // n_ctx, tokens
+    int numThreads = 4;      // decode threads
+    int batchSize = 512;     // max tokens per decode call
+    int maxSequences = 4;    // sequences sharing the KV cache (n_seq_max)
+    KvCacheType kvType = KvCacheType::F16;
+
+    // Cores and priority for decode threads (thread_placement.h)
+    ThreadPlacement placement;
+
+    // Persistent decode worker pool from newThreadPool, optional; contexts
+    // driven from the same thread may share one
+    BackendThreadPool* threadPool = nullptr;
+};
+
+struct SamplingParams {
+    float temperature = 0.7f;  // <= 0 selects greedy decoding
+    float topP = 0.9f;
+    int topK = 40;
+    uint32_t seed = 0xFFFFFFFF;  // LLAMA_DEFAULT_SEED: random
+    const char* grammar = nullptr;  // GBNF constraint (root rule "root"), optional
+};
+
+/**
+ * One entry of a multi-sequence decode batch
+ */
+struct BatchToken {
+    Token token;
+    int pos;      // position within its sequence
+    int seq;      // sequence id, 0..maxSequences-1
+    bool logits;  // produce logits for sampling after this token
+};
+
+namespace backend {
+
+/**
+ * Human readable backend name ("llama.cpp" or "stub")
+ */
+const char* name();
+
+/**
+ * Process-wide initialization and teardown (llama_backend_init/free)
+ */
+void initialize();
+void shutdown();
+
+/**
+ * Load model weights
+ *
+ * @return nullptr on failure
+ */
+BackendModel* loadModel(const std::string& path, const ModelParams& params);
+void freeModel(BackendModel* model);
+
+ModelShape modelShape(BackendModel* model);
+
+/**
+ * Create an inference context (KV cache, compute buffers) over a model
+ *
+ * @return nullptr on failure
+ */
+BackendContext* newContext(BackendModel* model, const ContextParams& params);
+void freeContext(BackendContext* ctx);
+
+/**
+ * Create a persistent pool of numThreads decode workers placed per
+ * params.placement, so passes do not spawn threads or lose them to other
+ * cores. Must outlive the contexts it is given to.
+ *
+ * @return nullptr if the backend runs decode without one
+ */
+BackendThreadPool* newThreadPool(const ContextParams& params);
+void freeThreadPool(BackendThreadPool* pool);
+
+/**
+ * Actual context length in tokens
+ */
+int contextSize(BackendContext* ctx);
+
+/**
+ * Tokenize UTF-8 text
+ *
+ * @param addSpecial Prepend BOS (and other model-specific special tokens)
+ * @param parseSpecial Turn the text of special tokens, such as
+ *        "<|im_end|>", into those tokens; clear for text the user typed
+ */
+std::vector<Token> tokenize(BackendModel* model, std::string_view text, bool addSpecial, bool parseSpecial = true);
+
+/**
+ * Append the UTF-8 text of a token to out
+ */
+void appendPiece(BackendModel* model, Token token, std::string& out);
+
+/**
+ * True for end-of-generation tokens (EOS, EOT, ...)
+ */
+bool isEndOfGeneration(BackendModel* model, Token token);
+
+/**
+ * True if draft tokenizes text exactly like target, so tokens it guesses
+ * can be verified by target (speculative decoding)
+ */
+bool vocabCompatible(BackendModel* target, BackendModel* draft);
+
+/**
+ * Evaluate tokens of one sequence into the KV cache
+ *
+ * @param tokens Tokens to evaluate, at positions startPos..startPos+count-1
+ * @param logitsForAll Produce logits for every token (speculative
+ *        verification); otherwise only for the last one
+ * @param seq Sequence id
+ * @return false on failure
+ */
+bool decode(BackendContext* ctx, const Token* tokens, int count, int startPos, bool logitsForAll,
+            int seq = 0);
+
+/**
+ * Evaluate a batch mixing tokens of several sequences in one pass
+ *
+ * @param count At most ContextParams::batchSize entries
+ * @return false on failure (the batch is then not in the cache)
+ */
+bool decodeBatch(BackendContext* ctx, const BatchToken* tokens, int count);
+
+/**
+ * Remove the cells of a sequence at positions [fromPos, end)
+ *
+ * @return false if the cache cannot be cut partially (e.g. recurrent
+ *         models); the caller should then clear it with fromPos 0
+ */
+bool truncateCache(BackendContext* ctx, int fromPos, int seq = 0);
+
+/**
+ * Remove the cells of a sequence at positions [keep, keep + discard) and
+ * move the cells after them down by discard, so the sequence continues at
+ * its old end minus discard (context shifting). Cells keep their evaluated
+ * state; only their positions change.
+ *
+ * @return false if the cache cannot shift positions (e.g. recurrent
+ *         models); it is then unchanged
+ */
+bool shiftCache(BackendContext* ctx, int keep, int discard, int seq = 0);
+
+/**
+ * Size in bytes of the serialized KV state of sequence 0
+ */
+size_t stateSize(BackendContext* ctx);
+
+/**
+ * Serialize the KV state into dst
+ *
+ * @return Bytes written, 0 on failure
+ */
+size_t saveState(BackendContext* ctx, uint8_t* dst, size_t capacity);
+
+/**
+ * Replace the KV state of sequence 0 with one produced by saveState for the
+ * same model; other sequences are untouched
+ *
+ * @param src Serialized state; only read during the call, so it may point
+ *        into a memory-mapped file
+ * @return false if the state was rejected (sequence 0 is then empty)
+ */
+bool loadState(BackendContext* ctx, const uint8_t* src, size_t size);
+
+/**
+ * Create a sampler chain for one generation
+ */
+BackendSampler* newSampler(BackendModel* model, const SamplingParams& params);
+void freeSampler(BackendSampler* sampler);
+
+/**
+ * Sample the next token from the logits of the last decode. The sampled
+ * token is accepted into the sampler state (repetition, grammar).
+ *
+ * @param batchIndex Index, within the last decode call, of a token that
+ *        requested logits; -1 for the last one
+ */
+Token sample(BackendSampler* sampler, BackendContext* ctx, int batchIndex);
+
+} // namespace backend
+
+} // namespace llamacore
+
+#endif // LLAMACORE_BACKEND_H
@@ -0,0 +1,362 @@
+/**
+ * backend_llama.cpp - llama.cpp inference backend
+ *
+ * Compiled when CMake finds a llama.cpp source tree (LLAMACORE_WITH_LLAMA).
+ * Weights are mmap'd from the GGUF file; decode runs on the CPU with the
+ * thread count passed down from LlamaInference.loadModel, on a persistent
+ * ggml threadpool pinned and prioritized per the context's placement.
+ *
+ * Written against the llama.cpp C API with llama_model_load_from_file,
+ * llama_vocab and the llama_memory_* KV functions (mid-2025 and later).
+ */
+
+#include "backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "ggml-cpu.h"
+#include "llama.h"
+#include "native_log.h"
+
+namespace llamacore {
+
+struct BackendModel {
+    llama_model* model = nullptr;
+    const llama_vocab* vocab = nullptr;
+};
+
+struct BackendContext {
+    BackendModel* model = nullptr;
+    llama_context* ctx = nullptr;
+    llama_batch batch{};
+    int batchCapacity = 0;
+};
+
+struct BackendSampler {
+    llama_sampler* chain = nullptr;
+};
+
+struct BackendThreadPool {
+    ggml_threadpool* pool = nullptr;
+};
+
+namespace backend {
+
+const char* name() {
+    return "llama.cpp";
+}
+
+void initialize() {
+    llama_backend_init();
+}
+
+void shutdown() {
+    llama_backend_free();
+}
+
+BackendModel* loadModel(const std::string& path, const ModelParams& params) {
+    llama_model_params modelParams = llama_model_default_params();
+    modelParams.n_gpu_layers = 0;  // CPU only
+    modelParams.use_mmap = params.useMmap;
+    modelParams.use_mlock = params.useMlock;
+
+    llama_model* model = llama_model_load_from_file(path.c_str(), modelParams);
+    if (model == nullptr) {
+        LOGE("Failed to load model from: %s", path.c_str());
+        return nullptr;
+    }
+
+    auto* result = new BackendModel();
+    result->model = model;
+    result->vocab = llama_model_get_vocab(model);
+    return result;
+}
+
+void freeModel(BackendModel* model) {
+    if (model != nullptr) {
+        llama_model_free(model->model);
+        delete model;
+    }
+}
+
+ModelShape modelShape(BackendModel* model) {
+    ModelShape shape;
+    shape.weightBytes = llama_model_size(model->model);
+    shape.layers = llama_model_n_layer(model->model);
+    shape.embedding = llama_model_n_embd(model->model);
+    int heads = llama_model_n_head(model->model);
+    int kvHeads = llama_model_n_head_kv(model->model);
+    shape.kvEmbedding = heads > 0 ? shape.embedding / heads * kvHeads : shape.embedding;
+    shape.vocabSize = llama_vocab_n_tokens(model->vocab);
+    shape.trainContext = llama_model_n_ctx_train(model->model);
+    return shape;
+}
+
+BackendContext* newContext(BackendModel* model, const ContextParams& params) {
+    llama_context_params ctxParams = llama_context_default_params();
+    ctxParams.n_ctx = static_cast<uint32_t>(params.contextSize);
+    ctxParams.n_batch = static_cast<uint32_t>(params.batchSize);
+    ctxParams.n_ubatch = static_cast<uint32_t>(std::min(params.batchSize, 512));
+    // Sequences share one cache of n_ctx cells instead of n_ctx / n_seq_max each
+    ctxParams.n_seq_max = static_cast<uint32_t>(std::max(1, params.maxSequences));
+    ctxParams.kv_unified = true;
+    ctxParams.n_threads = params.numThreads;
+    ctxParams.n_threads_batch = params.numThreads;
+    switch (params.kvType) {
+        case KvCacheType::F16:
+            ctxParams.type_k = ctxParams.type_v = GGML_TYPE_F16;
+            break;
+        case KvCacheType::Q8_0:
+            ctxParams.type_k = ctxParams.type_v = GGML_TYPE_Q8_0;
+            break;
+        case KvCacheType::Q4_0:
+            ctxParams.type_k = ctxParams.type_v = GGML_TYPE_Q4_0;
+            break;
+    }
+    if (params.kvType != KvCacheType::F16) {
+        // A quantized V cache is only supported by the flash attention path
+        ctxParams.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+    }
+
+    llama_context* ctx = llama_init_from_model(model->model, ctxParams);
+    if (ctx == nullptr) {
+        LOGE("Failed to create llama context (n_ctx=%d)", params.contextSize);
+        return nullptr;
+    }
+    if (params.threadPool != nullptr) {
+        // Single-token decode and prompt batches run on the same workers
+        llama_attach_threadpool(ctx, params.threadPool->pool, params.threadPool->pool);
+    }
+
+    auto* result = new BackendContext();
+    result->model = model;
+    result->ctx = ctx;
+    result->batchCapacity = params.batchSize;
+    result->batch = llama_batch_init(params.batchSize, 0, 1);
+    return result;
+}
+
+void freeContext(BackendContext* ctx) {
+    if (ctx != nullptr) {
+        llama_batch_free(ctx->batch);
+        llama_free(ctx->ctx);
+        delete ctx;
+    }
+}
+
+BackendThreadPool* newThreadPool(const ContextParams& params) {
+    ggml_threadpool_params poolParams = ggml_threadpool_params_default(params.numThreads);
+    for (int cpu : params.placement.cpus) {
+        if (cpu < GGML_MAX_N_THREADS) {
+            poolParams.cpumask[cpu] = true;
+        }
+    }
+    // Workers float over the whole set rather than one core each, so a
+    // core busy with the UI does not hold back a pinned worker
+    poolParams.strict_cpu = false;
+    switch (params.placement.priority) {
+        case ThreadPriority::Low:
+            poolParams.prio = GGML_SCHED_PRIO_LOW;
+            break;
+        case ThreadPriority::Normal:
+            poolParams.prio = GGML_SCHED_PRIO_NORMAL;
+            break;
+        case ThreadPriority::High:
+            poolParams.prio = GGML_SCHED_PRIO_HIGH;
+            break;
+        case ThreadPriority::Realtime:
+            poolParams.prio = GGML_SCHED_PRIO_REALTIME;
+            break;
+    }
+
+    ggml_threadpool* pool = ggml_threadpool_new(&poolParams);
+    if (pool == nullptr) {
+        LOGE("Failed to create a threadpool of %d threads", params.numThreads);
+        return nullptr;
+    }
+    return new BackendThreadPool{pool};
+}
+
+void freeThreadPool(BackendThreadPool* pool) {
+    if (pool != nullptr) {
+        ggml_threadpool_free(pool->pool);
+        delete pool;
+    }
+}
+
+int contextSize(BackendContext* ctx) {
+    return static_cast<int>(llama_n_ctx(ctx->ctx));
+}
+
+std::vector<Token> tokenize(BackendModel* model, std::string_view text, bool addSpecial, bool parseSpecial) {
+    // A token covers at least one byte, plus room for BOS/EOS
+    std::vector<Token> tokens(text.size() + 2);
+    int count = llama_tokenize(model->vocab, text.data(), static_cast<int32_t>(text.size()),
+                               tokens.data(), static_cast<int32_t>(tokens.size()), addSpecial, parseSpecial);
+    if (count < 0) {
+        tokens.resize(static_cast<size_t>(-count));
+        count = llama_tokenize(model->vocab, text.data(), static_cast<int32_t>(text.size()),
+                               tokens.data(), static_cast<int32_t>(tokens.size()), addSpecial, parseSpecial);
+    }
+    tokens.resize(static_cast<size_t>(std::max(count, 0)));
+    return tokens;
+}
+
+void appendPiece(BackendModel* model, Token token, std::string& out) {
+    char buffer[128];
+    int length = llama_token_to_piece(model->vocab, token, buffer, sizeof(buffer), 0, false);
+    if (length >= 0) {
+        out.append(buffer, static_cast<size_t>(length));
+        return;
+    }
+    std::string large(static_cast<size_t>(-length), '\0');
+    length = llama_token_to_piece(model->vocab, token, &large[0], -length, 0, false);
+    out.append(large.data(), static_cast<size_t>(std::max(length, 0)));
+}
+
+bool isEndOfGeneration(BackendModel* model, Token token) {
+    return llama_vocab_is_eog(model->vocab, token);
+}
+
+bool vocabCompatible(BackendModel* target, BackendModel* draft) {
+    // The checks llama.cpp's speculative example makes: same tokenizer
+    // type and special tokens, and the same text for every shared id
+    const llama_vocab* a = target->vocab;
+    const llama_vocab* b = draft->vocab;
+    if (llama_vocab_type(a) != llama_vocab_type(b) ||
+        llama_vocab_get_add_bos(a) != llama_vocab_get_add_bos(b) ||
+        llama_vocab_bos(a) != llama_vocab_bos(b) || llama_vocab_eos(a) != llama_vocab_eos(b)) {
+        return false;
+    }
+    int targetTokens = llama_vocab_n_tokens(a);
+    int draftTokens = llama_vocab_n_tokens(b);
+    if (std::abs(targetTokens - draftTokens) > 128) {
+        return false;
+    }
+    for (int id = 5; id < std::min(targetTokens, draftTokens); ++id) {
+        if (std::strcmp(llama_vocab_get_text(a, id), llama_vocab_get_text(b, id)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decode(BackendContext* ctx, const Token* tokens, int count, int startPos, bool logitsForAll,
+            int seq) {
+    // Logits for every token only survive from the final chunk, so callers
+    // verifying drafts must keep count within the batch size
+    for (int offset = 0; offset < count; offset += ctx->batchCapacity) {
+        int chunk = std::min(ctx->batchCapacity, count - offset);
+        llama_batch& batch = ctx->batch;
+        batch.n_tokens = chunk;
+        for (int i = 0; i < chunk; ++i) {
+            batch.token[i] = tokens[offset + i];
+            batch.pos[i] = startPos + offset + i;
+            batch.n_seq_id[i] = 1;
+            batch.seq_id[i][0] = seq;
+            batch.logits[i] = logitsForAll || offset + i == count - 1;
+        }
+        int status = llama_decode(ctx->ctx, batch);
+        if (status != 0) {
+            LOGE("llama_decode failed (%d) at pos %d", status, startPos + offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decodeBatch(BackendContext* ctx, const BatchToken* tokens, int count) {
+    if (count <= 0 || count > ctx->batchCapacity) {
+        return false;
+    }
+    llama_batch& batch = ctx->batch;
+    batch.n_tokens = count;
+    for (int i = 0; i < count; ++i) {
+        batch.token[i] = tokens[i].token;
+        batch.pos[i] = tokens[i].pos;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = tokens[i].seq;
+        batch.logits[i] = tokens[i].logits;
+    }
+    int status = llama_decode(ctx->ctx, batch);
+    if (status != 0) {
+        LOGE("llama_decode failed (%d) for a batch of %d", status, count);
+        return false;
+    }
+    return true;
+}
+
+bool truncateCache(BackendContext* ctx, int fromPos, int seq) {
+    // Removing a whole sequence always succeeds, even on recurrent models
+    return llama_memory_seq_rm(llama_get_memory(ctx->ctx), seq, fromPos <= 0 ? -1 : fromPos, -1);
+}
+
+bool shiftCache(BackendContext* ctx, int keep, int discard, int seq) {
+    llama_memory_t memory = llama_get_memory(ctx->ctx);
+    if (!llama_memory_can_shift(memory) || discard <= 0) {
+        return false;
+    }
+    // RoPE is re-applied to the moved keys on the next decode
+    if (!llama_memory_seq_rm(memory, seq, keep, keep + discard)) {
+        return false;
+    }
+    llama_memory_seq_add(memory, seq, keep + discard, -1, -discard);
+    return true;
+}
+
+size_t stateSize(BackendContext* ctx) {
+    return llama_state_seq_get_size(ctx->ctx, 0);
+}
+
+size_t saveState(BackendContext* ctx, uint8_t* dst, size_t capacity) {
+    return llama_state_seq_get_data(ctx->ctx, dst, capacity, 0);
+}
+
+bool loadState(BackendContext* ctx, const uint8_t* src, size_t size) {
+    truncateCache(ctx, 0, 0);
+    if (llama_state_seq_set_data(ctx->ctx, src, size, 0) == 0) {
+        truncateCache(ctx, 0, 0);
+        return false;
+    }
+    return true;
+}
+
+BackendSampler* newSampler(BackendModel* model, const SamplingParams& params) {
+    llama_sampler* chain = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    if (params.grammar != nullptr) {
+        // First in the chain, so later samplers only see tokens it allows
+        llama_sampler* grammar = llama_sampler_init_grammar(model->vocab, params.grammar, "root");
+        if (grammar != nullptr) {
+            llama_sampler_chain_add(chain, grammar);
+        } else {
+            LOGE("Grammar failed to parse, sampling unconstrained");
+        }
+    }
+    if (params.temperature <= 0.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_greedy());
+    } else {
+        llama_sampler_chain_add(chain, llama_sampler_init_top_k(params.topK));
+        llama_sampler_chain_add(chain, llama_sampler_init_top_p(params.topP, 1));
+        llama_sampler_chain_add(chain, llama_sampler_init_temp(params.temperature));
+        llama_sampler_chain_add(chain, llama_sampler_init_dist(params.seed));
+    }
+    return new BackendSampler{chain};
+}
+
+void freeSampler(BackendSampler* sampler) {
+    if (sampler != nullptr) {
+        llama_sampler_free(sampler->chain);
+        delete sampler;
+    }
+}
+
+Token sample(BackendSampler* sampler, BackendContext* ctx, int batchIndex) {
+    // llama_sampler_sample also accepts the token into the chain
+    return llama_sampler_sample(sampler->chain, ctx->ctx, batchIndex);
+}
+
+} // namespace backend
+
+} // namespace llamacore
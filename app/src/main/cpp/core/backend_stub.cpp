@@ -0,0 +1,410 @@
+/**
+ * backend_stub.cpp - Compile-time fallback backend (no llama.cpp)
+ *
+ * Simulates a small language model so the generation engine can run
+ * unchanged on any host:
+ *
+ * - Vocabulary: every byte string of length 1..3 is a token, packed as
+ *   (length << 24) | bytes, plus BOS/EOS. Text tokenizes into 3-byte chunks,
+ *   roughly the density of a real BPE vocabulary. Like a BPE pre-tokenizer,
+ *   chunks stop at line breaks, and a run of line breaks is a chunk of its
+ *   own. A model file named *.spm.gguf tokenizes like a SentencePiece
+ *   vocabulary with add_space_prefix: every tokenize call starts with a
+ *   "▁" token (which decodes to nothing here, as the detokenizer strips
+ *   it).
+ * - "Weights": given a prompt, the model predicts the canned JSON reply for
+ *   the prompt's intent (the original stub responses), one token at a time.
+ * - KV cache: the token at each position of each sequence, sharing one
+ *   budget of contextSize cells, so prefix reuse, truncation, multi-sequence
+ *   batches and batched verification behave like the real thing.
+ */
+
+#include "backend.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "intent_detector.h"
+#include "response_builder.h"
+
+namespace llamacore {
+
+namespace {
+
+constexpr Token kTokenBos = 1;
+constexpr Token kTokenEos = 2;
+constexpr Token kTokenSpacePrefix = 3;
+constexpr int kBytesPerToken = 3;
+
+inline int pieceLength(Token token) {
+    return static_cast<int>(static_cast<uint32_t>(token) >> 24);
+}
+
+} // namespace
+
+struct BackendModel {
+    std::string path;
+    bool spacePrefix = false;  // SentencePiece-like, see above
+};
+
+struct StubSequence {
+    // KV cache: token at each position
+    std::vector<Token> cells;
+
+    // The reply the model is producing for cells[0, promptLength)
+    bool scriptValid = false;
+    int promptLength = 0;
+    std::vector<Token> script;
+
+    // First position holding a token that departs from the script
+    int divergedAt = INT_MAX;
+};
+
+struct StubOutput {
+    int batchIndex;
+    int seq;
+    int pos;
+};
+
+struct BackendContext {
+    BackendModel* model = nullptr;
+    int contextSize = 0;
+    int batchSize = 0;
+    std::vector<StubSequence> sequences;
+
+    // Tokens whose logits the last decode produced
+    std::vector<StubOutput> outputs;
+
+    size_t usedCells() const {
+        size_t used = 0;
+        for (const StubSequence& sequence : sequences) {
+            used += sequence.cells.size();
+        }
+        return used;
+    }
+};
+
+struct BackendSampler {
+    SamplingParams params;
+};
+
+// The stub decodes on the calling thread; the pool only records its settings
+struct BackendThreadPool {
+    int threads = 0;
+};
+
+namespace backend {
+
+const char* name() {
+    return "stub";
+}
+
+void initialize() {}
+
+void shutdown() {}
+
+BackendModel* loadModel(const std::string& path, const ModelParams& /*params*/) {
+    // The stub accepts any path so the app works without a downloaded model
+    return new BackendModel{path, path.find(".spm.") != std::string::npos};
+}
+
+void freeModel(BackendModel* model) {
+    delete model;
+}
+
+ModelShape modelShape(BackendModel* /*model*/) {
+    // A notional small model, so memory planning has something to work on;
+    // the stub's real footprint is a few vectors
+    ModelShape shape;
+    shape.weightBytes = 64ull << 20;
+    shape.layers = 8;
+    shape.embedding = 512;
+    shape.kvEmbedding = 128;
+    shape.vocabSize = 1 << 15;
+    shape.trainContext = 8192;
+    return shape;
+}
+
+BackendContext* newContext(BackendModel* model, const ContextParams& params) {
+    auto* ctx = new BackendContext();
+    ctx->model = model;
+    ctx->contextSize = params.contextSize;
+    ctx->batchSize = params.batchSize;
+    ctx->sequences.resize(std::max(1, params.maxSequences));
+    return ctx;
+}
+
+void freeContext(BackendContext* ctx) {
+    delete ctx;
+}
+
+BackendThreadPool* newThreadPool(const ContextParams& params) {
+    return new BackendThreadPool{params.numThreads};
+}
+
+void freeThreadPool(BackendThreadPool* pool) {
+    delete pool;
+}
+
+int contextSize(BackendContext* ctx) {
+    return ctx->contextSize;
+}
+
+std::vector<Token> tokenize(BackendModel* model, std::string_view text, bool addSpecial, bool /*parseSpecial*/) {
+    std::vector<Token> tokens;
+    tokens.reserve(text.size() / kBytesPerToken + 3);
+    if (addSpecial) {
+        tokens.push_back(kTokenBos);
+    }
+    if (model->spacePrefix && !text.empty()) {
+        tokens.push_back(kTokenSpacePrefix);
+    }
+    for (size_t i = 0, length = 0; i < text.size(); i += length) {
+        length = std::min<size_t>(kBytesPerToken, text.size() - i);
+        // A chunk is all line breaks or none
+        bool lineBreak = text[i] == '\n';
+        for (size_t j = 1; j < length; ++j) {
+            if ((text[i + j] == '\n') != lineBreak) {
+                length = j;
+                break;
+            }
+        }
+        uint32_t packed = static_cast<uint32_t>(length) << 24;
+        for (size_t j = 0; j < length; ++j) {
+            packed |= static_cast<uint32_t>(static_cast<uint8_t>(text[i + j])) << (8 * j);
+        }
+        tokens.push_back(static_cast<Token>(packed));
+    }
+    return tokens;
+}
+
+void appendPiece(BackendModel* /*model*/, Token token, std::string& out) {
+    int length = pieceLength(token);
+    for (int j = 0; j < length; ++j) {
+        out.push_back(static_cast<char>((static_cast<uint32_t>(token) >> (8 * j)) & 0xFF));
+    }
+}
+
+bool isEndOfGeneration(BackendModel* /*model*/, Token token) {
+    return token == kTokenEos;
+}
+
+bool vocabCompatible(BackendModel* target, BackendModel* draft) {
+    // Stub models share the byte-chunk vocabulary, with or without the
+    // space prefix
+    return target->spacePrefix == draft->spacePrefix;
+}
+
+/**
+ * Append a batch to the cache; decode() calls this with whole prompts, which
+ * may exceed the batch size
+ */
+static bool evaluate(BackendContext* ctx, const BatchToken* tokens, int count) {
+    if (count <= 0 ||
+        ctx->usedCells() + static_cast<size_t>(count) > static_cast<size_t>(ctx->contextSize)) {
+        return false;
+    }
+
+    // Like llama.cpp, each sequence's positions must continue its cache;
+    // check the whole batch before touching anything
+    std::vector<int> next(ctx->sequences.size());
+    for (size_t s = 0; s < ctx->sequences.size(); ++s) {
+        next[s] = static_cast<int>(ctx->sequences[s].cells.size());
+    }
+    for (int i = 0; i < count; ++i) {
+        const BatchToken& entry = tokens[i];
+        if (entry.seq < 0 || entry.seq >= static_cast<int>(next.size()) || entry.pos != next[entry.seq]) {
+            return false;
+        }
+        ++next[entry.seq];
+    }
+
+    ctx->outputs.clear();
+    for (int i = 0; i < count; ++i) {
+        const BatchToken& entry = tokens[i];
+        StubSequence& sequence = ctx->sequences[entry.seq];
+        if (sequence.scriptValid && entry.pos < sequence.divergedAt) {
+            size_t k = static_cast<size_t>(entry.pos - sequence.promptLength);
+            if (k >= sequence.script.size() || entry.token != sequence.script[k]) {
+                sequence.divergedAt = entry.pos;
+            }
+        }
+        sequence.cells.push_back(entry.token);
+        if (entry.logits) {
+            ctx->outputs.push_back({i, entry.seq, entry.pos});
+        }
+    }
+    return true;
+}
+
+bool decodeBatch(BackendContext* ctx, const BatchToken* tokens, int count) {
+    return count <= ctx->batchSize && evaluate(ctx, tokens, count);
+}
+
+bool decode(BackendContext* ctx, const Token* tokens, int count, int startPos, bool logitsForAll,
+            int seq) {
+    std::vector<BatchToken> batch(static_cast<size_t>(std::max(count, 0)));
+    for (int i = 0; i < count; ++i) {
+        batch[i] = {tokens[i], startPos + i, seq, logitsForAll || i == count - 1};
+    }
+    return evaluate(ctx, batch.data(), count);
+}
+
+bool truncateCache(BackendContext* ctx, int fromPos, int seq) {
+    StubSequence& sequence = ctx->sequences[seq];
+    if (fromPos < static_cast<int>(sequence.cells.size())) {
+        sequence.cells.resize(std::max(0, fromPos));
+    }
+    if (fromPos < sequence.promptLength) {
+        sequence.scriptValid = false;
+    } else if (fromPos <= sequence.divergedAt) {
+        sequence.divergedAt = INT_MAX;
+    }
+    return true;
+}
+
+bool shiftCache(BackendContext* ctx, int keep, int discard, int seq) {
+    StubSequence& sequence = ctx->sequences[seq];
+    int size = static_cast<int>(sequence.cells.size());
+    if (keep < 0 || discard <= 0 || keep + discard > size) {
+        return false;
+    }
+    sequence.cells.erase(sequence.cells.begin() + keep, sequence.cells.begin() + keep + discard);
+    ctx->outputs.clear();
+
+    // A real model keeps going on the cells it still has; so does the
+    // script, as long as only prompt cells went
+    if (keep + discard <= sequence.promptLength) {
+        sequence.promptLength -= discard;
+        if (sequence.divergedAt != INT_MAX && sequence.divergedAt >= keep) {
+            sequence.divergedAt = std::max(keep, sequence.divergedAt - discard);
+        }
+    } else {
+        sequence.scriptValid = false;
+    }
+    return true;
+}
+
+size_t stateSize(BackendContext* ctx) {
+    return ctx->sequences[0].cells.size() * sizeof(Token);
+}
+
+size_t saveState(BackendContext* ctx, uint8_t* dst, size_t capacity) {
+    size_t size = stateSize(ctx);
+    if (capacity < size) {
+        return 0;
+    }
+    std::memcpy(dst, ctx->sequences[0].cells.data(), size);
+    return size;
+}
+
+bool loadState(BackendContext* ctx, const uint8_t* src, size_t size) {
+    StubSequence& sequence = ctx->sequences[0];
+    sequence = StubSequence();
+    ctx->outputs.clear();
+    size_t count = size / sizeof(Token);
+    if (size % sizeof(Token) != 0 ||
+        ctx->usedCells() + count > static_cast<size_t>(ctx->contextSize)) {
+        return false;
+    }
+    sequence.cells.resize(count);
+    std::memcpy(sequence.cells.data(), src, size);
+    return true;
+}
+
+BackendSampler* newSampler(BackendModel* /*model*/, const SamplingParams& params) {
+    // Grammars need no enforcing: the scripted replies already follow the
+    // action schema
+    return new BackendSampler{params};
+}
+
+void freeSampler(BackendSampler* sampler) {
+    delete sampler;
+}
+
+/**
+ * Tokens of text continuing a sequence: no BOS and no space prefix
+ */
+static std::vector<Token> continuationTokens(BackendModel* model, std::string_view text) {
+    std::vector<Token> tokens = tokenize(model, text, false);
+    if (!tokens.empty() && tokens.front() == kTokenSpacePrefix) {
+        tokens.erase(tokens.begin());
+    }
+    return tokens;
+}
+
+/**
+ * Canned reply, as tokens, for the prompt in cells[0, length)
+ */
+static std::vector<Token> replyFor(BackendContext* ctx, const StubSequence& sequence, int length) {
+    std::string prompt;
+    prompt.reserve(static_cast<size_t>(length) * kBytesPerToken);
+    for (int pos = 0; pos < length; ++pos) {
+        appendPiece(ctx->model, sequence.cells[pos], prompt);
+    }
+    return continuationTokens(ctx->model, buildResponse(detectIntent(prompt), prompt));
+}
+
+/**
+ * Work out what the model is producing after cells[0, next). A model sees
+ * no boundary between prompt and reply, so when the cells end in the start
+ * of the reply to the text before it (a draft model catching up on accepted
+ * tokens in one pass), it continues that reply rather than starting anew.
+ */
+static void rescript(BackendContext* ctx, StubSequence& sequence, int next) {
+    // Every canned reply opens with this token
+    static const Token kReplyStart = continuationTokens(ctx->model, "{\"a").front();
+    constexpr int kMaxReplyTokens = 256;
+
+    sequence.promptLength = next;
+    sequence.script.clear();
+    for (int start = next - 1; start > 0 && start >= next - kMaxReplyTokens; --start) {
+        if (sequence.cells[start] != kReplyStart) {
+            continue;
+        }
+        std::vector<Token> script = replyFor(ctx, sequence, start);
+        size_t partial = static_cast<size_t>(next - start);
+        if (partial <= script.size() &&
+            std::equal(script.begin(), script.begin() + partial, sequence.cells.begin() + start)) {
+            sequence.promptLength = start;
+            sequence.script = std::move(script);
+            break;
+        }
+    }
+    if (sequence.promptLength == next) {
+        sequence.script = replyFor(ctx, sequence, next);
+    }
+    sequence.scriptValid = true;
+    sequence.divergedAt = INT_MAX;
+}
+
+Token sample(BackendSampler* /*sampler*/, BackendContext* ctx, int batchIndex) {
+    if (ctx->outputs.empty()) {
+        return kTokenEos;
+    }
+    const StubOutput* output = &ctx->outputs.back();
+    if (batchIndex >= 0) {
+        auto it = std::find_if(ctx->outputs.begin(), ctx->outputs.end(),
+                               [batchIndex](const StubOutput& o) { return o.batchIndex == batchIndex; });
+        if (it == ctx->outputs.end()) {
+            return kTokenEos;
+        }
+        output = &*it;
+    }
+    StubSequence& sequence = ctx->sequences[output->seq];
+    int next = output->pos + 1;
+
+    // Anything off-script before this position is a new prompt: "run the
+    // model" over it by building the canned reply for its intent
+    if (!sequence.scriptValid || sequence.divergedAt < next) {
+        rescript(ctx, sequence, next);
+    }
+
+    size_t k = static_cast<size_t>(next - sequence.promptLength);
+    return k < sequence.script.size() ? sequence.script[k] : kTokenEos;
+}
+
+} // namespace backend
+
+} // namespace llamacore
@@ -0,0 +1,369 @@
+/**
+ * batch_scheduler.cpp - Continuous batching of concurrent generations
+ *
+ * Lock order: ModelContext::mutex, then queueMutex_. generate() and
+ * submit() only ever take queueMutex_, so callers never wait on a decode
+ * pass to enqueue. Streamed chunks and completions are delivered with
+ * neither lock held.
+ */
+
+#include "batch_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "model_context.h"
+#include "native_log.h"
+#include "prompt_lookup.h"
+#include "thread_placement.h"
+
+namespace llamacore {
+
+BatchScheduler::BatchScheduler(ModelContext& ctx) : ctx_(ctx) {
+    batch_.reserve(static_cast<size_t>(ctx.batchSize));
+    worker_ = std::thread(&BatchScheduler::run, this);
+}
+
+BatchScheduler::~BatchScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+
+    // Only submitted requests can be left; their submitters are not waiting
+    // on this context
+    std::vector<Request*> completed(active_.begin(), active_.end());
+    completed.insert(completed.end(), pending_.begin(), pending_.end());
+    active_.clear();
+    pending_.clear();
+    for (Request* request : completed) {
+        request->generation.cancel();
+    }
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    complete(completed, lock);
+}
+
+std::string BatchScheduler::generate(std::string_view prompt, const GenerateParams& params, bool* objectClosed) {
+    // Tokenizing only reads the vocabulary, so it runs here rather than on
+    // the worker, and the prompt is not needed after this
+    Request request(ctx_, prompt, params);
+    if (!request.generation.valid()) {
+        return request.generation.result();
+    }
+
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    pending_.push_back(&request);
+    wake_.notify_one();
+    finished_.wait(lock, [&request] { return request.finished; });
+    if (objectClosed != nullptr) {
+        *objectClosed = request.generation.objectClosed();
+    }
+    return request.generation.result();
+}
+
+void BatchScheduler::submit(std::string_view prompt, const GenerateParams& params, Completion onComplete) {
+    auto* request = new Request(ctx_, prompt, params);
+    if (!request->generation.valid()) {
+        onComplete(request->generation);
+        delete request;
+        return;
+    }
+    request->onComplete = std::move(onComplete);
+
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    pending_.push_back(request);
+    wake_.notify_one();
+}
+
+void BatchScheduler::run() {
+    // The worker drives every pass, so it gets the decode threads' placement
+    ctx_.placementApplied.store(applyPlacement(ctx_.placement), std::memory_order_relaxed);
+
+    std::vector<Request*> completed;
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return stopping_ || !pending_.empty() || !active_.empty(); });
+        if (stopping_) {
+            break;
+        }
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> ctxLock(ctx_.mutex);
+            admit(completed);
+            step(completed);
+        }
+        deliver(completed);
+
+        lock.lock();
+        complete(completed, lock);
+    }
+}
+
+void BatchScheduler::deliver(const std::vector<Request*>& completed) {
+    // active_ is worker-only, so it is safe to walk without ctx.mutex; the
+    // next pass picks up any request whose sink asked to stop
+    for (Request* request : active_) {
+        request->generation.deliver();
+    }
+    for (Request* request : completed) {
+        request->generation.deliver();
+    }
+}
+
+void BatchScheduler::complete(std::vector<Request*>& completed, std::unique_lock<std::mutex>& lock) {
+    if (completed.empty()) {
+        return;
+    }
+    // Synchronous requests live on their caller's stack and may be gone as
+    // soon as finished is set, so submitted ones are set aside first
+    std::vector<Request*> submitted;
+    bool wake = false;
+    for (Request* request : completed) {
+        if (request->onComplete) {
+            submitted.push_back(request);
+        } else {
+            request->finished = true;
+            wake = true;
+        }
+    }
+    completed.clear();
+    if (wake) {
+        finished_.notify_all();
+    }
+    if (submitted.empty()) {
+        return;
+    }
+
+    lock.unlock();
+    for (Request* request : submitted) {
+        request->onComplete(request->generation);
+        delete request;
+    }
+    lock.lock();
+}
+
+void BatchScheduler::admit(std::vector<Request*>& completed) {
+    for (;;) {
+        Request* request;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (pending_.empty()) {
+                return;
+            }
+            request = pending_.front();
+        }
+
+        // A request cancelled while queued never takes a sequence
+        Generation& generation = request->generation;
+        if (generation.cancelRequested()) {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                pending_.pop_front();
+            }
+            generation.cancel();
+            completed.push_back(request);
+            continue;
+        }
+
+        // First come, first served: the head waits until it fits
+        int seq = pickSequence(generation.promptTokens());
+        if (seq < 0 || !makeRoom(seq, generation.reservedCells())) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            pending_.pop_front();
+        }
+        ctx_.sequences[seq].busy = true;
+        generation.start(seq);
+        active_.push_back(request);
+    }
+}
+
+int BatchScheduler::pickSequence(const std::vector<Token>& prompt) const {
+    int best = -1;
+    size_t bestShared = 0;
+    for (size_t seq = 0; seq < ctx_.sequences.size(); ++seq) {
+        const SequenceState& sequence = ctx_.sequences[seq];
+        if (sequence.busy) {
+            continue;
+        }
+        size_t limit = std::min(sequence.cachedTokens.size(), prompt.size());
+        size_t shared = std::mismatch(sequence.cachedTokens.begin(),
+                                      sequence.cachedTokens.begin() + limit, prompt.begin()).first -
+                        sequence.cachedTokens.begin();
+        if (best < 0 || shared > bestShared) {
+            best = static_cast<int>(seq);
+            bestShared = shared;
+        }
+    }
+    return best;
+}
+
+bool BatchScheduler::makeRoom(int seq, int reserved) {
+    // All sequences share contextSize cells. Active requests are counted at
+    // their full reservation so none can run out mid-generation; the chosen
+    // sequence's cache is covered by the new request's reservation.
+    size_t capacity = static_cast<size_t>(ctx_.contextSize);
+    size_t needed = static_cast<size_t>(reserved);
+    for (Request* request : active_) {
+        needed += static_cast<size_t>(request->generation.reservedCells());
+    }
+    if (needed > capacity) {
+        return false;
+    }
+
+    size_t idle = 0;
+    for (size_t s = 0; s < ctx_.sequences.size(); ++s) {
+        if (static_cast<int>(s) != seq && !ctx_.sequences[s].busy) {
+            idle += ctx_.sequences[s].cachedTokens.size();
+        }
+    }
+    for (size_t s = 0; s < ctx_.sequences.size() && needed + idle > capacity; ++s) {
+        SequenceState& sequence = ctx_.sequences[s];
+        if (static_cast<int>(s) == seq || sequence.busy || sequence.cachedTokens.empty()) {
+            continue;
+        }
+        backend::truncateCache(ctx_.backendContext, 0, static_cast<int>(s));
+        if (ctx_.draft) {
+            ctx_.draft->evict(static_cast<int>(s));
+        }
+        idle -= sequence.cachedTokens.size();
+        sequence.cachedTokens.clear();
+    }
+    return true;
+}
+
+void BatchScheduler::draftAhead() {
+    drafts_.clear();
+    for (Request* request : active_) {
+        Generation& generation = request->generation;
+        generation.draft().clear();
+        int budget = generation.draftBudget();
+        if (budget <= 0) {
+            continue;
+        }
+
+        // Echoed prompt text first: it costs nothing to guess
+        if (ctx_.promptLookupTokens > 0) {
+            lookupDraft(generation.history(), generation.pendingToken(),
+                        std::min(budget, ctx_.promptLookupTokens), generation.draft());
+            generation.setDraftFromLookup(true);
+            if (!generation.draft().empty()) {
+                continue;
+            }
+        }
+        if (ctx_.draft) {
+            generation.setDraftFromLookup(false);
+            drafts_.push_back({generation.sequence(), &generation.history(), generation.pendingToken(),
+                               std::min(budget, ctx_.draft->draftTokens()), &generation.draft()});
+        }
+    }
+    if (drafts_.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ctx_.draft->draft(drafts_);
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    ctx_.speculative.draftNanos.fetch_add(static_cast<uint64_t>(nanos), std::memory_order_relaxed);
+}
+
+void BatchScheduler::retire(std::vector<Request*>& completed) {
+    auto finished = std::stable_partition(active_.begin(), active_.end(),
+                                          [](Request* request) { return !request->generation.done(); });
+    for (auto it = finished; it != active_.end(); ++it) {
+        ctx_.sequences[(*it)->generation.sequence()].busy = false;
+        completed.push_back(*it);
+    }
+    active_.erase(finished, active_.end());
+}
+
+void BatchScheduler::step(std::vector<Request*>& completed) {
+    // Cancellation takes effect between passes, at a token boundary
+    bool cancelled = false;
+    for (Request* request : active_) {
+        if (request->generation.cancelRequested() || request->generation.sinkStopped()) {
+            request->generation.cancel();
+            cancelled = true;
+        }
+    }
+    if (cancelled) {
+        retire(completed);
+    }
+    if (active_.empty()) {
+        lastDecodeStart_ = {};
+        return;
+    }
+
+    if (ctx_.draft || ctx_.promptLookupTokens > 0) {
+        draftAhead();
+    }
+
+    // Decoding requests go first with one token each (plus guesses), so a
+    // long prompt being prefilled never stalls generations already under way
+    batch_.clear();
+    int room = ctx_.batchSize;
+    for (Request* request : active_) {
+        if (request->generation.decoding()) {
+            room -= request->generation.appendToBatch(batch_, room);
+        }
+    }
+    for (Request* request : active_) {
+        if (!request->generation.decoding()) {
+            room -= request->generation.appendToBatch(batch_, room);
+        }
+    }
+
+    bool verifying = std::any_of(active_.begin(), active_.end(),
+                                 [](Request* request) { return !request->generation.draft().empty(); });
+    bool decodeOnly = std::all_of(active_.begin(), active_.end(),
+                                  [](Request* request) { return request->generation.decoding(); });
+    auto passStart = std::chrono::steady_clock::now();
+    bool ok = backend::decodeBatch(ctx_.backendContext, batch_.data(), static_cast<int>(batch_.size()));
+    if (verifying) {
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - passStart).count();
+        ctx_.speculative.targetNanos.fetch_add(static_cast<uint64_t>(nanos), std::memory_order_relaxed);
+    }
+
+    SchedulerStats& stats = ctx_.schedulerStats;
+    if (decodeOnly && lastDecodeStart_ != std::chrono::steady_clock::time_point{}) {
+        stats.recordDecodeStep(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(passStart - lastDecodeStart_).count()));
+    }
+    lastDecodeStart_ = decodeOnly && ok ? passStart : std::chrono::steady_clock::time_point{};
+    stats.batches.fetch_add(1, std::memory_order_relaxed);
+    stats.batchTokens.fetch_add(batch_.size(), std::memory_order_relaxed);
+    if (static_cast<int>(active_.size()) > stats.peakActive.load(std::memory_order_relaxed)) {
+        stats.peakActive.store(static_cast<int>(active_.size()), std::memory_order_relaxed);
+    }
+
+    for (Request* request : active_) {
+        Generation& generation = request->generation;
+        if (!generation.inBatch()) {
+            continue;
+        }
+        if (!ok) {
+            generation.onDecodeFailed();
+            continue;
+        }
+        generation.onDecoded();
+        if (generation.logitsIndex() >= 0) {
+            generation.sampleNext();
+        }
+    }
+
+    retire(completed);
+    if (active_.empty()) {
+        // The worker may sleep before the next pass; that is not jitter
+        lastDecodeStart_ = {};
+    }
+}
+
+} // namespace llamacore
@@ -0,0 +1,163 @@
+/**
+ * batch_scheduler.h - Continuous batching of concurrent generations
+ *
+ * Every ModelContext owns one scheduler and its worker thread. generate
+ * calls from any number of threads tokenize their prompt, queue a
+ * Generation and block. The worker admits queued requests into free KV
+ * sequences as soon as their cells fit, then runs decode passes that carry
+ * one token for every decoding request plus prompt chunks for requests
+ * still prefilling. Requests join and leave between passes, so throughput
+ * grows with the number in flight instead of queueing behind one another.
+ *
+ * With a draft model attached (draft_model.h) or prompt lookup enabled
+ * (prompt_lookup.h), each decoding request also carries guesses at its next
+ * tokens, which the same pass verifies.
+ *
+ * submit() queues a request without blocking; the worker hands the finished
+ * Generation to a completion callback instead of waking a waiting caller.
+ */
+
+#ifndef LLAMACORE_BATCH_SCHEDULER_H
+#define LLAMACORE_BATCH_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "draft_model.h"
+#include "inference_engine.h"
+
+namespace llamacore {
+
+struct ModelContext;
+
+/**
+ * Receives a submitted request's finished generation, on the worker thread
+ * (or on the submitting thread if the prompt cannot run). Must not call
+ * generate or submit on the same context.
+ */
+using Completion = std::function<void(const Generation& generation)>;
+
+class BatchScheduler {
+public:
+    explicit BatchScheduler(ModelContext& ctx);
+
+    /**
+     * Stops the worker. No generate call may be in flight (callers hold a
+     * ContextRef, so the context outlives them); submitted requests still
+     * queued or running are cancelled and completed here.
+     */
+    ~BatchScheduler();
+
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+    /**
+     * Run a generation to completion, sharing decode passes with whatever
+     * else is in flight on this context
+     *
+     * @param objectClosed If set, receives whether the reply is one complete
+     *        JSON action object (see Generation::objectClosed)
+     * @return Generated text, or a JSON error reply
+     */
+    std::string generate(std::string_view prompt, const GenerateParams& params, bool* objectClosed = nullptr);
+
+    /**
+     * Queue a generation and return at once; onComplete runs when it
+     * finishes, is cancelled (GenerateParams::cancel) or fails
+     */
+    void submit(std::string_view prompt, const GenerateParams& params, Completion onComplete);
+
+private:
+    struct Request {
+        Request(ModelContext& ctx, std::string_view prompt, const GenerateParams& params)
+            : generation(ctx, prompt, params) {}
+
+        Generation generation;
+        Completion onComplete;  // set for submitted requests, which the worker owns
+        bool finished = false;  // guarded by queueMutex_
+    };
+
+    void run();
+
+    /**
+     * Move queued requests onto idle sequences while their cells fit
+     * (ctx.mutex held)
+     *
+     * @param completed Receives queued requests cancelled before they ran
+     */
+    void admit(std::vector<Request*>& completed);
+
+    /**
+     * Move finished requests from active_ to completed, freeing their
+     * sequences (ctx.mutex held)
+     */
+    void retire(std::vector<Request*>& completed);
+
+    /**
+     * Hand the chunks streamed in the last pass to the sinks of active and
+     * completed requests (no lock held)
+     */
+    void deliver(const std::vector<Request*>& completed);
+
+    /**
+     * Wake synchronous callers and run completions of submitted requests
+     * (queueMutex_ held by lock, released around the completions)
+     */
+    void complete(std::vector<Request*>& completed, std::unique_lock<std::mutex>& lock);
+
+    /**
+     * One decode pass over every active request (ctx.mutex held)
+     *
+     * @param completed Receives requests that finished in this pass
+     */
+    void step(std::vector<Request*>& completed);
+
+    /**
+     * Guess ahead for every decoding request, by prompt lookup or with the
+     * draft model (ctx.mutex held)
+     */
+    void draftAhead();
+
+    /**
+     * Idle sequence whose cached tokens share the longest prefix with the
+     * prompt, -1 if every sequence is busy
+     */
+    int pickSequence(const std::vector<Token>& prompt) const;
+
+    /**
+     * Make sure a request reserving `reserved` cells fits next to the active
+     * ones, evicting caches of idle sequences other than seq if needed
+     *
+     * @return false if the active requests leave too little room
+     */
+    bool makeRoom(int seq, int reserved);
+
+    ModelContext& ctx_;
+
+    std::mutex queueMutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    std::deque<Request*> pending_;
+    bool stopping_ = false;
+
+    // Worker-only state
+    std::vector<Request*> active_;
+    std::vector<BatchToken> batch_;
+    std::vector<DraftRequest> drafts_;
+    // Start of the last pass if it carried only decoding requests, for the
+    // step cadence in SchedulerStats
+    std::chrono::steady_clock::time_point lastDecodeStart_{};
+
+    std::thread worker_;
+};
+
+} // namespace llamacore
+
+#endif // LLAMACORE_BATCH_SCHEDULER_H
@@ -0,0 +1,54 @@
+/**
+ * android/log.h - Host stand-in for the NDK logging header
+ *
+ * Only used when llamacore is built outside the Android NDK (benchmarks,
+ * fuzzing, profiling on build machines). Mirrors the subset of the NDK API
+ * used by native_log.h and writes to stderr instead of logcat.
+ */
+
+#ifndef LLAMACORE_COMPAT_ANDROID_LOG_H
+#define LLAMACORE_COMPAT_ANDROID_LOG_H
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+/**
+ * Minimum priority printed on host. Defaults to WARN so benchmarks are not
+ * dominated by stderr writes; override with LLAMACORE_LOG_LEVEL=<priority>.
+ */
+static inline int __llamacore_host_log_level() {
+    static const int level = [] {
+        const char* env = std::getenv("LLAMACORE_LOG_LEVEL");
+        return env != nullptr ? std::atoi(env) : static_cast<int>(ANDROID_LOG_WARN);
+    }();
+    return level;
+}
+
+static inline int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+    if (prio < __llamacore_host_log_level()) {
+        return 0;
+    }
+    static const char kPriorityChars[] = "??VDIWEFS";
+    std::fprintf(stderr, "%c/%s: ", kPriorityChars[prio & 7], tag);
+    va_list args;
+    va_start(args, fmt);
+    int written = std::vfprintf(stderr, fmt, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+    return written;
+}
+
+#endif // LLAMACORE_COMPAT_ANDROID_LOG_H
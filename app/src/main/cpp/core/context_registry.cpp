@@ -0,0 +1,208 @@
+/**
+ * context_registry.cpp - Handle table for loaded model contexts
+ */
+
+#include "context_registry.h"
+
+#include "response_builder.h"
+
+namespace llamacore {
+
+namespace {
+
+constexpr uint64_t kGenerationMask = 0x7fffffffull;  // keeps handles positive
+
+inline uint32_t generationOf(uint64_t word) {
+    return static_cast<uint32_t>(word >> 32);
+}
+
+inline int64_t makeHandle(uint32_t slot, uint32_t generation) {
+    return static_cast<int64_t>((static_cast<uint64_t>(generation) << 32) | slot);
+}
+
+} // namespace
+
+// ============================================================================
+// ContextRef
+// ============================================================================
+
+ContextRef::ContextRef(ContextRef&& other) noexcept
+    : registry_(other.registry_), slot_(other.slot_), ctx_(other.ctx_) {
+    other.registry_ = nullptr;
+    other.ctx_ = nullptr;
+}
+
+ContextRef& ContextRef::operator=(ContextRef&& other) noexcept {
+    if (this != &other) {
+        reset();
+        registry_ = other.registry_;
+        slot_ = other.slot_;
+        ctx_ = other.ctx_;
+        other.registry_ = nullptr;
+        other.ctx_ = nullptr;
+    }
+    return *this;
+}
+
+ContextRef::~ContextRef() {
+    reset();
+}
+
+void ContextRef::reset() {
+    if (registry_ != nullptr) {
+        registry_->release(slot_);
+        registry_ = nullptr;
+        ctx_ = nullptr;
+    }
+}
+
+// ============================================================================
+// ContextRegistry
+// ============================================================================
+
+ContextRegistry::ContextRegistry() {
+    // Popped from the back, so low slots are handed out first
+    freeSlots_.reserve(kCapacity);
+    for (uint32_t i = kCapacity; i > 0; --i) {
+        freeSlots_.push_back(i - 1);
+    }
+}
+
+ContextRegistry::~ContextRegistry() {
+    clear();
+}
+
+int64_t ContextRegistry::add(ModelContext* ctx) {
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(freeMutex_);
+        if (freeSlots_.empty()) {
+            delete ctx;
+            return 0;
+        }
+        index = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+
+    Slot& slot = slots_[index];
+    slot.ctx.store(ctx, std::memory_order_relaxed);
+    uint32_t generation = generationOf(slot.word.load(std::memory_order_relaxed));
+    slot.word.store((static_cast<uint64_t>(generation) << 32) | kLiveBit, std::memory_order_release);
+
+    uint32_t used = slotsUsed_.load(std::memory_order_relaxed);
+    while (used < index + 1 &&
+           !slotsUsed_.compare_exchange_weak(used, index + 1, std::memory_order_relaxed)) {
+    }
+    liveCount_.fetch_add(1, std::memory_order_relaxed);
+
+    return makeHandle(index, generation);
+}
+
+ContextRef ContextRegistry::acquire(int64_t handle) {
+    uint32_t index = static_cast<uint32_t>(handle & 0xffffffff);
+    uint32_t generation = static_cast<uint32_t>(static_cast<uint64_t>(handle) >> 32);
+    if (index >= kCapacity) {
+        return {};
+    }
+
+    Slot& slot = slots_[index];
+    uint64_t word = slot.word.load(std::memory_order_acquire);
+    do {
+        if (generationOf(word) != generation || (word & kLiveBit) == 0) {
+            return {};
+        }
+    } while (!slot.word.compare_exchange_weak(word, word + 1, std::memory_order_acq_rel,
+                                              std::memory_order_acquire));
+
+    return ContextRef(this, index, slot.ctx.load(std::memory_order_acquire));
+}
+
+bool ContextRegistry::contains(int64_t handle) {
+    return static_cast<bool>(acquire(handle));
+}
+
+bool ContextRegistry::remove(int64_t handle) {
+    uint32_t index = static_cast<uint32_t>(handle & 0xffffffff);
+    uint32_t generation = static_cast<uint32_t>(static_cast<uint64_t>(handle) >> 32);
+    if (index >= kCapacity) {
+        return false;
+    }
+
+    Slot& slot = slots_[index];
+    uint64_t word = slot.word.load(std::memory_order_acquire);
+    do {
+        if (generationOf(word) != generation || (word & kLiveBit) == 0) {
+            return false;
+        }
+    } while (!slot.word.compare_exchange_weak(word, word & ~kLiveBit, std::memory_order_acq_rel,
+                                              std::memory_order_acquire));
+
+    liveCount_.fetch_sub(1, std::memory_order_relaxed);
+    if ((word & kRefMask) == 0) {
+        reclaim(index, word & ~kLiveBit);
+    }
+    return true;
+}
+
+void ContextRegistry::release(uint32_t index) {
+    uint64_t word = slots_[index].word.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    // Last reference to a removed context: this thread frees it
+    if ((word & (kRefMask | kLiveBit)) == 0) {
+        reclaim(index, word);
+    }
+}
+
+void ContextRegistry::reclaim(uint32_t index, uint64_t word) {
+    Slot& slot = slots_[index];
+    delete slot.ctx.exchange(nullptr, std::memory_order_acq_rel);
+
+    // New generation invalidates every outstanding copy of the old handle
+    uint64_t next = (generationOf(word) + 1) & kGenerationMask;
+    if (next == 0) next = 1;
+    slot.word.store(next << 32, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(freeMutex_);
+    freeSlots_.push_back(index);
+}
+
+int64_t ContextRegistry::firstHandle() {
+    uint32_t used = slotsUsed_.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < used; ++i) {
+        uint64_t word = slots_[i].word.load(std::memory_order_acquire);
+        if ((word & kLiveBit) != 0) {
+            return makeHandle(i, generationOf(word));
+        }
+    }
+    return 0;
+}
+
+std::string ContextRegistry::describeFirst() {
+    // Retry if the first context is freed between lookup and acquire
+    for (int64_t handle = firstHandle(); handle != 0; handle = firstHandle()) {
+        if (ContextRef ref = acquire(handle)) {
+            return buildModelInfo(*ref);
+        }
+    }
+    return "";
+}
+
+bool ContextRegistry::empty() const {
+    return liveCount_.load(std::memory_order_relaxed) == 0;
+}
+
+void ContextRegistry::clear() {
+    uint32_t used = slotsUsed_.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < used; ++i) {
+        uint64_t word = slots_[i].word.load(std::memory_order_acquire);
+        if ((word & kLiveBit) != 0) {
+            remove(makeHandle(i, generationOf(word)));
+        }
+    }
+}
+
+ContextRegistry& contextRegistry() {
+    static ContextRegistry registry;
+    return registry;
+}
+
+} // namespace llamacore
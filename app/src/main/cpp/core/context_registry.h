@@ -0,0 +1,142 @@
+/**
+ * context_registry.h - Handle table for loaded model contexts
+ *
+ * Maps the opaque jlong handles handed to Kotlin onto ModelContext objects.
+ *
+ * A handle packs a slot index (low 32 bits) and that slot's generation
+ * (high bits). Looking a handle up is lock-free: one atomic load plus a CAS
+ * that bumps the slot's reference count, so generate calls on different
+ * handles never contend and calls on the same handle only share a cache
+ * line. Freeing a handle bumps the generation, so stale handles are rejected
+ * without any map lookup. Only add() and slot reuse take a mutex.
+ */
+
+#ifndef LLAMACORE_CONTEXT_REGISTRY_H
+#define LLAMACORE_CONTEXT_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "model_context.h"
+
+namespace llamacore {
+
+class ContextRegistry;
+
+/**
+ * Reference to a live context. Holding one keeps the context alive even if
+ * its handle is freed concurrently; the context is deleted when the last
+ * reference goes away.
+ */
+class ContextRef {
+public:
+    ContextRef() = default;
+    ContextRef(ContextRef&& other) noexcept;
+    ContextRef& operator=(ContextRef&& other) noexcept;
+    ContextRef(const ContextRef&) = delete;
+    ContextRef& operator=(const ContextRef&) = delete;
+    ~ContextRef();
+
+    explicit operator bool() const { return ctx_ != nullptr; }
+    ModelContext* operator->() const { return ctx_; }
+    ModelContext& operator*() const { return *ctx_; }
+
+private:
+    friend class ContextRegistry;
+    ContextRef(ContextRegistry* registry, uint32_t slot, ModelContext* ctx)
+        : registry_(registry), slot_(slot), ctx_(ctx) {}
+    void reset();
+
+    ContextRegistry* registry_ = nullptr;
+    uint32_t slot_ = 0;
+    ModelContext* ctx_ = nullptr;
+};
+
+class ContextRegistry {
+public:
+    // Maximum number of simultaneously live handles
+    static constexpr uint32_t kCapacity = 256;
+
+    ContextRegistry();
+    ~ContextRegistry();
+
+    /**
+     * Take ownership of a context and return its handle
+     *
+     * @return Handle (never 0), or 0 if the table is full
+     */
+    int64_t add(ModelContext* ctx);
+
+    /**
+     * Acquire a reference to the context behind a handle (lock-free)
+     *
+     * @return Empty reference if the handle is unknown or stale
+     */
+    ContextRef acquire(int64_t handle);
+
+    /**
+     * Check whether a handle refers to a live context
+     */
+    bool contains(int64_t handle);
+
+    /**
+     * Invalidate a handle. The context is deleted immediately, or when the
+     * last outstanding ContextRef is released.
+     *
+     * @return false if the handle was unknown or stale
+     */
+    bool remove(int64_t handle);
+
+    /**
+     * Handle of the live context in the lowest slot, 0 if none.
+     * Used by the single-model LlamaInference interface.
+     */
+    int64_t firstHandle();
+
+    /**
+     * Model info JSON for the first live context, empty string if none
+     */
+    std::string describeFirst();
+
+    bool empty() const;
+
+    /**
+     * Invalidate every handle
+     */
+    void clear();
+
+private:
+    friend class ContextRef;
+
+    // Slot word layout: [generation:32][live:1][refs:31]
+    static constexpr uint64_t kLiveBit = 1ull << 31;
+    static constexpr uint64_t kRefMask = kLiveBit - 1;
+
+    // One cache line per slot so handles never false-share
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> word{uint64_t(1) << 32};
+        std::atomic<ModelContext*> ctx{nullptr};
+    };
+
+    void release(uint32_t slot);
+    void reclaim(uint32_t slot, uint64_t word);
+
+    Slot slots_[kCapacity];
+    std::atomic<uint32_t> slotsUsed_{0};   // high-water mark bounding scans
+    std::atomic<uint32_t> liveCount_{0};
+
+    std::mutex freeMutex_;                 // guards freeSlots_ only
+    std::vector<uint32_t> freeSlots_;
+};
+
+/**
+ * Process-wide registry shared by all JNI entry points
+ */
+ContextRegistry& contextRegistry();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_CONTEXT_REGISTRY_H
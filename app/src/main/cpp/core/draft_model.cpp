@@ -0,0 +1,184 @@
+/**
+ * draft_model.cpp - Small draft model for speculative decoding
+ */
+
+#include "draft_model.h"
+
+#include <algorithm>
+
+#include "memory_plan.h"
+#include "native_log.h"
+
+namespace llamacore {
+
+DraftModel* DraftModel::load(const std::string& path, BackendModel* target, const ContextParams& params,
+                             int draftTokens, uint64_t budgetBytes) {
+    ModelParams modelParams;
+    WeightsRef weights = weightsCache().acquire(path, modelParams);
+    if (!weights) {
+        return nullptr;
+    }
+    BackendModel* model = weights->model;
+    if (!backend::vocabCompatible(target, model)) {
+        LOGE("Draft model %s does not share the target vocabulary", path.c_str());
+        return nullptr;
+    }
+
+    // Each sequence may hold up to draftTokens unverified guesses on top of
+    // what the target holds
+    ContextParams draftParams = params;
+    draftParams.contextSize += std::max(1, params.maxSequences) * draftTokens;
+
+    // The process overhead is already charged to the target
+    MemoryPlan plan = estimateMemory(backend::modelShape(model), draftParams, modelParams.useMmap);
+    plan.overheadBytes = 0;
+    if (budgetBytes > 0 && plan.budgetedBytes() > budgetBytes) {
+        LOGE("Refusing draft model %s: needs %llu MB, %llu MB of the budget left", path.c_str(),
+             (unsigned long long)(plan.budgetedBytes() >> 20), (unsigned long long)(budgetBytes >> 20));
+        return nullptr;
+    }
+    BackendContext* context = backend::newContext(model, draftParams);
+    if (context == nullptr) {
+        return nullptr;
+    }
+
+    // Greedy and unconstrained: guesses only need to be likely, the
+    // target's own sampler decides what is kept
+    SamplingParams sampling;
+    sampling.temperature = 0.0f;
+
+    auto* draft = new DraftModel();
+    draft->weights_ = std::move(weights);
+    draft->model_ = model;
+    draft->context_ = context;
+    draft->sampler_.reset(backend::newSampler(model, sampling));
+    draft->batchSize_ = params.batchSize;
+    draft->draftTokens_ = draftTokens;
+    draft->cached_.resize(std::max(1, params.maxSequences));
+    return draft;
+}
+
+DraftModel::~DraftModel() {
+    sampler_.reset();
+    backend::freeContext(context_);
+}
+
+void DraftModel::evict(int seq) {
+    backend::truncateCache(context_, 0, seq);
+    cached_[seq].clear();
+}
+
+void DraftModel::shift(int seq, int keep, int discard) {
+    std::vector<Token>& cached = cached_[seq];
+    if (static_cast<int>(cached.size()) >= keep + discard && backend::shiftCache(context_, keep, discard, seq)) {
+        cached.erase(cached.begin() + keep, cached.begin() + keep + discard);
+        return;
+    }
+    // The next draft pass catches up from the pinned prefix
+    size_t kept = std::min(cached.size(), static_cast<size_t>(keep));
+    if (!backend::truncateCache(context_, static_cast<int>(kept), seq)) {
+        evict(seq);
+        return;
+    }
+    cached.resize(kept);
+}
+
+void DraftModel::catchUp(std::vector<DraftRequest>& requests, std::vector<int>& logitsIndex) {
+    std::vector<bool> failed(requests.size(), false);
+    logitsIndex.assign(requests.size(), -1);
+
+    // Decode batch_, or drop every sequence it touched
+    auto flush = [this, &requests, &failed] {
+        if (batch_.empty()) {
+            return true;
+        }
+        bool ok = backend::decodeBatch(context_, batch_.data(), static_cast<int>(batch_.size()));
+        for (const BatchToken& entry : batch_) {
+            if (ok) {
+                cached_[entry.seq].push_back(entry.token);
+            } else {
+                for (size_t i = 0; i < requests.size(); ++i) {
+                    if (requests[i].seq == entry.seq && !failed[i]) {
+                        failed[i] = true;
+                        evict(entry.seq);
+                    }
+                }
+            }
+        }
+        batch_.clear();
+        return ok;
+    };
+
+    // Keep the prefix each draft sequence shares with its history and
+    // evaluate the rest; only the last tokens need logits, and they all go
+    // in one final pass so every request's logits survive until sampling
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const DraftRequest& request = requests[i];
+        const std::vector<Token>& history = *request.history;
+        std::vector<Token>& cached = cached_[request.seq];
+        size_t limit = std::min(cached.size(), history.size());
+        size_t shared = std::mismatch(cached.begin(), cached.begin() + limit, history.begin()).first -
+                        cached.begin();
+        if (!backend::truncateCache(context_, static_cast<int>(shared), request.seq)) {
+            shared = 0;
+            backend::truncateCache(context_, 0, request.seq);
+        }
+        cached.resize(shared);
+
+        for (size_t pos = shared; pos < history.size() && !failed[i]; ++pos) {
+            batch_.push_back({history[pos], static_cast<int>(pos), request.seq, false});
+            if (static_cast<int>(batch_.size()) == batchSize_) {
+                flush();
+            }
+        }
+    }
+    flush();
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (!failed[i]) {
+            logitsIndex[i] = static_cast<int>(batch_.size());
+            batch_.push_back({requests[i].last, static_cast<int>(requests[i].history->size()),
+                              requests[i].seq, true});
+        }
+    }
+    if (!flush()) {
+        std::fill(logitsIndex.begin(), logitsIndex.end(), -1);
+    }
+}
+
+void DraftModel::draft(std::vector<DraftRequest>& requests) {
+    std::vector<int> logitsIndex;
+    catchUp(requests, logitsIndex);
+
+    // One draft pass per round of guesses, shared by all requests
+    for (;;) {
+        batch_.clear();
+        for (size_t i = 0; i < requests.size(); ++i) {
+            if (logitsIndex[i] < 0) {
+                continue;
+            }
+            DraftRequest& request = requests[i];
+            Token token = backend::sample(sampler_.get(), context_, logitsIndex[i]);
+            request.out->push_back(token);
+            logitsIndex[i] = -1;
+            if (static_cast<int>(request.out->size()) < request.maxTokens &&
+                !backend::isEndOfGeneration(model_, token)) {
+                logitsIndex[i] = static_cast<int>(batch_.size());
+                batch_.push_back({token, static_cast<int>(cached_[request.seq].size()), request.seq, true});
+            }
+        }
+        if (batch_.empty()) {
+            return;
+        }
+        if (!backend::decodeBatch(context_, batch_.data(), static_cast<int>(batch_.size()))) {
+            // Nothing was added to the cache; keep the guesses made so far
+            batch_.clear();
+            return;
+        }
+        for (const BatchToken& entry : batch_) {
+            cached_[entry.seq].push_back(entry.token);
+        }
+    }
+}
+
+} // namespace llamacore
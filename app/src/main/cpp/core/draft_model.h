@@ -0,0 +1,109 @@
+/**
+ * draft_model.h - Small draft model for speculative decoding
+ *
+ * A draft model shares the target model's vocabulary but is several times
+ * cheaper to run. For every decoding request the scheduler lets it guess
+ * the next few tokens greedily; the target then evaluates the last sampled
+ * token plus all guesses in one batched pass and keeps the guesses its own
+ * sampler agrees with. Output is exactly what the target alone would
+ * produce, and memory-bound CPU decoding costs about the same for a few
+ * tokens per sequence as for one, so each accepted guess is a target pass
+ * saved.
+ *
+ * The draft context mirrors the target's sequences: sequence s of the draft
+ * follows the tokens of target sequence s and is brought up to date before
+ * every round of guesses.
+ */
+
+#ifndef LLAMACORE_DRAFT_MODEL_H
+#define LLAMACORE_DRAFT_MODEL_H
+
+#include <string>
+#include <vector>
+
+#include "backend.h"
+#include "inference_engine.h"
+#include "model_weights.h"
+
+namespace llamacore {
+
+/**
+ * One sequence to draft for
+ */
+struct DraftRequest {
+    int seq;
+    const std::vector<Token>* history;  // tokens in the target cache, positions 0..n-1
+    Token last;                         // sampled token at position n, not yet evaluated
+    int maxTokens;                      // guesses wanted (> 0)
+    std::vector<Token>* out;            // receives up to maxTokens guesses
+};
+
+class DraftModel {
+public:
+    /**
+     * Load a draft model for a target context
+     *
+     * @param target Model the guesses are verified by; its vocabulary must
+     *        match the draft's token for token
+     * @param params Target context settings; the draft gets the same
+     *        sequences plus room for unverified guesses
+     * @param draftTokens Guesses per verification pass
+     * @param budgetBytes Memory the draft's weights and context may take
+     *        (see MemoryPlan::budgetedBytes), 0 for no limit
+     * @return nullptr if the draft cannot be loaded, is incompatible or
+     *         does not fit the budget
+     */
+    static DraftModel* load(const std::string& path, BackendModel* target, const ContextParams& params,
+                            int draftTokens, uint64_t budgetBytes);
+
+    ~DraftModel();
+
+    DraftModel(const DraftModel&) = delete;
+    DraftModel& operator=(const DraftModel&) = delete;
+
+    int draftTokens() const { return draftTokens_; }
+
+    /**
+     * Guess the next tokens of several sequences, sharing draft passes
+     * between them. A sequence whose draft pass fails gets no guesses.
+     */
+    void draft(std::vector<DraftRequest>& requests);
+
+    /**
+     * Forget a sequence (the target evicted its cache)
+     */
+    void evict(int seq);
+
+    /**
+     * Follow a context shift of the target (backend::shiftCache), dropping
+     * what the draft cannot shift along
+     */
+    void shift(int seq, int keep, int discard);
+
+private:
+    DraftModel() = default;
+
+    /**
+     * Bring draft sequences up to date with their histories and evaluate
+     * each request's last token
+     *
+     * @param logitsIndex Receives, per request, the batch index of its
+     *        logits in the final pass, -1 if it failed
+     */
+    void catchUp(std::vector<DraftRequest>& requests, std::vector<int>& logitsIndex);
+
+    WeightsRef weights_;
+    BackendModel* model_ = nullptr;  // weights_->model
+    BackendContext* context_ = nullptr;
+    SamplerPtr sampler_;
+    int batchSize_ = 0;
+    int draftTokens_ = 0;
+
+    // Tokens in each draft sequence's cache
+    std::vector<std::vector<Token>> cached_;
+    std::vector<BatchToken> batch_;
+};
+
+} // namespace llamacore
+
+#endif // LLAMACORE_DRAFT_MODEL_H
@@ -0,0 +1,34 @@
+/**
+ * hash.h - FNV-1a hashing for cache keys and file fingerprints
+ *
+ * Keys written to disk (session snapshots, autotune results, template
+ * tokens) depend on these values, so the constants must not change.
+ */
+
+#ifndef LLAMACORE_HASH_H
+#define LLAMACORE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace llamacore {
+
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+
+/**
+ * 64-bit FNV-1a of a byte range
+ *
+ * @param hash Hash to continue from, so several ranges can be chained
+ */
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = kFnvOffset) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * kFnvPrime;
+    }
+    return hash;
+}
+
+} // namespace llamacore
+
+#endif // LLAMACORE_HASH_H
@@ -0,0 +1,372 @@
+/**
+ * inference_engine.cpp - Token-level generation
+ */
+
+#include "inference_engine.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "draft_model.h"
+#include "model_context.h"
+#include "native_log.h"
+#include "response_builder.h"
+#include "template_tokens.h"
+
+namespace llamacore {
+
+namespace {
+
+/**
+ * Length of the longest prefix of text that does not end inside a UTF-8
+ * sequence; a token piece may carry only part of a multi-byte character
+ */
+size_t completeUtf8Length(std::string_view text) {
+    size_t size = text.size();
+    // Walk back over continuation bytes to the last lead byte
+    for (size_t back = 1; back <= 4 && back <= size; ++back) {
+        auto byte = static_cast<unsigned char>(text[size - back]);
+        if ((byte & 0xC0) == 0x80) {
+            continue;
+        }
+        size_t needed = byte < 0x80 ? 1 : (byte & 0xE0) == 0xC0 ? 2 : (byte & 0xF0) == 0xE0 ? 3 : 4;
+        return back >= needed ? size : size - back;
+    }
+    return size;
+}
+
+} // namespace
+
+Generation::Generation(ModelContext& ctx, std::string_view prompt, const GenerateParams& params)
+    : ctx_(ctx),
+      params_(params),
+      tokens_(params.promptTokens ? *params.promptTokens
+                                  : templateTokens().tokenize(ctx.vocabKey, ctx.model, prompt)) {
+    size_t pinned = std::min<size_t>(tokens_.size(), 1);
+    if (std::shared_ptr<const std::vector<Token>> prefix = std::atomic_load(&ctx.pinnedPrefix)) {
+        size_t limit = std::min(prefix->size(), tokens_.size());
+        size_t shared = std::mismatch(prefix->begin(), prefix->begin() + limit, tokens_.begin()).first -
+                        prefix->begin();
+        pinned = std::max(pinned, shared);
+    }
+    pinned_ = static_cast<int>(pinned);
+
+    // Too long for the context: drop the oldest whole blocks after the
+    // pinned prefix until a cell is left for the reply
+    int block = shiftBlock();
+    if (block > 0 && static_cast<int>(tokens_.size()) >= ctx.contextSize) {
+        size_t excess = tokens_.size() - static_cast<size_t>(ctx.contextSize) + 1;
+        size_t discard = (excess + block - 1) / block * block;
+        LOGI("Prompt of %zu tokens exceeds context of %d: dropping %zu after the %d pinned", tokens_.size(),
+             ctx.contextSize, discard, pinned_);
+        tokens_.erase(tokens_.begin() + pinned_, tokens_.begin() + pinned_ + discard);
+        ctx.promptCache.truncatedPrompts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int promptTokens = static_cast<int>(tokens_.size());
+    if (promptTokens == 0 || promptTokens >= ctx.contextSize) {
+        LOGE("Prompt of %d tokens does not fit context of %d", promptTokens, ctx.contextSize);
+        valid_ = false;
+        done_ = true;
+        result_ = kResponsePromptTooLong;
+    }
+    if (params_.actionSchema) {
+        params_.sampling.grammar = kActionSchemaGrammar;
+    }
+}
+
+int Generation::reservedCells() const {
+    int budget = std::max(params_.maxTokens, 0);
+    return std::min(ctx_.contextSize, static_cast<int>(tokens_.size()) + budget);
+}
+
+int Generation::draftBudget() const {
+    if (!decoding()) {
+        return 0;
+    }
+    // pendingToken_ and the guesses occupy pos_..pos_+n; the reservation
+    // already counts every token the budget allows
+    return std::max(0, std::min(params_.maxTokens - generated_, reservedCells() - pos_ - 1));
+}
+
+const std::vector<Token>& Generation::history() const {
+    return ctx_.sequences[seq_].cachedTokens;
+}
+
+void Generation::start(int seq) {
+    seq_ = seq;
+
+    // Only the suffix past the prefix shared with the sequence's previous
+    // request (the system instruction, usually) is evaluated. At least the
+    // last prompt token is always decoded so there are logits to sample.
+    std::vector<Token>& cached = ctx_.sequences[seq].cachedTokens;
+    size_t limit = std::min(cached.size(), tokens_.size() - 1);
+    size_t reuse = std::mismatch(cached.begin(), cached.begin() + limit, tokens_.begin()).first -
+                   cached.begin();
+
+    PromptCacheStats& stats = ctx_.promptCache;
+
+    // A conversation that outgrew the context since this sequence's last
+    // turn: its tokens after the pinned prefix sit a whole number of blocks
+    // further along in the cache. Shifting them into place beats evaluating.
+    int block = shiftBlock();
+    size_t pin = static_cast<size_t>(pinned_);
+    if (block > 0 && reuse >= pin && reuse + 1 < tokens_.size()) {
+        size_t bestDiscard = 0;
+        size_t bestMatch = reuse - pin;
+        for (size_t discard = static_cast<size_t>(block); pin + discard < cached.size(); discard += block) {
+            auto from = cached.begin() + pin + discard;
+            size_t span = std::min(cached.size() - pin - discard, tokens_.size() - 1 - pin);
+            size_t match = std::mismatch(from, from + span, tokens_.begin() + pin).first - from;
+            if (match > bestMatch) {
+                bestMatch = match;
+                bestDiscard = discard;
+            }
+        }
+        if (bestDiscard > 0 &&
+            backend::shiftCache(ctx_.backendContext, pinned_, static_cast<int>(bestDiscard), seq)) {
+            cached.erase(cached.begin() + pin, cached.begin() + pin + bestDiscard);
+            if (ctx_.draft) {
+                ctx_.draft->shift(seq, pinned_, static_cast<int>(bestDiscard));
+            }
+            reuse = pin + bestMatch;
+            stats.contextShifts.fetch_add(1, std::memory_order_relaxed);
+            stats.shiftedTokens.fetch_add(bestMatch, std::memory_order_relaxed);
+        }
+    }
+    if (!backend::truncateCache(ctx_.backendContext, static_cast<int>(reuse), seq)) {
+        reuse = 0;
+        backend::truncateCache(ctx_.backendContext, 0, seq);
+    }
+    cached.resize(reuse);
+
+    (reuse > 0 ? stats.hits : stats.misses).fetch_add(1, std::memory_order_relaxed);
+    stats.reusedTokens.fetch_add(reuse, std::memory_order_relaxed);
+    stats.evaluatedTokens.fetch_add(tokens_.size() - reuse, std::memory_order_relaxed);
+    LOGD("Prompt on seq %d: %zu tokens reused, %zu to evaluate", seq, reuse, tokens_.size() - reuse);
+
+    prefillCursor_ = reuse;
+    sampler_.reset(backend::newSampler(ctx_.model, params_.sampling));
+}
+
+int Generation::appendToBatch(std::vector<BatchToken>& batch, int room) {
+    inFlight_ = 0;
+    logitsIndex_ = -1;
+    if (done_ || room <= 0) {
+        return 0;
+    }
+
+    if (prefilled_) {
+        // Logits after every guess, to check each against the target
+        if (static_cast<int>(draft_.size()) > room - 1) {
+            draft_.resize(static_cast<size_t>(room - 1));
+        }
+        logitsIndex_ = static_cast<int>(batch.size());
+        batch.push_back({pendingToken_, pos_, seq_, true});
+        for (size_t i = 0; i < draft_.size(); ++i) {
+            batch.push_back({draft_[i], pos_ + 1 + static_cast<int>(i), seq_, true});
+        }
+        inFlight_ = 1 + static_cast<int>(draft_.size());
+        return inFlight_;
+    }
+
+    size_t count = std::min(static_cast<size_t>(room), tokens_.size() - prefillCursor_);
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = prefillCursor_ + i;
+        bool last = index + 1 == tokens_.size();
+        if (last) {
+            logitsIndex_ = static_cast<int>(batch.size());
+        }
+        batch.push_back({tokens_[index], static_cast<int>(index), seq_, last});
+    }
+    inFlight_ = static_cast<int>(count);
+    return inFlight_;
+}
+
+void Generation::onDecoded() {
+    std::vector<Token>& cached = ctx_.sequences[seq_].cachedTokens;
+    if (prefilled_) {
+        cached.push_back(pendingToken_);
+        ++pos_;
+    } else {
+        cached.insert(cached.end(), tokens_.begin() + prefillCursor_,
+                      tokens_.begin() + prefillCursor_ + inFlight_);
+        prefillCursor_ += inFlight_;
+        if (prefillCursor_ == tokens_.size()) {
+            prefilled_ = true;
+            pos_ = static_cast<int>(tokens_.size());
+        }
+    }
+    inFlight_ = 0;
+}
+
+void Generation::onDecodeFailed() {
+    std::vector<Token>& cached = ctx_.sequences[seq_].cachedTokens;
+    inFlight_ = 0;
+    logitsIndex_ = -1;
+    draft_.clear();
+    if (!prefilled_) {
+        backend::truncateCache(ctx_.backendContext, 0, seq_);
+        cached.clear();
+        result_ = kResponseDecodeFailed;
+        done_ = true;
+        sampler_.reset();
+        return;
+    }
+
+    // Cache contents past the prompt are unknown after a failure; after a
+    // shift, so is where the prompt ends
+    size_t keep = shifted_ ? static_cast<size_t>(pinned_) : tokens_.size();
+    backend::truncateCache(ctx_.backendContext, static_cast<int>(keep), seq_);
+    cached.resize(keep);
+    finish(true);
+}
+
+void Generation::sampleNext() {
+    if (params_.maxTokens <= 0) {
+        finish(true);
+        return;
+    }
+
+    // Logits at logitsIndex_ + i follow guess i - 1. The target samples
+    // each position as usual; while it picks the guess, that guess is
+    // already in the cache and the next position's logits are valid too.
+    size_t accepted = 0;
+    for (;;) {
+        Token token = backend::sample(sampler_.get(), ctx_.backendContext,
+                                      logitsIndex_ + static_cast<int>(accepted));
+        if (!emit(token)) {
+            break;
+        }
+        if (accepted == draft_.size() || token != draft_[accepted]) {
+            pendingToken_ = token;
+            break;
+        }
+        ctx_.sequences[seq_].cachedTokens.push_back(token);
+        ++pos_;
+        ++accepted;
+    }
+
+    if (!draft_.empty()) {
+        // Drop the rejected guesses (and, if generation ended, the rest)
+        backend::truncateCache(ctx_.backendContext, pos_, seq_);
+        SpeculativeStats& stats = ctx_.speculative;
+        stats.drafted.fetch_add(draft_.size(), std::memory_order_relaxed);
+        stats.accepted.fetch_add(accepted, std::memory_order_relaxed);
+        stats.verifications.fetch_add(1, std::memory_order_relaxed);
+        stats.verifiedTokens.fetch_add(accepted + 1, std::memory_order_relaxed);
+        if (draftFromLookup_) {
+            stats.lookupDrafted.fetch_add(draft_.size(), std::memory_order_relaxed);
+            stats.lookupAccepted.fetch_add(accepted, std::memory_order_relaxed);
+        }
+        draft_.clear();
+    }
+
+    // The pending token needs a cell past the end of the context
+    if (!done_ && pos_ >= ctx_.contextSize && !shiftContext()) {
+        finish(true);
+    }
+}
+
+int Generation::shiftBlock() const {
+    return std::max(0, (ctx_.contextSize - pinned_) / 2);
+}
+
+bool Generation::shiftContext() {
+    int block = shiftBlock();
+    if (block <= 0 || !backend::shiftCache(ctx_.backendContext, pinned_, block, seq_)) {
+        return false;
+    }
+    std::vector<Token>& cached = ctx_.sequences[seq_].cachedTokens;
+    cached.erase(cached.begin() + pinned_, cached.begin() + pinned_ + block);
+    pos_ -= block;
+    shifted_ = true;
+    if (ctx_.draft) {
+        ctx_.draft->shift(seq_, pinned_, block);
+    }
+    ctx_.promptCache.contextShifts.fetch_add(1, std::memory_order_relaxed);
+    LOGD("Context full on seq %d: shifted out %d tokens after the %d pinned", seq_, block, pinned_);
+    return true;
+}
+
+bool Generation::emit(Token token) {
+    if (backend::isEndOfGeneration(ctx_.model, token)) {
+        finish(true);
+        return false;
+    }
+    ++generated_;
+    size_t pieceStart = output_.size();
+    backend::appendPiece(ctx_.model, token, output_);
+
+    if (params_.actionSchema) {
+        size_t end = objectEnd_.feed(std::string_view(output_).substr(pieceStart));
+        if (end != std::string_view::npos) {
+            // Drop anything the closing token carried past the brace
+            output_.resize(pieceStart + end);
+            objectClosed_ = true;
+        }
+    }
+
+    ++unflushedTokens_;
+    stream(false);
+
+    // The last sampled token never needs evaluating
+    if (objectClosed_ || generated_ == params_.maxTokens) {
+        finish(true);
+        return false;
+    }
+    return true;
+}
+
+void Generation::cancel() {
+    if (done_) {
+        return;
+    }
+    // Nothing is in flight between passes: the cache holds exactly the
+    // committed tokens, and unverified guesses were never decoded
+    draft_.clear();
+    // A cancelled reply is not a complete one
+    objectClosed_ = false;
+    cancelled_ = cancelRequested() || !sinkStopped_;
+    finish(false);
+}
+
+void Generation::stream(bool force) {
+    if (!params_.onChunk) {
+        return;
+    }
+    if (!force && emitted_ > 0 && unflushedTokens_ < std::max(1, params_.chunkTokens)) {
+        return;
+    }
+    std::string_view pending(output_.data() + emitted_, output_.size() - emitted_);
+    size_t length = completeUtf8Length(pending);
+    if (length == 0) {
+        return;
+    }
+    unsent_.append(pending.substr(0, length));
+    emitted_ += length;
+    unflushedTokens_ = 0;
+}
+
+void Generation::deliver() {
+    if (unsent_.empty() || sinkStopped_) {
+        unsent_.clear();
+        return;
+    }
+    if (!params_.onChunk(unsent_)) {
+        sinkStopped_ = true;
+    }
+    unsent_.clear();
+}
+
+void Generation::finish(bool flush) {
+    if (flush) {
+        stream(true);
+    }
+    LOGD("Generated %zu prompt tokens -> %zu bytes", tokens_.size(), output_.size());
+    result_ = std::move(output_);
+    sampler_.reset();
+    done_ = true;
+}
+
+} // namespace llamacore
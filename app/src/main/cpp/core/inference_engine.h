@@ -0,0 +1,277 @@
+/**
+ * inference_engine.h - Token-level generation
+ *
+ * A Generation is one request moving through prefill and decode on a KV
+ * sequence of the context. BatchScheduler (batch_scheduler.h) steps many of
+ * them through shared decode passes on whichever backend is compiled in.
+ *
+ * Context shifting: a sequence never holds more than contextSize cells.
+ * The first pinnedLength() tokens of a prompt (the pinned prefix, usually
+ * the system prompt) always stay; everything after them is evicted in
+ * blocks of half the remaining window, oldest first. A prompt too long for
+ * the context loses as many blocks as it takes to fit, and a reply that
+ * reaches the end of the context drops the oldest block from the cache and
+ * moves the rest down (backend::shiftCache) instead of stopping. Block
+ * boundaries are fixed relative to the pinned prefix, so the next turn of
+ * a conversation that keeps growing finds its tokens in the cache at a
+ * whole number of blocks from where they were, shifts them into place and
+ * evaluates only what is new.
+ */
+
+#ifndef LLAMACORE_INFERENCE_ENGINE_H
+#define LLAMACORE_INFERENCE_ENGINE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "action_schema.h"
+#include "backend.h"
+
+namespace llamacore {
+
+struct ModelContext;
+
+/**
+ * Receives decoded text while generation runs. Chunks always end on a UTF-8
+ * character boundary. Return false to stop generating.
+ */
+using ChunkSink = std::function<bool(std::string_view chunk)>;
+
+struct GenerateParams {
+    int maxTokens = 256;
+    SamplingParams sampling;
+
+    // Optional streaming sink, called on the scheduler's worker thread after
+    // each decode pass, with no lock held (the next pass waits for it). The first token is delivered on
+    // its own to keep time-to-first-token low; after that tokens are grouped
+    // into chunks of chunkTokens so each delivery (a JNI call) is amortized.
+    // A sink that returns false stops the generation before the next pass.
+    // Sinks must not call generate.
+    ChunkSink onChunk;
+    int chunkTokens = 4;
+
+    // Constrain output to one JSON action object (kActionSchemaGrammar) and
+    // stop as soon as that object closes
+    bool actionSchema = false;
+
+    // Optional cancellation flag, checked before every decode pass. Once set
+    // the generation stops at the next token boundary with the text decoded
+    // so far. Must outlive the generation.
+    const std::atomic<bool>* cancel = nullptr;
+
+    // Tokens of the prompt when the caller has them already (assemblePrompt);
+    // the prompt text is then only used by the response cache
+    std::shared_ptr<const std::vector<Token>> promptTokens;
+};
+
+struct SamplerDeleter {
+    void operator()(BackendSampler* sampler) const { backend::freeSampler(sampler); }
+};
+
+using SamplerPtr = std::unique_ptr<BackendSampler, SamplerDeleter>;
+
+/**
+ * One generation request
+ *
+ * The constructor only tokenizes and may run on any thread. Everything from
+ * start() on runs with ctx.mutex held.
+ */
+class Generation {
+public:
+    Generation(ModelContext& ctx, std::string_view prompt, const GenerateParams& params);
+
+    /**
+     * False if the prompt cannot run (empty, or too long for the context);
+     * the error reply is then already in result()
+     */
+    bool valid() const { return valid_; }
+
+    const std::vector<Token>& promptTokens() const { return tokens_; }
+
+    /**
+     * KV cells this request may occupy: prompt plus token budget
+     */
+    int reservedCells() const;
+
+    /**
+     * Leading prompt tokens context shifting keeps: those shared with the
+     * context's pinned prefix, at least the first (BOS)
+     */
+    int pinnedLength() const { return pinned_; }
+
+    /**
+     * Bind to a KV sequence, keeping the longest prefix it already caches
+     */
+    void start(int seq);
+
+    int sequence() const { return seq_; }
+
+    /**
+     * Draft guesses this request can take in its next pass without running
+     * past its token budget or reservation; 0 unless decoding
+     */
+    int draftBudget() const;
+
+    /**
+     * Tokens in this request's KV sequence, and the sampled token to be
+     * evaluated after them (valid while decoding)
+     */
+    const std::vector<Token>& history() const;
+    Token pendingToken() const { return pendingToken_; }
+
+    /**
+     * Guesses for the tokens after pendingToken(), verified in the next pass
+     */
+    std::vector<Token>& draft() { return draft_; }
+
+    /**
+     * The current guesses came from prompt lookup rather than a draft model
+     * (only changes which counters they are reported under)
+     */
+    void setDraftFromLookup(bool fromLookup) { draftFromLookup_ = fromLookup; }
+
+    /**
+     * Append this request's next tokens to a decode batch: the last sampled
+     * token plus any draft guesses (as many as fit), or up to room prompt
+     * tokens while prefilling
+     *
+     * @return Number of entries appended
+     */
+    int appendToBatch(std::vector<BatchToken>& batch, int room);
+
+    bool decoding() const { return prefilled_ && !done_; }
+
+    /**
+     * The last appendToBatch added at least one entry
+     */
+    bool inBatch() const { return inFlight_ > 0; }
+
+    /**
+     * Commit the tokens appended by the last appendToBatch once the batch
+     * is in the cache
+     */
+    void onDecoded();
+
+    /**
+     * The batch holding this request's tokens failed to decode
+     */
+    void onDecodeFailed();
+
+    /**
+     * Index of this request's logits in the last batch, -1 if it has none
+     */
+    int logitsIndex() const { return logitsIndex_; }
+
+    /**
+     * Sample the next token from the last batch and advance. With draft
+     * guesses in the batch, keeps sampling at each guess's position while
+     * the sampled token matches the guess.
+     */
+    void sampleNext();
+
+    bool done() const { return done_; }
+
+    /**
+     * The caller set GenerateParams::cancel
+     */
+    bool cancelRequested() const {
+        return params_.cancel != nullptr && params_.cancel->load(std::memory_order_relaxed);
+    }
+
+    /**
+     * The sink returned false; the generation stops like a cancelled one,
+     * but is not reported as cancelled
+     */
+    bool sinkStopped() const { return sinkStopped_; }
+
+    /**
+     * Hand the chunks streamed during the last pass to the sink. Called by
+     * the worker between passes without the context lock, so other threads
+     * can use the context while the sink runs.
+     */
+    void deliver();
+
+    /**
+     * Stop before the next pass, keeping the output so far; also valid
+     * before start(). Counts as cancelled() unless the sink stopped it.
+     */
+    void cancel();
+
+    bool cancelled() const { return cancelled_; }
+
+    /**
+     * Generation ended by closing the JSON action object (actionSchema),
+     * so result() is one complete reply
+     */
+    bool objectClosed() const { return objectClosed_; }
+
+    const std::string& result() const { return result_; }
+
+private:
+    /**
+     * Queue pending output for deliver() when a chunk is due (or always,
+     * if force)
+     */
+    void stream(bool force);
+
+    /**
+     * Add a sampled token to the output
+     *
+     * @return false if generation finished with it
+     */
+    bool emit(Token token);
+
+    void finish(bool flush);
+
+    /**
+     * Tokens evicted at a time: half the cells after the pinned prefix, 0
+     * if the prefix leaves too little room to shift
+     */
+    int shiftBlock() const;
+
+    /**
+     * Drop the oldest block of the sequence after the pinned prefix and
+     * move the rest down, once the reply has filled the context
+     *
+     * @return false if the backend cannot shift
+     */
+    bool shiftContext();
+
+    ModelContext& ctx_;
+    GenerateParams params_;
+    std::vector<Token> tokens_;
+    int pinned_ = 0;
+    bool valid_ = true;
+
+    int seq_ = -1;
+    size_t prefillCursor_ = 0;  // prompt tokens already in the cache
+    bool prefilled_ = false;
+    int pos_ = 0;               // position of the next token to decode
+    bool shifted_ = false;      // the reply shifted the context
+    Token pendingToken_ = 0;    // sampled, not yet decoded
+    std::vector<Token> draft_;  // guesses following pendingToken_
+    bool draftFromLookup_ = false;
+    int inFlight_ = 0;          // entries in the current batch
+    int logitsIndex_ = -1;
+    int generated_ = 0;
+
+    SamplerPtr sampler_;
+    JsonObjectEnd objectEnd_;
+    std::string output_;
+    size_t emitted_ = 0;
+    int unflushedTokens_ = 0;
+    std::string unsent_;        // streamed, waiting for deliver()
+    bool sinkStopped_ = false;
+    bool done_ = false;
+    bool objectClosed_ = false;
+    bool cancelled_ = false;
+    std::string result_;
+};
+
+} // namespace llamacore
+
+#endif // LLAMACORE_INFERENCE_ENGINE_H
@@ -0,0 +1,194 @@
+/**
+ * intent_detector.cpp - Keyword-based intent detection for the stub backend
+ *
+ * All intent keywords are compiled once into an Aho-Corasick automaton with
+ * failure links resolved into a dense DFA. Classification walks the prompt
+ * bytes exactly once, folding ASCII case through the transition table, and
+ * collects a bitmask of the keywords seen. The original if/else priority is
+ * then evaluated on that mask.
+ */
+
+#include "intent_detector.h"
+
+#include <array>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+namespace llamacore {
+
+namespace {
+
+// Keyword bits, in the order the original find() chain tested them
+enum Keyword : uint32_t {
+    kCreate   = 1u << 0,
+    kGoal     = 1u << 1,
+    kAdd      = 1u << 2,
+    kTask     = 1u << 3,
+    kList     = 1u << 4,
+    kShow     = 1u << 5,
+    kHelp     = 1u << 6,
+    kComplete = 1u << 7,
+    kDone     = 1u << 8,
+    kFinish   = 1u << 9,
+    kDelete   = 1u << 10,
+    kRemove   = 1u << 11,
+    kProgress = 1u << 12,
+    kHowAmI   = 1u << 13,
+    kStatus   = 1u << 14,
+};
+
+struct KeywordSpec {
+    const char* text;
+    uint32_t bit;
+};
+
+const KeywordSpec kKeywords[] = {
+    {"create", kCreate},     {"goal", kGoal},     {"add", kAdd},
+    {"task", kTask},         {"list", kList},     {"show", kShow},
+    {"help", kHelp},         {"complete", kComplete}, {"done", kDone},
+    {"finish", kFinish},     {"delete", kDelete}, {"remove", kRemove},
+    {"progress", kProgress}, {"how am i", kHowAmI}, {"status", kStatus},
+};
+
+// Once both bits are seen the result is CreateGoal no matter what follows
+constexpr uint32_t kHighestPriority = kCreate | kGoal;
+
+/**
+ * Dense Aho-Corasick DFA over bytes. States fit in a uint8_t (the keyword
+ * set has well under 256 trie nodes), so the whole table is a few KB.
+ */
+class KeywordMatcher {
+public:
+    KeywordMatcher() {
+        newState();  // root
+
+        // Build the trie over lowercase keyword bytes
+        for (const KeywordSpec& keyword : kKeywords) {
+            uint8_t state = 0;
+            for (const char* p = keyword.text; *p != '\0'; ++p) {
+                uint8_t c = static_cast<uint8_t>(*p);
+                if (next_[state][c] == 0) {
+                    next_[state][c] = newState();
+                }
+                state = next_[state][c];
+            }
+            output_[state] |= keyword.bit;
+        }
+
+        // Resolve failure links breadth-first so every transition is direct
+        std::vector<uint8_t> fail(next_.size(), 0);
+        std::queue<uint8_t> pending;
+        for (int c = 0; c < 256; ++c) {
+            if (next_[0][c] != 0) {
+                pending.push(next_[0][c]);
+            }
+        }
+        while (!pending.empty()) {
+            uint8_t state = pending.front();
+            pending.pop();
+            output_[state] |= output_[fail[state]];
+            for (int c = 0; c < 256; ++c) {
+                uint8_t child = next_[state][c];
+                if (child != 0) {
+                    fail[child] = next_[fail[state]][c];
+                    pending.push(child);
+                } else {
+                    next_[state][c] = next_[fail[state]][c];
+                }
+            }
+        }
+
+        // Fold ASCII case into the table: 'A'..'Z' behave like 'a'..'z'
+        for (auto& row : next_) {
+            for (int c = 'A'; c <= 'Z'; ++c) {
+                row[c] = row[c - 'A' + 'a'];
+            }
+        }
+    }
+
+    /**
+     * Single pass over the bytes, returning the set of keywords present
+     */
+    uint32_t scan(const char* data, size_t length) const {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        const std::array<uint8_t, 256>* next = next_.data();
+        const uint32_t* output = output_.data();
+        uint32_t seen = 0;
+        uint8_t state = 0;
+        for (size_t i = 0; i < length; ++i) {
+            state = next[state][bytes[i]];
+            uint32_t out = output[state];
+            if (out != 0) {
+                seen |= out;
+                if ((seen & kHighestPriority) == kHighestPriority) {
+                    break;
+                }
+            }
+        }
+        return seen;
+    }
+
+private:
+    uint8_t newState() {
+        next_.emplace_back();
+        next_.back().fill(0);
+        output_.push_back(0);
+        return static_cast<uint8_t>(next_.size() - 1);
+    }
+
+    std::vector<std::array<uint8_t, 256>> next_;
+    std::vector<uint32_t> output_;
+};
+
+const KeywordMatcher& keywordMatcher() {
+    static const KeywordMatcher matcher;
+    return matcher;
+}
+
+} // namespace
+
+Intent detectIntent(std::string_view prompt) {
+    uint32_t seen = keywordMatcher().scan(prompt.data(), prompt.size());
+
+    auto has = [seen](uint32_t bits) { return (seen & bits) != 0; };
+
+    if (has(kCreate) && has(kGoal)) {
+        return Intent::CreateGoal;
+    }
+    if (has(kAdd) && has(kTask)) {
+        return Intent::AddTask;
+    }
+    if (has(kList | kShow)) {
+        return Intent::List;
+    }
+    if (has(kHelp)) {
+        return Intent::Help;
+    }
+    if (has(kComplete | kDone | kFinish)) {
+        return Intent::Complete;
+    }
+    if (has(kDelete | kRemove)) {
+        return Intent::Delete;
+    }
+    if (has(kProgress | kHowAmI | kStatus)) {
+        return Intent::Progress;
+    }
+    return Intent::Default;
+}
+
+const char* intentName(Intent intent) {
+    switch (intent) {
+        case Intent::CreateGoal: return "create_goal";
+        case Intent::AddTask:    return "add_task";
+        case Intent::List:       return "list";
+        case Intent::Help:       return "help";
+        case Intent::Complete:   return "complete";
+        case Intent::Delete:     return "delete";
+        case Intent::Progress:   return "progress";
+        case Intent::Default:    return "default";
+    }
+    return "default";
+}
+
+} // namespace llamacore
@@ -0,0 +1,43 @@
+/**
+ * intent_detector.h - Keyword-based intent detection for the stub backend
+ *
+ * Classifies a prompt into one of the actions the stub generator knows how
+ * to answer. Branch priority matches the original if/else chain in
+ * llama_jni.cpp: the first matching intent wins. Matching is a single
+ * case-insensitive pass over the prompt bytes.
+ */
+
+#ifndef LLAMACORE_INTENT_DETECTOR_H
+#define LLAMACORE_INTENT_DETECTOR_H
+
+#include <string_view>
+
+namespace llamacore {
+
+enum class Intent {
+    CreateGoal,   // "create" && "goal"
+    AddTask,      // "add" && "task"
+    List,         // "list" || "show"
+    Help,         // "help"
+    Complete,     // "complete" || "done" || "finish"
+    Delete,       // "delete" || "remove"
+    Progress,     // "progress" || "how am i" || "status"
+    Default
+};
+
+/**
+ * Detect the intent of a prompt (case-insensitive)
+ *
+ * @param prompt Full prompt text (UTF-8, not copied)
+ * @return Highest-priority matching intent, Intent::Default if none match
+ */
+Intent detectIntent(std::string_view prompt);
+
+/**
+ * Human readable name of an intent, used in logs and benchmark output
+ */
+const char* intentName(Intent intent);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_INTENT_DETECTOR_H
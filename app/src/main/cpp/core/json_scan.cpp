@@ -0,0 +1,499 @@
+/**
+ * json_scan.cpp - Locating and validating the action object of a reply
+ *
+ * Stage 1 follows simdjson's json_string_scanner: escaped characters come
+ * from the runs of backslashes by one subtraction, the string mask is the
+ * prefix XOR of the unescaped quotes, and both carry into the next block.
+ */
+
+#include "json_scan.h"
+
+#include <cstring>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LLAMACORE_SCAN_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LLAMACORE_SCAN_SSE2 1
+#endif
+
+namespace llamacore {
+
+namespace {
+
+constexpr size_t kBlockBytes = 64;
+constexpr uint64_t kOddBits = 0xAAAAAAAAAAAAAAAAull;
+
+// As action_record.cpp; deeper replies are refused
+constexpr int kMaxDepth = 16;
+
+/**
+ * Bit i set for byte i of a block
+ */
+struct BlockMasks {
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t structural = 0;  // { } [ ] : ,
+};
+
+#if LLAMACORE_SCAN_NEON
+/**
+ * _mm_movemask_epi8 for NEON: one bit per all-ones byte. Pairwise adds
+ * only, which armeabi-v7a has as well.
+ */
+inline uint64_t movemask(uint8x16_t matches) {
+    static const uint8_t kBits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(matches, vld1q_u8(kBits));
+    uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+    sum = vpadd_u8(sum, sum);
+    sum = vpadd_u8(sum, sum);
+    return vget_lane_u16(vreinterpret_u16_u8(sum), 0);
+}
+#endif
+
+/**
+ * Classify 64 bytes, 16 per vector. Brackets and braces are matched in
+ * two compares: OR-ing 0x20 folds '[' onto '{' and ']' onto '}'.
+ */
+BlockMasks classify(const uint8_t* block) {
+    BlockMasks masks;
+    for (size_t i = 0; i < kBlockBytes; i += 16) {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t structural;
+#if LLAMACORE_SCAN_NEON
+        uint8x16_t chunk = vld1q_u8(block + i);
+        uint8x16_t folded = vorrq_u8(chunk, vdupq_n_u8(0x20));
+        quote = movemask(vceqq_u8(chunk, vdupq_n_u8('"')));
+        backslash = movemask(vceqq_u8(chunk, vdupq_n_u8('\\')));
+        structural = movemask(vorrq_u8(
+                vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+                vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(':')), vceqq_u8(chunk, vdupq_n_u8(',')))));
+#elif LLAMACORE_SCAN_SSE2
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        quote = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))));
+        backslash = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))));
+        structural = static_cast<uint16_t>(_mm_movemask_epi8(_mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))))));
+#else
+        quote = backslash = structural = 0;
+        for (size_t j = 0; j < 16; ++j) {
+            uint8_t c = block[i + j];
+            uint8_t folded = c | 0x20;
+            quote |= static_cast<uint64_t>(c == '"') << j;
+            backslash |= static_cast<uint64_t>(c == '\\') << j;
+            structural |= static_cast<uint64_t>(folded == '{' || folded == '}' || c == ':' || c == ',') << j;
+        }
+#endif
+        masks.quote |= quote << i;
+        masks.backslash |= backslash << i;
+        masks.structural |= structural << i;
+    }
+    return masks;
+}
+
+/**
+ * Bit i set if an odd number of bits at or below i are set
+ */
+inline uint64_t prefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/**
+ * Characters escaped by a backslash, carried across blocks
+ */
+class EscapeScanner {
+public:
+    uint64_t next(uint64_t backslash) {
+        if (backslash == 0) {
+            uint64_t escaped = nextIsEscaped_;
+            nextIsEscaped_ = 0;
+            return escaped;
+        }
+        // A backslash escaped by the previous block starts no escape; of
+        // every other run, the backslashes at even distance from its start
+        // escape the next character
+        uint64_t potential = backslash & ~nextIsEscaped_;
+        uint64_t maybeEscaped = potential << 1;
+        uint64_t escapeAndTerminal = ((maybeEscaped | kOddBits) - potential) ^ kOddBits;
+        uint64_t escaped = escapeAndTerminal ^ (backslash | nextIsEscaped_);
+        nextIsEscaped_ = (escapeAndTerminal & backslash) >> 63;
+        return escaped;
+    }
+
+private:
+    uint64_t nextIsEscaped_ = 0;
+};
+
+/**
+ * Stage 1: offsets of the unescaped quotes and of the structural
+ * characters outside strings, from the start of text
+ */
+void indexStructurals(std::string_view text, std::vector<uint32_t>& tokens) {
+    EscapeScanner escapes;
+    uint64_t inString = 0;  // all ones if the previous block ended inside a string
+    uint8_t tail[kBlockBytes];
+    for (size_t base = 0; base < text.size(); base += kBlockBytes) {
+        const uint8_t* block = reinterpret_cast<const uint8_t*>(text.data()) + base;
+        if (text.size() - base < kBlockBytes) {
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, block, text.size() - base);
+            block = tail;
+        }
+        BlockMasks masks = classify(block);
+        uint64_t quotes = masks.quote & ~escapes.next(masks.backslash);
+        // Set from an opening quote up to, not including, its closing quote
+        uint64_t strings = prefixXor(quotes) ^ inString;
+        inString = static_cast<uint64_t>(static_cast<int64_t>(strings) >> 63);
+
+        uint64_t bits = (masks.structural & ~strings) | quotes;
+        while (bits != 0) {
+            tokens.push_back(static_cast<uint32_t>(base + __builtin_ctzll(bits)));
+            bits &= bits - 1;
+        }
+    }
+}
+
+/**
+ * A member of an object, as much as the schema check needs
+ */
+struct Member {
+    std::string_view key;
+    char kind;              // '"' string, '0' number, 't' literal, '{' object, '[' array
+    std::string_view text;  // string contents or number
+};
+
+struct Members {
+    static constexpr int kCapacity = 8;  // more than any action object has
+    Member items[kCapacity];
+    int count = 0;
+    bool overflow = false;
+
+    void add(const Member& member) {
+        if (count < kCapacity) {
+            items[count++] = member;
+        } else {
+            overflow = true;
+        }
+    }
+
+    const Member* find(std::string_view key) const {
+        for (int i = 0; i < count; ++i) {
+            if (items[i].key == key) {
+                return &items[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Stage 2: the grammar over the structural index. Scalars, which stage 1
+ * does not mark, are the non-blank text between two structurals.
+ */
+class Walker {
+public:
+    Walker(std::string_view text, const std::vector<uint32_t>& tokens) : text_(text), tokens_(tokens) {}
+
+    /**
+     * The object starting at the first token
+     *
+     * @param top Members of the object
+     * @param data Members of its "data" object
+     * @return Offset just past the object, 0 if it is malformed
+     */
+    size_t object(Members& top, Members& data) {
+        return object(1, &top, &data) ? cursor_ : 0;
+    }
+
+private:
+    /**
+     * Consume the next structural if it is c and only blanks precede it
+     */
+    bool take(char c) {
+        if (next_ >= tokens_.size() || text_[tokens_[next_]] != c || !blank(cursor_, tokens_[next_])) {
+            return false;
+        }
+        cursor_ = tokens_[next_++] + 1;
+        return true;
+    }
+
+    bool blank(size_t from, size_t to) const {
+        for (size_t i = from; i < to; ++i) {
+            if (!isSpace(text_[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool object(int depth, Members* members, Members* data) {
+        if (depth > kMaxDepth || !take('{')) {
+            return false;
+        }
+        if (take('}')) {
+            return true;
+        }
+        do {
+            Member member;
+            if (!string(member.key) || !take(':')) {
+                return false;
+            }
+            bool isData = members != nullptr && member.key == "data";
+            if (!value(depth, member, isData ? data : nullptr)) {
+                return false;
+            }
+            if (members != nullptr) {
+                members->add(member);
+            }
+        } while (take(','));
+        return take('}');
+    }
+
+    bool array(int depth) {
+        if (depth > kMaxDepth || !take('[')) {
+            return false;
+        }
+        if (take(']')) {
+            return true;
+        }
+        Member element;
+        do {
+            if (!value(depth, element, nullptr)) {
+                return false;
+            }
+        } while (take(','));
+        return take(']');
+    }
+
+    bool value(int depth, Member& member, Members* nested) {
+        size_t end = next_ < tokens_.size() ? tokens_[next_] : text_.size();
+        if (!blank(cursor_, end)) {
+            return scalar(end, member);
+        }
+        if (next_ >= tokens_.size()) {
+            return false;
+        }
+        member.kind = text_[end];
+        member.text = std::string_view();
+        switch (member.kind) {
+            case '"':
+                return string(member.text);
+            case '{':
+                return object(depth + 1, nested, nullptr);
+            case '[':
+                return array(depth + 1);
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * A string; its closing quote is the next structural
+     */
+    bool string(std::string_view& contents) {
+        if (!take('"') || next_ >= tokens_.size() || text_[tokens_[next_]] != '"') {
+            return false;
+        }
+        size_t close = tokens_[next_++];
+        contents = text_.substr(cursor_, close - cursor_);
+        cursor_ = close + 1;
+        return validEscapes(contents);
+    }
+
+    static bool validEscapes(std::string_view contents) {
+        for (size_t i = contents.find('\\'); i != std::string_view::npos; i = contents.find('\\', i)) {
+            if (++i >= contents.size()) {
+                return false;
+            }
+            char c = contents[i++];
+            if (c == 'u') {
+                for (int k = 0; k < 4; ++k, ++i) {
+                    char h = i < contents.size() ? (contents[i] | 0x20) : 0;
+                    if (!isDigit(h) && !(h >= 'a' && h <= 'f')) {
+                        return false;
+                    }
+                }
+            } else if (std::strchr("\"\\/bfnrt", c) == nullptr || c == '\0') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * A number or literal filling the text up to end, blanks aside
+     */
+    bool scalar(size_t end, Member& member) {
+        size_t begin = cursor_;
+        while (isSpace(text_[begin])) {
+            ++begin;
+        }
+        while (isSpace(text_[end - 1])) {
+            --end;
+        }
+        std::string_view word = text_.substr(begin, end - begin);
+        cursor_ = end;
+        member.text = word;
+        if (word == "true" || word == "false" || word == "null") {
+            member.kind = 't';
+            return true;
+        }
+        member.kind = '0';
+        size_t i = 0;
+        auto digits = [&] {
+            size_t start = i;
+            while (i < word.size() && isDigit(word[i])) {
+                ++i;
+            }
+            return i > start;
+        };
+        if (i < word.size() && word[i] == '-') {
+            ++i;
+        }
+        if (!digits()) {
+            return false;
+        }
+        if (i < word.size() && word[i] == '.') {
+            ++i;
+            if (!digits()) {
+                return false;
+            }
+        }
+        if (i < word.size() && (word[i] == 'e' || word[i] == 'E')) {
+            ++i;
+            if (i < word.size() && (word[i] == '+' || word[i] == '-')) {
+                ++i;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+        return i == word.size();
+    }
+
+    std::string_view text_;
+    const std::vector<uint32_t>& tokens_;
+    size_t next_ = 0;    // next token
+    size_t cursor_ = 0;  // first byte not consumed
+};
+
+struct DataKey {
+    std::string_view name;
+    char kind;  // '"' string, '#' count
+    bool required;
+};
+
+struct ActionShape {
+    std::string_view action;
+    DataKey keys[4];
+};
+
+// kActionSchemaGrammar, member by member
+const ActionShape kActionShapes[] = {
+        {"create_goal", {{"goalTitle", '"', true}, {"durationMonths", '#', true}, {"dailyMinutes", '#', true}}},
+        {"create_task",
+         {{"taskTitle", '"', true}, {"dueDate", '"', true}, {"minutes", '#', true}, {"goalTitle", '"', false}}},
+        {"complete_task", {{"taskTitle", '"', true}}},
+        {"delete_goal", {{"goalTitle", '"', true}}},
+        {"delete_task", {{"taskTitle", '"', true}}},
+        {"show_progress", {}},
+        {"reply", {}},
+};
+
+bool isCount(const Member& member) {
+    if (member.kind != '0' || member.text.empty()) {
+        return false;
+    }
+    for (char c : member.text) {
+        if (!isDigit(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool matchesSchema(const Members& top, const Members& data) {
+    const Member* action = top.find("action");
+    const Member* message = top.find("message");
+    const Member* dataMember = top.find("data");
+    if (top.overflow || data.overflow || top.count != 3 || action == nullptr || message == nullptr ||
+        dataMember == nullptr || action->kind != '"' || message->kind != '"' || dataMember->kind != '{') {
+        return false;
+    }
+
+    for (const ActionShape& shape : kActionShapes) {
+        if (shape.action != action->text) {
+            continue;
+        }
+        int matched = 0;
+        for (const DataKey& key : shape.keys) {
+            if (key.name.empty()) {
+                break;
+            }
+            const Member* member = data.find(key.name);
+            if (member == nullptr) {
+                if (key.required) {
+                    return false;
+                }
+                continue;
+            }
+            bool typed = key.kind == '#' ? isCount(*member) : member->kind == '"';
+            if (!typed) {
+                return false;
+            }
+            ++matched;
+        }
+        // Unknown or repeated keys leave members unmatched
+        return matched == data.count;
+    }
+    return false;
+}
+
+} // namespace
+
+ActionScan scanAction(std::string_view reply) {
+    ActionScan scan;
+    size_t begin = reply.find('{');
+    if (begin == std::string_view::npos) {
+        return scan;
+    }
+    scan.status = ScanStatus::Malformed;
+    scan.begin = begin;
+    std::string_view text = reply.substr(begin);
+
+    // Replies are a few hundred bytes; the index is reused per thread
+    thread_local std::vector<uint32_t> tokens;
+    tokens.clear();
+    indexStructurals(text, tokens);
+
+    Members top;
+    Members data;
+    size_t size = Walker(text, tokens).object(top, data);
+    if (size == 0) {
+        return scan;
+    }
+    scan.end = begin + size;
+    scan.status = matchesSchema(top, data) ? ScanStatus::Valid : ScanStatus::OffSchema;
+    return scan;
+}
+
+} // namespace llamacore
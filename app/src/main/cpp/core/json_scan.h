@@ -0,0 +1,52 @@
+/**
+ * json_scan.h - Locating and validating the action object of a reply
+ *
+ * JsonResponseParser cut the object out with a brace count in Kotlin and
+ * checked it by building a JSONObject. scanAction does both natively, in
+ * the two stages of simdjson: stage 1 classifies the reply 64 bytes at a
+ * time with NEON (SSE2 on a host build) into bitmasks of quotes,
+ * backslashes and structural characters, resolves escapes and string
+ * spans with bit arithmetic, and writes the offsets of the structural
+ * characters outside strings; stage 2 walks only those offsets to check
+ * the JSON grammar and the action schema. A malformed reply is rejected
+ * without decoding a single string.
+ */
+
+#ifndef LLAMACORE_JSON_SCAN_H
+#define LLAMACORE_JSON_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace llamacore {
+
+// Numbered as LlamaNative.SCAN_* in Kotlin
+enum class ScanStatus : uint8_t {
+    NoObject = 0,   // no opening brace
+    Malformed = 1,  // the first object is not well-formed JSON
+    OffSchema = 2,  // well-formed, but not as kActionSchemaGrammar has it
+    Valid = 3,
+};
+
+struct ActionScan {
+    ScanStatus status = ScanStatus::NoObject;
+    size_t begin = 0;  // offset of the opening brace
+    size_t end = 0;    // just past the closing brace
+};
+
+/**
+ * Find the outermost object of a reply, starting at its first brace, and
+ * check it against JSON and the action schema
+ *
+ * Well-formed here is what action_record.h parses: strict JSON, except
+ * that control characters may appear raw in strings, as org.json allows.
+ * The schema check takes the keys in any order but requires the action,
+ * message and data members, the data members of the action (goalTitle
+ * optional for create_task) with the grammar's types, and nothing else.
+ */
+ActionScan scanAction(std::string_view reply);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_JSON_SCAN_H
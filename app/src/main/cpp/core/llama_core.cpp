@@ -0,0 +1,505 @@
+/**
+ * llama_core.cpp - Platform-independent native inference core
+ *
+ * Handle lifecycle and request entry points. Token-level work is done by
+ * inference_engine.cpp on top of the backend selected at compile time
+ * (llama.cpp, or the stub that answers with canned JSON per intent).
+ */
+
+#include "llama_core.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include "action_record.h"
+#include "autotune.h"
+#include "batch_scheduler.h"
+#include "context_registry.h"
+#include "draft_model.h"
+#include "inference_engine.h"
+#include "memory_plan.h"
+#include "native_log.h"
+#include "response_builder.h"
+#include "request_table.h"
+#include "response_cache.h"
+#include "template_tokens.h"
+
+namespace llamacore {
+
+namespace {
+
+/**
+ * Mix the settings that shape a reply into one response cache variant
+ */
+uint64_t responseVariant(const GenerateParams& params) {
+    uint64_t hash = static_cast<uint32_t>(params.maxTokens);
+    auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 0x100000001b3ull; };
+    uint32_t bits;
+    std::memcpy(&bits, &params.sampling.temperature, sizeof(bits));
+    mix(bits);
+    std::memcpy(&bits, &params.sampling.topP, sizeof(bits));
+    mix(bits);
+    mix(static_cast<uint32_t>(params.sampling.topK));
+    return hash;
+}
+
+/**
+ * Answer an action prompt from the response cache
+ *
+ * @param variant Receives the cache variant for storing a decoded reply
+ * @return true and the reply in out on a hit, already streamed to onChunk
+ */
+bool cachedReply(const ModelContext& ctx, std::string_view prompt, const GenerateParams& params,
+                 uint64_t& variant, std::string& out) {
+    if (!params.actionSchema) {
+        return false;
+    }
+    variant = responseVariant(params);
+    if (!responseCache().lookup(ctx.modelId, variant, prompt, out)) {
+        return false;
+    }
+    LOGI("Response cache hit");
+    if (params.onChunk) {
+        params.onChunk(out);
+    }
+    return true;
+}
+
+/**
+ * Tokenize prefix as prompts are tokenized and make it the context's
+ * pinned prefix
+ */
+void pinPrefix(ModelContext& ctx, std::string_view prefix) {
+    std::shared_ptr<const std::vector<Token>> tokens;
+    if (!prefix.empty()) {
+        tokens = std::make_shared<const std::vector<Token>>(templateTokens().tokenize(ctx.vocabKey, ctx.model, prefix));
+    }
+    std::atomic_store(&ctx.pinnedPrefix, tokens);
+    LOGI("Pinned prefix: %zu tokens", tokens ? tokens->size() : 0);
+}
+
+/**
+ * Assemble a structured prompt in the context's format
+ *
+ * @return false if no format was set
+ */
+bool assembleFor(const ModelContext& ctx, const PromptContext& context, AssembledPrompt& out) {
+    std::shared_ptr<const PromptFormat> format = std::atomic_load(&ctx.promptFormat);
+    if (!format) {
+        LOGE("No prompt format set for structured prompts");
+        return false;
+    }
+    out = assemblePrompt(*format, context, ctx.vocabKey, ctx.model);
+    return true;
+}
+
+} // namespace
+
+void initBackend() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        LOGI("Initializing %s backend", backend::name());
+        backend::initialize();
+    });
+}
+
+void shutdownBackend() {
+    // llama_backend_free only releases global state and is safe to skip;
+    // the backend stays initialized for the life of the process so a later
+    // nativeInit does not have to re-run it
+    LOGI("Backend shutdown requested (%s)", backend::name());
+}
+
+int64_t initModel(const std::string& modelPath, const ContextParams& params, const LoadOptions& options) {
+    LOGI("LlamaNative.initModel called with path: %s (threads=%d, n_ctx=%d, cpus=%s, priority=%s)",
+         modelPath.c_str(), params.numThreads, params.contextSize, formatCpuSet(params.placement.cpus).c_str(),
+         threadPriorityName(params.placement.priority));
+
+    initBackend();
+
+    // Planning and probing need the weights (mmap'd, so nothing is read
+    // yet); holding them keeps create from loading them a second time
+    ModelParams modelParams;
+    WeightsRef weights = weightsCache().acquire(modelPath, modelParams);
+    if (!weights) {
+        LOGE("Failed to load model from: %s", modelPath.c_str());
+        return 0;
+    }
+    ModelShape shape = backend::modelShape(weights->model);
+
+    MemoryPlan plan;
+    if (!planMemory(shape, params, options.memoryBudgetBytes, modelParams.useMmap, plan)) {
+        LOGE("Refusing to load %s: needs at least %llu MB, budget is %llu MB", modelPath.c_str(),
+             (unsigned long long)(plan.budgetedBytes() >> 20), (unsigned long long)(options.memoryBudgetBytes >> 20));
+        return 0;
+    }
+    ContextParams contextParams = params;
+    contextParams.contextSize = plan.contextSize;
+    contextParams.kvType = plan.kvType;
+    contextParams.batchSize = plan.batchSize;
+    if (plan.degraded) {
+        LOGI("Memory budget %llu MB: n_ctx=%d, kv=%s, batch=%d (budgeted %llu MB)",
+             (unsigned long long)(plan.budgetBytes >> 20), plan.contextSize, kvCacheTypeName(plan.kvType),
+             plan.batchSize, (unsigned long long)(plan.budgetedBytes() >> 20));
+    }
+
+    // Tuning may only lower the planned batch size, never raise it
+    TuneResult tuning;
+    TuneSource tuneSource = TuneSource::Off;
+    if (!options.tuneDirectory.empty()) {
+        tuneSource = autotune(*weights, contextParams, options.tuneDirectory, tuning);
+        if (tuneSource == TuneSource::Measured || tuneSource == TuneSource::Cached) {
+            contextParams.numThreads = tuning.numThreads;
+            contextParams.batchSize = tuning.batchSize;
+        }
+    }
+
+    ModelContext* ctx = ModelContext::create(modelPath, contextParams);
+    if (ctx == nullptr) {
+        LOGE("Failed to load model from: %s", modelPath.c_str());
+        return 0;
+    }
+    ctx->tuneSource = tuneSource;
+    ctx->tuning = tuning;
+    ctx->memoryPlan = estimateMemory(shape, contextParams, modelParams.useMmap);
+    ctx->memoryPlan.budgetBytes = plan.budgetBytes;
+    ctx->memoryPlan.degraded = plan.degraded;
+
+    // Precompiled template tokens shipped with the model, if any
+    templateTokens().load(templateTokensPath(modelPath), ctx->vocabKey);
+
+    int64_t handle = contextRegistry().add(ctx);
+    if (handle == 0) {
+        LOGE("Context table full, cannot load: %s", modelPath.c_str());
+        return 0;
+    }
+
+    LOGI("Model initialized with handle: %lld", (long long)handle);
+    return handle;
+}
+
+std::string generate(int64_t handle, std::string_view prompt, const GenerateParams& params) {
+    LOGI("LlamaNative.generate called - handle: %lld, maxTokens: %d", (long long)handle, params.maxTokens);
+    LOGD("Prompt: %.*s...", (int)std::min<size_t>(prompt.size(), 100), prompt.data());
+
+    // Check if context exists; the reference keeps it alive until we return
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return kResponseModelNotLoaded;
+    }
+
+    // Repeated action prompts are answered from the response cache; the
+    // variant keeps replies with different budgets or sampling apart
+    uint64_t variant = 0;
+    std::string cached;
+    if (cachedReply(*ctx, prompt, params, variant, cached)) {
+        return cached;
+    }
+
+    // Concurrent calls on one handle share decode passes
+    bool objectClosed = false;
+    std::string response = ctx->scheduler->generate(prompt, params, &objectClosed);
+    if (objectClosed) {
+        responseCache().store(ctx->modelId, variant, prompt, response);
+    }
+
+    LOGI("Generated response: %s", response.c_str());
+    return response;
+}
+
+std::string generateAction(int64_t handle, std::string_view prompt, int maxTokens) {
+    GenerateParams params;
+    params.maxTokens = maxTokens;
+    params.actionSchema = true;
+    return generate(handle, prompt, params);
+}
+
+int64_t submitGenerate(int64_t handle, std::string_view prompt, const GenerateParams& params,
+                       RequestDone onDone) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return 0;
+    }
+
+    std::shared_ptr<AsyncRequest> request = requestTable().create();
+    int64_t id = request->id;
+    LOGI("Submitted request %lld on handle %lld", (long long)id, (long long)handle);
+
+    uint64_t variant = 0;
+    std::string cached;
+    if (cachedReply(*ctx, prompt, params, variant, cached)) {
+        requestTable().complete(id, RequestStatus::Done, std::move(cached));
+        if (onDone) {
+            onDone(id);
+        }
+        return id;
+    }
+
+    // The scheduler owns the request from here; the context may be freed
+    // before it finishes, which cancels it
+    GenerateParams submitted = params;
+    submitted.cancel = &request->cancel;
+    std::string cachePrompt = params.actionSchema ? std::string(prompt) : std::string();
+    uint64_t modelId = ctx->modelId;
+    ctx->scheduler->submit(prompt, submitted,
+            [request, onDone = std::move(onDone), cachePrompt = std::move(cachePrompt), modelId,
+             variant](const Generation& generation) {
+                if (generation.objectClosed()) {
+                    responseCache().store(modelId, variant, cachePrompt, generation.result());
+                }
+                RequestStatus status = generation.cancelled() ? RequestStatus::Cancelled : RequestStatus::Done;
+                requestTable().complete(request->id, status, generation.result());
+                if (onDone) {
+                    onDone(request->id);
+                }
+            });
+    return id;
+}
+
+int64_t submitGenerateAction(int64_t handle, std::string_view prompt, int maxTokens, RequestDone onDone) {
+    GenerateParams params;
+    params.maxTokens = maxTokens;
+    params.actionSchema = true;
+    return submitGenerate(handle, prompt, params, std::move(onDone));
+}
+
+RequestStatus pollGenerate(int64_t requestId, std::string& reply) {
+    return requestTable().poll(requestId, reply);
+}
+
+size_t pollAction(int64_t requestId, uint8_t* out, size_t capacity) {
+    if (capacity < kActionRecordHeaderBytes) {
+        return 0;
+    }
+    std::string reply;
+    switch (pollGenerate(requestId, reply)) {
+        case RequestStatus::Done:
+            return writeActionRecord(reply, out, capacity);
+        case RequestStatus::Cancelled:
+            return writeActionRecord(kResponseCancelled, out, capacity);
+        case RequestStatus::Pending:
+        case RequestStatus::Unknown:
+            break;
+    }
+    return 0;
+}
+
+bool cancelGenerate(int64_t requestId) {
+    bool cancelled = requestTable().cancel(requestId);
+    LOGI("Cancel request %lld: %s", (long long)requestId, cancelled ? "stopping" : "not running");
+    return cancelled;
+}
+
+SnapshotResult warmStart(int64_t handle, const std::string& directory, std::string_view prefix) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return SnapshotResult::Failed;
+    }
+
+    pinPrefix(*ctx, prefix);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    SnapshotResult result = warmStartPrefix(*ctx, directory, prefix);
+    LOGI("Prefix warm start for handle %lld: %s", (long long)handle, snapshotResultName(result));
+    return result;
+}
+
+bool setPinnedPrefix(int64_t handle, std::string_view prefix) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return false;
+    }
+
+    pinPrefix(*ctx, prefix);
+    return true;
+}
+
+bool registerTemplate(int64_t handle, std::string_view text, bool head) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return false;
+    }
+
+    return templateTokens().add(ctx->vocabKey, ctx->model, text, head);
+}
+
+bool setPromptFormat(int64_t handle, const PromptFormat& format) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return false;
+    }
+
+    // Prompts built as text in the same format then share the head and tail
+    templateTokens().add(ctx->vocabKey, ctx->model, format.head, true);
+    templateTokens().add(ctx->vocabKey, ctx->model, format.tail, false);
+    std::shared_ptr<const PromptFormat> shared = std::make_shared<const PromptFormat>(format);
+    std::atomic_store(&ctx->promptFormat, shared);
+    return true;
+}
+
+std::string generateActionFromContext(int64_t handle, const PromptContext& context, int maxTokens) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return kResponseModelNotLoaded;
+    }
+
+    AssembledPrompt prompt;
+    if (!assembleFor(*ctx, context, prompt)) {
+        return kResponseInvalidPrompt;
+    }
+    GenerateParams params;
+    params.maxTokens = maxTokens;
+    params.actionSchema = true;
+    params.promptTokens = std::move(prompt.tokens);
+    return generate(handle, prompt.text, params);
+}
+
+int64_t submitActionFromContext(int64_t handle, const PromptContext& context, int maxTokens,
+                                RequestDone onDone) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return 0;
+    }
+
+    AssembledPrompt prompt;
+    if (!assembleFor(*ctx, context, prompt)) {
+        return 0;
+    }
+    GenerateParams params;
+    params.maxTokens = maxTokens;
+    params.actionSchema = true;
+    params.promptTokens = std::move(prompt.tokens);
+    return submitGenerate(handle, prompt.text, params, std::move(onDone));
+}
+
+bool saveTemplateTokens(int64_t handle, const std::string& path) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return false;
+    }
+
+    bool saved = templateTokens().save(path, ctx->vocabKey);
+    LOGI("Template tokens for handle %lld %s %s", (long long)handle, saved ? "written to" : "not written to",
+         path.c_str());
+    return saved;
+}
+
+bool attachDraftModel(int64_t handle, const std::string& draftPath, int draftTokens) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return false;
+    }
+
+    // Load outside the context lock so generations keep running meanwhile
+    std::unique_ptr<DraftModel> draft;
+    if (!draftPath.empty()) {
+        // The draft gets what the target's plan left of the budget
+        uint64_t budget = ctx->memoryPlan.budgetBytes;
+        uint64_t used = ctx->memoryPlan.budgetedBytes();
+        if (budget > 0 && used >= budget) {
+            LOGE("Refusing draft model %s: the memory budget of %llu MB is taken", draftPath.c_str(),
+                 (unsigned long long)(budget >> 20));
+            return false;
+        }
+        ContextParams params;
+        params.contextSize = ctx->contextSize;
+        params.numThreads = ctx->numThreads;
+        params.placement = ctx->placement;
+        params.threadPool = ctx->threadPool;
+        params.batchSize = ctx->batchSize;
+        params.kvType = ctx->memoryPlan.kvType;
+        params.maxSequences = static_cast<int>(ctx->sequences.size());
+        draft.reset(DraftModel::load(draftPath, ctx->model, params, std::max(1, draftTokens),
+                                     budget > 0 ? budget - used : 0));
+        if (!draft) {
+            LOGE("Failed to attach draft model: %s", draftPath.c_str());
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->draft = std::move(draft);
+    ctx->speculative.draftTokens.store(ctx->draft ? ctx->draft->draftTokens() : 0,
+                                       std::memory_order_relaxed);
+    LOGI("Draft model for handle %lld: %s", (long long)handle,
+         draftPath.empty() ? "(none)" : draftPath.c_str());
+    return true;
+}
+
+bool setPromptLookup(int64_t handle, int draftTokens) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    if (!ctx) {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->promptLookupTokens = std::max(0, draftTokens);
+    ctx->speculative.lookupTokens.store(ctx->promptLookupTokens, std::memory_order_relaxed);
+    LOGI("Prompt lookup for handle %lld: %d tokens", (long long)handle, ctx->promptLookupTokens);
+    return true;
+}
+
+void setResponseCacheCapacity(size_t capacityBytes) {
+    responseCache().setCapacity(capacityBytes);
+    LOGI("Response cache capacity: %zu bytes", capacityBytes);
+}
+
+bool freeModel(int64_t handle) {
+    LOGI("LlamaNative.freeModel called - handle: %lld", (long long)handle);
+
+    // Weights and KV cache are released once no generation holds the context
+    bool freed = contextRegistry().remove(handle);
+    if (freed) {
+        LOGI("Model context freed successfully");
+    } else {
+        LOGE("Invalid context handle: %lld", (long long)handle);
+    }
+    return freed;
+}
+
+int64_t defaultHandle() {
+    return contextRegistry().firstHandle();
+}
+
+void freeAllModels() {
+    contextRegistry().clear();
+}
+
+bool isAnyModelLoaded() {
+    return !contextRegistry().empty();
+}
+
+bool isModelLoaded(int64_t handle) {
+    return contextRegistry().contains(handle);
+}
+
+std::string modelInfo() {
+    return contextRegistry().describeFirst();
+}
+
+std::string modelInfo(int64_t handle) {
+    ContextRef ctx = contextRegistry().acquire(handle);
+    return ctx ? buildModelInfo(*ctx) : std::string();
+}
+
+const char* version() {
+#ifdef LLAMACORE_WITH_LLAMA
+    return "llama.cpp JNI v1.1.0 (llama.cpp backend)";
+#else
+    return "llama.cpp JNI v1.1.0 (stub with JSON responses)";
+#endif
+}
+
+} // namespace llamacore
@@ -0,0 +1,272 @@
+/**
+ * llama_core.h - Platform-independent native inference core
+ *
+ * Everything the JNI functions in llama_jni.cpp do, minus the JNI type
+ * conversions. Built as the llamacore static library so it can be compiled,
+ * benchmarked and fuzzed on a Linux host without the Android NDK.
+ */
+
+#ifndef LLAMACORE_LLAMA_CORE_H
+#define LLAMACORE_LLAMA_CORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "backend.h"
+#include "inference_engine.h"
+#include "prompt_assembly.h"
+#include "request_table.h"
+#include "session_snapshot.h"
+
+namespace llamacore {
+
+// Guesses per pass: acceptance falls off with distance, while verifying a
+// few extra tokens costs a memory-bound CPU pass next to nothing
+constexpr int kDefaultDraftTokens = 4;
+
+// Prompt lookup guesses are free to make and echoed titles run long
+constexpr int kDefaultLookupTokens = 8;
+
+/**
+ * Initialize the compiled-in backend (idempotent; initModel calls it too)
+ */
+void initBackend();
+void shutdownBackend();
+
+struct LoadOptions {
+    // If set, replace numThreads and batchSize with the fastest ones for
+    // this model and device, measured on the first load and kept in a tune
+    // file in this directory (autotune.h)
+    std::string tuneDirectory;
+
+    // Memory the load may allocate: KV cache, compute buffers and, unless
+    // they are mmap'd, the weights. The context length, KV precision and
+    // batch size are reduced to fit, and the load refused if they cannot be
+    // (memory_plan.h). 0 for no limit.
+    uint64_t memoryBudgetBytes = 0;
+};
+
+/**
+ * Initialize a model and return a context handle
+ *
+ * @param modelPath Path to the .gguf model file
+ * @param params Context length, decode threads, batch size and KV cache
+ *        type requested; the context is created with what options allow
+ * @return Context handle, 0 if failed or the model does not fit the budget
+ */
+int64_t initModel(const std::string& modelPath, const ContextParams& params = ContextParams(),
+                  const LoadOptions& options = LoadOptions());
+
+/**
+ * Generate a JSON action response for a prompt
+ *
+ * @param handle Context handle from initModel
+ * @param prompt Input prompt text (UTF-8). Only read for the duration of the
+ *        call, so it may point straight into a JNI direct buffer.
+ * @param params Token budget and sampling settings
+ * @return Model output (JSON reply on error, e.g. invalid handle)
+ */
+std::string generate(int64_t handle, std::string_view prompt, const GenerateParams& params);
+
+/**
+ * generate() as used by LlamaNative: default sampling, output constrained
+ * to one JSON action object
+ */
+std::string generateAction(int64_t handle, std::string_view prompt, int maxTokens);
+
+/**
+ * Told that a submitted request can be polled. Runs on the context's worker
+ * thread (or the submitting thread if the request finished at once), so it
+ * must return quickly and must not generate on the same context.
+ */
+using RequestDone = std::function<void(int64_t requestId)>;
+
+/**
+ * generate() without blocking: queue the request and return its ID
+ *
+ * @param onDone Optional notification once the reply can be polled
+ * @return Request ID for pollGenerate/cancelGenerate, 0 if the handle is
+ *         unknown
+ */
+int64_t submitGenerate(int64_t handle, std::string_view prompt, const GenerateParams& params,
+                       RequestDone onDone = nullptr);
+
+/**
+ * submitGenerate() with generateAction()'s settings
+ */
+int64_t submitGenerateAction(int64_t handle, std::string_view prompt, int maxTokens,
+                             RequestDone onDone = nullptr);
+
+/**
+ * Check on a submitted request. Once it is no longer pending its reply
+ * (the text so far, if cancelled) is moved to reply and the ID forgotten.
+ */
+RequestStatus pollGenerate(int64_t requestId, std::string& reply);
+
+/**
+ * pollGenerate with the reply parsed and written to out as an action
+ * record (action_record.h), so no JSON string reaches Kotlin
+ *
+ * @param capacity Bytes at out; with less than kActionRecordHeaderBytes
+ *        the request is left alone
+ * @return Record bytes, 0 while the request is pending or if it is unknown
+ */
+size_t pollAction(int64_t requestId, uint8_t* out, size_t capacity);
+
+/**
+ * Stop a submitted request at its next token boundary; it then polls as
+ * Cancelled. Freeing the request's context cancels it as well.
+ *
+ * @return false if the request is unknown or already finished
+ */
+bool cancelGenerate(int64_t requestId);
+
+/**
+ * Load the KV state of a static prompt prefix into a context, restoring it
+ * from the on-disk snapshot in directory when that is still valid and
+ * (re)writing the snapshot otherwise. The prefix is also pinned, as by
+ * setPinnedPrefix.
+ *
+ * @param handle Context handle from initModel
+ * @param directory Directory holding snapshot files
+ * @param prefix Text every later prompt starts with
+ */
+SnapshotResult warmStart(int64_t handle, const std::string& directory, std::string_view prefix);
+
+/**
+ * Set the prompt head that context shifting never evicts (the system
+ * prompt). Prompts starting with it keep it when they, or the conversation
+ * they continue, outgrow the context; see inference_engine.h.
+ *
+ * @param handle Context handle from initModel
+ * @param prefix Text prompts start with, empty to pin only the first token
+ * @return false if the handle is unknown
+ */
+bool setPinnedPrefix(int64_t handle, std::string_view prefix);
+
+/**
+ * Register a static prompt piece whose tokens are kept for the model's
+ * vocabulary, so prompts starting (or ending) with it only tokenize the
+ * rest; see template_tokens.h
+ *
+ * @param handle Context handle from initModel
+ * @param text Template text, e.g. PromptTemplates.SIMPLE_PROMPT_PREFIX
+ * @param head true for prompt heads, false for tails
+ * @return false if the handle is unknown or the template was not kept
+ */
+bool registerTemplate(int64_t handle, std::string_view text, bool head);
+
+/**
+ * Set the text around the structured prompts of generateActionFromContext
+ * and register its head and tail as templates
+ *
+ * @param handle Context handle from initModel
+ * @return false if the handle is unknown
+ */
+bool setPromptFormat(int64_t handle, const PromptFormat& format);
+
+/**
+ * generateAction on a prompt assembled from goal and task fields
+ * (prompt_assembly.h) in the format set by setPromptFormat
+ *
+ * @param handle Context handle from initModel
+ * @param context Fields of one turn; the views need only last the call
+ * @return JSON response, kResponseInvalidPrompt if no format is set
+ */
+std::string generateActionFromContext(int64_t handle, const PromptContext& context, int maxTokens);
+
+/**
+ * submitGenerateAction on a prompt assembled as by generateActionFromContext
+ *
+ * @param context Fields of one turn; the views need only last the call
+ * @return Request ID, 0 if the handle is unknown or no format is set
+ */
+int64_t submitActionFromContext(int64_t handle, const PromptContext& context, int maxTokens,
+                                RequestDone onDone);
+
+/**
+ * Write the templates registered for the model's vocabulary to a token
+ * file; shipped as templateTokensPath(modelPath), initModel loads it
+ *
+ * @param handle Context handle from initModel
+ * @return false if the handle is unknown, nothing is registered or the
+ *         file could not be written
+ */
+bool saveTemplateTokens(int64_t handle, const std::string& path);
+
+/**
+ * Attach a draft model for speculative decoding, replacing any previous one
+ *
+ * @param handle Context handle from initModel
+ * @param draftPath Path to a smaller .gguf model with the same vocabulary;
+ *        empty to detach the current draft
+ * @param draftTokens Guesses verified per target pass
+ * @return false if the handle is unknown or the draft could not be loaded,
+ *         does not share the target's vocabulary or does not fit in what
+ *         the target's memory plan left of LoadOptions::memoryBudgetBytes
+ */
+bool attachDraftModel(int64_t handle, const std::string& draftPath, int draftTokens = kDefaultDraftTokens);
+
+/**
+ * Enable or disable prompt lookup speculative decoding (prompt_lookup.h)
+ *
+ * @param handle Context handle from initModel
+ * @param draftTokens Guesses verified per target pass, 0 to disable
+ * @return false if the handle is unknown
+ */
+bool setPromptLookup(int64_t handle, int draftTokens);
+
+/**
+ * Resize the process-wide response cache (response_cache.h) that answers
+ * repeated action prompts without decoding
+ *
+ * @param capacityBytes Byte budget, 0 to disable the cache and drop its
+ *        entries
+ */
+void setResponseCacheCapacity(size_t capacityBytes);
+
+/**
+ * Free a context
+ *
+ * @return false if the handle was unknown
+ */
+bool freeModel(int64_t handle);
+
+/**
+ * Handle used by the single-model LlamaInference interface, 0 if none loaded
+ */
+int64_t defaultHandle();
+
+/**
+ * Free every loaded context
+ */
+void freeAllModels();
+
+bool isAnyModelLoaded();
+
+/**
+ * Check whether a handle refers to a live context
+ */
+bool isModelLoaded(int64_t handle);
+
+/**
+ * Model info JSON for the default context, empty string if none loaded
+ */
+std::string modelInfo();
+
+/**
+ * Model info JSON for one context, empty string if the handle is unknown
+ */
+std::string modelInfo(int64_t handle);
+
+/**
+ * Native library version string
+ */
+const char* version();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_LLAMA_CORE_H
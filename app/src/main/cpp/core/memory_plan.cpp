@@ -0,0 +1,118 @@
+/**
+ * memory_plan.cpp - Fit a context into a memory budget
+ */
+
+#include "memory_plan.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace llamacore {
+
+namespace {
+
+// Bytes per 32 cache elements
+uint64_t kvBlockBytes(KvCacheType type) {
+    switch (type) {
+        case KvCacheType::F16: return 64;
+        case KvCacheType::Q8_0: return 34;
+        case KvCacheType::Q4_0: return 18;
+    }
+    return 64;
+}
+
+/**
+ * Halve a context length, keeping it a multiple of 256
+ */
+int halveContext(int contextSize, int floor) {
+    return std::max(floor, contextSize / 2 / 256 * 256);
+}
+
+} // namespace
+
+const char* kvCacheTypeName(KvCacheType type) {
+    switch (type) {
+        case KvCacheType::F16: return "f16";
+        case KvCacheType::Q8_0: return "q8_0";
+        case KvCacheType::Q4_0: return "q4_0";
+    }
+    return "f16";
+}
+
+MemoryPlan estimateMemory(const ModelShape& shape, const ContextParams& params, bool weightsMapped) {
+    MemoryPlan plan;
+    plan.weightsMapped = weightsMapped;
+    plan.contextSize = params.contextSize;
+    plan.batchSize = params.batchSize;
+    plan.kvType = params.kvType;
+    plan.weightBytes = shape.weightBytes;
+
+    // K and V for every layer and cell; sequences share one unified cache
+    uint64_t elements = 2ull * shape.layers * static_cast<uint64_t>(params.contextSize) * shape.kvEmbedding;
+    plan.kvBytes = (elements + 31) / 32 * kvBlockBytes(params.kvType);
+
+    // The CPU compute buffer is dominated by per-token activations and the
+    // output projection over the vocabulary for a full micro-batch, f32;
+    // eight activations of n_embd per token is a deliberately generous
+    // allowance for the intermediate tensors
+    uint64_t microBatch = static_cast<uint64_t>(std::min(params.batchSize, 512));
+    plan.computeBytes = microBatch * (static_cast<uint64_t>(shape.vocabSize) + 8ull * shape.embedding) * 4;
+    return plan;
+}
+
+bool planMemory(const ModelShape& shape, const ContextParams& params, uint64_t budgetBytes, bool weightsMapped,
+                MemoryPlan& plan) {
+    ContextParams candidate = params;
+    if (shape.trainContext > 0 && candidate.contextSize > shape.trainContext) {
+        // Longer contexts than the model was trained on only degrade output
+        candidate.contextSize = shape.trainContext;
+    }
+    plan = estimateMemory(shape, candidate, weightsMapped);
+    plan.budgetBytes = budgetBytes;
+    if (budgetBytes == 0) {
+        return true;
+    }
+
+    bool degraded = false;
+    while (plan.budgetedBytes() > budgetBytes) {
+        if (candidate.batchSize > 128) {
+            candidate.batchSize = std::max(128, candidate.batchSize / 2);
+        } else if (candidate.kvType == KvCacheType::F16) {
+            candidate.kvType = KvCacheType::Q8_0;
+        } else if (candidate.batchSize > 32) {
+            candidate.batchSize = std::max(32, candidate.batchSize / 2);
+        } else if (candidate.contextSize > 1024) {
+            candidate.contextSize = halveContext(candidate.contextSize, 1024);
+        } else if (candidate.kvType == KvCacheType::Q8_0) {
+            candidate.kvType = KvCacheType::Q4_0;
+        } else if (candidate.contextSize > kMinContextSize) {
+            candidate.contextSize = halveContext(candidate.contextSize, kMinContextSize);
+        } else {
+            return false;
+        }
+        degraded = true;
+        plan = estimateMemory(shape, candidate, weightsMapped);
+        plan.budgetBytes = budgetBytes;
+    }
+    plan.degraded = degraded;
+    return true;
+}
+
+uint64_t residentBytes() {
+    FILE* in = std::fopen("/proc/self/statm", "r");
+    if (in == nullptr) {
+        return 0;
+    }
+    unsigned long long sizePages = 0;
+    unsigned long long residentPages = 0;
+    int fields = std::fscanf(in, "%llu %llu", &sizePages, &residentPages);
+    std::fclose(in);
+    if (fields != 2) {
+        return 0;
+    }
+    return residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+} // namespace llamacore
@@ -0,0 +1,87 @@
+/**
+ * memory_plan.h - Fit a context into a memory budget
+ *
+ * A model's resident memory is its weights plus, per context, the KV cache
+ * (growing with context length and its element type) and the compute
+ * buffers (growing with the batch size). Weights mapped from the GGUF file
+ * are file-backed pages the kernel can drop and read back, so they are not
+ * charged to the budget; weights read into memory are. Loading with fixed settings on a
+ * phone low on RAM gets the process OOM-killed mid-load or on the first
+ * long prompt. Given a budget, the planner estimates these parts and, if
+ * the requested settings do not fit, walks a degradation ladder ordered by
+ * how little each step costs the user:
+ *
+ *   1. smaller batches, down to 128 tokens (slower prompt evaluation only)
+ *   2. q8_0 KV cache (near-lossless)
+ *   3. smaller batches, down to 32 tokens
+ *   4. shorter context, down to 1024 tokens
+ *   5. q4_0 KV cache
+ *   6. shorter context, down to kMinContextSize
+ *
+ * If even the last step does not fit, the load is refused.
+ */
+
+#ifndef LLAMACORE_MEMORY_PLAN_H
+#define LLAMACORE_MEMORY_PLAN_H
+
+#include <cstdint>
+
+#include "backend.h"
+
+namespace llamacore {
+
+// Process, allocator and graph bookkeeping on top of the estimated buffers
+constexpr uint64_t kRuntimeOverheadBytes = 48ull << 20;
+
+// Shortest context worth loading: the instruction block plus a short turn
+constexpr int kMinContextSize = 256;
+
+struct MemoryPlan {
+    uint64_t budgetBytes = 0;  // 0: no budget, the requested settings were kept
+    bool weightsMapped = true; // weights are mmap'd and outside the budget
+    int contextSize = 0;
+    int batchSize = 0;
+    KvCacheType kvType = KvCacheType::F16;
+    bool degraded = false;     // settings were reduced to fit the budget
+
+    uint64_t weightBytes = 0;
+    uint64_t kvBytes = 0;
+    uint64_t computeBytes = 0;
+    uint64_t overheadBytes = kRuntimeOverheadBytes;
+
+    uint64_t estimatedBytes() const { return weightBytes + kvBytes + computeBytes + overheadBytes; }
+
+    /**
+     * The part of the estimate charged to the budget
+     */
+    uint64_t budgetedBytes() const { return estimatedBytes() - (weightsMapped ? weightBytes : 0); }
+};
+
+const char* kvCacheTypeName(KvCacheType type);
+
+/**
+ * Estimated footprint of a model with one context of the given settings
+ */
+MemoryPlan estimateMemory(const ModelShape& shape, const ContextParams& params, bool weightsMapped);
+
+/**
+ * Choose contextSize, kvType and batchSize for params within budgetBytes
+ *
+ * @param budgetBytes Memory the load may allocate (see budgetedBytes), 0
+ *        for no limit
+ * @param weightsMapped The weights are mmap'd (ModelParams::useMmap)
+ * @param plan Receives the chosen settings and their estimate; on failure,
+ *        the smallest configuration tried
+ * @return false if nothing fits the budget
+ */
+bool planMemory(const ModelShape& shape, const ContextParams& params, uint64_t budgetBytes, bool weightsMapped,
+                MemoryPlan& plan);
+
+/**
+ * Resident set size of this process, 0 if unknown
+ */
+uint64_t residentBytes();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_MEMORY_PLAN_H
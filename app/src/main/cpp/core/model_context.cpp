@@ -0,0 +1,94 @@
+/**
+ * model_context.cpp - Per-handle native model state
+ */
+
+#include "model_context.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "batch_scheduler.h"
+#include "draft_model.h"
+#include "native_log.h"
+#include "template_tokens.h"
+
+namespace llamacore {
+
+ModelContext::ModelContext(const std::string& path)
+    : modelPath(path), isLoaded(false), contextSize(0), numThreads(0) {}
+
+void SchedulerStats::recordDecodeStep(uint64_t nanos) {
+    int bucket = nanos <= 100 ? 0 : static_cast<int>(std::log2(static_cast<double>(nanos) / 100.0) * 4.0);
+    bucket = std::min(bucket, kStepBuckets - 1);
+    stepBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    decodeSteps.fetch_add(1, std::memory_order_relaxed);
+}
+
+double SchedulerStats::stepQuantileMicros(double q) const {
+    uint64_t counts[kStepBuckets];
+    uint64_t total = 0;
+    for (int i = 0; i < kStepBuckets; ++i) {
+        counts[i] = stepBuckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    int bucket = 0;
+    for (; bucket < kStepBuckets - 1; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    // Geometric middle of the bucket
+    return 0.1 * std::exp2((bucket + 0.5) / 4.0);
+}
+
+ModelContext* ModelContext::create(const std::string& path, const ContextParams& params) {
+    ModelParams modelParams;
+    WeightsRef weights = weightsCache().acquire(path, modelParams);
+    if (!weights) {
+        return nullptr;
+    }
+
+    ContextParams contextParams = params;
+    contextParams.numThreads = resolveThreadCount(params.numThreads, params.placement);
+    // Without a pool the backend falls back to per-pass threads
+    contextParams.threadPool = backend::newThreadPool(contextParams);
+    BackendContext* backendContext = backend::newContext(weights->model, contextParams);
+    if (backendContext == nullptr) {
+        backend::freeThreadPool(contextParams.threadPool);
+        return nullptr;
+    }
+
+    auto* ctx = new ModelContext(path);
+    ctx->modelId = weights->identity;
+    ctx->vocabKey = vocabularyKey(weights->model);
+    ctx->model = weights->model;
+    ctx->weights = std::move(weights);
+    ctx->backendContext = backendContext;
+    ctx->contextSize = backend::contextSize(backendContext);
+    ctx->numThreads = contextParams.numThreads;
+    ctx->placement = params.placement;
+    ctx->threadPool = contextParams.threadPool;
+    ctx->batchSize = params.batchSize;
+    ctx->sequences.resize(std::max(1, params.maxSequences));
+    ctx->scheduler.reset(new BatchScheduler(*ctx));
+    ctx->isLoaded = true;
+    return ctx;
+}
+
+ModelContext::~ModelContext() {
+    // Stop the worker before the context it decodes on goes away
+    scheduler.reset();
+    draft.reset();
+    backend::freeContext(backendContext);
+    backend::freeThreadPool(threadPool);
+    // The weights go with the last handle (or draft) referencing them
+}
+
+} // namespace llamacore
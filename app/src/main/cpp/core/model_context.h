@@ -0,0 +1,178 @@
+/**
+ * model_context.h - Per-handle native model state
+ *
+ * One ModelContext sits behind every handle returned by initModel: a
+ * reference to the loaded weights (shared with other handles on the same
+ * file, see model_weights.h), its own backend inference context (KV cache)
+ * and the settings it was created with.
+ */
+
+#ifndef LLAMACORE_MODEL_CONTEXT_H
+#define LLAMACORE_MODEL_CONTEXT_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "autotune.h"
+#include "backend.h"
+#include "memory_plan.h"
+#include "model_weights.h"
+
+namespace llamacore {
+
+/**
+ * Prompt prefix reuse counters, readable without the context lock
+ */
+struct PromptCacheStats {
+    std::atomic<uint64_t> hits{0};             // prompts that reused a cached prefix
+    std::atomic<uint64_t> misses{0};           // prompts evaluated from scratch
+    std::atomic<uint64_t> reusedTokens{0};     // prompt tokens served from the KV cache
+    std::atomic<uint64_t> evaluatedTokens{0};  // prompt tokens decoded
+
+    // Context shifting, see inference_engine.h
+    std::atomic<uint64_t> truncatedPrompts{0};  // prompts that lost their oldest tokens to fit
+    std::atomic<uint64_t> contextShifts{0};     // cache cells discarded and moved down
+    std::atomic<uint64_t> shiftedTokens{0};     // prompt tokens reused after a shift
+};
+
+/**
+ * Continuous batching counters, readable without the context lock
+ */
+struct SchedulerStats {
+    // Step time histogram: quarter-octave buckets from 100 ns, up to ~1.7 s
+    static constexpr int kStepBuckets = 96;
+
+    std::atomic<uint64_t> batches{0};      // decode passes
+    std::atomic<uint64_t> batchTokens{0};  // tokens over all passes
+    std::atomic<int> peakActive{0};        // most requests sharing one pass
+
+    // Start-to-start times of back-to-back passes that only carried
+    // decoding requests: the per-token cadence, including any time the
+    // worker lost to preemption between passes. Its spread is the jitter a
+    // user sees while a reply streams.
+    std::atomic<uint64_t> decodeSteps{0};
+    std::array<std::atomic<uint64_t>, kStepBuckets> stepBuckets{};
+
+    void recordDecodeStep(uint64_t nanos);
+
+    /**
+     * Decode step time at quantile q (0..1), in microseconds, 0 before the
+     * first step. Accurate to a bucket, about 19%.
+     */
+    double stepQuantileMicros(double q) const;
+};
+
+/**
+ * Speculative decoding counters, readable without the context lock
+ */
+struct SpeculativeStats {
+    std::atomic<int> draftTokens{0};           // guesses per pass, 0 without a draft model
+    std::atomic<uint64_t> drafted{0};          // guesses verified by the target
+    std::atomic<uint64_t> accepted{0};         // guesses the target agreed with
+    std::atomic<uint64_t> verifications{0};    // request steps that carried guesses
+    std::atomic<uint64_t> verifiedTokens{0};   // tokens those steps produced
+    std::atomic<uint64_t> draftNanos{0};       // time spent drafting
+    std::atomic<uint64_t> targetNanos{0};      // target passes that carried guesses
+
+    // Prompt lookup (prompt_lookup.h) share of drafted/accepted
+    std::atomic<int> lookupTokens{0};          // guesses per pass, 0 when disabled
+    std::atomic<uint64_t> lookupDrafted{0};
+    std::atomic<uint64_t> lookupAccepted{0};
+};
+
+/**
+ * One KV cache sequence. Guarded by ModelContext::mutex.
+ */
+struct SequenceState {
+    // Tokens held at positions 0..n-1: the prompt and evaluated output of
+    // the last generation on this sequence, kept for prefix reuse
+    std::vector<Token> cachedTokens;
+
+    // A generation is running on this sequence
+    bool busy = false;
+};
+
+class BatchScheduler;
+class DraftModel;
+struct PromptFormat;
+
+struct ModelContext {
+    std::string modelPath;
+    uint64_t modelId = 0;  // modelIdentity, keys the response cache
+    uint64_t vocabKey = 0;  // vocabularyKey, keys the template tokens
+    bool isLoaded;
+    int contextSize;
+    int numThreads;
+    int batchSize = 0;
+
+    // Cores and priority of the decode threads, and whether the scheduler
+    // thread managed to apply them to itself
+    ThreadPlacement placement;
+    std::atomic<bool> placementApplied{false};
+
+    // Where numThreads and batchSize came from, see autotune.h
+    TuneSource tuneSource = TuneSource::Off;
+    TuneResult tuning;
+
+    // Estimated footprint of the settings in use, and the budget they were
+    // fitted to (memory_plan.h)
+    MemoryPlan memoryPlan;
+
+    WeightsRef weights;
+    BackendModel* model = nullptr;  // weights->model
+    BackendContext* backendContext = nullptr;
+    BackendThreadPool* threadPool = nullptr;  // shared with the draft context
+
+    // Guards the backend context and sequences. Generations are driven by
+    // the scheduler's worker, which holds it for one decode pass at a time.
+    std::mutex mutex;
+
+    std::vector<SequenceState> sequences;
+
+    // Leading tokens context shifting never evicts (the system prompt), set
+    // by setPinnedPrefix or warmStart. Generations read it while tokenizing,
+    // outside the lock, so it is only swapped whole, with std::atomic_store.
+    std::shared_ptr<const std::vector<Token>> pinnedPrefix;
+
+    // Text around structured prompts (prompt_assembly.h), set by
+    // setPromptFormat and swapped whole like pinnedPrefix
+    std::shared_ptr<const PromptFormat> promptFormat;
+
+    // Optional speculative decoding draft, see draft_model.h
+    std::unique_ptr<DraftModel> draft;
+
+    // Guesses per pass from prompt lookup, 0 when disabled. Tried before
+    // the draft model, which then only guesses where no n-gram matched.
+    int promptLookupTokens = 0;
+
+    // Interleaves concurrent generate calls into shared decode batches
+    std::unique_ptr<BatchScheduler> scheduler;
+
+    PromptCacheStats promptCache;
+    SchedulerStats schedulerStats;
+    SpeculativeStats speculative;
+
+    /**
+     * Reference the model's weights, loading them unless another handle
+     * already holds them, and create this handle's inference context and
+     * decode thread pool. params.numThreads <= 0 picks one thread per core
+     * of params.placement (resolveThreadCount).
+     *
+     * @return nullptr if the weights or the context could not be created
+     */
+    static ModelContext* create(const std::string& path, const ContextParams& params);
+
+    ~ModelContext();
+
+private:
+    explicit ModelContext(const std::string& path);
+};
+
+} // namespace llamacore
+
+#endif // LLAMACORE_MODEL_CONTEXT_H
@@ -0,0 +1,73 @@
+/**
+ * model_weights.cpp - Loaded model weights shared between handles
+ */
+
+#include "model_weights.h"
+
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "native_log.h"
+
+namespace llamacore {
+
+uint64_t modelIdentity(const std::string& path) {
+    uint64_t hash = fnv1a(path.data(), path.size());
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+        int64_t size = static_cast<int64_t>(info.st_size);
+        int64_t modified = static_cast<int64_t>(info.st_mtime);
+        hash = fnv1a(&size, sizeof(size), hash);
+        hash = fnv1a(&modified, sizeof(modified), hash);
+    }
+    return hash;
+}
+
+WeightsRef WeightsCache::acquire(const std::string& path, const ModelParams& params) {
+    uint64_t identity = modelIdentity(path);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = loaded_.find(path);
+    if (found != loaded_.end()) {
+        WeightsRef weights = found->second.lock();
+        if (weights && weights->identity == identity) {
+            LOGI("Sharing loaded weights: %s", path.c_str());
+            return weights;
+        }
+        // Expired, or the file changed on disk; holders of the old weights
+        // keep them until they let go
+        loaded_.erase(found);
+    }
+
+    BackendModel* model = backend::loadModel(path, params);
+    if (model == nullptr) {
+        return nullptr;
+    }
+    auto weights = std::make_shared<ModelWeights>();
+    weights->path = path;
+    weights->identity = identity;
+    weights->model = model;
+    loaded_.emplace(path, weights);
+    return weights;
+}
+
+size_t WeightsCache::loadedCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (auto it = loaded_.begin(); it != loaded_.end();) {
+        if (it->second.expired()) {
+            it = loaded_.erase(it);
+        } else {
+            ++count;
+            ++it;
+        }
+    }
+    return count;
+}
+
+WeightsCache& weightsCache() {
+    static WeightsCache cache;
+    return cache;
+}
+
+} // namespace llamacore
@@ -0,0 +1,75 @@
+/**
+ * model_weights.h - Loaded model weights shared between handles
+ *
+ * Weights are the bulk of a model's memory; the KV cache and compute
+ * buffers of a context are small next to them. Every handle used to load
+ * its own copy, so LlamaInference and LocalAssistantRepository holding the
+ * same model doubled RSS. Loaded weights are now kept per path and
+ * reference counted: each ModelContext (and each draft model) holds a
+ * reference next to its own backend context, and the weights are freed
+ * when the last one goes away.
+ */
+
+#ifndef LLAMACORE_MODEL_WEIGHTS_H
+#define LLAMACORE_MODEL_WEIGHTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "backend.h"
+
+namespace llamacore {
+
+/**
+ * Identity of a model file: path, size and modification time, so a
+ * re-downloaded file is neither shared with nor mistaken for the old one
+ */
+uint64_t modelIdentity(const std::string& path);
+
+struct ModelWeights {
+    std::string path;
+    uint64_t identity = 0;
+    BackendModel* model = nullptr;
+
+    ModelWeights() = default;
+    ModelWeights(const ModelWeights&) = delete;
+    ModelWeights& operator=(const ModelWeights&) = delete;
+    ~ModelWeights() { backend::freeModel(model); }
+};
+
+using WeightsRef = std::shared_ptr<ModelWeights>;
+
+class WeightsCache {
+public:
+    /**
+     * Reference the weights loaded from path, loading them if no handle
+     * holds them yet. Loads are serialized, so concurrent initModel calls
+     * for one path load it once.
+     *
+     * @param params Used only when this call loads the file
+     * @return Empty reference if the model could not be loaded
+     */
+    WeightsRef acquire(const std::string& path, const ModelParams& params);
+
+    /**
+     * Number of distinct weight files currently loaded
+     */
+    size_t loadedCount();
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::weak_ptr<ModelWeights>> loaded_;
+};
+
+/**
+ * Process-wide cache used by ModelContext and DraftModel
+ */
+WeightsCache& weightsCache();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_MODEL_WEIGHTS_H
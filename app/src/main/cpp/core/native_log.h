@@ -0,0 +1,19 @@
+/**
+ * native_log.h - Logging macros shared by the JNI shim and llamacore
+ *
+ * On Android these go to logcat. Host builds pick up the stand-in
+ * android/log.h from core/compat, which prints to stderr.
+ */
+
+#ifndef LLAMACORE_NATIVE_LOG_H
+#define LLAMACORE_NATIVE_LOG_H
+
+#include <android/log.h>
+
+// Logging macros for Android logcat
+#define LOG_TAG "LlamaInference"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+#endif // LLAMACORE_NATIVE_LOG_H
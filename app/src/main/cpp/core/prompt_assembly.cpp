@@ -0,0 +1,196 @@
+/**
+ * prompt_assembly.cpp - Assistant prompts built from goal and task fields
+ */
+
+#include "prompt_assembly.h"
+
+#include "hash.h"
+#include "template_tokens.h"
+
+namespace llamacore {
+
+namespace {
+
+// Labels PromptTemplates.buildContext writes
+constexpr std::string_view kGoalsLabel = "\nContext - Goals: ";
+constexpr std::string_view kTasksLabel = "\nContext - Today's Tasks: ";
+constexpr std::string_view kEmptyContext = "\nContext: No active goals or tasks yet.";
+constexpr std::string_view kSeparator = "; ";
+constexpr std::string_view kCompleted = "\xE2\x9C\x93";  // ✓
+constexpr std::string_view kPending = "\xE2\x97\x8B";    // ○
+
+/**
+ * Prompt text with the byte ranges of what the user typed
+ */
+struct PromptText {
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    std::string text;
+    std::vector<Range> fields;
+
+    void field(std::string_view value) {
+        if (!value.empty()) {
+            fields.push_back({text.size(), text.size() + value.size()});
+        }
+        text += value;
+    }
+};
+
+/**
+ * "title|30min|ends:2025-06-01", after a separator unless first
+ */
+void formatGoal(const GoalItem& goal, bool first, PromptText& out) {
+    if (!first) {
+        out.text += kSeparator;
+    }
+    out.field(goal.title);
+    out.text += '|';
+    out.text += std::to_string(goal.dailyMinutes);
+    out.text += "min|ends:";
+    out.field(goal.endDate);
+}
+
+/**
+ * "✓title|20min" (the minutes only when set), after a separator unless first
+ */
+void formatTask(const TaskItem& task, bool first, PromptText& out) {
+    if (!first) {
+        out.text += kSeparator;
+    }
+    out.text += task.completed ? kCompleted : kPending;
+    out.field(task.title);
+    if (task.minutes > 0) {
+        out.text += '|';
+        out.text += std::to_string(task.minutes);
+        out.text += "min";
+    }
+}
+
+std::vector<Token> tokenizeSpan(BackendModel* model, std::string_view text, bool first, bool parseSpecial) {
+    return first ? backend::tokenize(model, text, true, parseSpecial)
+                 : tokenizeAfterLineBreak(model, text, parseSpecial);
+}
+
+} // namespace
+
+void TokenSpanCache::append(uint64_t vocab, BackendModel* model, std::string_view text, bool first,
+                            bool parseSpecial, std::vector<Token>& out) {
+    if (text.empty()) {
+        return;
+    }
+    uint64_t key = fnv1a(text.data(), text.size(), vocab ^ (first ? 1 : 0) ^ (parseSpecial ? 2 : 0));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(key);
+        if (found != index_.end() && found->second->text == text) {
+            spans_.splice(spans_.begin(), spans_, found->second);
+            out.insert(out.end(), found->second->tokens.begin(), found->second->tokens.end());
+            ++stats_.hits;
+            return;
+        }
+        ++stats_.misses;
+    }
+
+    // Tokenize outside the lock; a concurrent miss on the same span only
+    // stores the same tokens twice
+    std::vector<Token> tokens = tokenizeSpan(model, text, first, parseSpecial);
+    out.insert(out.end(), tokens.begin(), tokens.end());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) {
+        return;
+    }
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        spans_.erase(found->second);
+        index_.erase(found);
+    }
+    while (spans_.size() >= capacity_) {
+        index_.erase(spans_.back().key);
+        spans_.pop_back();
+        ++stats_.evicted;
+    }
+    spans_.push_front(Span{key, std::string(text), std::move(tokens)});
+    index_[key] = spans_.begin();
+}
+
+void TokenSpanCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_.clear();
+    index_.clear();
+}
+
+TokenSpanStats TokenSpanCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TokenSpanStats stats = stats_;
+    stats.entries = spans_.size();
+    return stats;
+}
+
+AssembledPrompt assemblePrompt(const PromptFormat& format, const PromptContext& context, uint64_t vocab,
+                               BackendModel* model) {
+    PromptText prompt;
+    std::string& text = prompt.text;
+    text.reserve(format.head.size() + format.input.size() + format.tail.size() + context.userMessage.size() +
+                 64 * (context.goals.size() + context.tasks.size()) + kEmptyContext.size());
+
+    text += format.head;
+    if (!context.goals.empty()) {
+        text += kGoalsLabel;
+        for (size_t i = 0; i < context.goals.size(); ++i) {
+            formatGoal(context.goals[i], i == 0, prompt);
+        }
+    }
+    if (!context.tasks.empty()) {
+        text += kTasksLabel;
+        for (size_t i = 0; i < context.tasks.size(); ++i) {
+            formatTask(context.tasks[i], i == 0, prompt);
+        }
+    }
+    if (context.goals.empty() && context.tasks.empty()) {
+        text += kEmptyContext;
+    }
+    text += format.input;
+    size_t messageBegin = text.size();
+    text += context.userMessage;
+    size_t messageEnd = text.size();
+    text += format.tail;
+
+    // One span per run of text between token boundaries; BOS goes with
+    // the first
+    TokenSpanCache& spans = tokenSpans();
+    auto tokens = std::make_shared<std::vector<Token>>();
+    size_t field = 0;
+    for (size_t begin = 0, end = 0; begin < text.size(); begin = end) {
+        // Boundaries follow line breaks
+        end = begin;
+        do {
+            end = text.find('\n', end);
+            end = end == std::string::npos ? text.size() : end + 1;
+        } while (end < text.size() && !isTokenBoundary(text, end));
+        std::string_view span(text.data() + begin, end - begin);
+        while (field < prompt.fields.size() && prompt.fields[field].end <= begin) {
+            ++field;
+        }
+        bool typed = field < prompt.fields.size() && prompt.fields[field].begin < end;
+        if (messageEnd > messageBegin && begin < messageEnd && end > messageBegin) {
+            // The one span that changes every turn is not worth a cache entry
+            std::vector<Token> message = tokenizeSpan(model, span, begin == 0, false);
+            tokens->insert(tokens->end(), message.begin(), message.end());
+        } else {
+            spans.append(vocab, model, span, begin == 0, !typed, *tokens);
+        }
+    }
+
+    return {std::move(text), std::move(tokens)};
+}
+
+TokenSpanCache& tokenSpans() {
+    static TokenSpanCache cache(kTokenSpanEntries);
+    return cache;
+}
+
+} // namespace llamacore
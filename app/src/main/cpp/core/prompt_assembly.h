@@ -0,0 +1,140 @@
+/**
+ * prompt_assembly.h - Assistant prompts built from goal and task fields
+ *
+ * PromptTemplates.buildSimplePrompt formats the goals and tasks with a
+ * StringBuilder, the string crosses JNI, and the whole of it is tokenized,
+ * although from one turn to the next only the user message changes. Here
+ * the caller passes the fields themselves; the prompt text, byte for byte
+ * what buildSimplePrompt writes, is split into spans at its token
+ * boundaries (template_tokens.h), which in this format fall between
+ * lines: the instruction lines, the goals line, the tasks line, the input
+ * label and the response tail. Span tokens are cached by content, so a
+ * turn only tokenizes its user message and the lines that changed, and
+ * the tokens equal those of the whole text.
+ *
+ * The user message, and the spans holding goal or task fields, are
+ * tokenized without parsing special tokens, so text the user typed cannot
+ * end a turn or open another role.
+ */
+
+#ifndef LLAMACORE_PROMPT_ASSEMBLY_H
+#define LLAMACORE_PROMPT_ASSEMBLY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "backend.h"
+
+namespace llamacore {
+
+// Spans kept over all vocabularies; a context entry is a few dozen bytes
+constexpr size_t kTokenSpanEntries = 1024;
+
+/**
+ * The fixed text around a structured prompt:
+ * head + context + input + user message + tail
+ */
+struct PromptFormat {
+    std::string head;   // PromptTemplates.SIMPLE_PROMPT_PREFIX
+    std::string input;  // PromptTemplates.SIMPLE_PROMPT_INPUT
+    std::string tail;   // PromptTemplates.SIMPLE_PROMPT_SUFFIX
+};
+
+// Fields of GoalContext and TaskContext (PromptTemplates.kt)
+struct GoalItem {
+    std::string_view title;
+    int dailyMinutes = 0;
+    std::string_view endDate;
+};
+
+struct TaskItem {
+    std::string_view title;
+    bool completed = false;
+    int minutes = 0;
+};
+
+/**
+ * One turn; every entry given is formatted, so the caller applies
+ * PromptTemplates.MAX_CONTEXT_ITEMS
+ */
+struct PromptContext {
+    std::vector<GoalItem> goals;
+    std::vector<TaskItem> tasks;
+    std::string_view userMessage;
+};
+
+struct AssembledPrompt {
+    std::string text;
+    std::shared_ptr<const std::vector<Token>> tokens;
+};
+
+struct TokenSpanStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evicted = 0;
+    size_t entries = 0;
+};
+
+/**
+ * Least recently used cache of span tokens, keyed by vocabulary and text
+ */
+class TokenSpanCache {
+public:
+    explicit TokenSpanCache(size_t capacity) : capacity_(capacity) {}
+
+    /**
+     * Append the tokens of text to out, tokenizing it only if not cached
+     *
+     * @param first Set for the first span of a prompt, which gets BOS;
+     *        later spans start at a token boundary (tokenizeAfterLineBreak)
+     * @param parseSpecial As for backend::tokenize
+     */
+    void append(uint64_t vocab, BackendModel* model, std::string_view text, bool first, bool parseSpecial,
+                std::vector<Token>& out);
+
+    /**
+     * Forget every span
+     */
+    void clear();
+
+    TokenSpanStats stats() const;
+
+private:
+    struct Span {
+        uint64_t key;
+        std::string text;  // to rule out hash collisions
+        std::vector<Token> tokens;
+    };
+
+    using SpanList = std::list<Span>;
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    SpanList spans_;  // most recently used first
+    std::unordered_map<uint64_t, SpanList::iterator> index_;
+    TokenSpanStats stats_;
+};
+
+/**
+ * Build the text and tokens of a structured prompt
+ *
+ * @param vocab vocabularyKey of model
+ */
+AssembledPrompt assemblePrompt(const PromptFormat& format, const PromptContext& context, uint64_t vocab,
+                               BackendModel* model);
+
+/**
+ * Process-wide span cache used by assemblePrompt
+ */
+TokenSpanCache& tokenSpans();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_PROMPT_ASSEMBLY_H
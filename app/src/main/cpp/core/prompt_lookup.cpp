@@ -0,0 +1,45 @@
+/**
+ * prompt_lookup.cpp - Model-free draft guesses from the request's own tokens
+ */
+
+#include "prompt_lookup.h"
+
+namespace llamacore {
+
+void lookupDraft(const std::vector<Token>& history, Token last, int maxTokens, std::vector<Token>& out) {
+    out.clear();
+    // The sequence is history followed by last. One backward pass finds,
+    // for every earlier position holding `last`, how many of the tokens
+    // before it also match the tokens before `last`; the longest match wins
+    // and among equals the latest, which is the likeliest to be echoed.
+    const size_t n = history.size();
+    size_t bestEnd = 0;
+    int bestLength = 0;
+    for (size_t end = n; end-- > 0;) {
+        if (history[end] != last) {
+            continue;
+        }
+        int length = 1;
+        while (length < kPromptLookupMaxNgram && static_cast<size_t>(length) <= end &&
+               history[end - length] == history[n - length]) {
+            ++length;
+        }
+        if (length > bestLength) {
+            bestLength = length;
+            bestEnd = end;
+            if (length == kPromptLookupMaxNgram) {
+                break;
+            }
+        }
+    }
+    if (bestLength < kPromptLookupMinNgram) {
+        return;
+    }
+
+    // What followed the match, which may run on into `last` itself
+    for (size_t i = bestEnd + 1; i <= n && out.size() < static_cast<size_t>(maxTokens); ++i) {
+        out.push_back(i < n ? history[i] : last);
+    }
+}
+
+} // namespace llamacore
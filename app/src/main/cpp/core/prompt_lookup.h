@@ -0,0 +1,40 @@
+/**
+ * prompt_lookup.h - Model-free draft guesses from the request's own tokens
+ *
+ * Action replies mostly echo text already in the prompt: goal and task
+ * titles from the context section, the quoted name in the user message.
+ * Prompt lookup decoding finds the latest earlier occurrence of the last
+ * few tokens and guesses that whatever followed it comes next. The target
+ * verifies the guesses like a draft model's, so output is unchanged; a
+ * miss costs a few extra cells in one batched pass.
+ */
+
+#ifndef LLAMACORE_PROMPT_LOOKUP_H
+#define LLAMACORE_PROMPT_LOOKUP_H
+
+#include <vector>
+
+#include "backend.h"
+
+namespace llamacore {
+
+// Longest and shortest n-gram, ending in the last sampled token, that is
+// matched. Single tokens (quotes, commas) recur too often to predict
+// anything.
+constexpr int kPromptLookupMaxNgram = 3;
+constexpr int kPromptLookupMinNgram = 2;
+
+/**
+ * Guess the tokens after `last` by matching the sequence's trailing n-gram
+ * against earlier tokens: the longest match wins, the latest among equals
+ *
+ * @param history Tokens before `last` (prompt and output so far)
+ * @param last Last sampled token
+ * @param maxTokens Guesses wanted
+ * @param out Receives up to maxTokens guesses; empty if nothing matched
+ */
+void lookupDraft(const std::vector<Token>& history, Token last, int maxTokens, std::vector<Token>& out);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_PROMPT_LOOKUP_H
@@ -0,0 +1,63 @@
+/**
+ * request_table.cpp - Asynchronous generate requests
+ */
+
+#include "request_table.h"
+
+namespace llamacore {
+
+std::shared_ptr<AsyncRequest> RequestTable::create() {
+    auto request = std::make_shared<AsyncRequest>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    request->id = nextId_++;
+    entries_[request->id].request = request;
+    return request;
+}
+
+void RequestTable::complete(int64_t id, RequestStatus status, std::string reply) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(id);
+    if (found == entries_.end()) {
+        return;
+    }
+    found->second.status = status;
+    found->second.reply = std::move(reply);
+    // The scheduler's copy keeps the flag alive until it is done with it
+    found->second.request.reset();
+}
+
+RequestStatus RequestTable::poll(int64_t id, std::string& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(id);
+    if (found == entries_.end()) {
+        return RequestStatus::Unknown;
+    }
+    RequestStatus status = found->second.status;
+    if (status != RequestStatus::Pending) {
+        out = std::move(found->second.reply);
+        entries_.erase(found);
+    }
+    return status;
+}
+
+bool RequestTable::cancel(int64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(id);
+    if (found == entries_.end() || found->second.status != RequestStatus::Pending) {
+        return false;
+    }
+    found->second.request->cancel.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+size_t RequestTable::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+RequestTable& requestTable() {
+    static RequestTable table;
+    return table;
+}
+
+} // namespace llamacore
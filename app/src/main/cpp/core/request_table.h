@@ -0,0 +1,87 @@
+/**
+ * request_table.h - Asynchronous generate requests
+ *
+ * submitGenerate (llama_core.h) hands a request to the context's scheduler
+ * and returns an ID at once, so no caller thread is parked for the seconds
+ * a reply takes. The table maps IDs to each request's cancellation flag and,
+ * once it finishes, its reply, which stays until polled.
+ */
+
+#ifndef LLAMACORE_REQUEST_TABLE_H
+#define LLAMACORE_REQUEST_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace llamacore {
+
+enum class RequestStatus {
+    Pending = 0,    // queued or decoding
+    Done = 1,       // reply ready
+    Cancelled = 2,  // stopped by cancelGenerate; the reply holds the text so far
+    Unknown = 3,    // never submitted, or already polled
+};
+
+/**
+ * One submitted request. The scheduler's completion keeps it alive, so
+ * cancel stays valid for the whole generation.
+ */
+struct AsyncRequest {
+    int64_t id = 0;
+    std::atomic<bool> cancel{false};
+};
+
+class RequestTable {
+public:
+    /**
+     * Register a new pending request
+     */
+    std::shared_ptr<AsyncRequest> create();
+
+    /**
+     * Record a request's reply; it stays until polled
+     */
+    void complete(int64_t id, RequestStatus status, std::string reply);
+
+    /**
+     * Status of a request. Once it is no longer pending the reply is moved
+     * to out and the request forgotten.
+     */
+    RequestStatus poll(int64_t id, std::string& out);
+
+    /**
+     * Ask a pending request to stop at its next token boundary
+     *
+     * @return false if the request is unknown or already finished
+     */
+    bool cancel(int64_t id);
+
+    /**
+     * Requests submitted and not yet polled
+     */
+    size_t size();
+
+private:
+    struct Entry {
+        std::shared_ptr<AsyncRequest> request;
+        RequestStatus status = RequestStatus::Pending;
+        std::string reply;
+    };
+
+    std::mutex mutex_;
+    int64_t nextId_ = 1;
+    std::unordered_map<int64_t, Entry> entries_;
+};
+
+/**
+ * Process-wide table shared by all handles
+ */
+RequestTable& requestTable();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_REQUEST_TABLE_H
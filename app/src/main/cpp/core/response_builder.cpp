@@ -0,0 +1,251 @@
+/**
+ * response_builder.cpp - JSON response construction for the action schema
+ */
+
+#include "response_builder.h"
+
+#include <cstdio>
+#include <memory>
+
+#include "model_context.h"
+#include "prompt_assembly.h"
+#include "response_cache.h"
+#include "template_tokens.h"
+#include "thread_placement.h"
+
+namespace llamacore {
+
+const char* const kResponseModelNotLoaded =
+        "{\"action\":\"reply\",\"message\":\"Error: Model not loaded\",\"data\":{}}";
+const char* const kResponseNoModel =
+        "{\"action\":\"reply\",\"message\":\"No model loaded. Please download a model first.\",\"data\":{}}";
+const char* const kResponseInvalidPrompt =
+        "{\"action\":\"reply\",\"message\":\"Error: Invalid prompt buffer\",\"data\":{}}";
+const char* const kResponsePromptTooLong =
+        "{\"action\":\"reply\",\"message\":\"Error: Prompt is too long for the model context\",\"data\":{}}";
+const char* const kResponseDecodeFailed =
+        "{\"action\":\"reply\",\"message\":\"Error: Model evaluation failed\",\"data\":{}}";
+const char* const kResponseCancelled =
+        "{\"action\":\"reply\",\"message\":\"Generation cancelled\",\"data\":{}}";
+
+std::string extractQuoted(std::string_view prompt, const char* fallback) {
+    size_t quoteStart = prompt.find('"');
+    size_t quoteEnd = prompt.find('"', quoteStart + 1);
+    if (quoteStart != std::string_view::npos && quoteEnd != std::string_view::npos) {
+        return std::string(prompt.substr(quoteStart + 1, quoteEnd - quoteStart - 1));
+    }
+    return fallback;
+}
+
+std::string buildResponse(Intent intent, std::string_view prompt) {
+    switch (intent) {
+        case Intent::CreateGoal: {
+            // Extract goal name if present (simple heuristic)
+            std::string goalName = extractQuoted(prompt, "New Goal");
+            return "{\"action\":\"create_goal\",\"message\":\"I'll create a goal for " + goalName +
+                   "\",\"data\":{\"goalTitle\":\"" + goalName +
+                   "\",\"durationMonths\":3,\"dailyMinutes\":30}}";
+        }
+        case Intent::AddTask: {
+            std::string taskName = extractQuoted(prompt, "New Task");
+            return "{\"action\":\"create_task\",\"message\":\"I'll add the task: " + taskName +
+                   "\",\"data\":{\"taskTitle\":\"" + taskName +
+                   "\",\"dueDate\":\"today\",\"minutes\":30}}";
+        }
+        case Intent::List:
+            return "{\"action\":\"reply\",\"message\":\"Here are your current items. You can ask me to create goals or add tasks!\",\"data\":{}}";
+        case Intent::Help:
+            return "{\"action\":\"reply\",\"message\":\"I can help you manage goals and tasks! Try saying: 'Create a goal to learn Python' or 'Add task review notes tomorrow'\",\"data\":{}}";
+        case Intent::Complete: {
+            std::string taskName = extractQuoted(prompt, "task");
+            return "{\"action\":\"complete_task\",\"message\":\"Great job! I'll mark that as complete.\",\"data\":{\"taskTitle\":\"" + taskName + "\"}}";
+        }
+        case Intent::Delete:
+            return "{\"action\":\"reply\",\"message\":\"To delete an item, please specify exactly which goal or task you want to remove.\",\"data\":{}}";
+        case Intent::Progress:
+            return "{\"action\":\"show_progress\",\"message\":\"Let me show you your progress summary!\",\"data\":{}}";
+        case Intent::Default:
+            break;
+    }
+    // Default conversational reply
+    return "{\"action\":\"reply\",\"message\":\"I'm your local AI assistant running on-device! I can help you create goals, add tasks, and track your progress. What would you like to do?\",\"data\":{}}";
+}
+
+namespace {
+
+std::string formatRatio(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+}
+
+std::string formatTenths(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.1f", value);
+    return buffer;
+}
+
+/**
+ * Speculative decoding section of the model info. drafted/accepted count
+ * guesses from both sources; promptLookup breaks out its share.
+ *
+ * tokensPerPass is the tokens each verifying target pass yields (1.0
+ * without speculation). estimatedSpeedup discounts it by the share of time
+ * spent drafting, taking a verifying pass to cost what a plain one-token
+ * pass would; both are memory-bound on CPU.
+ */
+std::string buildSpeculativeInfo(const SpeculativeStats& stats) {
+    uint64_t drafted = stats.drafted.load(std::memory_order_relaxed);
+    uint64_t accepted = stats.accepted.load(std::memory_order_relaxed);
+    uint64_t verifications = stats.verifications.load(std::memory_order_relaxed);
+    uint64_t verifiedTokens = stats.verifiedTokens.load(std::memory_order_relaxed);
+    uint64_t draftNanos = stats.draftNanos.load(std::memory_order_relaxed);
+    uint64_t targetNanos = stats.targetNanos.load(std::memory_order_relaxed);
+
+    uint64_t lookupDrafted = stats.lookupDrafted.load(std::memory_order_relaxed);
+    uint64_t lookupAccepted = stats.lookupAccepted.load(std::memory_order_relaxed);
+
+    double acceptanceRate = drafted > 0 ? static_cast<double>(accepted) / drafted : 0.0;
+    double lookupAcceptanceRate = lookupDrafted > 0 ? static_cast<double>(lookupAccepted) / lookupDrafted : 0.0;
+    double tokensPerPass = verifications > 0 ? static_cast<double>(verifiedTokens) / verifications : 1.0;
+    double targetShare = draftNanos + targetNanos > 0
+            ? static_cast<double>(targetNanos) / (draftNanos + targetNanos) : 1.0;
+
+    return "{\"draftTokens\":" + std::to_string(stats.draftTokens.load(std::memory_order_relaxed)) +
+           ",\"drafted\":" + std::to_string(drafted) +
+           ",\"accepted\":" + std::to_string(accepted) +
+           ",\"acceptanceRate\":" + formatRatio(acceptanceRate) +
+           ",\"tokensPerPass\":" + formatRatio(tokensPerPass) +
+           ",\"draftMicros\":" + std::to_string(draftNanos / 1000) +
+           ",\"targetMicros\":" + std::to_string(targetNanos / 1000) +
+           ",\"estimatedSpeedup\":" + formatRatio(tokensPerPass * targetShare) +
+           ",\"promptLookup\":{\"draftTokens\":" +
+           std::to_string(stats.lookupTokens.load(std::memory_order_relaxed)) +
+           ",\"drafted\":" + std::to_string(lookupDrafted) +
+           ",\"accepted\":" + std::to_string(lookupAccepted) +
+           ",\"acceptanceRate\":" + formatRatio(lookupAcceptanceRate) + "}}";
+}
+
+/**
+ * Response cache section of the model info; the cache is process-wide, so
+ * every handle reports the same numbers
+ */
+std::string buildResponseCacheInfo(const ResponseCacheStats& stats) {
+    uint64_t lookups = stats.hits + stats.misses;
+    double hitRatio = lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0;
+    return "{\"entries\":" + std::to_string(stats.entries) +
+           ",\"bytes\":" + std::to_string(stats.bytes) +
+           ",\"capacityBytes\":" + std::to_string(stats.capacityBytes) +
+           ",\"hits\":" + std::to_string(stats.hits) +
+           ",\"misses\":" + std::to_string(stats.misses) +
+           ",\"hitRatio\":" + formatRatio(hitRatio) +
+           ",\"invalidated\":" + std::to_string(stats.invalidated) +
+           ",\"evicted\":" + std::to_string(stats.evicted) + "}";
+}
+
+/**
+ * Template token section of the model info (process-wide, like the
+ * response cache)
+ */
+std::string buildTemplateTokensInfo(const TemplateTokenStats& stats) {
+    return "{\"templates\":" + std::to_string(stats.templates) +
+           ",\"prompts\":" + std::to_string(stats.prompts) +
+           ",\"templated\":" + std::to_string(stats.templated) +
+           ",\"cachedTokens\":" + std::to_string(stats.cachedTokens) +
+           ",\"tokenizedBytes\":" + std::to_string(stats.tokenizedBytes) + "}";
+}
+
+/**
+ * Span cache section of the model info (process-wide)
+ */
+std::string buildTokenSpansInfo(const TokenSpanStats& stats) {
+    return "{\"entries\":" + std::to_string(stats.entries) +
+           ",\"hits\":" + std::to_string(stats.hits) +
+           ",\"misses\":" + std::to_string(stats.misses) +
+           ",\"evicted\":" + std::to_string(stats.evicted) + "}";
+}
+
+/**
+ * Scheduler section of the model info. Step times are the cadence of
+ * back-to-back decode-only passes; jitterMicros (p99 - p50) is how much
+ * later the occasional token arrives than the typical one, which the
+ * thread placement is meant to keep small.
+ */
+std::string buildSchedulerInfo(const ModelContext& ctx) {
+    const SchedulerStats& scheduler = ctx.schedulerStats;
+    double p50 = scheduler.stepQuantileMicros(0.50);
+    double p99 = scheduler.stepQuantileMicros(0.99);
+    return "{\"batches\":" + std::to_string(scheduler.batches.load(std::memory_order_relaxed)) +
+           ",\"batchTokens\":" + std::to_string(scheduler.batchTokens.load(std::memory_order_relaxed)) +
+           ",\"peakActive\":" + std::to_string(scheduler.peakActive.load(std::memory_order_relaxed)) +
+           ",\"decodeSteps\":" + std::to_string(scheduler.decodeSteps.load(std::memory_order_relaxed)) +
+           ",\"stepP50Micros\":" + formatTenths(p50) +
+           ",\"stepP99Micros\":" + formatTenths(p99) +
+           ",\"jitterMicros\":" + formatTenths(p99 - p50) +
+           ",\"placement\":{\"cpus\":\"" + formatCpuSet(ctx.placement.cpus) +
+           "\",\"priority\":\"" + threadPriorityName(ctx.placement.priority) +
+           "\",\"applied\":" + (ctx.placementApplied.load(std::memory_order_relaxed) ? "true" : "false") +
+           "}}";
+}
+
+/**
+ * Autotune section of the model info: where threads and batchSize came
+ * from and the probe throughput they were picked by
+ */
+std::string buildAutotuneInfo(const ModelContext& ctx) {
+    return "{\"source\":\"" + std::string(tuneSourceName(ctx.tuneSource)) +
+           "\",\"threads\":" + std::to_string(ctx.numThreads) +
+           ",\"batchSize\":" + std::to_string(ctx.batchSize) +
+           ",\"promptTokensPerSec\":" + formatTenths(ctx.tuning.promptTokensPerSecond) +
+           ",\"decodeTokensPerSec\":" + formatTenths(ctx.tuning.decodeTokensPerSecond) + "}";
+}
+
+/**
+ * Memory section of the model info: the settings chosen for the budget,
+ * their estimated footprint, and the process RSS measured now
+ */
+std::string buildMemoryInfo(const MemoryPlan& plan) {
+    return "{\"budgetBytes\":" + std::to_string(plan.budgetBytes) +
+           ",\"contextSize\":" + std::to_string(plan.contextSize) +
+           ",\"kvType\":\"" + kvCacheTypeName(plan.kvType) +
+           "\",\"batchSize\":" + std::to_string(plan.batchSize) +
+           ",\"degraded\":" + (plan.degraded ? "true" : "false") +
+           ",\"weightsMapped\":" + (plan.weightsMapped ? "true" : "false") +
+           ",\"weightBytes\":" + std::to_string(plan.weightBytes) +
+           ",\"kvBytes\":" + std::to_string(plan.kvBytes) +
+           ",\"computeBytes\":" + std::to_string(plan.computeBytes) +
+           ",\"estimatedBytes\":" + std::to_string(plan.estimatedBytes()) +
+           ",\"budgetedBytes\":" + std::to_string(plan.budgetedBytes()) +
+           ",\"rssBytes\":" + std::to_string(residentBytes()) + "}";
+}
+
+} // namespace
+
+std::string buildModelInfo(const ModelContext& ctx) {
+    const PromptCacheStats& stats = ctx.promptCache;
+    std::shared_ptr<const std::vector<Token>> pinned = std::atomic_load(&ctx.pinnedPrefix);
+    return "{\"status\":\"loaded\",\"path\":\"" + ctx.modelPath +
+           "\",\"backend\":\"" + backend::name() +
+           "\",\"contextSize\":" + std::to_string(ctx.contextSize) +
+           ",\"threads\":" + std::to_string(ctx.numThreads) +
+           ",\"sequences\":" + std::to_string(ctx.sequences.size()) +
+           ",\"weightRefs\":" + std::to_string(ctx.weights.use_count()) +
+           ",\"autotune\":" + buildAutotuneInfo(ctx) +
+           ",\"memory\":" + buildMemoryInfo(ctx.memoryPlan) +
+           ",\"promptCache\":{\"hits\":" + std::to_string(stats.hits.load(std::memory_order_relaxed)) +
+           ",\"misses\":" + std::to_string(stats.misses.load(std::memory_order_relaxed)) +
+           ",\"reusedTokens\":" + std::to_string(stats.reusedTokens.load(std::memory_order_relaxed)) +
+           ",\"evaluatedTokens\":" + std::to_string(stats.evaluatedTokens.load(std::memory_order_relaxed)) +
+           ",\"pinnedTokens\":" + std::to_string(pinned ? pinned->size() : 0) +
+           ",\"truncatedPrompts\":" + std::to_string(stats.truncatedPrompts.load(std::memory_order_relaxed)) +
+           ",\"contextShifts\":" + std::to_string(stats.contextShifts.load(std::memory_order_relaxed)) +
+           ",\"shiftedTokens\":" + std::to_string(stats.shiftedTokens.load(std::memory_order_relaxed)) +
+           "},\"scheduler\":" + buildSchedulerInfo(ctx) +
+           ",\"speculative\":" + buildSpeculativeInfo(ctx.speculative) +
+           ",\"responseCache\":" + buildResponseCacheInfo(responseCache().stats()) +
+           ",\"templateTokens\":" + buildTemplateTokensInfo(templateTokens().stats()) +
+           ",\"tokenSpans\":" + buildTokenSpansInfo(tokenSpans().stats()) +
+           "}";
+}
+
+} // namespace llamacore
@@ -0,0 +1,52 @@
+/**
+ * response_builder.h - JSON response construction for the action schema
+ *
+ * Builds the {"action", "message", "data"} objects that JsonResponseParser
+ * on the Kotlin side expects, plus the canned error replies.
+ */
+
+#ifndef LLAMACORE_RESPONSE_BUILDER_H
+#define LLAMACORE_RESPONSE_BUILDER_H
+
+#include <string>
+#include <string_view>
+
+#include "intent_detector.h"
+
+namespace llamacore {
+
+struct ModelContext;
+
+// Canned replies for error paths
+extern const char* const kResponseModelNotLoaded;
+extern const char* const kResponseNoModel;
+extern const char* const kResponseInvalidPrompt;
+extern const char* const kResponsePromptTooLong;
+extern const char* const kResponseDecodeFailed;
+extern const char* const kResponseCancelled;
+
+/**
+ * Build the stub JSON response for a detected intent
+ *
+ * @param intent Intent detected from the prompt
+ * @param prompt Original (non-lowercased) prompt, used to extract quoted titles
+ * @return JSON action object
+ */
+std::string buildResponse(Intent intent, std::string_view prompt);
+
+/**
+ * Extract the first double-quoted substring of the prompt
+ *
+ * @param prompt Prompt text
+ * @param fallback Value returned when no closed quote pair exists
+ */
+std::string extractQuoted(std::string_view prompt, const char* fallback);
+
+/**
+ * Build the JSON blob returned by nativeGetModelInfo
+ */
+std::string buildModelInfo(const ModelContext& ctx);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_RESPONSE_BUILDER_H
@@ -0,0 +1,162 @@
+/**
+ * response_cache.cpp - Exact-match cache of action replies
+ */
+
+#include "response_cache.h"
+
+#include <iterator>
+
+#include "hash.h"
+
+namespace llamacore {
+
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * Collapse whitespace runs to one space and trim, so prompts that differ
+ * only in line breaks or indentation share an entry
+ */
+std::string normalize(std::string_view prompt) {
+    std::string out;
+    out.reserve(prompt.size());
+    bool pendingSpace = false;
+    for (char c : prompt) {
+        if (isSpace(c)) {
+            pendingSpace = !out.empty();
+            continue;
+        }
+        if (pendingSpace) {
+            out.push_back(' ');
+            pendingSpace = false;
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+/**
+ * Hash of the goal/task context segment PromptTemplates.buildContext
+ * writes ahead of "### Input:", 0 if the prompt has none
+ */
+uint64_t contextHash(std::string_view prompt) {
+    size_t start = prompt.find("\nContext");
+    if (start == std::string_view::npos) {
+        return 0;
+    }
+    size_t end = prompt.find("### Input:", start);
+    if (end == std::string_view::npos) {
+        end = prompt.size();
+    }
+    std::string segment = normalize(prompt.substr(start, end - start));
+    return fnv1a(segment.data(), segment.size());
+}
+
+} // namespace
+
+bool ResponseCache::lookup(uint64_t modelId, uint64_t variant, std::string_view prompt, std::string& out) {
+    std::string normalized = normalize(prompt);
+    uint64_t key = fnv1a(normalized.data(), normalized.size(), modelId ^ variant);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) {
+        return false;
+    }
+    checkContext(modelId, contextHash(prompt));
+
+    auto found = index_.find(key);
+    if (found == index_.end() || found->second->modelId != modelId || found->second->prompt != normalized) {
+        ++stats_.misses;
+        return false;
+    }
+    entries_.splice(entries_.begin(), entries_, found->second);
+    out = found->second->reply;
+    ++stats_.hits;
+    return true;
+}
+
+void ResponseCache::store(uint64_t modelId, uint64_t variant, std::string_view prompt, const std::string& reply) {
+    Entry entry{0, modelId, contextHash(prompt), normalize(prompt), reply};
+    entry.key = fnv1a(entry.prompt.data(), entry.prompt.size(), modelId ^ variant);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entry.bytes() > capacity_) {
+        return;
+    }
+    // Replies generated against a context that has since changed are stale
+    // before they are stored
+    auto current = currentContext_.find(modelId);
+    if (entry.contextHash != 0 && current != currentContext_.end() && current->second != entry.contextHash) {
+        return;
+    }
+
+    auto found = index_.find(entry.key);
+    if (found != index_.end()) {
+        erase(found->second);
+    }
+    evictToFit(capacity_ - entry.bytes());
+    bytes_ += entry.bytes();
+    entries_.push_front(std::move(entry));
+    index_[entries_.front().key] = entries_.begin();
+}
+
+void ResponseCache::setCapacity(size_t capacityBytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacityBytes;
+    evictToFit(capacity_);
+}
+
+ResponseCacheStats ResponseCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ResponseCacheStats stats = stats_;
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    stats.capacityBytes = capacity_;
+    return stats;
+}
+
+void ResponseCache::checkContext(uint64_t modelId, uint64_t hash) {
+    if (hash == 0) {
+        return;
+    }
+    auto current = currentContext_.find(modelId);
+    if (current == currentContext_.end()) {
+        currentContext_.emplace(modelId, hash);
+        return;
+    }
+    if (current->second == hash) {
+        return;
+    }
+    current->second = hash;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto next = std::next(it);
+        if (it->modelId == modelId && it->contextHash != 0 && it->contextHash != hash) {
+            erase(it);
+            ++stats_.invalidated;
+        }
+        it = next;
+    }
+}
+
+void ResponseCache::erase(EntryList::iterator it) {
+    bytes_ -= it->bytes();
+    index_.erase(it->key);
+    entries_.erase(it);
+}
+
+void ResponseCache::evictToFit(size_t capacity) {
+    while (bytes_ > capacity && !entries_.empty()) {
+        erase(std::prev(entries_.end()));
+        ++stats_.evicted;
+    }
+}
+
+ResponseCache& responseCache() {
+    static ResponseCache cache(kResponseCacheBytes);
+    return cache;
+}
+
+} // namespace llamacore
@@ -0,0 +1,107 @@
+/**
+ * response_cache.h - Exact-match cache of action replies
+ *
+ * Users repeat the same requests ("show my progress", "help") and each one
+ * used to cost a full generation. Completed action replies are kept in a
+ * process-wide LRU cache bounded in bytes, keyed by the model and the
+ * prompt after whitespace normalization, so a repeat is answered without
+ * touching the decoder.
+ *
+ * A reply is only valid for the goals and tasks it was generated against.
+ * Each model remembers the context segment ("Context - Goals: ...") of its
+ * latest prompt; when a prompt arrives with a different one, the model's
+ * entries for the old context are dropped.
+ */
+
+#ifndef LLAMACORE_RESPONSE_CACHE_H
+#define LLAMACORE_RESPONSE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace llamacore {
+
+// Default budget: a few hundred prompt/reply pairs of typical size
+constexpr size_t kResponseCacheBytes = 512 * 1024;
+
+struct ResponseCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidated = 0;  // entries dropped because the context changed
+    uint64_t evicted = 0;      // entries dropped to stay within capacity
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacityBytes = 0;
+};
+
+class ResponseCache {
+public:
+    explicit ResponseCache(size_t capacityBytes) : capacity_(capacityBytes) {}
+
+    /**
+     * Look up the reply to a prompt, refreshing its recency
+     *
+     * @param modelId modelIdentity of the model file, so a re-downloaded
+     *        file does not serve replies of the old one
+     * @param variant Hash of settings that change the reply (token budget,
+     *        sampling), mixed into the key
+     * @return true and the reply in out on a hit
+     */
+    bool lookup(uint64_t modelId, uint64_t variant, std::string_view prompt, std::string& out);
+
+    /**
+     * Store a completed reply, evicting least recently used entries to fit
+     */
+    void store(uint64_t modelId, uint64_t variant, std::string_view prompt, const std::string& reply);
+
+    /**
+     * Change the byte budget; 0 disables the cache and drops every entry
+     */
+    void setCapacity(size_t capacityBytes);
+
+    ResponseCacheStats stats() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint64_t modelId;
+        uint64_t contextHash;
+        std::string prompt;  // normalized, to rule out hash collisions
+        std::string reply;
+
+        size_t bytes() const { return sizeof(Entry) + prompt.size() + reply.size(); }
+    };
+
+    using EntryList = std::list<Entry>;
+
+    /**
+     * Drop the model's entries for other contexts if contextHash is not
+     * the one its last prompt had (mutex_ held)
+     */
+    void checkContext(uint64_t modelId, uint64_t contextHash);
+
+    void erase(EntryList::iterator it);
+    void evictToFit(size_t capacity);
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    size_t bytes_ = 0;
+    EntryList entries_;  // most recently used first
+    std::unordered_map<uint64_t, EntryList::iterator> index_;
+    std::unordered_map<uint64_t, uint64_t> currentContext_;  // per model
+    ResponseCacheStats stats_;
+};
+
+/**
+ * Process-wide cache used by generateAction
+ */
+ResponseCache& responseCache();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_RESPONSE_CACHE_H
@@ -0,0 +1,264 @@
+/**
+ * session_snapshot.cpp - On-disk KV snapshot of the static prompt prefix
+ *
+ * File layout (native byte order, the file never leaves the device):
+ *
+ *   SnapshotHeader
+ *   Token[tokenCount]   prefix tokens, i.e. the cache contents
+ *   uint8_t[stateSize]  backend::saveState output
+ */
+
+#include "session_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "backend.h"
+#include "hash.h"
+#include "model_context.h"
+#include "native_log.h"
+#include "template_tokens.h"
+
+namespace llamacore {
+
+namespace {
+
+constexpr char kMagic[8] = {'L', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t kFormatVersion = 1;
+
+// Bytes hashed from each end of the model file
+constexpr size_t kFingerprintBytes = 1 << 20;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tokenCount;
+    uint64_t modelKey;
+    uint64_t templateKey;
+    uint64_t stateSize;
+};
+
+/**
+ * Fingerprint of a model file: its size plus a hash of the first and last
+ * megabyte. GGUF keeps metadata and the vocabulary at the head and tensor
+ * data behind it, so a different model or quantization changes the key
+ * without reading a whole 1 GB file on every launch.
+ */
+bool modelFingerprint(const std::string& path, uint64_t& key) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    uint64_t size = ok ? static_cast<uint64_t>(st.st_size) : 0;
+    uint64_t hash = fnv1a(&size, sizeof(size));
+    hash = fnv1a(backend::name(), std::strlen(backend::name()), hash);
+
+    std::vector<uint8_t> buffer(kFingerprintBytes);
+    off_t offsets[2] = {0, static_cast<off_t>(size > kFingerprintBytes ? size - kFingerprintBytes : 0)};
+    for (off_t offset : offsets) {
+        if (!ok) {
+            break;
+        }
+        ssize_t length = pread(fd, buffer.data(), buffer.size(), offset);
+        ok = length >= 0;
+        if (ok) {
+            hash = fnv1a(buffer.data(), static_cast<size_t>(length), hash);
+        }
+    }
+
+    close(fd);
+    key = hash;
+    return ok;
+}
+
+/**
+ * Read-only mapping of a whole file
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const uint8_t*>(data);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * Restore the KV state from a snapshot whose keys match
+ *
+ * @return false if the file is missing, stale, corrupt or rejected
+ */
+bool restoreSnapshot(ModelContext& ctx, const std::string& path,
+                     uint64_t modelKey, uint64_t templateKey) {
+    MappedFile file(path);
+    if (file.data() == nullptr || file.size() < sizeof(SnapshotHeader)) {
+        return false;
+    }
+
+    SnapshotHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kFormatVersion) {
+        LOGI("Snapshot %s has an unknown format", path.c_str());
+        return false;
+    }
+    if (header.modelKey != modelKey || header.templateKey != templateKey) {
+        LOGI("Snapshot %s is stale (model or template changed)", path.c_str());
+        return false;
+    }
+
+    size_t tokensBytes = static_cast<size_t>(header.tokenCount) * sizeof(Token);
+    if (header.tokenCount == 0 || static_cast<int>(header.tokenCount) >= ctx.contextSize ||
+        file.size() != sizeof(header) + tokensBytes + header.stateSize) {
+        LOGE("Snapshot %s is truncated or does not fit the context", path.c_str());
+        return false;
+    }
+
+    const uint8_t* tokens = file.data() + sizeof(header);
+    if (!backend::loadState(ctx.backendContext, tokens + tokensBytes, header.stateSize)) {
+        LOGE("Backend rejected snapshot %s", path.c_str());
+        ctx.sequences[0].cachedTokens.clear();
+        return false;
+    }
+
+    std::vector<Token>& cached = ctx.sequences[0].cachedTokens;
+    cached.resize(header.tokenCount);
+    std::memcpy(cached.data(), tokens, tokensBytes);
+    return true;
+}
+
+/**
+ * Write the current KV state as a snapshot, atomically replacing any old one
+ */
+bool writeSnapshot(ModelContext& ctx, const std::string& path,
+                   uint64_t modelKey, uint64_t templateKey) {
+    const std::vector<Token>& cached = ctx.sequences[0].cachedTokens;
+    std::vector<uint8_t> state(backend::stateSize(ctx.backendContext));
+    size_t stateSize = backend::saveState(ctx.backendContext, state.data(), state.size());
+    if (stateSize == 0) {
+        return false;
+    }
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFormatVersion;
+    header.tokenCount = static_cast<uint32_t>(cached.size());
+    header.modelKey = modelKey;
+    header.templateKey = templateKey;
+    header.stateSize = stateSize;
+
+    // Readers only ever see a complete file: write aside, then rename
+    std::string tempPath = path + ".tmp";
+    FILE* out = std::fopen(tempPath.c_str(), "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+              std::fwrite(cached.data(), sizeof(Token), cached.size(), out) == cached.size() &&
+              std::fwrite(state.data(), 1, stateSize, out) == stateSize;
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+const char* snapshotResultName(SnapshotResult result) {
+    switch (result) {
+        case SnapshotResult::Restored: return "restored";
+        case SnapshotResult::Rebuilt: return "rebuilt";
+        case SnapshotResult::Evaluated: return "evaluated";
+        case SnapshotResult::Failed: return "failed";
+    }
+    return "failed";
+}
+
+std::string snapshotPath(const std::string& directory, const std::string& modelPath) {
+    size_t slash = modelPath.find_last_of('/');
+    std::string name = slash == std::string::npos ? modelPath : modelPath.substr(slash + 1);
+    return directory + "/" + name + ".session";
+}
+
+SnapshotResult warmStartPrefix(ModelContext& ctx, const std::string& directory,
+                               std::string_view prefix) {
+    // The snapshot lives in sequence 0, which a generation may be using
+    SequenceState& sequence = ctx.sequences[0];
+    if (sequence.busy) {
+        LOGI("Sequence 0 busy, skipping prefix warm start");
+        return SnapshotResult::Failed;
+    }
+
+    std::string path = snapshotPath(directory, ctx.modelPath);
+    KvCacheType kvType = ctx.memoryPlan.kvType;
+    uint64_t templateKey = fnv1a(&kvType, sizeof(kvType), fnv1a(prefix.data(), prefix.size()));
+    uint64_t modelKey = 0;
+    bool persistent = modelFingerprint(ctx.modelPath, modelKey);
+    if (!persistent) {
+        LOGE("Cannot fingerprint %s, snapshot disabled", ctx.modelPath.c_str());
+    }
+
+    if (persistent && restoreSnapshot(ctx, path, modelKey, templateKey)) {
+        LOGI("Restored %zu prefix tokens from %s", sequence.cachedTokens.size(), path.c_str());
+        return SnapshotResult::Restored;
+    }
+
+    // Missing or stale: evaluate the prefix and replace the file
+    std::vector<Token> tokens = templateTokens().tokenize(ctx.vocabKey, ctx.model, prefix);
+    if (tokens.empty() || static_cast<int>(tokens.size()) >= ctx.contextSize) {
+        return SnapshotResult::Failed;
+    }
+    sequence.cachedTokens.clear();
+    backend::truncateCache(ctx.backendContext, 0);
+    if (!backend::decode(ctx.backendContext, tokens.data(), static_cast<int>(tokens.size()), 0, false)) {
+        backend::truncateCache(ctx.backendContext, 0);
+        return SnapshotResult::Failed;
+    }
+    sequence.cachedTokens = std::move(tokens);
+
+    if (persistent && writeSnapshot(ctx, path, modelKey, templateKey)) {
+        LOGI("Wrote %zu prefix tokens to %s", sequence.cachedTokens.size(), path.c_str());
+        return SnapshotResult::Rebuilt;
+    }
+    std::remove(path.c_str());
+    return SnapshotResult::Evaluated;
+}
+
+} // namespace llamacore
@@ -0,0 +1,54 @@
+/**
+ * session_snapshot.h - On-disk KV snapshot of the static prompt prefix
+ *
+ * Every assistant prompt starts with the same instruction block, which
+ * evaluates to the same KV state on every launch. The first evaluation is
+ * written to a file next to the model; later loads map that file and
+ * restore the state instead of running the prefix through the model again.
+ *
+ * A snapshot is keyed by a fingerprint of the model file and a hash of the
+ * prefix text and the KV cache type, as the saved state only restores into
+ * a cache of the same type. When any of them changes the file is discarded
+ * and rebuilt.
+ */
+
+#ifndef LLAMACORE_SESSION_SNAPSHOT_H
+#define LLAMACORE_SESSION_SNAPSHOT_H
+
+#include <string>
+#include <string_view>
+
+namespace llamacore {
+
+struct ModelContext;
+
+enum class SnapshotResult {
+    Restored,   // KV state mapped back from the snapshot file
+    Rebuilt,    // no valid snapshot: prefix evaluated and written
+    Evaluated,  // prefix evaluated, but no snapshot could be written
+    Failed,     // prefix could not be evaluated
+};
+
+const char* snapshotResultName(SnapshotResult result);
+
+/**
+ * Snapshot file used for a model inside a directory
+ */
+std::string snapshotPath(const std::string& directory, const std::string& modelPath);
+
+/**
+ * Bring the prefix into the context's KV cache, from the snapshot if it is
+ * still valid. Generations whose prompt starts with the prefix then only
+ * evaluate the rest (see the prefix reuse in inference_engine.cpp).
+ *
+ * The caller must hold ctx.mutex.
+ *
+ * @param directory Where snapshots live (ModelManager.getModelsDirectory)
+ * @param prefix Static prompt head, e.g. PromptTemplates.SIMPLE_PROMPT_PREFIX
+ */
+SnapshotResult warmStartPrefix(ModelContext& ctx, const std::string& directory,
+                               std::string_view prefix);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_SESSION_SNAPSHOT_H
@@ -0,0 +1,370 @@
+/**
+ * template_tokens.cpp - Token cache of the static prompt templates
+ *
+ * Token file layout (little-endian, as on every Android ABI):
+ *
+ *   TokenFileHeader
+ *   per template:
+ *     TokenFileEntry
+ *     char[textBytes]        template text
+ *     Token[tokenCount]      its tokens
+ *     Token[cutTokenCount]   tokens of its cut part
+ */
+
+#include "template_tokens.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "hash.h"
+#include "native_log.h"
+
+namespace llamacore {
+
+namespace {
+
+constexpr char kMagic[8] = {'L', 'C', 'T', 'O', 'K', 'S', '\0', '\0'};
+// 2: tails no longer carry a SentencePiece space prefix
+// 3: cut parts
+constexpr uint32_t kFormatVersion = 3;
+
+// Covers what the prompts contain: JSON punctuation, markdown headers,
+// digits and dates, and multi-byte characters
+constexpr char kVocabProbe[] =
+    "### Input:\nAdd task 'Buy groceries' to goal #12 - due 2024-05-01\n\n"
+    "{\"action\": \"create_goal\", \"data\": {\"title\": \"Learn Spanish\", \"progress\": 0.75}}\n"
+    "<|im_start|>assistant [INST] </s> caf\xC3\xA9 \xE2\x9C\x93 \xE4\xB8\xAD\xE6\x96\x87 \xF0\x9F\x8E\xAF";
+
+struct TokenFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t vocabKey;
+};
+
+struct TokenFileEntry {
+    uint64_t textHash;
+    uint32_t textBytes;
+    uint32_t tokenCount;
+    uint32_t head;
+    uint32_t cutBytes;
+    uint32_t cutTokenCount;
+    uint32_t reserved;
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool endsWith(std::string_view text, std::string_view suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+bool TemplateTokens::add(uint64_t vocab, BackendModel* model, std::string_view text, bool head) {
+    if (text.empty()) {
+        return false;
+    }
+    uint64_t hash = fnv1a(text.data(), text.size());
+    if (std::shared_ptr<const TemplateSet> set = find(vocab)) {
+        for (const Template& entry : *set) {
+            if (entry.hash == hash && entry.head == head && entry.text == text) {
+                return true;
+            }
+        }
+    }
+
+    // Tokenize outside the lock; a concurrent add of the same text only
+    // replaces the entry with identical tokens
+    Template entry = make(model, text, head);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return insert(vocab, std::move(entry));
+}
+
+TemplateTokens::Template TemplateTokens::make(BackendModel* model, std::string_view text, bool head) {
+    Template entry{fnv1a(text.data(), text.size()), std::string(text), head,
+                   head ? backend::tokenize(model, text, true) : tokenizeAfterLineBreak(model, text)};
+    if (head) {
+        for (size_t pos = text.size() - 1; pos > 0 && entry.cut == 0; --pos) {
+            if (isTokenBoundary(text, pos)) {
+                entry.cut = pos;
+                entry.cutTokens = backend::tokenize(model, text.substr(0, pos), true);
+            }
+        }
+    } else {
+        for (size_t pos = 1; pos < text.size() && entry.cut == 0; ++pos) {
+            if (isTokenBoundary(text, pos)) {
+                entry.cut = pos;
+                entry.cutTokens = tokenizeAfterLineBreak(model, text.substr(pos));
+            }
+        }
+    }
+    return entry;
+}
+
+std::vector<Token> TemplateTokens::tokenize(uint64_t vocab, BackendModel* model, std::string_view prompt) {
+    prompts_.fetch_add(1, std::memory_order_relaxed);
+
+    // Longest head the prompt starts with, then the longest tail it ends
+    // with that does not overlap the head
+    const Template* head = nullptr;
+    const Template* tail = nullptr;
+    std::shared_ptr<const TemplateSet> set = find(vocab);
+    if (set) {
+        for (const Template& entry : *set) {
+            if (entry.head && startsWith(prompt, entry.text) &&
+                (head == nullptr || entry.text.size() > head->text.size())) {
+                head = &entry;
+            }
+        }
+        size_t room = prompt.size() - (head ? head->text.size() : 0);
+        for (const Template& entry : *set) {
+            if (!entry.head && entry.text.size() <= room && endsWith(prompt, entry.text) &&
+                (tail == nullptr || entry.text.size() > tail->text.size())) {
+                tail = &entry;
+            }
+        }
+    }
+
+    // Cut at the template's edge where that is a token boundary, else at
+    // its cut, else not at all
+    size_t begin = 0;
+    const std::vector<Token>* headTokens = nullptr;
+    if (head && (head->text.size() == prompt.size() || isTokenBoundary(prompt, head->text.size()))) {
+        begin = head->text.size();
+        headTokens = &head->tokens;
+    } else if (head && head->cut > 0) {
+        begin = head->cut;
+        headTokens = &head->cutTokens;
+    }
+    size_t end = prompt.size();
+    const std::vector<Token>* tailTokens = nullptr;
+    if (tail) {
+        size_t start = prompt.size() - tail->text.size();
+        if (isTokenBoundary(prompt, start) && start >= begin) {
+            end = start;
+            tailTokens = &tail->tokens;
+        } else if (tail->cut > 0 && start + tail->cut >= begin) {
+            end = start + tail->cut;
+            tailTokens = &tail->cutTokens;
+        }
+        // The first piece carries BOS, which tail tokens do not
+        if (end == 0) {
+            end = prompt.size();
+            tailTokens = nullptr;
+        }
+    }
+
+    if (headTokens == nullptr && tailTokens == nullptr) {
+        tokenizedBytes_.fetch_add(prompt.size(), std::memory_order_relaxed);
+        return backend::tokenize(model, prompt, true);
+    }
+
+    std::vector<Token> tokens;
+    if (headTokens) {
+        tokens = *headTokens;
+    }
+    if (end > begin) {
+        // Without a head the middle starts the prompt and carries BOS
+        std::string_view text = prompt.substr(begin, end - begin);
+        std::vector<Token> middle =
+                headTokens ? tokenizeAfterLineBreak(model, text) : backend::tokenize(model, text, true);
+        tokens.insert(tokens.end(), middle.begin(), middle.end());
+    }
+    if (tailTokens) {
+        tokens.insert(tokens.end(), tailTokens->begin(), tailTokens->end());
+    }
+
+    size_t cached = (headTokens ? headTokens->size() : 0) + (tailTokens ? tailTokens->size() : 0);
+    templated_.fetch_add(1, std::memory_order_relaxed);
+    cachedTokens_.fetch_add(cached, std::memory_order_relaxed);
+    tokenizedBytes_.fetch_add(end - begin, std::memory_order_relaxed);
+    return tokens;
+}
+
+bool TemplateTokens::load(const std::string& path, uint64_t vocab) {
+    FILE* in = std::fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        return false;
+    }
+
+    TokenFileHeader header;
+    if (std::fread(&header, sizeof(header), 1, in) != 1 ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kFormatVersion) {
+        LOGI("Token file %s has an unknown format", path.c_str());
+        std::fclose(in);
+        return false;
+    }
+    if (header.vocabKey != vocab) {
+        LOGI("Token file %s is for another vocabulary", path.c_str());
+        std::fclose(in);
+        return false;
+    }
+
+    // Read everything before adding anything, so a corrupt file adds nothing
+    std::vector<Template> entries;
+    bool ok = header.count <= kMaxTemplates;
+    for (uint32_t i = 0; ok && i < header.count; ++i) {
+        TokenFileEntry record;
+        ok = std::fread(&record, sizeof(record), 1, in) == 1 && record.textBytes > 0 &&
+             record.textBytes <= (1u << 20) && record.tokenCount <= record.textBytes + 8 &&
+             record.cutBytes < record.textBytes && record.cutTokenCount <= record.tokenCount + 8;
+        if (!ok) {
+            break;
+        }
+        Template entry{record.textHash, std::string(record.textBytes, '\0'), record.head != 0,
+                       std::vector<Token>(record.tokenCount), record.cutBytes,
+                       std::vector<Token>(record.cutTokenCount)};
+        ok = std::fread(&entry.text[0], 1, record.textBytes, in) == record.textBytes &&
+             std::fread(entry.tokens.data(), sizeof(Token), record.tokenCount, in) == record.tokenCount &&
+             std::fread(entry.cutTokens.data(), sizeof(Token), record.cutTokenCount, in) == record.cutTokenCount &&
+             fnv1a(entry.text.data(), entry.text.size()) == record.textHash &&
+             (entry.cut == 0 ? entry.cutTokens.empty() : isTokenBoundary(entry.text, entry.cut));
+        entries.push_back(std::move(entry));
+    }
+    ok = ok && std::fgetc(in) == EOF;
+    std::fclose(in);
+    if (!ok) {
+        LOGE("Token file %s is truncated or corrupt", path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Template& entry : entries) {
+        if (!insert(vocab, std::move(entry))) {
+            return false;
+        }
+    }
+    LOGI("Loaded %zu template(s) from %s", entries.size(), path.c_str());
+    return true;
+}
+
+bool TemplateTokens::save(const std::string& path, uint64_t vocab) const {
+    std::shared_ptr<const TemplateSet> set = find(vocab);
+    if (!set || set->empty()) {
+        return false;
+    }
+
+    TokenFileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFormatVersion;
+    header.count = static_cast<uint32_t>(set->size());
+    header.vocabKey = vocab;
+
+    // Readers only ever see a complete file: write aside, then rename
+    std::string tempPath = path + ".tmp";
+    FILE* out = std::fopen(tempPath.c_str(), "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+    for (const Template& entry : *set) {
+        TokenFileEntry record{entry.hash,
+                              static_cast<uint32_t>(entry.text.size()),
+                              static_cast<uint32_t>(entry.tokens.size()),
+                              entry.head ? 1u : 0u,
+                              static_cast<uint32_t>(entry.cut),
+                              static_cast<uint32_t>(entry.cutTokens.size()),
+                              0};
+        ok = ok && std::fwrite(&record, sizeof(record), 1, out) == 1 &&
+             std::fwrite(entry.text.data(), 1, entry.text.size(), out) == entry.text.size() &&
+             std::fwrite(entry.tokens.data(), sizeof(Token), entry.tokens.size(), out) == entry.tokens.size() &&
+             std::fwrite(entry.cutTokens.data(), sizeof(Token), entry.cutTokens.size(), out) ==
+                     entry.cutTokens.size();
+    }
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void TemplateTokens::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sets_.clear();
+}
+
+TemplateTokenStats TemplateTokens::stats() const {
+    TemplateTokenStats stats;
+    stats.prompts = prompts_.load(std::memory_order_relaxed);
+    stats.templated = templated_.load(std::memory_order_relaxed);
+    stats.cachedTokens = cachedTokens_.load(std::memory_order_relaxed);
+    stats.tokenizedBytes = tokenizedBytes_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& set : sets_) {
+        stats.templates += set.second->size();
+    }
+    return stats;
+}
+
+std::shared_ptr<const TemplateTokens::TemplateSet> TemplateTokens::find(uint64_t vocab) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = sets_.find(vocab);
+    return found == sets_.end() ? nullptr : found->second;
+}
+
+bool TemplateTokens::insert(uint64_t vocab, Template entry) {
+    std::shared_ptr<const TemplateSet>& current = sets_[vocab];
+    auto next = std::make_shared<TemplateSet>();
+    if (current) {
+        *next = *current;
+    }
+    for (Template& existing : *next) {
+        if (existing.hash == entry.hash && existing.head == entry.head && existing.text == entry.text) {
+            existing = std::move(entry);
+            current = std::move(next);
+            return true;
+        }
+    }
+    if (next->size() >= kMaxTemplates) {
+        LOGE("Template limit of %zu reached", kMaxTemplates);
+        return false;
+    }
+    next->push_back(std::move(entry));
+    current = std::move(next);
+    return true;
+}
+
+bool isTokenBoundary(std::string_view text, size_t pos) {
+    return pos > 0 && pos < text.size() && text[pos - 1] == '\n' && !isSpace(text[pos]);
+}
+
+std::vector<Token> tokenizeAfterLineBreak(BackendModel* model, std::string_view text, bool parseSpecial) {
+    std::vector<Token> lineBreak = backend::tokenize(model, "\n", false);
+    std::string behind;
+    behind.reserve(text.size() + 1);
+    behind += '\n';
+    behind += text;
+    std::vector<Token> tokens = backend::tokenize(model, behind, false, parseSpecial);
+    if (tokens.size() < lineBreak.size() || !std::equal(lineBreak.begin(), lineBreak.end(), tokens.begin())) {
+        return backend::tokenize(model, text, false, parseSpecial);
+    }
+    tokens.erase(tokens.begin(), tokens.begin() + lineBreak.size());
+    return tokens;
+}
+
+uint64_t vocabularyKey(BackendModel* model) {
+    uint64_t hash = fnv1a(backend::name(), std::strlen(backend::name()));
+    int vocabSize = backend::modelShape(model).vocabSize;
+    hash = fnv1a(&vocabSize, sizeof(vocabSize), hash);
+    std::vector<Token> probe = backend::tokenize(model, kVocabProbe, true);
+    return fnv1a(probe.data(), probe.size() * sizeof(Token), hash);
+}
+
+std::string templateTokensPath(const std::string& modelPath) {
+    return modelPath + ".tokens";
+}
+
+TemplateTokens& templateTokens() {
+    static TemplateTokens cache;
+    return cache;
+}
+
+} // namespace llamacore
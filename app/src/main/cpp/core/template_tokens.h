@@ -0,0 +1,168 @@
+/**
+ * template_tokens.h - Token cache of the static prompt templates
+ *
+ * Every assistant prompt is a fixed head (the instruction block, or a
+ * whole few-shot example), the goal/task context and user message, and a
+ * fixed tail ("### Response (JSON only):"). Tokenizing the full string per
+ * request spends most of the time on text whose tokens never change.
+ * Registered templates are tokenized once per vocabulary; a prompt that
+ * starts with a registered head or ends with a registered tail reuses
+ * their tokens, and only the text between them goes through the tokenizer.
+ *
+ * The result must equal the tokens of the whole prompt, or the model sees
+ * a different prompt than on the string path. So a prompt is only cut at
+ * token boundaries (isTokenBoundary): right after a line break, before
+ * text that is not whitespace. No pre-tokenizer merges across those, but
+ * a run of line breaks is one token on a BPE vocabulary, so a head ending
+ * in "\n" is cut from a middle starting with "\n" at the head's own last
+ * boundary instead, and a tail starting with "\n\n" is used from its first
+ * boundary on. Every piece after the head is tokenized as it appears behind
+ * a line break (tokenizeAfterLineBreak), without the "▁" a SentencePiece
+ * vocabulary puts in front of each tokenize call.
+ *
+ * Tokens can be precompiled into a file shipped next to the model
+ * (templateTokensPath); initModel loads it when its vocabulary key matches
+ * the model's.
+ */
+
+#ifndef LLAMACORE_TEMPLATE_TOKENS_H
+#define LLAMACORE_TEMPLATE_TOKENS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "backend.h"
+
+namespace llamacore {
+
+// Templates kept per vocabulary; the app registers about a dozen
+constexpr size_t kMaxTemplates = 64;
+
+struct TemplateTokenStats {
+    uint64_t prompts = 0;         // prompts tokenized
+    uint64_t templated = 0;       // ... that matched a head or a tail
+    uint64_t cachedTokens = 0;    // tokens taken from templates
+    uint64_t tokenizedBytes = 0;  // prompt bytes that went through the tokenizer
+    size_t templates = 0;         // over all vocabularies
+};
+
+class TemplateTokens {
+public:
+    /**
+     * Tokenize a template for a vocabulary, unless it is already known
+     *
+     * @param head true for prompt heads (tokenized with BOS), false for
+     *        tails
+     * @return false if text is empty or the vocabulary has kMaxTemplates
+     */
+    bool add(uint64_t vocab, BackendModel* model, std::string_view text, bool head);
+
+    /**
+     * Tokens of a whole prompt, as backend::tokenize(model, prompt, true)
+     * with template pieces taken from the cache
+     */
+    std::vector<Token> tokenize(uint64_t vocab, BackendModel* model, std::string_view prompt);
+
+    /**
+     * Add the templates of a token file written by save for this vocabulary
+     *
+     * @return false if the file is missing, for another vocabulary or corrupt
+     */
+    bool load(const std::string& path, uint64_t vocab);
+
+    /**
+     * Write the vocabulary's templates to a token file, atomically
+     * replacing any old one
+     */
+    bool save(const std::string& path, uint64_t vocab) const;
+
+    /**
+     * Forget every template
+     */
+    void clear();
+
+    TemplateTokenStats stats() const;
+
+private:
+    struct Template {
+        uint64_t hash;  // of text
+        std::string text;
+        bool head;
+        std::vector<Token> tokens;
+
+        // The part usable when the prompt is not cut right at the
+        // template's edge: text[0, cut) of a head, text[cut, end) of a
+        // tail, cut being its last (head) or first (tail) token boundary;
+        // 0 if it has none
+        size_t cut = 0;
+        std::vector<Token> cutTokens;
+    };
+
+    /**
+     * Tokens of a template and of its cut part
+     */
+    static Template make(BackendModel* model, std::string_view text, bool head);
+
+    // Replaced whole on every change, so tokenize reads without the lock
+    using TemplateSet = std::vector<Template>;
+
+    std::shared_ptr<const TemplateSet> find(uint64_t vocab) const;
+
+    /**
+     * Add or replace a template (mutex_ held)
+     *
+     * @return false if the vocabulary has kMaxTemplates
+     */
+    bool insert(uint64_t vocab, Template entry);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, std::shared_ptr<const TemplateSet>> sets_;
+
+    std::atomic<uint64_t> prompts_{0};
+    std::atomic<uint64_t> templated_{0};
+    std::atomic<uint64_t> cachedTokens_{0};
+    std::atomic<uint64_t> tokenizedBytes_{0};
+};
+
+/**
+ * True if tokenizing text[0, pos) and text[pos, end) apart gives the
+ * tokens of the whole: pos follows a line break and precedes text that is
+ * not whitespace
+ */
+bool isTokenBoundary(std::string_view text, size_t pos);
+
+/**
+ * Tokens of text as it appears in a longer prompt at a token boundary:
+ * no BOS, and no SentencePiece space prefix. The text is tokenized behind
+ * a line break whose tokens are then dropped; should the break merge with
+ * the text anyway, the text is tokenized alone.
+ *
+ * @param parseSpecial As for backend::tokenize
+ */
+std::vector<Token> tokenizeAfterLineBreak(BackendModel* model, std::string_view text, bool parseSpecial = true);
+
+/**
+ * Key of a model's tokenizer: the backend, the vocabulary size and the
+ * tokens of a probe text. Models that tokenize alike share templates.
+ */
+uint64_t vocabularyKey(BackendModel* model);
+
+/**
+ * Token file shipped next to a model
+ */
+std::string templateTokensPath(const std::string& modelPath);
+
+/**
+ * Process-wide cache used by every generation
+ */
+TemplateTokens& templateTokens();
+
+} // namespace llamacore
+
+#endif // LLAMACORE_TEMPLATE_TOKENS_H
@@ -0,0 +1,245 @@
+/**
+ * thread_placement.cpp - CPU affinity and priority of inference threads
+ */
+
+#include "thread_placement.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "native_log.h"
+
+namespace llamacore {
+
+namespace {
+
+constexpr std::string_view kPerformanceSet = "performance";
+constexpr const char* kCpuSysfsRoot = "/sys/devices/system/cpu";
+
+// CPU_SETSIZE; also bounds the ranges a CPU set may expand to
+constexpr long kMaxCpus = 1024;
+
+int onlineCpuCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * cpuinfo_max_freq of a core in kHz, 0 if unknown
+ */
+long maxFrequency(const std::string& root, int cpu) {
+    std::string path = root + "/cpu" + std::to_string(cpu) + "/cpufreq/cpuinfo_max_freq";
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    long frequency = 0;
+    if (std::fscanf(file, "%ld", &frequency) != 1) {
+        frequency = 0;
+    }
+    std::fclose(file);
+    return frequency;
+}
+
+} // namespace
+
+std::vector<long> cpuMaxFrequencies(const std::string& root, int count) {
+    std::vector<long> frequencies(static_cast<size_t>(std::max(count, 0)));
+    for (int cpu = 0; cpu < count; ++cpu) {
+        frequencies[cpu] = maxFrequency(root, cpu);
+    }
+    return frequencies;
+}
+
+std::vector<long> cpuMaxFrequencies() {
+    return cpuMaxFrequencies(kCpuSysfsRoot, onlineCpuCount());
+}
+
+std::vector<int> parseCpuSet(std::string_view text, bool* ok) {
+    if (text == kPerformanceSet) {
+        return parseCpuSet(text, cpuMaxFrequencies(), ok);
+    }
+    return parseCpuSet(text, {}, ok);
+}
+
+std::vector<int> parseCpuSet(std::string_view text, const std::vector<long>& frequencies, bool* ok) {
+    if (ok != nullptr) {
+        *ok = true;
+    }
+    if (text == kPerformanceSet) {
+        return performanceCores(frequencies);
+    }
+
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        std::string item(text.substr(pos, end - pos));
+        const char* cursor = item.c_str();
+        char* stop = nullptr;
+        long first = std::strtol(cursor, &stop, 10);
+        bool valid = stop != cursor;
+        long last = first;
+        if (valid && *stop == '-') {
+            cursor = stop + 1;
+            last = std::strtol(cursor, &stop, 10);
+            valid = stop != cursor;
+        }
+        if (!valid || *stop != '\0' || first < 0 || last < first || last >= kMaxCpus) {
+            LOGE("Malformed CPU set: %.*s", static_cast<int>(text.size()), text.data());
+            if (ok != nullptr) {
+                *ok = false;
+            }
+            return {};
+        }
+        for (int cpu = static_cast<int>(first); cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        pos = end + 1;
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::string formatCpuSet(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t run = i;
+        while (run + 1 < cpus.size() && cpus[run + 1] == cpus[run] + 1) {
+            ++run;
+        }
+        if (!text.empty()) {
+            text += ',';
+        }
+        text += std::to_string(cpus[i]);
+        if (run > i) {
+            text += '-' + std::to_string(cpus[run]);
+        }
+        i = run + 1;
+    }
+    return text;
+}
+
+std::vector<int> performanceCores(const std::vector<long>& frequencies) {
+    // Cores whose frequency cannot be read belong to no cluster
+    long fastest = 0;
+    long slowest = 0;
+    for (long frequency : frequencies) {
+        if (frequency > 0) {
+            fastest = std::max(fastest, frequency);
+            slowest = slowest == 0 ? frequency : std::min(slowest, frequency);
+        }
+    }
+    if (fastest == slowest) {
+        return {};
+    }
+
+    std::vector<int> cpus;
+    for (size_t cpu = 0; cpu < frequencies.size(); ++cpu) {
+        if (frequencies[cpu] > slowest) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> performanceCores() {
+    return performanceCores(cpuMaxFrequencies());
+}
+
+int resolveThreadCount(int numThreads, const ThreadPlacement& placement) {
+    return resolveThreadCount(numThreads, placement, cpuMaxFrequencies());
+}
+
+int resolveThreadCount(int numThreads, const ThreadPlacement& placement, const std::vector<long>& frequencies) {
+    int online = std::max(1, static_cast<int>(frequencies.size()));
+    int available = placement.cpus.empty() ? online : static_cast<int>(placement.cpus.size());
+    if (numThreads <= 0) {
+        std::vector<int> fast = placement.cpus.empty() ? performanceCores(frequencies) : placement.cpus;
+        return fast.empty() ? available : static_cast<int>(fast.size());
+    }
+    if (numThreads > available && !placement.cpus.empty()) {
+        // More threads than cores only adds preemption inside each pass
+        LOGI("Clamping %d decode threads to the %d cores of the CPU set", numThreads, available);
+        return available;
+    }
+    return numThreads;
+}
+
+bool applyPlacement(const ThreadPlacement& placement) {
+#ifdef __linux__
+    bool ok = true;
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : placement.cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+            LOGE("Could not pin thread %d to CPUs %s", static_cast<int>(tid), formatCpuSet(placement.cpus).c_str());
+            ok = false;
+        }
+    }
+
+    int nice = 0;
+    switch (placement.priority) {
+        case ThreadPriority::Normal:
+            return ok;
+        case ThreadPriority::Low:
+            nice = 10;
+            break;
+        case ThreadPriority::High:
+            nice = -10;
+            break;
+        case ThreadPriority::Realtime: {
+            sched_param param{};
+            param.sched_priority = 1;
+            if (sched_setscheduler(tid, SCHED_FIFO, &param) == 0) {
+                return ok;
+            }
+            LOGI("SCHED_FIFO not permitted, using high priority");
+            nice = -10;
+            break;
+        }
+    }
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid), nice) != 0) {
+        LOGE("Could not set thread %d to nice %d", static_cast<int>(tid), nice);
+        ok = false;
+    }
+    return ok;
+#else
+    return placement.cpus.empty() && placement.priority == ThreadPriority::Normal;
+#endif
+}
+
+const char* threadPriorityName(ThreadPriority priority) {
+    switch (priority) {
+        case ThreadPriority::Low:
+            return "low";
+        case ThreadPriority::Normal:
+            return "normal";
+        case ThreadPriority::High:
+            return "high";
+        case ThreadPriority::Realtime:
+            return "realtime";
+    }
+    return "unknown";
+}
+
+} // namespace llamacore
@@ -0,0 +1,94 @@
+/**
+ * thread_placement.h - CPU affinity and priority of inference threads
+ *
+ * Decode on a phone is bound by the slowest thread of each pass. On
+ * big.LITTLE SoCs a decode thread the kernel parks on a little core, or
+ * preempts for a background job, stretches the whole step. A
+ * ThreadPlacement names the cores inference may use and the priority it
+ * runs at. The llama.cpp backend gives every context a persistent worker
+ * pool (a ggml threadpool) created with the placement, and the context's
+ * scheduler thread, which drives each pass, applies it to itself.
+ */
+
+#ifndef LLAMACORE_THREAD_PLACEMENT_H
+#define LLAMACORE_THREAD_PLACEMENT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llamacore {
+
+enum class ThreadPriority {
+    Low = 0,       // nice 10: yield to the UI
+    Normal = 1,    // inherit
+    High = 2,      // nice -10
+    Realtime = 3,  // SCHED_FIFO where permitted, else High
+};
+
+struct ThreadPlacement {
+    std::vector<int> cpus;  // cores threads may run on; empty for any
+    ThreadPriority priority = ThreadPriority::Normal;
+};
+
+/**
+ * Maximum frequency of cores 0..count-1 in kHz (cpufreq's
+ * cpuinfo_max_freq under root), 0 where it cannot be read
+ */
+std::vector<long> cpuMaxFrequencies(const std::string& root, int count);
+
+/**
+ * cpuMaxFrequencies of the online cores, from the live sysfs
+ */
+std::vector<long> cpuMaxFrequencies();
+
+/**
+ * Parse a CPU set: "" for any core, "performance" for the performance
+ * cores (performanceCores), or a list such as "0-3,6"
+ *
+ * @param frequencies Per-core maximum frequencies for "performance"
+ * @param ok Set to false if the text is malformed
+ */
+std::vector<int> parseCpuSet(std::string_view text, const std::vector<long>& frequencies, bool* ok = nullptr);
+std::vector<int> parseCpuSet(std::string_view text, bool* ok = nullptr);
+
+/**
+ * Format a CPU set as a compact list ("4-7"), "" for any core
+ */
+std::string formatCpuSet(const std::vector<int>& cpus);
+
+/**
+ * Every core but those of the slowest cluster: the big and prime cores of
+ * a phone SoC, which usually has three clusters (1+3+4, 2+2+4). Keeping
+ * only the fastest cluster would leave one or two cores, fewer decode
+ * threads than the default. Empty if all cores are alike or frequencies
+ * cannot be read.
+ *
+ * @param frequencies Maximum frequency per core, 0 where unknown
+ */
+std::vector<int> performanceCores(const std::vector<long>& frequencies);
+std::vector<int> performanceCores();
+
+/**
+ * Decode threads for a placement: numThreads when positive, otherwise one
+ * per core in the set (or per performance core, or per online core). Never
+ * more threads than cores in the set.
+ *
+ * @param frequencies Maximum frequency of each online core
+ */
+int resolveThreadCount(int numThreads, const ThreadPlacement& placement, const std::vector<long>& frequencies);
+int resolveThreadCount(int numThreads, const ThreadPlacement& placement);
+
+/**
+ * Apply a placement to the calling thread. Failures (no permission for a
+ * priority, cores offline) are logged and leave that setting unchanged.
+ *
+ * @return true if every part of the placement took effect
+ */
+bool applyPlacement(const ThreadPlacement& placement);
+
+const char* threadPriorityName(ThreadPriority priority);
+
+} // namespace llamacore
+
+#endif // LLAMACORE_THREAD_PLACEMENT_H
@@ -1,57 +1,257 @@
 /**
  * llama_jni.cpp - JNI wrapper for llama.cpp on-device inference
- * 
+ *
  * This file provides the native interface between Kotlin/Java and llama.cpp.
- * Currently implements stub functions that return placeholder values until
- * the full llama.cpp library is integrated.
- * 
- * To complete integration:
- * 1. Add llama.cpp as a submodule or place prebuilt libs in jniLibs/
- * 2. Uncomment the llama.cpp includes and linking in CMakeLists.txt
- * 3. Replace stub implementations with actual llama.cpp calls
+ * It is a thin shim: each function converts JNI types and forwards to the
+ * platform-independent llamacore library (core/), which holds the intent
+ * detection, context registry and JSON response construction.
+ *
+ * llamacore runs real llama.cpp inference when the llama.cpp sources are
+ * checked out at app/src/main/cpp/llama_cpp (or LLAMA_CPP_DIR), and falls
+ * back to a stub backend returning canned JSON responses otherwise.
  */
 
 #include <jni.h>
+#include <algorithm>
+#include <cstdint>
 #include <string>
-#include <android/log.h>
-#include <cstdlib>
-#include <ctime>
-#include <unordered_map>
-#include <mutex>
-
-// Logging macros for Android logcat
-#define LOG_TAG "LlamaInference"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-
-// TODO: Uncomment when llama.cpp is integrated
-// #include "llama.h"
-// #include "common.h"
+#include <string_view>
+#include <vector>
+
+#include "json_scan.h"
+#include "llama_core.h"
+#include "native_log.h"
+#include "response_builder.h"
 
 // ============================================================================
-// Model Context Management
+// JNI Helpers
 // ============================================================================
 
-// Simulated model context for stub implementation
-struct ModelContext {
-    std::string modelPath;
-    bool isLoaded;
-    int contextSize;
-    int numThreads;
-    
-    ModelContext(const std::string& path) 
-        : modelPath(path), isLoaded(true), contextSize(2048), numThreads(4) {}
-};
+/**
+ * Copy a Java string into a std::string as standard UTF-8
+ *
+ * GetStringUTFChars yields modified UTF-8, which splits characters outside
+ * the BMP (emoji) into two three-byte surrogates the tokenizer cannot read,
+ * and returns null when out of memory. The UTF-16 units are copied with
+ * GetStringRegion instead, which cannot fail for a valid string, and
+ * converted here; an unpaired surrogate becomes U+FFFD.
+ */
+static std::string toStdString(JNIEnv* env, jstring str) {
+    std::string result;
+    if (str == nullptr) {
+        return result;
+    }
+    jsize length = env->GetStringLength(str);
+    std::vector<jchar> units(static_cast<size_t>(length));
+    env->GetStringRegion(str, 0, length, units.data());
+
+    result.reserve(units.size());
+    for (size_t i = 0; i < units.size(); ++i) {
+        uint32_t code = units[i];
+        if (code >= 0xD800 && code <= 0xDFFF) {
+            if (code <= 0xDBFF && i + 1 < units.size() && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (units[++i] - 0xDC00);
+            } else {
+                code = 0xFFFD;
+            }
+        }
+        if (code < 0x80) {
+            result += static_cast<char>(code);
+        } else if (code < 0x800) {
+            result += static_cast<char>(0xC0 | (code >> 6));
+            result += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            result += static_cast<char>(0xE0 | (code >> 12));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            result += static_cast<char>(0xF0 | (code >> 18));
+            result += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+    return result;
+}
+
+/**
+ * Java string from standard UTF-8 text, such as decoded model output
+ *
+ * NewStringUTF expects modified UTF-8: a four-byte sequence (an emoji) is
+ * invalid input to it, which CheckJNI aborts on and release builds garble.
+ * The text is converted to UTF-16 for NewString instead; bytes that are not
+ * well-formed UTF-8 become U+FFFD, one per byte.
+ */
+static jstring toJavaString(JNIEnv* env, std::string_view text) {
+    std::vector<jchar> units;
+    units.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        auto lead = static_cast<unsigned char>(text[i]);
+        if (lead < 0x80) {
+            units.push_back(lead);
+            ++i;
+            continue;
+        }
+        // Sequence length, smallest code point and lead bits by lead byte
+        size_t length = lead >= 0xC2 && lead <= 0xDF ? 2 : lead >= 0xE0 && lead <= 0xEF ? 3
+                      : lead >= 0xF0 && lead <= 0xF4 ? 4 : 0;
+        uint32_t code = lead & (0x7F >> length);
+        bool ok = length > 0 && text.size() - i >= length;
+        for (size_t k = 1; ok && k < length; ++k) {
+            auto next = static_cast<unsigned char>(text[i + k]);
+            ok = (next & 0xC0) == 0x80;
+            code = (code << 6) | (next & 0x3F);
+        }
+        static constexpr uint32_t kSmallest[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (!ok || code < kSmallest[length] || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+            units.push_back(0xFFFD);
+            ++i;
+            continue;
+        }
+        if (code >= 0x10000) {
+            code -= 0x10000;
+            units.push_back(static_cast<jchar>(0xD800 + (code >> 10)));
+            units.push_back(static_cast<jchar>(0xDC00 + (code & 0x3FF)));
+        } else {
+            units.push_back(static_cast<jchar>(code));
+        }
+        i += length;
+    }
+    return env->NewString(units.data(), static_cast<jsize>(units.size()));
+}
+
+/**
+ * UTF-16 length of modified UTF-8 text (GetStringUTFChars): every UTF-16
+ * unit, surrogates included, is encoded alone with one lead byte
+ */
+static jint utf16Length(const char* bytes, size_t size) {
+    jint units = 0;
+    for (size_t i = 0; i < size; ++i) {
+        units += (static_cast<unsigned char>(bytes[i]) & 0xC0) != 0x80;
+    }
+    return units;
+}
+
+// Resolved once in JNI_OnLoad; method IDs stay valid while the class is loaded
+static JavaVM* g_vm = nullptr;
+static jmethodID g_onTokenMethod = nullptr;
+static jclass g_nativeClass = nullptr;  // global ref to LlamaNative
+static jmethodID g_onGenerateDoneMethod = nullptr;
+
+/**
+ * JNIEnv for the current thread, attaching it to the VM if needed
+ *
+ * Threads attached here stay attached until they exit, so native worker
+ * threads pay the attach cost once rather than per callback.
+ */
+static JNIEnv* currentEnv() {
+    JNIEnv* env = nullptr;
+    if (g_vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_OK) {
+        return env;
+    }
+
+    struct Attachment {
+        JNIEnv* env = nullptr;
+        ~Attachment() {
+            if (env != nullptr) {
+                g_vm->DetachCurrentThread();
+            }
+        }
+    };
+    thread_local Attachment attachment;
+#ifdef __ANDROID__
+    jint status = g_vm->AttachCurrentThread(&attachment.env, nullptr);
+#else
+    // The desktop JDK declares the out parameter as void**
+    jint status = g_vm->AttachCurrentThread(reinterpret_cast<void**>(&attachment.env), nullptr);
+#endif
+    if (status != JNI_OK) {
+        LOGE("Failed to attach thread to the JVM");
+        attachment.env = nullptr;
+    }
+    return attachment.env;
+}
+
+/**
+ * Completion callback of submitted requests: LlamaNative.onGenerateDone on
+ * the native worker thread
+ */
+static llamacore::RequestDone doneCallback() {
+    if (g_onGenerateDoneMethod == nullptr) {
+        return nullptr;
+    }
+    return [](int64_t requestId) {
+        JNIEnv* doneEnv = currentEnv();
+        if (doneEnv == nullptr) {
+            return;
+        }
+        doneEnv->CallStaticVoidMethod(g_nativeClass, g_onGenerateDoneMethod, static_cast<jlong>(requestId));
+        if (doneEnv->ExceptionCheck()) {
+            // Nothing up this stack can handle it; the reply stays pollable
+            doneEnv->ExceptionDescribe();
+            doneEnv->ExceptionClear();
+        }
+    };
+}
+
+/**
+ * View packed goal and task fields (LlamaNative.generateFromContextAsync) as a
+ * PromptContext over the UTF-8 strings they point into
+ *
+ * @param strings UTF-8 bytes, the user message first
+ * @param goals 5 ints per goal: title offset and length, daily minutes,
+ *        end date offset and length
+ * @param tasks 4 ints per task: title offset and length, completed (0/1),
+ *        minutes
+ * @return false if an array is malformed or a string lies outside strings
+ */
+static bool unpackContext(JNIEnv* env, const char* strings, jint length, jint messageLength, jintArray goals,
+                          jintArray tasks, llamacore::PromptContext& context) {
+    auto span = [&](jint offset, jint size, std::string_view& out) {
+        if (offset < 0 || size < 0 || offset > length - size) {
+            return false;
+        }
+        out = std::string_view(strings + offset, static_cast<size_t>(size));
+        return true;
+    };
+    if (!span(0, messageLength, context.userMessage)) {
+        return false;
+    }
 
-// Global context storage with thread-safety
-static std::unordered_map<jlong, ModelContext*> g_contexts;
-static std::mutex g_contexts_mutex;
-static jlong g_next_handle = 1;
+    jsize goalInts = goals != nullptr ? env->GetArrayLength(goals) : 0;
+    jsize taskInts = tasks != nullptr ? env->GetArrayLength(tasks) : 0;
+    if (goalInts % 5 != 0 || taskInts % 4 != 0) {
+        return false;
+    }
+    std::vector<jint> fields(static_cast<size_t>(goalInts + taskInts));
+    if (goalInts > 0) {
+        env->GetIntArrayRegion(goals, 0, goalInts, fields.data());
+    }
+    if (taskInts > 0) {
+        env->GetIntArrayRegion(tasks, 0, taskInts, fields.data() + goalInts);
+    }
 
-// Helper to generate unique handle
-static jlong allocateHandle() {
-    return g_next_handle++;
+    context.goals.resize(static_cast<size_t>(goalInts / 5));
+    for (size_t i = 0; i < context.goals.size(); ++i) {
+        const jint* goal = fields.data() + i * 5;
+        llamacore::GoalItem& item = context.goals[i];
+        item.dailyMinutes = goal[2];
+        if (!span(goal[0], goal[1], item.title) || !span(goal[3], goal[4], item.endDate)) {
+            return false;
+        }
+    }
+    context.tasks.resize(static_cast<size_t>(taskInts / 4));
+    for (size_t i = 0; i < context.tasks.size(); ++i) {
+        const jint* task = fields.data() + goalInts + i * 4;
+        llamacore::TaskItem& item = context.tasks[i];
+        item.completed = task[2] != 0;
+        item.minutes = task[3];
+        if (!span(task[0], task[1], item.title)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // ============================================================================
@@ -60,9 +260,46 @@ static jlong allocateHandle() {
 
 extern "C" {
 
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM* vm, void* reserved) {
+    g_vm = vm;
+
+    JNIEnv* env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+
+    // FindClass must run here, on the app class loader, not on native threads
+    jclass callbackClass = env->FindClass("com/example/todoapp/llm/TokenCallback");
+    if (callbackClass != nullptr) {
+        g_onTokenMethod = env->GetMethodID(callbackClass, "onToken", "(Ljava/lang/String;)V");
+        env->DeleteLocalRef(callbackClass);
+    }
+    if (g_onTokenMethod == nullptr) {
+        // Streaming degrades to returning the full response only
+        env->ExceptionClear();
+        LOGE("TokenCallback.onToken not found, streaming disabled");
+    }
+
+    jclass nativeClass = env->FindClass("com/example/todoapp/llm/LlamaNative");
+    if (nativeClass != nullptr) {
+        g_onGenerateDoneMethod = env->GetStaticMethodID(nativeClass, "onGenerateDone", "(J)V");
+        if (g_onGenerateDoneMethod != nullptr) {
+            g_nativeClass = static_cast<jclass>(env->NewGlobalRef(nativeClass));
+        }
+        env->DeleteLocalRef(nativeClass);
+    }
+    if (g_onGenerateDoneMethod == nullptr) {
+        // Submitted requests can still be polled
+        env->ExceptionClear();
+        LOGE("LlamaNative.onGenerateDone not found, completions must be polled");
+    }
+    return JNI_VERSION_1_6;
+}
+
 /**
  * Initialize a model and return a context handle
- * 
+ *
  * @param env JNI environment
  * @param clazz Java class reference
  * @param modelPath Path to the .gguf model file
@@ -73,42 +310,277 @@ Java_com_example_todoapp_llm_LlamaNative_initModel(
         JNIEnv* env,
         jclass clazz,
         jstring modelPath) {
-    
-    const char* path = env->GetStringUTFChars(modelPath, nullptr);
-    LOGI("LlamaNative.initModel called with path: %s", path);
-    
-    std::string pathStr(path);
-    env->ReleaseStringUTFChars(modelPath, path);
-    
-    // TODO: Replace with actual llama.cpp model loading
-    /*
-    llama_model_params model_params = llama_model_default_params();
-    llama_model* model = llama_load_model_from_file(pathStr.c_str(), model_params);
-    if (model == nullptr) {
-        LOGE("Failed to load model from: %s", pathStr.c_str());
+    return static_cast<jlong>(llamacore::initModel(toStdString(env, modelPath)));
+}
+
+/**
+ * Initialize a model with explicit context length and thread count
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param modelPath Path to the .gguf model file
+ * @param nThreads Decode threads (<= 0 for the default)
+ * @param nCtx Context length in tokens (<= 0 for the default)
+ * @return Context handle (jlong), 0 if failed
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_todoapp_llm_LlamaNative_initModelWithParams(
+        JNIEnv* env,
+        jclass clazz,
+        jstring modelPath,
+        jint nThreads,
+        jint nCtx) {
+    llamacore::ContextParams params;
+    if (nThreads > 0) params.numThreads = nThreads;
+    if (nCtx > 0) params.contextSize = nCtx;
+    return static_cast<jlong>(llamacore::initModel(toStdString(env, modelPath), params));
+}
+
+/**
+ * Initialize a model with every load option: decode thread placement,
+ * thread count and batch size tuning, and a memory budget
+ *
+ * With tuneDir, the first load probes several configurations (a few
+ * seconds) and writes the fastest to a tune file there; later loads read it
+ * back until the model file, CPU, placement or KV cache type changes. With
+ * a memory budget, context length, KV cache precision and batch size are
+ * reduced until what the load allocates (not the mmap'd weights) fits, and
+ * the load fails if nothing does.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param modelPath Path to the .gguf model file
+ * @param nThreads Decode threads when tuneDir is null (<= 0 for one per
+ *        core of the set)
+ * @param nCtx Context length in tokens (<= 0 for the default), the most
+ *        the memory budget may allow
+ * @param cpuSet "" for any core, "performance" for the big cores, or a
+ *        list such as "4-7"
+ * @param priority 0 low, 1 normal, 2 high, 3 realtime
+ * @param kvType KV cache element type: 0 f16, 1 q8_0, 2 q4_0; the memory
+ *        budget may lower it further
+ * @param tuneDir Directory for tune files, null to skip tuning
+ * @param memoryBudgetBytes Memory the load may allocate besides the mapped
+ *        weights, <= 0 for no limit
+ * @return Context handle (jlong), 0 if failed, cpuSet or kvType is
+ *         malformed or the model does not fit the budget
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_todoapp_llm_LlamaNative_initModelWithOptions(
+        JNIEnv* env,
+        jclass clazz,
+        jstring modelPath,
+        jint nThreads,
+        jint nCtx,
+        jstring cpuSet,
+        jint priority,
+        jint kvType,
+        jstring tuneDir,
+        jlong memoryBudgetBytes) {
+    llamacore::ContextParams params;
+    params.numThreads = nThreads;
+    if (nCtx > 0) params.contextSize = nCtx;
+
+    bool ok = true;
+    params.placement.cpus = llamacore::parseCpuSet(toStdString(env, cpuSet), &ok);
+    if (!ok) {
+        LOGE("Malformed CPU set for initModel");
         return 0;
     }
-    
-    llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx = 2048;
-    ctx_params.n_threads = 4;
-    llama_context* ctx = llama_new_context_with_model(model, ctx_params);
-    */
-    
-    // Stub implementation: create a simulated context
-    ModelContext* ctx = new ModelContext(pathStr);
-    
-    std::lock_guard<std::mutex> lock(g_contexts_mutex);
-    jlong handle = allocateHandle();
-    g_contexts[handle] = ctx;
-    
-    LOGI("Model initialized with handle: %lld", (long long)handle);
-    return handle;
+    params.placement.priority = static_cast<llamacore::ThreadPriority>(
+            std::clamp<jint>(priority, 0, static_cast<jint>(llamacore::ThreadPriority::Realtime)));
+    if (kvType < 0 || kvType > static_cast<jint>(llamacore::KvCacheType::Q4_0)) {
+        LOGE("Unknown KV cache type %d for initModel", kvType);
+        return 0;
+    }
+    params.kvType = static_cast<llamacore::KvCacheType>(kvType);
+
+    llamacore::LoadOptions options;
+    if (tuneDir != nullptr) options.tuneDirectory = toStdString(env, tuneDir);
+    if (memoryBudgetBytes > 0) options.memoryBudgetBytes = static_cast<uint64_t>(memoryBudgetBytes);
+    return static_cast<jlong>(llamacore::initModel(toStdString(env, modelPath), params, options));
+}
+
+/**
+ * Initialize a model whose decode threads are pinned to a CPU set and run
+ * at a given priority
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param modelPath Path to the .gguf model file
+ * @param nThreads Decode threads (<= 0 for one per core of the set)
+ * @param nCtx Context length in tokens (<= 0 for the default)
+ * @param cpuSet "" for any core, "performance" for the big cores, or a
+ *        list such as "4-7"
+ * @param priority 0 low, 1 normal, 2 high, 3 realtime
+ * @return Context handle (jlong), 0 if failed or cpuSet is malformed
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_todoapp_llm_LlamaNative_initModelWithPlacement(
+        JNIEnv* env,
+        jclass clazz,
+        jstring modelPath,
+        jint nThreads,
+        jint nCtx,
+        jstring cpuSet,
+        jint priority) {
+    return Java_com_example_todoapp_llm_LlamaNative_initModelWithOptions(
+            env, clazz, modelPath, nThreads, nCtx, cpuSet, priority,
+            static_cast<jint>(llamacore::KvCacheType::F16), nullptr, 0);
+}
+
+/**
+ * Bring the KV state of a static prompt prefix into a context
+ *
+ * Restores the snapshot kept in sessionDir when it matches the model file
+ * and prefix, and evaluates the prefix and rewrites the snapshot otherwise.
+ * The prefix is also pinned against context shifting.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param sessionDir Directory for snapshot files
+ * @param prefix Text every later prompt starts with
+ * @return 0 restored, 1 rebuilt, 2 evaluated without snapshot, 3 failed
+ */
+JNIEXPORT jint JNICALL
+Java_com_example_todoapp_llm_LlamaNative_warmStart(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring sessionDir,
+        jstring prefix) {
+    llamacore::SnapshotResult result = llamacore::warmStart(
+            ctxPtr, toStdString(env, sessionDir), toStdString(env, prefix));
+    return static_cast<jint>(result);
+}
+
+/**
+ * Set the prompt head kept when a prompt or conversation outgrows the
+ * context and older tokens are shifted out
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param prefix Text prompts start with (the system prompt), empty to pin
+ *        only the first token
+ * @return JNI_TRUE if set
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_setPinnedPrefix(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring prefix) {
+    return llamacore::setPinnedPrefix(ctxPtr, toStdString(env, prefix)) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Keep the tokens of a static prompt piece for the model's vocabulary
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param text Template text
+ * @param head JNI_TRUE for prompt heads, JNI_FALSE for tails
+ * @return JNI_TRUE if the template is kept
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_registerTemplate(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring text,
+        jboolean head) {
+    return llamacore::registerTemplate(ctxPtr, toStdString(env, text), head == JNI_TRUE) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Set the text around prompts assembled by submitGenerateFromContext
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param head Text before the context (PromptTemplates.SIMPLE_PROMPT_PREFIX)
+ * @param input Text between the context and the user message
+ * @param tail Text after the user message
+ * @return JNI_TRUE if set
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_setPromptFormat(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring head,
+        jstring input,
+        jstring tail) {
+    llamacore::PromptFormat format{toStdString(env, head), toStdString(env, input), toStdString(env, tail)};
+    return llamacore::setPromptFormat(ctxPtr, format) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Write the registered template tokens to a file to ship next to the model
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param path Output file, normally <model path>.tokens
+ * @return JNI_TRUE if written
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_saveTemplateTokens(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring path) {
+    return llamacore::saveTemplateTokens(ctxPtr, toStdString(env, path)) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Attach a draft model for speculative decoding
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param draftPath Path to a smaller .gguf model sharing the vocabulary,
+ *        empty to detach
+ * @param draftTokens Guesses verified per target pass (<= 0 for the default)
+ * @return JNI_TRUE if attached
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_attachDraftModel(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring draftPath,
+        jint draftTokens) {
+    int tokens = draftTokens > 0 ? draftTokens : llamacore::kDefaultDraftTokens;
+    return llamacore::attachDraftModel(ctxPtr, toStdString(env, draftPath), tokens) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Enable or disable prompt lookup speculative decoding
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param draftTokens Guesses verified per target pass, 0 to disable,
+ *        < 0 for the default
+ * @return JNI_TRUE if the handle was valid
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_setPromptLookup(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jint draftTokens) {
+    int tokens = draftTokens < 0 ? llamacore::kDefaultLookupTokens : draftTokens;
+    return llamacore::setPromptLookup(ctxPtr, tokens) ? JNI_TRUE : JNI_FALSE;
 }
 
 /**
  * Generate text from a prompt
- * 
+ *
  * @param env JNI environment
  * @param clazz Java class reference
  * @param ctxPtr Context handle from initModel
@@ -123,104 +595,269 @@ Java_com_example_todoapp_llm_LlamaNative_generate(
         jlong ctxPtr,
         jstring prompt,
         jint maxTokens) {
-    
-    const char* promptStr = env->GetStringUTFChars(prompt, nullptr);
-    LOGI("LlamaNative.generate called - handle: %lld, maxTokens: %d", (long long)ctxPtr, maxTokens);
-    LOGD("Prompt: %.100s...", promptStr);
-    
-    std::string promptText(promptStr);
-    env->ReleaseStringUTFChars(prompt, promptStr);
-    
-    // Check if context exists
-    {
-        std::lock_guard<std::mutex> lock(g_contexts_mutex);
-        if (g_contexts.find(ctxPtr) == g_contexts.end()) {
-            LOGE("Invalid context handle: %lld", (long long)ctxPtr);
-            return env->NewStringUTF("{\"action\":\"reply\",\"message\":\"Error: Model not loaded\",\"data\":{}}");
-        }
+    std::string response = llamacore::generateAction(ctxPtr, toStdString(env, prompt), maxTokens);
+    return toJavaString(env, response);
+}
+
+/**
+ * Generate text from a UTF-8 prompt held in a direct ByteBuffer
+ *
+ * The prompt bytes are read in place through GetDirectBufferAddress, so no
+ * Java string, UTF-8 conversion or native copy is made per request.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param prompt Direct ByteBuffer holding the UTF-8 prompt at offset 0
+ * @param length Number of valid prompt bytes in the buffer
+ * @param maxTokens Maximum tokens to generate
+ * @return Generated text (JSON)
+ */
+JNIEXPORT jstring JNICALL
+Java_com_example_todoapp_llm_LlamaNative_generateFromBuffer(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jobject prompt,
+        jint length,
+        jint maxTokens) {
+
+    auto* data = static_cast<const char*>(env->GetDirectBufferAddress(prompt));
+    jlong capacity = env->GetDirectBufferCapacity(prompt);
+    if (data == nullptr || length < 0 || length > capacity) {
+        LOGE("generateFromBuffer: not a direct buffer or bad length %d", length);
+        return env->NewStringUTF(llamacore::kResponseInvalidPrompt);
     }
-    
-    // TODO: Replace with actual llama.cpp generation
-    /*
-    std::vector<llama_token> tokens = llama_tokenize(ctx, promptText, true);
-    std::string result;
-    // ... actual generation loop ...
-    return env->NewStringUTF(result.c_str());
-    */
-    
-    // Stub implementation: analyze prompt and return appropriate JSON response
-    std::string response;
-    std::string lowerPrompt = promptText;
-    for (auto& c : lowerPrompt) c = tolower(c);
-    
-    // Detect intent from prompt and return structured JSON
-    if (lowerPrompt.find("create") != std::string::npos && 
-        lowerPrompt.find("goal") != std::string::npos) {
-        // Extract goal name if present (simple heuristic)
-        std::string goalName = "New Goal";
-        size_t quoteStart = promptText.find('"');
-        size_t quoteEnd = promptText.find('"', quoteStart + 1);
-        if (quoteStart != std::string::npos && quoteEnd != std::string::npos) {
-            goalName = promptText.substr(quoteStart + 1, quoteEnd - quoteStart - 1);
-        }
-        
-        response = "{\"action\":\"create_goal\",\"message\":\"I'll create a goal for " + goalName + 
-                   "\",\"data\":{\"goalTitle\":\"" + goalName + 
-                   "\",\"durationMonths\":3,\"dailyMinutes\":30}}";
-    }
-    else if (lowerPrompt.find("add") != std::string::npos && 
-             lowerPrompt.find("task") != std::string::npos) {
-        std::string taskName = "New Task";
-        size_t quoteStart = promptText.find('"');
-        size_t quoteEnd = promptText.find('"', quoteStart + 1);
-        if (quoteStart != std::string::npos && quoteEnd != std::string::npos) {
-            taskName = promptText.substr(quoteStart + 1, quoteEnd - quoteStart - 1);
-        }
-        
-        response = "{\"action\":\"create_task\",\"message\":\"I'll add the task: " + taskName + 
-                   "\",\"data\":{\"taskTitle\":\"" + taskName + 
-                   "\",\"dueDate\":\"today\",\"minutes\":30}}";
-    }
-    else if (lowerPrompt.find("list") != std::string::npos || 
-             lowerPrompt.find("show") != std::string::npos) {
-        response = "{\"action\":\"reply\",\"message\":\"Here are your current items. You can ask me to create goals or add tasks!\",\"data\":{}}";
-    }
-    else if (lowerPrompt.find("help") != std::string::npos) {
-        response = "{\"action\":\"reply\",\"message\":\"I can help you manage goals and tasks! Try saying: 'Create a goal to learn Python' or 'Add task review notes tomorrow'\",\"data\":{}}";
-    }
-    else if (lowerPrompt.find("complete") != std::string::npos || 
-             lowerPrompt.find("done") != std::string::npos ||
-             lowerPrompt.find("finish") != std::string::npos) {
-        std::string taskName = "task";
-        size_t quoteStart = promptText.find('"');
-        size_t quoteEnd = promptText.find('"', quoteStart + 1);
-        if (quoteStart != std::string::npos && quoteEnd != std::string::npos) {
-            taskName = promptText.substr(quoteStart + 1, quoteEnd - quoteStart - 1);
-        }
-        
-        response = "{\"action\":\"complete_task\",\"message\":\"Great job! I'll mark that as complete.\",\"data\":{\"taskTitle\":\"" + taskName + "\"}}";
+
+    std::string response = llamacore::generateAction(
+            ctxPtr, std::string_view(data, static_cast<size_t>(length)), maxTokens);
+    return toJavaString(env, response);
+}
+
+/**
+ * Generate text from a UTF-8 prompt held in a byte[] region
+ *
+ * Heap arrays cannot be pinned safely for the length of a generation, so the
+ * region is copied into a per-thread scratch buffer that is reused across
+ * calls; after warm-up this costs one memcpy and no allocation.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param prompt Array holding the UTF-8 prompt
+ * @param offset Offset of the first prompt byte
+ * @param length Number of prompt bytes
+ * @param maxTokens Maximum tokens to generate
+ * @return Generated text (JSON)
+ */
+JNIEXPORT jstring JNICALL
+Java_com_example_todoapp_llm_LlamaNative_generateFromBytes(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jbyteArray prompt,
+        jint offset,
+        jint length,
+        jint maxTokens) {
+
+    jsize arrayLength = env->GetArrayLength(prompt);
+    if (offset < 0 || length < 0 || offset > arrayLength - length) {
+        LOGE("generateFromBytes: bad region offset %d length %d", offset, length);
+        return env->NewStringUTF(llamacore::kResponseInvalidPrompt);
+    }
+
+    thread_local std::string scratch;
+    scratch.resize(static_cast<size_t>(length));
+    env->GetByteArrayRegion(prompt, offset, length, reinterpret_cast<jbyte*>(&scratch[0]));
+
+    std::string response = llamacore::generateAction(ctxPtr, scratch, maxTokens);
+    return toJavaString(env, response);
+}
+
+/**
+ * Queue a generation and return without waiting for it
+ *
+ * Output is constrained like generate(). When the reply is ready,
+ * LlamaNative.onGenerateDone(requestId) is called on a native worker thread
+ * (or on this thread, for a cached reply), after which poll returns it.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param prompt Input prompt text
+ * @param maxTokens Maximum tokens to generate
+ * @return Request ID, 0 if the handle is invalid
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_todoapp_llm_LlamaNative_submitGenerate(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jstring prompt,
+        jint maxTokens) {
+    return static_cast<jlong>(llamacore::submitGenerateAction(
+            ctxPtr, toStdString(env, prompt), maxTokens, doneCallback()));
+}
+
+/**
+ * Queue a generation on a prompt assembled natively from goal and task
+ * fields, in the format set by setPromptFormat
+ *
+ * The fields are read in place and tokenized through the span cache, so
+ * no prompt string is built in Kotlin or copied across JNI. Completion is
+ * reported as for submitGenerate.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param ctxPtr Context handle from initModel
+ * @param strings Direct ByteBuffer of UTF-8 strings, the user message first
+ * @param length Number of valid bytes in strings
+ * @param messageLength Bytes of the user message
+ * @param goals Packed goal fields, see unpackContext
+ * @param tasks Packed task fields, see unpackContext
+ * @param maxTokens Maximum tokens to generate
+ * @return Request ID, 0 if the handle is invalid, no format is set or the
+ *         fields are malformed
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_todoapp_llm_LlamaNative_submitGenerateFromContext(
+        JNIEnv* env,
+        jclass clazz,
+        jlong ctxPtr,
+        jobject strings,
+        jint length,
+        jint messageLength,
+        jintArray goals,
+        jintArray tasks,
+        jint maxTokens) {
+    auto* data = static_cast<const char*>(env->GetDirectBufferAddress(strings));
+    jlong capacity = env->GetDirectBufferCapacity(strings);
+    llamacore::PromptContext context;
+    if (data == nullptr || length < 0 || length > capacity ||
+        !unpackContext(env, data, length, messageLength, goals, tasks, context)) {
+        LOGE("submitGenerateFromContext: malformed context fields");
+        return 0;
     }
-    else if (lowerPrompt.find("delete") != std::string::npos || 
-             lowerPrompt.find("remove") != std::string::npos) {
-        response = "{\"action\":\"reply\",\"message\":\"To delete an item, please specify exactly which goal or task you want to remove.\",\"data\":{}}";
+    return static_cast<jlong>(llamacore::submitActionFromContext(ctxPtr, context, maxTokens, doneCallback()));
+}
+
+/**
+ * Collect the reply of a submitted request
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param requestId ID from submitGenerate
+ * @return The reply once finished (a cancellation reply if it was
+ *         cancelled), null while it is still running or if the ID is
+ *         unknown or was already polled
+ */
+JNIEXPORT jstring JNICALL
+Java_com_example_todoapp_llm_LlamaNative_poll(
+        JNIEnv* env,
+        jclass clazz,
+        jlong requestId) {
+    std::string reply;
+    switch (llamacore::pollGenerate(requestId, reply)) {
+        case llamacore::RequestStatus::Done:
+            return toJavaString(env, reply);
+        case llamacore::RequestStatus::Cancelled:
+            return env->NewStringUTF(llamacore::kResponseCancelled);
+        case llamacore::RequestStatus::Pending:
+        case llamacore::RequestStatus::Unknown:
+            break;
     }
-    else if (lowerPrompt.find("progress") != std::string::npos || 
-             lowerPrompt.find("how am i") != std::string::npos ||
-             lowerPrompt.find("status") != std::string::npos) {
-        response = "{\"action\":\"show_progress\",\"message\":\"Let me show you your progress summary!\",\"data\":{}}";
+    return nullptr;
+}
+
+/**
+ * Collect the reply of a submitted request as an action record
+ *
+ * The reply is parsed natively and written to the buffer as a binary
+ * record (core/action_record.h) that ActionRecord.decode maps to an
+ * AssistantAction, so neither a JSON string nor NewStringUTF's modified
+ * UTF-8 is involved.
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param requestId ID from submitGenerate
+ * @param record Direct ByteBuffer the record is written to at offset 0
+ * @return Record bytes once finished, 0 while the request is running, if
+ *         the ID is unknown or already polled, or if record is not a
+ *         direct buffer of at least the record header
+ */
+JNIEXPORT jint JNICALL
+Java_com_example_todoapp_llm_LlamaNative_pollAction(
+        JNIEnv* env,
+        jclass clazz,
+        jlong requestId,
+        jobject record) {
+    auto* data = static_cast<uint8_t*>(env->GetDirectBufferAddress(record));
+    jlong capacity = env->GetDirectBufferCapacity(record);
+    if (data == nullptr || capacity < 0) {
+        LOGE("pollAction: not a direct buffer");
+        return 0;
+    }
+    // Records stay far below 2 GiB; cap so the size fits the jint
+    size_t room = static_cast<size_t>(std::min<jlong>(capacity, 1 << 30));
+    return static_cast<jint>(llamacore::pollAction(requestId, data, room));
+}
+
+/**
+ * Stop a submitted request at its next token boundary
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param requestId ID from submitGenerate
+ * @return false if the request is unknown or already finished
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_todoapp_llm_LlamaNative_cancel(
+        JNIEnv* env,
+        jclass clazz,
+        jlong requestId) {
+    return llamacore::cancelGenerate(requestId) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Locate the action object in a reply and validate it (core/json_scan.h)
+ *
+ * @param env JNI environment
+ * @param clazz Java class reference
+ * @param text Model reply
+ * @param bounds Receives the object's start and end (exclusive) as String
+ *        indices when it is well-formed; needs 2 elements
+ * @return ScanStatus: 0 no object, 1 malformed, 2 off the action schema,
+ *         3 valid
+ */
+JNIEXPORT jint JNICALL
+Java_com_example_todoapp_llm_LlamaNative_scanAction(
+        JNIEnv* env,
+        jclass clazz,
+        jstring text,
+        jintArray bounds) {
+    // JSON structure is ASCII, which modified UTF-8 leaves as it is
+    const char* chars = env->GetStringUTFChars(text, nullptr);
+    if (chars == nullptr) {
+        // OutOfMemoryError is pending and surfaces on return
+        return static_cast<jint>(llamacore::ScanStatus::NoObject);
     }
-    else {
-        // Default conversational reply
-        response = "{\"action\":\"reply\",\"message\":\"I'm your local AI assistant running on-device! I can help you create goals, add tasks, and track your progress. What would you like to do?\",\"data\":{}}";
+    auto size = static_cast<size_t>(env->GetStringUTFLength(text));
+    llamacore::ActionScan scan = llamacore::scanAction(std::string_view(chars, size));
+    if (scan.status == llamacore::ScanStatus::Valid || scan.status == llamacore::ScanStatus::OffSchema) {
+        jint offsets[2];
+        offsets[0] = utf16Length(chars, scan.begin);
+        offsets[1] = offsets[0] + utf16Length(chars + scan.begin, scan.end - scan.begin);
+        if (env->GetArrayLength(bounds) >= 2) {
+            env->SetIntArrayRegion(bounds, 0, 2, offsets);
+        }
     }
-    
-    LOGI("Generated response: %s", response.c_str());
-    return env->NewStringUTF(response.c_str());
+    env->ReleaseStringUTFChars(text, chars);
+    return static_cast<jint>(scan.status);
 }
 
 /**
  * Free model resources
- * 
+ *
  * @param env JNI environment
  * @param clazz Java class reference
  * @param ctxPtr Context handle to free
@@ -230,28 +867,14 @@ Java_com_example_todoapp_llm_LlamaNative_freeModel(
         JNIEnv* env,
         jclass clazz,
         jlong ctxPtr) {
-    
-    LOGI("LlamaNative.freeModel called - handle: %lld", (long long)ctxPtr);
-    
-    std::lock_guard<std::mutex> lock(g_contexts_mutex);
-    auto it = g_contexts.find(ctxPtr);
-    if (it != g_contexts.end()) {
-        delete it->second;
-        g_contexts.erase(it);
-        LOGI("Model context freed successfully");
-    } else {
-        LOGE("Invalid context handle: %lld", (long long)ctxPtr);
-    }
-    
-    // TODO: Replace with actual llama.cpp cleanup
-    /*
-    llama_free(ctx);
-    llama_free_model(model);
-    */
+    llamacore::freeModel(ctxPtr);
 }
 
 // ============================================================================
 // LlamaInference JNI Functions (Extended Interface - backward compatibility)
+//
+// Each LlamaInference instance holds its own handle, so it can share loaded
+// weights with LlamaNative handles without freeing them on unload.
 // ============================================================================
 
 /**
@@ -262,23 +885,30 @@ Java_com_example_todoapp_llm_LlamaInference_nativeInit(
         JNIEnv* env,
         jobject thiz) {
     LOGI("LlamaInference.nativeInit called");
-    // TODO: llama_backend_init(false);
+    llamacore::initBackend();
     return JNI_TRUE;
 }
 
 /**
  * Load a GGUF model file (instance method version)
+ *
+ * @return Handle for the other instance methods, 0 on failure
  */
-JNIEXPORT jboolean JNICALL
+JNIEXPORT jlong JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeLoadModel(
         JNIEnv* env,
         jobject thiz,
         jstring modelPath,
         jint nThreads,
-        jint nCtx) {
-    
-    jlong handle = Java_com_example_todoapp_llm_LlamaNative_initModel(env, nullptr, modelPath);
-    return handle != 0 ? JNI_TRUE : JNI_FALSE;
+        jint nCtx,
+        jstring cpuSet,
+        jint priority,
+        jint kvType,
+        jstring tuneDir,
+        jlong memoryBudgetBytes) {
+
+    return Java_com_example_todoapp_llm_LlamaNative_initModelWithOptions(
+            env, nullptr, modelPath, nThreads, nCtx, cpuSet, priority, kvType, tuneDir, memoryBudgetBytes);
 }
 
 /**
@@ -288,59 +918,107 @@ JNIEXPORT jstring JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeGenerate(
         JNIEnv* env,
         jobject thiz,
+        jlong handle,
         jstring prompt,
         jint maxTokens,
         jfloat temperature,
         jfloat topP) {
-    
-    // Use default context (first one if exists)
-    jlong handle = 0;
-    {
-        std::lock_guard<std::mutex> lock(g_contexts_mutex);
-        if (!g_contexts.empty()) {
-            handle = g_contexts.begin()->first;
-        }
-    }
-    
+
     if (handle == 0) {
-        return env->NewStringUTF("{\"action\":\"reply\",\"message\":\"No model loaded. Please download a model first.\",\"data\":{}}");
+        return env->NewStringUTF(llamacore::kResponseNoModel);
     }
-    
-    return Java_com_example_todoapp_llm_LlamaNative_generate(env, nullptr, handle, prompt, maxTokens);
+
+    llamacore::GenerateParams params;
+    params.maxTokens = maxTokens;
+    params.sampling.temperature = temperature;
+    params.sampling.topP = topP;
+    std::string response = llamacore::generate(handle, toStdString(env, prompt), params);
+    return toJavaString(env, response);
 }
 
 /**
  * Generate with streaming callback
+ *
+ * Decoded text is pushed to callback.onToken as it is produced: the first
+ * token alone, then a few tokens per call. If onToken throws, generation
+ * stops and the exception propagates to the caller.
  */
 JNIEXPORT jstring JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeGenerateWithCallback(
         JNIEnv* env,
         jobject thiz,
+        jlong handle,
         jstring prompt,
         jint maxTokens,
         jfloat temperature,
         jobject callback) {
-    
-    // For stub, just call regular generate
-    return Java_com_example_todoapp_llm_LlamaInference_nativeGenerate(
-            env, thiz, prompt, maxTokens, temperature, 0.9f);
+
+    if (handle == 0) {
+        return env->NewStringUTF(llamacore::kResponseNoModel);
+    }
+
+    llamacore::GenerateParams params;
+    params.maxTokens = maxTokens;
+    params.sampling.temperature = temperature;
+
+    // The sink runs on the scheduler's worker thread, so the callback needs a
+    // global reference, and an exception it throws is carried back here to
+    // be rethrown on the calling thread
+    struct SinkState {
+        jobject callback = nullptr;
+        jthrowable error = nullptr;
+    } sink;
+    if (callback != nullptr && g_onTokenMethod != nullptr) {
+        sink.callback = env->NewGlobalRef(callback);
+        params.onChunk = [&sink](std::string_view chunk) {
+            JNIEnv* sinkEnv = currentEnv();
+            if (sinkEnv == nullptr) {
+                return false;
+            }
+            // Chunks end on a character boundary, so no character is split
+            // between two onToken calls
+            jstring jchunk = toJavaString(sinkEnv, chunk);
+            if (jchunk != nullptr) {
+                sinkEnv->CallVoidMethod(sink.callback, g_onTokenMethod, jchunk);
+                sinkEnv->DeleteLocalRef(jchunk);
+            }
+            jthrowable error = sinkEnv->ExceptionOccurred();
+            if (error == nullptr) {
+                return jchunk != nullptr;
+            }
+            sinkEnv->ExceptionClear();
+            sink.error = static_cast<jthrowable>(sinkEnv->NewGlobalRef(error));
+            sinkEnv->DeleteLocalRef(error);
+            return false;
+        };
+    }
+
+    std::string response = llamacore::generate(handle, toStdString(env, prompt), params);
+
+    if (sink.callback != nullptr) {
+        env->DeleteGlobalRef(sink.callback);
+    }
+    if (sink.error != nullptr) {
+        env->Throw(sink.error);
+        env->DeleteGlobalRef(sink.error);
+        return nullptr;
+    }
+    return toJavaString(env, response);
 }
 
 /**
  * Unload model
+ *
+ * Frees this instance's context only; the weights stay loaded while other
+ * handles use them.
  */
 JNIEXPORT void JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeUnloadModel(
         JNIEnv* env,
-        jobject thiz) {
+        jobject thiz,
+        jlong handle) {
     LOGI("LlamaInference.nativeUnloadModel called");
-    
-    // Free all contexts
-    std::lock_guard<std::mutex> lock(g_contexts_mutex);
-    for (auto& pair : g_contexts) {
-        delete pair.second;
-    }
-    g_contexts.clear();
+    llamacore::freeModel(handle);
 }
 
 /**
@@ -349,10 +1027,11 @@ Java_com_example_todoapp_llm_LlamaInference_nativeUnloadModel(
 JNIEXPORT void JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeCleanup(
         JNIEnv* env,
-        jobject thiz) {
+        jobject thiz,
+        jlong handle) {
     LOGI("LlamaInference.nativeCleanup called");
-    Java_com_example_todoapp_llm_LlamaInference_nativeUnloadModel(env, thiz);
-    // TODO: llama_backend_free();
+    Java_com_example_todoapp_llm_LlamaInference_nativeUnloadModel(env, thiz, handle);
+    llamacore::shutdownBackend();
 }
 
 /**
@@ -361,9 +1040,9 @@ Java_com_example_todoapp_llm_LlamaInference_nativeCleanup(
 JNIEXPORT jboolean JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeIsModelLoaded(
         JNIEnv* env,
-        jobject thiz) {
-    std::lock_guard<std::mutex> lock(g_contexts_mutex);
-    return !g_contexts.empty() ? JNI_TRUE : JNI_FALSE;
+        jobject thiz,
+        jlong handle) {
+    return llamacore::isModelLoaded(handle) ? JNI_TRUE : JNI_FALSE;
 }
 
 /**
@@ -372,18 +1051,10 @@ Java_com_example_todoapp_llm_LlamaInference_nativeIsModelLoaded(
 JNIEXPORT jstring JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeGetModelInfo(
         JNIEnv* env,
-        jobject thiz) {
-    
-    std::lock_guard<std::mutex> lock(g_contexts_mutex);
-    if (g_contexts.empty()) {
-        return env->NewStringUTF("");
-    }
-    
-    auto* ctx = g_contexts.begin()->second;
-    std::string info = "{\"status\":\"loaded\",\"path\":\"" + ctx->modelPath + 
-                       "\",\"contextSize\":" + std::to_string(ctx->contextSize) +
-                       ",\"threads\":" + std::to_string(ctx->numThreads) + "}";
-    return env->NewStringUTF(info.c_str());
+        jobject thiz,
+        jlong handle) {
+    // Holds the model path, which may be any text
+    return toJavaString(env, llamacore::modelInfo(handle));
 }
 
 /**
@@ -393,7 +1064,7 @@ JNIEXPORT jstring JNICALL
 Java_com_example_todoapp_llm_LlamaInference_nativeGetVersion(
         JNIEnv* env,
         jclass clazz) {
-    return env->NewStringUTF("llama.cpp JNI v1.0.0 (stub with JSON responses)");
+    return env->NewStringUTF(llamacore::version());
 }
 
 /**
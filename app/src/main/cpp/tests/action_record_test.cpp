@@ -0,0 +1,214 @@
+/**
+ * action_record_test.cpp - Action records written and read back
+ *
+ * Records are decoded here the way ActionRecord.kt reads them: a 32 byte
+ * header at fixed offsets followed by the message, title, due date and
+ * goal title.
+ */
+
+#include "action_record.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+using namespace llamacore;
+
+namespace {
+
+struct Record {
+    size_t size = 0;
+    ActionRecordHeader header{};
+    std::string message;
+    std::string title;
+    std::string dueDate;
+    std::string goalTitle;
+};
+
+Record roundTrip(const std::string& reply, size_t capacity = 4096) {
+    std::vector<uint8_t> buffer(capacity);
+    Record record;
+    record.size = writeActionRecord(reply, buffer.data(), buffer.size());
+    if (record.size < kActionRecordHeaderBytes) {
+        return record;
+    }
+    std::memcpy(&record.header, buffer.data(), sizeof(record.header));
+    const char* next = reinterpret_cast<const char*>(buffer.data()) + kActionRecordHeaderBytes;
+    for (auto [bytes, out] : {std::make_pair(record.header.messageBytes, &record.message),
+                              std::make_pair(record.header.titleBytes, &record.title),
+                              std::make_pair(record.header.dueDateBytes, &record.dueDate),
+                              std::make_pair(record.header.goalTitleBytes, &record.goalTitle)}) {
+        out->assign(next, bytes);
+        next += bytes;
+    }
+    CHECK_EQ(static_cast<size_t>(next - reinterpret_cast<const char*>(buffer.data())), record.size);
+    return record;
+}
+
+bool validUtf8Prefix(const std::string& text) {
+    // Cut strings never end inside a character
+    size_t i = 0;
+    while (i < text.size()) {
+        auto byte = static_cast<unsigned char>(text[i]);
+        size_t length = byte < 0x80 ? 1 : (byte & 0xE0) == 0xC0 ? 2 : (byte & 0xF0) == 0xE0 ? 3 : 4;
+        if (i + length > text.size()) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+void testHeaderLayout() {
+    // The offsets ActionRecord.kt reads
+    CHECK_EQ(offsetof(ActionRecordHeader, status), size_t(0));
+    CHECK_EQ(offsetof(ActionRecordHeader, action), size_t(1));
+    CHECK_EQ(offsetof(ActionRecordHeader, flags), size_t(2));
+    CHECK_EQ(offsetof(ActionRecordHeader, durationMonths), size_t(4));
+    CHECK_EQ(offsetof(ActionRecordHeader, dailyMinutes), size_t(8));
+    CHECK_EQ(offsetof(ActionRecordHeader, minutes), size_t(12));
+    CHECK_EQ(offsetof(ActionRecordHeader, messageBytes), size_t(16));
+    CHECK_EQ(offsetof(ActionRecordHeader, titleBytes), size_t(20));
+    CHECK_EQ(offsetof(ActionRecordHeader, dueDateBytes), size_t(24));
+    CHECK_EQ(offsetof(ActionRecordHeader, goalTitleBytes), size_t(28));
+    CHECK_EQ(kActionRecordHeaderBytes, size_t(32));
+}
+
+void testCreateGoal() {
+    Record record = roundTrip(
+        R"({"action":"create_goal","message":"Goal created!","data":{"title":"Learn Python",)"
+        R"("duration_months":6,"daily_minutes":"45"}})");
+    CHECK_EQ(record.header.status, kRecordAction);
+    CHECK_EQ(record.header.action, uint8_t(ActionType::CreateGoal));
+    CHECK_EQ(record.header.flags, uint8_t(0));
+    CHECK_EQ(record.message, std::string("Goal created!"));
+    CHECK_EQ(record.title, std::string("Learn Python"));
+    CHECK_EQ(record.header.durationMonths, 6);
+    CHECK_EQ(record.header.dailyMinutes, 45);
+
+    // JsonResponseParser's defaults
+    record = roundTrip(R"({"action":"CREATE_GOAL","data":{}})");
+    CHECK_EQ(record.header.action, uint8_t(ActionType::CreateGoal));
+    CHECK_EQ(record.title, std::string("New Goal"));
+    CHECK_EQ(record.header.durationMonths, 3);
+    CHECK_EQ(record.header.dailyMinutes, 30);
+}
+
+void testCreateTask() {
+    Record record = roundTrip(
+        R"({"action":"create_task","message":"Added","data":{"taskTitle":"Read","dueDate":"tomorrow",)"
+        R"("duration":20.9,"goal_title":"Books"}})");
+    CHECK_EQ(record.header.action, uint8_t(ActionType::CreateTask));
+    CHECK_EQ(record.header.flags, kRecordHasGoalTitle);
+    CHECK_EQ(record.title, std::string("Read"));
+    CHECK_EQ(record.dueDate, std::string("tomorrow"));
+    CHECK_EQ(record.header.minutes, 20);
+    CHECK_EQ(record.goalTitle, std::string("Books"));
+
+    record = roundTrip(R"({"action":"create_task","message":"Added"})");
+    CHECK_EQ(record.header.flags, uint8_t(0));
+    CHECK_EQ(record.title, std::string("New Task"));
+    CHECK_EQ(record.dueDate, std::string("today"));
+    CHECK_EQ(record.header.minutes, 30);
+    CHECK(record.goalTitle.empty());
+}
+
+void testOtherActions() {
+    struct Case {
+        const char* reply;
+        ActionType type;
+        const char* title;
+    };
+    const Case cases[] = {
+        {R"({"action":"complete_task","message":"Done","data":{"task_title":"Run"}})", ActionType::CompleteTask,
+         "Run"},
+        {R"({"action":"delete_goal","message":"Gone","data":{"goalTitle":"Chess"}})", ActionType::DeleteGoal,
+         "Chess"},
+        {R"({"action":"delete_task","message":"Gone","data":{"title":"Swim"}})", ActionType::DeleteTask, "Swim"},
+        {R"({"action":"show_progress","message":"Here"})", ActionType::ShowProgress, ""},
+        {R"({"action":"reply","message":"Hi"})", ActionType::Reply, ""},
+    };
+    for (const Case& c : cases) {
+        Record record = roundTrip(c.reply);
+        CHECK_EQ(record.header.status, kRecordAction);
+        CHECK_EQ(record.header.action, uint8_t(c.type));
+        CHECK_EQ(record.title, std::string(c.title));
+        CHECK(!record.message.empty());
+    }
+
+    // Unknown actions become replies with the message, or the whole reply
+    Record record = roundTrip(R"({"action":"dance","message":"No"})");
+    CHECK_EQ(record.header.action, uint8_t(ActionType::Reply));
+    CHECK_EQ(record.message, std::string("No"));
+    std::string bare = R"({"action":"dance"})";
+    CHECK_EQ(roundTrip(bare).message, bare);
+}
+
+void testStringsDecodeEscapes() {
+    Record record = roundTrip(
+        R"(Sure! {"action":"reply","message":"Tab\there \"quoted\" é 🏃 \ud800 end"} trailing)");
+    CHECK_EQ(record.header.status, kRecordAction);
+    CHECK_EQ(record.message, std::string("Tab\there \"quoted\" \xC3\xA9 \xF0\x9F\x8F\x83 \xEF\xBF\xBD end"));
+
+    // Raw four-byte characters pass through as plain UTF-8
+    record = roundTrip("{\"action\":\"reply\",\"message\":\"Go \xF0\x9F\x8F\x83\"}");
+    CHECK_EQ(record.message, std::string("Go \xF0\x9F\x8F\x83"));
+}
+
+void testInvalidReplies() {
+    for (std::string reply : {std::string("no json here"), std::string(R"({"action":"reply")"),
+                              std::string(R"({'action':'reply'})"), std::string(R"({"message":bare})")}) {
+        Record record = roundTrip(reply);
+        CHECK_EQ(record.header.status, kRecordInvalid);
+        CHECK_EQ(record.message, reply);
+        CHECK(record.title.empty());
+        ParsedAction action;
+        CHECK(!parseAction(reply, action));
+    }
+}
+
+void testTruncation() {
+    std::vector<uint8_t> small(kActionRecordHeaderBytes - 1);
+    CHECK_EQ(writeActionRecord("{}", small.data(), small.size()), size_t(0));
+
+    std::string reply = "{\"action\":\"create_task\",\"message\":\"\xF0\x9F\x8F\x83\xF0\x9F\x8F\x83 long message\","
+                        "\"data\":{\"title\":\"Run\",\"dueDate\":\"today\"}}";
+    Record full = roundTrip(reply);
+    CHECK_EQ(full.header.flags & kRecordTruncated, 0);
+
+    // Room for the title, date and part of the message: the message gives
+    // way first, and at a character boundary
+    for (size_t spare = 0; spare <= full.message.size(); ++spare) {
+        size_t capacity = kActionRecordHeaderBytes + full.title.size() + full.dueDate.size() + spare;
+        Record cut = roundTrip(reply, capacity);
+        CHECK(cut.size <= capacity);
+        CHECK_EQ(cut.title, full.title);
+        CHECK_EQ(cut.dueDate, full.dueDate);
+        CHECK(cut.message.size() <= spare);
+        CHECK(full.message.compare(0, cut.message.size(), cut.message) == 0);
+        CHECK(validUtf8Prefix(cut.message));
+        CHECK_EQ((cut.header.flags & kRecordTruncated) != 0, spare < full.message.size());
+    }
+
+    // A header-only buffer still carries the action
+    Record bare = roundTrip(reply, kActionRecordHeaderBytes);
+    CHECK_EQ(bare.size, kActionRecordHeaderBytes);
+    CHECK_EQ(bare.header.action, uint8_t(ActionType::CreateTask));
+    CHECK(bare.header.flags & kRecordTruncated);
+}
+
+} // namespace
+
+int main() {
+    testHeaderLayout();
+    testCreateGoal();
+    testCreateTask();
+    testOtherActions();
+    testStringsDecodeEscapes();
+    testInvalidReplies();
+    testTruncation();
+    return test::checkResult();
+}
@@ -0,0 +1,61 @@
+/**
+ * check.h - Minimal assertions for the llamacore host tests
+ *
+ * The build defines NDEBUG, so assert() is compiled out; these checks are
+ * not. A failed check prints its location and the test keeps going, so one
+ * run reports every failure. main() returns checkResult().
+ */
+
+#ifndef LLAMACORE_TESTS_CHECK_H
+#define LLAMACORE_TESTS_CHECK_H
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+namespace llamacore::test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const char* file, int line, const std::string& what) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what.c_str());
+    ++failures();
+}
+
+template <typename A, typename B>
+void checkEqual(const A& actual, const B& expected, const char* text, const char* file, int line) {
+    if (actual == expected) {
+        return;
+    }
+    std::ostringstream what;
+    what << text << " (got " << actual << ", expected " << expected << ")";
+    fail(file, line, what.str());
+}
+
+/**
+ * Exit status for main: 0 if every check passed
+ */
+inline int checkResult() {
+    if (failures() > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures());
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace llamacore::test
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            ::llamacore::test::fail(__FILE__, __LINE__, #condition);              \
+        }                                                                         \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    ::llamacore::test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+
+#endif // LLAMACORE_TESTS_CHECK_H
@@ -0,0 +1,166 @@
+/**
+ * context_registry_test.cpp - Handle lifetime in the lock-free context table
+ */
+
+#include "context_registry.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "llama_core.h"
+
+using namespace llamacore;
+
+namespace {
+
+ModelContext* newContext(const std::string& path = "/test/registry.gguf") {
+    ModelContext* ctx = ModelContext::create(path, ContextParams());
+    CHECK(ctx != nullptr);
+    return ctx;
+}
+
+uint32_t slotOf(int64_t handle) {
+    return static_cast<uint32_t>(handle & 0xffffffff);
+}
+
+void testAddAndRemove() {
+    ContextRegistry registry;
+    CHECK(registry.empty());
+    CHECK_EQ(registry.firstHandle(), int64_t(0));
+
+    int64_t handle = registry.add(newContext());
+    CHECK(handle != 0);
+    CHECK(!registry.empty());
+    CHECK(registry.contains(handle));
+    CHECK_EQ(registry.firstHandle(), handle);
+    if (ContextRef ref = registry.acquire(handle)) {
+        CHECK_EQ(ref->modelPath, std::string("/test/registry.gguf"));
+    } else {
+        CHECK(!"acquire of a live handle failed");
+    }
+
+    CHECK(registry.remove(handle));
+    CHECK(registry.empty());
+    CHECK(!registry.contains(handle));
+    CHECK(!registry.acquire(handle));
+    CHECK(!registry.remove(handle));
+}
+
+void testInvalidHandles() {
+    ContextRegistry registry;
+    int64_t handle = registry.add(newContext());
+    CHECK(!registry.acquire(0));
+    CHECK(!registry.acquire(-1));
+    CHECK(!registry.acquire(int64_t(ContextRegistry::kCapacity)));
+    // Right slot, wrong generation
+    CHECK(!registry.acquire(handle + (int64_t(1) << 32)));
+    CHECK(!registry.remove(handle + (int64_t(1) << 32)));
+    CHECK(registry.contains(handle));
+}
+
+void testReusedSlotRejectsStaleHandle() {
+    ContextRegistry registry;
+    int64_t first = registry.add(newContext());
+    CHECK(registry.remove(first));
+
+    // Low slots are handed out first, so the slot comes back with a new
+    // generation
+    int64_t second = registry.add(newContext());
+    CHECK_EQ(slotOf(second), slotOf(first));
+    CHECK(second != first);
+    CHECK(!registry.contains(first));
+    CHECK(!registry.remove(first));
+    CHECK(registry.contains(second));
+    CHECK(registry.remove(second));
+}
+
+void testReferenceOutlivesRemove() {
+    ContextRegistry registry;
+    int64_t handle = registry.add(newContext("/test/held.gguf"));
+    {
+        ContextRef ref = registry.acquire(handle);
+        CHECK(static_cast<bool>(ref));
+        CHECK(registry.remove(handle));
+        CHECK(!registry.contains(handle));
+
+        // The context is still usable, and its slot is not reused while held
+        CHECK_EQ(ref->modelPath, std::string("/test/held.gguf"));
+        int64_t other = registry.add(newContext());
+        CHECK(slotOf(other) != slotOf(handle));
+        CHECK(registry.remove(other));
+
+        ContextRef moved = std::move(ref);
+        CHECK(!ref);
+        CHECK(static_cast<bool>(moved));
+    }
+    // Released: the slot is free again, under a new generation
+    int64_t reused = registry.add(newContext());
+    CHECK_EQ(slotOf(reused), slotOf(handle));
+    CHECK(reused != handle);
+}
+
+void testCapacity() {
+    ContextRegistry registry;
+    std::vector<int64_t> handles;
+    for (uint32_t i = 0; i < ContextRegistry::kCapacity; ++i) {
+        handles.push_back(registry.add(newContext()));
+        CHECK(handles.back() != 0);
+    }
+    // The table owns the context it refuses and frees it
+    CHECK_EQ(registry.add(newContext()), int64_t(0));
+
+    registry.clear();
+    CHECK(registry.empty());
+    for (int64_t handle : handles) {
+        CHECK(!registry.contains(handle));
+    }
+}
+
+void testConcurrentAcquireAndRemove() {
+    ContextRegistry registry;
+    for (int round = 0; round < 50; ++round) {
+        int64_t handle = registry.add(newContext());
+        std::atomic<bool> go{false};
+        std::atomic<int> acquiredAfterRemove{0};
+        std::atomic<bool> removed{false};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                while (!go.load(std::memory_order_acquire)) {
+                }
+                for (int i = 0; i < 1000; ++i) {
+                    bool wasRemoved = removed.load(std::memory_order_acquire);
+                    if (ContextRef ref = registry.acquire(handle)) {
+                        if (wasRemoved) {
+                            acquiredAfterRemove.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        CHECK(!ref->modelPath.empty());
+                    }
+                }
+            });
+        }
+        go.store(true, std::memory_order_release);
+        CHECK(registry.remove(handle));
+        removed.store(true, std::memory_order_release);
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        CHECK_EQ(acquiredAfterRemove.load(), 0);
+        CHECK(registry.empty());
+    }
+}
+
+} // namespace
+
+int main() {
+    initBackend();
+    testAddAndRemove();
+    testInvalidHandles();
+    testReusedSlotRejectsStaleHandle();
+    testReferenceOutlivesRemove();
+    testCapacity();
+    testConcurrentAcquireAndRemove();
+    return test::checkResult();
+}
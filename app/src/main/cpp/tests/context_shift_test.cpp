@@ -0,0 +1,165 @@
+/**
+ * context_shift_test.cpp - Block math of context shifting
+ *
+ * A prompt that outgrows the context keeps its pinned prefix and loses
+ * whole blocks of (contextSize - pinned) / 2 tokens after it; a reply that
+ * reaches the end of the context shifts the oldest block out instead of
+ * stopping.
+ */
+
+#include "inference_engine.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "batch_scheduler.h"
+#include "check.h"
+#include "llama_core.h"
+#include "model_context.h"
+#include "response_builder.h"
+
+using namespace llamacore;
+
+namespace {
+
+constexpr int kContextSize = 64;
+
+using ContextPtr = std::unique_ptr<ModelContext>;
+
+ContextPtr newContext() {
+    ContextParams params;
+    params.contextSize = kContextSize;
+    ContextPtr ctx(ModelContext::create("/test/shift.gguf", params));
+    CHECK(ctx != nullptr);
+    return ctx;
+}
+
+std::vector<Token> tokenize(ModelContext& ctx, const std::string& text, bool addSpecial) {
+    return backend::tokenize(ctx.model, text, addSpecial);
+}
+
+void pin(ModelContext& ctx, std::vector<Token> prefix) {
+    std::atomic_store(&ctx.pinnedPrefix, std::shared_ptr<const std::vector<Token>>(
+                                             std::make_shared<std::vector<Token>>(std::move(prefix))));
+}
+
+/**
+ * Prompt of the prefix followed by filler until it is length tokens long
+ */
+std::vector<Token> promptOf(ModelContext& ctx, const std::vector<Token>& prefix, size_t length) {
+    std::vector<Token> tokens = prefix;
+    for (int i = 0; tokens.size() < length; ++i) {
+        std::vector<Token> word = tokenize(ctx, " w" + std::to_string(i % 100), false);
+        tokens.insert(tokens.end(), word.begin(), word.end());
+    }
+    tokens.resize(length);
+    return tokens;
+}
+
+GenerateParams paramsFor(const std::vector<Token>& tokens) {
+    GenerateParams params;
+    params.promptTokens = std::make_shared<std::vector<Token>>(tokens);
+    return params;
+}
+
+/**
+ * Check the prompt kept pinned tokens and dropped a whole number of blocks
+ * right after them, as few as leave a cell for the reply
+ */
+void checkTruncation(ModelContext& ctx, const std::vector<Token>& prompt, int pinned) {
+    Generation generation(ctx, "", paramsFor(prompt));
+    CHECK(generation.valid());
+    CHECK_EQ(generation.pinnedLength(), pinned);
+
+    size_t block = static_cast<size_t>((kContextSize - pinned) / 2);
+    size_t excess = prompt.size() - kContextSize + 1;
+    size_t discard = (excess + block - 1) / block * block;
+    const std::vector<Token>& kept = generation.promptTokens();
+    CHECK_EQ(kept.size(), prompt.size() - discard);
+    CHECK(static_cast<int>(kept.size()) < kContextSize);
+    CHECK(std::equal(prompt.begin(), prompt.begin() + pinned, kept.begin()));
+    CHECK(std::equal(prompt.begin() + pinned + discard, prompt.end(), kept.begin() + pinned));
+}
+
+void testPromptThatFitsIsUntouched() {
+    ContextPtr ctx = newContext();
+    std::vector<Token> prompt = promptOf(*ctx, {}, kContextSize - 1);
+    Generation generation(*ctx, "", paramsFor(prompt));
+    CHECK(generation.valid());
+    CHECK(generation.promptTokens() == prompt);
+    CHECK_EQ(ctx->promptCache.truncatedPrompts.load(), uint64_t(0));
+}
+
+void testWithoutPrefixOnlyFirstTokenIsPinned() {
+    ContextPtr ctx = newContext();
+    // One token over drops one block; one token over a block drops two
+    checkTruncation(*ctx, promptOf(*ctx, {}, kContextSize), 1);
+    checkTruncation(*ctx, promptOf(*ctx, {}, kContextSize + (kContextSize - 1) / 2), 1);
+    checkTruncation(*ctx, promptOf(*ctx, {}, 5 * kContextSize), 1);
+    CHECK_EQ(ctx->promptCache.truncatedPrompts.load(), uint64_t(3));
+}
+
+void testPinnedPrefixIsKept() {
+    ContextPtr ctx = newContext();
+    std::vector<Token> prefix = tokenize(*ctx, "### Instruction:\nReply with one JSON action.\n", true);
+    CHECK(prefix.size() > 1 && static_cast<int>(prefix.size()) < kContextSize / 2);
+    pin(*ctx, prefix);
+    int pinned = static_cast<int>(prefix.size());
+    for (size_t length : {size_t(kContextSize), size_t(kContextSize + 7), size_t(3 * kContextSize)}) {
+        checkTruncation(*ctx, promptOf(*ctx, prefix, length), pinned);
+    }
+
+    // Only the part of the prefix the prompt shares is pinned
+    std::vector<Token> other = promptOf(*ctx, {prefix.begin(), prefix.begin() + 3}, 2 * kContextSize);
+    other[3] = prefix[3] + 1;
+    checkTruncation(*ctx, other, 3);
+}
+
+void testPrefixFillingContextRefusesLongPrompt() {
+    ContextPtr ctx = newContext();
+    std::vector<Token> prefix = promptOf(*ctx, tokenize(*ctx, "", true), kContextSize - 1);
+    pin(*ctx, prefix);
+    // No room after the prefix to shift: the prompt cannot be made to fit
+    Generation generation(*ctx, "", paramsFor(promptOf(*ctx, prefix, kContextSize + 4)));
+    CHECK(!generation.valid());
+    CHECK_EQ(generation.result(), std::string(kResponsePromptTooLong));
+    CHECK_EQ(ctx->promptCache.truncatedPrompts.load(), uint64_t(0));
+}
+
+void testReplyShiftsAtEndOfContext() {
+    ContextPtr ctx = newContext();
+    std::string text = "### Instruction:\nReply with one JSON action for the request below.\n### Input:\nhelp me, what can you do for my goals?\n### Response:\n";
+    std::vector<Token> prompt = tokenize(*ctx, text, true);
+    CHECK(static_cast<int>(prompt.size()) > kContextSize / 2 && static_cast<int>(prompt.size()) < kContextSize);
+    std::vector<Token> prefix(prompt.begin(), prompt.begin() + 8);
+    pin(*ctx, prefix);
+
+    // The canned reply does not fit behind this prompt
+    GenerateParams params = paramsFor(prompt);
+    params.maxTokens = 2 * kContextSize;
+    std::string reply = ctx->scheduler->generate(text, params);
+    CHECK(!reply.empty());
+    CHECK(ctx->promptCache.contextShifts.load() >= 1);
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    for (const SequenceState& sequence : ctx->sequences) {
+        CHECK(static_cast<int>(sequence.cachedTokens.size()) <= kContextSize);
+    }
+    const std::vector<Token>& cached = ctx->sequences[0].cachedTokens;
+    CHECK(cached.size() >= prefix.size());
+    CHECK(std::equal(prefix.begin(), prefix.end(), cached.begin()));
+}
+
+} // namespace
+
+int main() {
+    initBackend();
+    testPromptThatFitsIsUntouched();
+    testWithoutPrefixOnlyFirstTokenIsPinned();
+    testPinnedPrefixIsKept();
+    testPrefixFillingContextRefusesLongPrompt();
+    testReplyShiftsAtEndOfContext();
+    return test::checkResult();
+}
@@ -0,0 +1,114 @@
+/**
+ * intent_detector_test.cpp - The DFA matcher against the find() chain it
+ * replaced
+ */
+
+#include "intent_detector.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+using namespace llamacore;
+
+namespace {
+
+/**
+ * The original if/else chain from llama_jni.cpp, lowercasing ASCII only
+ */
+Intent referenceIntent(std::string_view prompt) {
+    std::string lower(prompt);
+    for (char& c : lower) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    auto has = [&lower](const char* word) { return lower.find(word) != std::string::npos; };
+    if (has("create") && has("goal")) {
+        return Intent::CreateGoal;
+    }
+    if (has("add") && has("task")) {
+        return Intent::AddTask;
+    }
+    if (has("list") || has("show")) {
+        return Intent::List;
+    }
+    if (has("help")) {
+        return Intent::Help;
+    }
+    if (has("complete") || has("done") || has("finish")) {
+        return Intent::Complete;
+    }
+    if (has("delete") || has("remove")) {
+        return Intent::Delete;
+    }
+    if (has("progress") || has("how am i") || has("status")) {
+        return Intent::Progress;
+    }
+    return Intent::Default;
+}
+
+void checkAgrees(const std::string& prompt) {
+    Intent expected = referenceIntent(prompt);
+    Intent actual = detectIntent(prompt);
+    if (actual != expected) {
+        test::fail(__FILE__, __LINE__, "\"" + prompt + "\": got " + intentName(actual) + ", expected " +
+                                               intentName(expected));
+    }
+}
+
+void testPriority() {
+    // Earlier branches win when several match
+    CHECK(detectIntent("create a goal and add a task") == Intent::CreateGoal);
+    CHECK(detectIntent("add a task and show the list") == Intent::AddTask);
+    CHECK(detectIntent("show me help") == Intent::List);
+    CHECK(detectIntent("help, is it done?") == Intent::Help);
+    CHECK(detectIntent("remove the finished one") == Intent::Complete);
+    CHECK(detectIntent("delete my progress") == Intent::Delete);
+    CHECK(detectIntent("HOW AM I doing") == Intent::Progress);
+    CHECK(detectIntent("good morning") == Intent::Default);
+    CHECK(detectIntent("") == Intent::Default);
+
+    // Both words of a pair are required, in any order
+    CHECK(detectIntent("create something") == Intent::Default);
+    CHECK(detectIntent("my goal: create") == Intent::CreateGoal);
+    CHECK(detectIntent("address the taskbar") == Intent::AddTask);
+}
+
+void testOverlappingKeywords() {
+    // Keywords that share prefixes or overlap inside one word
+    for (const char* prompt : {"addone", "listatus", "showhelp", "finishow", "hhelp", "ddone", "removelist",
+                               "progresstatus", "how am  i", "how am ithe", "creatgoal", "ccreate goal"}) {
+        checkAgrees(prompt);
+    }
+}
+
+void testRandomAgainstReference() {
+    const std::vector<std::string> pieces = {
+        "create", "goal", "add", "task", "list", "show", "help", "complete", "done", "finish", "delete",
+        "remove", "progress", "how am i", "status", "CrEaTe", "GOAL", "how", "am", "i", "ad", "tas", "lis",
+        "sho", "hel", "don", "stat", " ", "x", "\"quoted\"", "\xC3\xA9", "\xF0\x9F\x98\x80"};
+    std::mt19937 rng(20261016);
+    for (int i = 0; i < 20000; ++i) {
+        std::string prompt;
+        int count = static_cast<int>(rng() % 6);
+        for (int k = 0; k < count; ++k) {
+            prompt += pieces[rng() % pieces.size()];
+            if (rng() % 3 == 0) {
+                prompt += ' ';
+            }
+        }
+        checkAgrees(prompt);
+    }
+}
+
+} // namespace
+
+int main() {
+    testPriority();
+    testOverlappingKeywords();
+    testRandomAgainstReference();
+    return test::checkResult();
+}
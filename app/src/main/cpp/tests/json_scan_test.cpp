@@ -0,0 +1,179 @@
+/**
+ * json_scan_test.cpp - Locating and checking the action object of a reply
+ *
+ * Stage 1 carries string and escape state from one 64 byte block to the
+ * next, so quotes and backslash runs are placed at every offset around
+ * the block boundaries.
+ */
+
+#include "json_scan.h"
+
+#include <string>
+
+#include "check.h"
+
+using namespace llamacore;
+
+namespace {
+
+const char* name(ScanStatus status) {
+    switch (status) {
+        case ScanStatus::NoObject: return "NoObject";
+        case ScanStatus::Malformed: return "Malformed";
+        case ScanStatus::OffSchema: return "OffSchema";
+        case ScanStatus::Valid: return "Valid";
+    }
+    return "?";
+}
+
+ScanStatus status(const std::string& reply) {
+    return scanAction(reply).status;
+}
+
+#define CHECK_SCAN(reply, expected) CHECK_EQ(std::string(name(status(reply))), std::string(name(expected)))
+
+std::string reply(const std::string& messageJson) {
+    return R"({"action":"reply","message":")" + messageJson + R"(","data":{}})";
+}
+
+void testLocatesFirstObject() {
+    std::string object = reply("Hi");
+    std::string text = "Sure! " + object + " and {\"action\":\"x\"}";
+    ActionScan scan = scanAction(text);
+    CHECK_SCAN(text, ScanStatus::Valid);
+    CHECK_EQ(scan.begin, size_t(6));
+    CHECK_EQ(scan.end, size_t(6) + object.size());
+
+    CHECK_SCAN("", ScanStatus::NoObject);
+    CHECK_SCAN("no braces at all", ScanStatus::NoObject);
+    CHECK_SCAN("closing only }", ScanStatus::NoObject);
+}
+
+void testEscapes() {
+    CHECK_SCAN(reply(R"(quote \" brace } bracket ] colon : comma ,)"), ScanStatus::Valid);
+    CHECK_SCAN(reply(R"(backslash \\)"), ScanStatus::Valid);
+    CHECK_SCAN(reply(R"(three \\\" quoted)"), ScanStatus::Valid);
+    CHECK_SCAN(reply(R"(\/ \b \f \n \r \t é 🏃)"), ScanStatus::Valid);
+    CHECK_SCAN(reply("raw\ttab and\nnewline"), ScanStatus::Valid);
+
+    CHECK_SCAN(reply(R"(bad \x escape)"), ScanStatus::Malformed);
+    CHECK_SCAN(reply(R"(short \u12)"), ScanStatus::Malformed);
+    CHECK_SCAN(reply(R"(short \u12g4)"), ScanStatus::Malformed);
+    // An even run leaves the quote unescaped: the string ends early
+    CHECK_SCAN(reply(R"(two \\" closes)"), ScanStatus::Malformed);
+    CHECK_SCAN(R"({"action":"reply","message":"unterminated)", ScanStatus::Malformed);
+    CHECK_SCAN(R"({"action":"reply","message":"ends in \)", ScanStatus::Malformed);
+}
+
+void testAcrossBlockBoundaries() {
+    const std::string tricky = R"(a\\\"b}{\\c\"d,:[)";
+    for (size_t lead = 0; lead < 4; ++lead) {
+        for (size_t pad = 0; pad <= 140; ++pad) {
+            std::string text = std::string(lead, ' ') + reply(std::string(pad, 'x') + tricky);
+            ActionScan scan = scanAction(text);
+            CHECK_SCAN(text, ScanStatus::Valid);
+            CHECK_EQ(scan.begin, lead);
+            CHECK_EQ(scan.end, text.size());
+
+            // Backslash runs that straddle a boundary, odd and even
+            std::string odd = reply(std::string(pad, 'x') + std::string(5, '\\') + "\"");
+            CHECK_SCAN(odd, ScanStatus::Valid);
+            std::string even = reply(std::string(pad, 'x') + std::string(4, '\\') + "\" x");
+            CHECK_SCAN(even, ScanStatus::Malformed);
+        }
+    }
+
+    // Long replies: the object ends many blocks in and text follows it
+    std::string object = reply(std::string(1000, 'm') + R"(\")");
+    std::string text = std::string(300, '.') + object + std::string(200, '}');
+    ActionScan scan = scanAction(text);
+    CHECK_SCAN(text, ScanStatus::Valid);
+    CHECK_EQ(scan.end, 300 + object.size());
+}
+
+std::string nested(int depth, char open, char close) {
+    std::string inner(1, open);
+    inner += close;
+    for (int i = 1; i < depth; ++i) {
+        inner = open == '{' ? "{\"k\":" + inner + "}" : "[" + inner + "]";
+    }
+    return inner;
+}
+
+void testDepth() {
+    // The top object is level 1; sixteen levels are allowed
+    CHECK_SCAN(nested(16, '{', '}'), ScanStatus::OffSchema);
+    CHECK_SCAN(nested(17, '{', '}'), ScanStatus::Malformed);
+    CHECK_SCAN("{\"k\":" + nested(15, '[', ']') + "}", ScanStatus::OffSchema);
+    CHECK_SCAN("{\"k\":" + nested(16, '[', ']') + "}", ScanStatus::Malformed);
+    CHECK_SCAN(std::string(100000, '{'), ScanStatus::Malformed);
+}
+
+void testMalformed() {
+    for (const char* text : {
+             R"({"action":"reply",})",
+             R"({"action" "reply"})",
+             R"({"action":reply})",
+             R"({'action':'reply'})",
+             R"({"n":01x})",
+             R"({"n":1.})",
+             R"({"n":-})",
+             R"({"n":1e})",
+             R"({"a":[1,2,]})",
+             R"({"a":{"b":1})",
+             R"({"a":tru})",
+             R"({"a" : "b" "c"})",
+         }) {
+        CHECK_SCAN(text, ScanStatus::Malformed);
+    }
+    for (const char* text : {
+             R"({})",
+             R"( { "n" : -1.5e+3 , "t" : true , "f":false, "z":null, "a":[1,"x",{}] } )",
+         }) {
+        CHECK_SCAN(text, ScanStatus::OffSchema);
+    }
+}
+
+void testSchema() {
+    for (const char* text : {
+             R"({"action":"create_goal","message":"m","data":{"goalTitle":"g","durationMonths":3,"dailyMinutes":30}})",
+             R"({"data":{"dailyMinutes":30,"goalTitle":"g","durationMonths":3},"message":"m","action":"create_goal"})",
+             R"({"action":"create_task","message":"m","data":{"taskTitle":"t","dueDate":"today","minutes":5}})",
+             R"({"action":"create_task","message":"m","data":{"taskTitle":"t","dueDate":"today","minutes":5,"goalTitle":"g"}})",
+             R"({"action":"complete_task","message":"m","data":{"taskTitle":"t"}})",
+             R"({"action":"delete_goal","message":"m","data":{"goalTitle":"g"}})",
+             R"({"action":"delete_task","message":"m","data":{"taskTitle":"t"}})",
+             R"({"action":"show_progress","message":"m","data":{}})",
+         }) {
+        CHECK_SCAN(text, ScanStatus::Valid);
+    }
+    for (const char* text : {
+             R"({"action":"reply","message":"m"})",
+             R"({"action":"reply","message":"m","data":{},"extra":1})",
+             R"({"action":"reply","message":"m","data":[]})",
+             R"({"action":"reply","message":1,"data":{}})",
+             R"({"action":"dance","message":"m","data":{}})",
+             R"({"action":"reply","message":"m","data":{"x":"y"}})",
+             R"({"action":"create_goal","message":"m","data":{"goalTitle":"g","durationMonths":"3","dailyMinutes":30}})",
+             R"({"action":"create_goal","message":"m","data":{"goalTitle":"g","durationMonths":-3,"dailyMinutes":30}})",
+             R"({"action":"create_goal","message":"m","data":{"goalTitle":"g","durationMonths":1.5,"dailyMinutes":30}})",
+             R"({"action":"create_goal","message":"m","data":{"goal_title":"g","duration_months":3,"daily_minutes":30}})",
+             R"({"action":"create_task","message":"m","data":{"taskTitle":"t","minutes":5}})",
+             R"({"action":"delete_task","message":"m","data":{"taskTitle":"t","taskTitle":"u"}})",
+             R"({"action":"complete_task","message":"m","data":{"taskTitle":null}})",
+         }) {
+        CHECK_SCAN(text, ScanStatus::OffSchema);
+    }
+}
+
+} // namespace
+
+int main() {
+    testLocatesFirstObject();
+    testEscapes();
+    testAcrossBlockBoundaries();
+    testDepth();
+    testMalformed();
+    testSchema();
+    return test::checkResult();
+}
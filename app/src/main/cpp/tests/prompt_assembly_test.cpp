@@ -0,0 +1,121 @@
+/**
+ * prompt_assembly_test.cpp - Assembled prompts against buildSimplePrompt
+ * and whole-prompt tokenization
+ *
+ * Runs on both stub vocabularies, as template_tokens_test.cpp does.
+ */
+
+#include "prompt_assembly.h"
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "llama_core.h"
+#include "template_tokens.h"
+
+using namespace llamacore;
+
+namespace {
+
+// PromptTemplates.SIMPLE_PROMPT_PREFIX, _INPUT and _SUFFIX
+const PromptFormat kFormat{
+        "### Instruction:\n"
+        "Reply in JSON only. Format: {\"action\":\"<type>\",\"message\":\"<text>\",\"data\":{...}}\n"
+        "Actions: reply, create_goal, create_task, complete_task, show_progress\n"
+        "create_goal data: goalTitle, durationMonths, dailyMinutes\n"
+        "create_task data: taskTitle, dueDate, minutes\n"
+        "Output JSON only, no other text.\n",
+        "\n\n### Input:\n",
+        "\n\n### Response (JSON only):\n"};
+
+/**
+ * PromptTemplates.buildSimplePrompt
+ */
+std::string buildSimplePrompt(const PromptContext& context) {
+    std::string sb;
+    if (!context.goals.empty()) {
+        sb += "\nContext - Goals: ";
+        for (size_t i = 0; i < context.goals.size(); ++i) {
+            const GoalItem& goal = context.goals[i];
+            if (i > 0) sb += "; ";
+            sb += std::string(goal.title) + "|" + std::to_string(goal.dailyMinutes) + "min|ends:" +
+                  std::string(goal.endDate);
+        }
+    }
+    if (!context.tasks.empty()) {
+        sb += "\nContext - Today's Tasks: ";
+        for (size_t i = 0; i < context.tasks.size(); ++i) {
+            const TaskItem& task = context.tasks[i];
+            if (i > 0) sb += "; ";
+            sb += task.completed ? "\xE2\x9C\x93" : "\xE2\x97\x8B";  // ✓ / ○
+            sb += task.title;
+            if (task.minutes > 0) sb += "|" + std::to_string(task.minutes) + "min";
+        }
+    }
+    if (context.goals.empty() && context.tasks.empty()) {
+        sb += "\nContext: No active goals or tasks yet.";
+    }
+    return kFormat.head + sb + kFormat.input + std::string(context.userMessage) + kFormat.tail;
+}
+
+std::vector<PromptContext> contexts() {
+    const std::vector<GoalItem> goals = {{"Learn Spanish", 30, "2026-06-01"}, {"Run a marathon", 45, "2026-09-15"}};
+    const std::vector<TaskItem> tasks = {{"Review notes", true, 20}, {"Morning run", false, 0}};
+    return {
+        {goals, {}, "How am I doing today?"},
+        {{}, tasks, "Add a task to stretch"},
+        {goals, tasks, "What's next?"},
+        {{}, {}, "Hello"},
+        {goals, tasks, ""},
+        {goals, tasks, " starts with a space"},
+        {goals, tasks, "\nstarts with a line break"},
+        {goals, tasks, "two\nlines\n\n"},
+        {{{"Split\ntitle", 10, ""}}, {{"", false, 5}}, "caf\xC3\xA9 \xF0\x9F\x8E\xAF"},
+    };
+}
+
+void testMatchesKotlin(BackendModel* model) {
+    uint64_t vocab = vocabularyKey(model);
+    tokenSpans().clear();
+    for (int turn = 0; turn < 2; ++turn) {
+        for (const PromptContext& context : contexts()) {
+            AssembledPrompt prompt = assemblePrompt(kFormat, context, vocab, model);
+            CHECK_EQ(prompt.text, buildSimplePrompt(context));
+            CHECK(*prompt.tokens == backend::tokenize(model, prompt.text, true));
+        }
+    }
+}
+
+void testSpansCached(BackendModel* model) {
+    uint64_t vocab = vocabularyKey(model);
+    tokenSpans().clear();
+    PromptContext context = contexts()[2];
+    TokenSpanStats before = tokenSpans().stats();
+    assemblePrompt(kFormat, context, vocab, model);
+    TokenSpanStats first = tokenSpans().stats();
+    CHECK_EQ(first.hits, before.hits);
+    CHECK(first.misses > before.misses);
+
+    // A new message tokenizes nothing else
+    context.userMessage = "And tomorrow?";
+    AssembledPrompt prompt = assemblePrompt(kFormat, context, vocab, model);
+    TokenSpanStats second = tokenSpans().stats();
+    CHECK_EQ(second.misses, first.misses);
+    CHECK_EQ(second.hits, first.hits + (first.misses - before.misses));
+    CHECK(*prompt.tokens == backend::tokenize(model, prompt.text, true));
+}
+
+} // namespace
+
+int main() {
+    initBackend();
+    for (const char* path : {"/test/vocab.gguf", "/test/vocab.spm.gguf"}) {
+        BackendModel* model = backend::loadModel(path, ModelParams());
+        CHECK(model != nullptr);
+        testMatchesKotlin(model);
+        testSpansCached(model);
+        backend::freeModel(model);
+    }
+    return test::checkResult();
+}
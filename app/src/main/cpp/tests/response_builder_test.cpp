@@ -0,0 +1,53 @@
+/**
+ * response_builder_test.cpp - Stub replies and title extraction
+ */
+
+#include "response_builder.h"
+
+#include <string>
+
+#include "check.h"
+
+using namespace llamacore;
+
+namespace {
+
+void testExtractQuoted() {
+    CHECK_EQ(extractQuoted("Create a goal \"Learn Spanish\" by June", "x"), std::string("Learn Spanish"));
+    CHECK_EQ(extractQuoted("\"\" is empty", "x"), std::string(""));
+    CHECK_EQ(extractQuoted("only \"one quote", "fallback"), std::string("fallback"));
+    CHECK_EQ(extractQuoted("no quotes", "fallback"), std::string("fallback"));
+    CHECK_EQ(extractQuoted("\"a\" and \"b\"", "x"), std::string("a"));
+}
+
+void testBuildResponse() {
+    std::string goal = buildResponse(Intent::CreateGoal, "create goal \"Run a marathon\"");
+    CHECK(goal.find("\"action\":\"create_goal\"") != std::string::npos);
+    CHECK(goal.find("\"goalTitle\":\"Run a marathon\"") != std::string::npos);
+
+    std::string task = buildResponse(Intent::AddTask, "add task");
+    CHECK(task.find("\"action\":\"create_task\"") != std::string::npos);
+    CHECK(task.find("\"taskTitle\":\"New Task\"") != std::string::npos);
+
+    CHECK(buildResponse(Intent::Progress, "").find("\"action\":\"show_progress\"") != std::string::npos);
+    CHECK(buildResponse(Intent::Complete, "done").find("\"action\":\"complete_task\"") != std::string::npos);
+    CHECK(buildResponse(Intent::Default, "hi").find("\"action\":\"reply\"") != std::string::npos);
+}
+
+void testCannedReplies() {
+    for (const char* reply : {kResponseModelNotLoaded, kResponseNoModel, kResponseInvalidPrompt,
+                              kResponsePromptTooLong, kResponseDecodeFailed, kResponseCancelled}) {
+        std::string text(reply);
+        CHECK(text.front() == '{' && text.back() == '}');
+        CHECK(text.find("\"action\":\"reply\"") != std::string::npos);
+    }
+}
+
+} // namespace
+
+int main() {
+    testExtractQuoted();
+    testBuildResponse();
+    testCannedReplies();
+    return test::checkResult();
+}
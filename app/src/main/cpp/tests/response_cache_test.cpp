@@ -0,0 +1,156 @@
+/**
+ * response_cache_test.cpp - LRU eviction and context invalidation in the reply cache
+ */
+
+#include "response_cache.h"
+
+#include <string>
+
+#include "check.h"
+
+using namespace llamacore;
+
+namespace {
+
+constexpr uint64_t kModel = 0x1111;
+constexpr uint64_t kOtherModel = 0x2222;
+constexpr uint64_t kVariant = 7;
+
+std::string prompt(const std::string& input, const std::string& context = "Goals: Run") {
+    return "### Instruction:\nReply with an action.\nContext - " + context + "\n### Input:\n" + input +
+           "\n### Response:\n";
+}
+
+bool has(ResponseCache& cache, uint64_t modelId, const std::string& text) {
+    std::string out;
+    return cache.lookup(modelId, kVariant, text, out);
+}
+
+/**
+ * Bytes one entry of this prompt/reply shape occupies
+ */
+size_t entryBytes(const std::string& text, const std::string& reply) {
+    ResponseCache probe(1 << 20);
+    probe.store(kModel, kVariant, text, reply);
+    return probe.stats().bytes;
+}
+
+void testHitAndMiss() {
+    ResponseCache cache(1 << 20);
+    std::string out;
+    CHECK(!cache.lookup(kModel, kVariant, prompt("help"), out));
+    cache.store(kModel, kVariant, prompt("help"), "{\"action\":\"help\"}");
+    CHECK(cache.lookup(kModel, kVariant, prompt("help"), out));
+    CHECK_EQ(out, std::string("{\"action\":\"help\"}"));
+
+    // Whitespace differences share an entry; model and variant do not
+    CHECK(cache.lookup(kModel, kVariant, "  " + prompt("help") + "\n\n", out));
+    CHECK(!cache.lookup(kModel, kVariant + 1, prompt("help"), out));
+    CHECK(!cache.lookup(kOtherModel, kVariant, prompt("help"), out));
+
+    ResponseCacheStats stats = cache.stats();
+    CHECK_EQ(stats.hits, uint64_t(2));
+    CHECK_EQ(stats.misses, uint64_t(3));
+    CHECK_EQ(stats.entries, size_t(1));
+}
+
+void testLeastRecentlyUsedIsEvicted() {
+    const std::string reply = "{\"action\":\"show_progress\"}";
+    size_t bytes = entryBytes(prompt("a"), reply);
+    ResponseCache cache(3 * bytes);
+
+    cache.store(kModel, kVariant, prompt("a"), reply);
+    cache.store(kModel, kVariant, prompt("b"), reply);
+    cache.store(kModel, kVariant, prompt("c"), reply);
+    CHECK_EQ(cache.stats().entries, size_t(3));
+    CHECK_EQ(cache.stats().bytes, 3 * bytes);
+
+    // Touching "a" makes "b" the oldest
+    CHECK(has(cache, kModel, prompt("a")));
+    cache.store(kModel, kVariant, prompt("d"), reply);
+    CHECK(!has(cache, kModel, prompt("b")));
+    CHECK(has(cache, kModel, prompt("a")));
+    CHECK(has(cache, kModel, prompt("c")));
+    CHECK(has(cache, kModel, prompt("d")));
+    CHECK_EQ(cache.stats().evicted, uint64_t(1));
+    CHECK(cache.stats().bytes <= cache.stats().capacityBytes);
+
+    // Storing an existing prompt replaces it instead of adding a second copy
+    cache.store(kModel, kVariant, prompt("a"), reply);
+    CHECK_EQ(cache.stats().entries, size_t(3));
+    CHECK_EQ(cache.stats().evicted, uint64_t(1));
+}
+
+void testOversizedReplyIsNotStored() {
+    const std::string reply = "{}";
+    size_t bytes = entryBytes(prompt("a"), reply);
+    ResponseCache cache(bytes);
+    cache.store(kModel, kVariant, prompt("a"), reply);
+    cache.store(kModel, kVariant, prompt("b"), std::string(bytes, 'x'));
+    CHECK(has(cache, kModel, prompt("a")));
+    CHECK(!has(cache, kModel, prompt("b")));
+    CHECK_EQ(cache.stats().evicted, uint64_t(0));
+}
+
+void testShrinkingCapacityEvicts() {
+    const std::string reply = "{}";
+    size_t bytes = entryBytes(prompt("a"), reply);
+    ResponseCache cache(4 * bytes);
+    for (const char* input : {"a", "b", "c", "d"}) {
+        cache.store(kModel, kVariant, prompt(input), reply);
+    }
+    cache.setCapacity(2 * bytes);
+    CHECK_EQ(cache.stats().entries, size_t(2));
+    CHECK(has(cache, kModel, prompt("d")));
+    CHECK(!has(cache, kModel, prompt("a")));
+
+    cache.setCapacity(0);
+    CHECK_EQ(cache.stats().entries, size_t(0));
+    CHECK_EQ(cache.stats().bytes, size_t(0));
+    cache.store(kModel, kVariant, prompt("a"), reply);
+    CHECK(!has(cache, kModel, prompt("a")));
+}
+
+void testContextChangeInvalidates() {
+    ResponseCache cache(1 << 20);
+    const std::string reply = "{\"action\":\"show_progress\"}";
+    cache.store(kModel, kVariant, prompt("progress", "Goals: Run"), reply);
+    cache.store(kModel, kVariant, prompt("help", "Goals: Run"), reply);
+    cache.store(kOtherModel, kVariant, prompt("progress", "Goals: Run"), reply);
+    CHECK(has(cache, kModel, prompt("progress", "Goals: Run")));
+
+    // A new goal list drops this model's entries, not the other model's
+    CHECK(!has(cache, kModel, prompt("progress", "Goals: Run, Read")));
+    CHECK_EQ(cache.stats().invalidated, uint64_t(2));
+    CHECK(!has(cache, kModel, prompt("help", "Goals: Run, Read")));
+    CHECK(has(cache, kOtherModel, prompt("progress", "Goals: Run")));
+
+    // A reply that finishes after the context moved on is stale and skipped
+    cache.store(kModel, kVariant, prompt("help", "Goals: Run"), reply);
+    CHECK_EQ(cache.stats().entries, size_t(1));
+
+    // Re-indenting the context is not a change
+    cache.store(kModel, kVariant, prompt("help", "Goals: Run, Read"), reply);
+    CHECK(has(cache, kModel, prompt("help", "Goals:   Run,\n Read")));
+    CHECK_EQ(cache.stats().invalidated, uint64_t(2));
+}
+
+void testPromptWithoutContextSurvives() {
+    ResponseCache cache(1 << 20);
+    cache.store(kModel, kVariant, "help", "{}");
+    cache.store(kModel, kVariant, prompt("a", "Goals: Run"), "{}");
+    CHECK(!has(cache, kModel, prompt("a", "Goals: Swim")));
+    CHECK(has(cache, kModel, "help"));
+}
+
+} // namespace
+
+int main() {
+    testHitAndMiss();
+    testLeastRecentlyUsedIsEvicted();
+    testOversizedReplyIsNotStored();
+    testShrinkingCapacityEvicts();
+    testContextChangeInvalidates();
+    testPromptWithoutContextSurvives();
+    return test::checkResult();
+}
@@ -0,0 +1,197 @@
+/**
+ * template_tokens_test.cpp - Cached template tokens against whole-prompt
+ * tokenization, and token files
+ *
+ * Runs on both stub vocabularies: the BPE-like one and the SentencePiece-
+ * like one (*.spm.gguf), whose every tokenize call starts with a space
+ * prefix token.
+ */
+
+#include "template_tokens.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "llama_core.h"
+
+using namespace llamacore;
+
+namespace {
+
+const std::string kHead = "### Instruction:\nReply with one JSON action.\n\n";
+const std::string kLongHead = kHead + "Example:\n{\"action\":\"reply\"}\n\n";
+const std::string kTail = "\n\n### Response (JSON only):\n";
+
+struct Model {
+    BackendModel* model;
+    uint64_t vocab;
+};
+
+Model load(const std::string& path) {
+    BackendModel* model = backend::loadModel(path, ModelParams());
+    CHECK(model != nullptr);
+    return Model{model, vocabularyKey(model)};
+}
+
+std::vector<std::string> prompts() {
+    const std::string middle = "Context - Goals: Run, Read\n\n### Input:\nhello there, what's next?";
+    return {
+        kHead + middle + kTail,
+        kLongHead + middle + kTail,
+        kHead + "\n" + middle + kTail,    // the middle opens with a blank line
+        kHead + middle + "\n" + kTail,    // and ends with one
+        kHead + " " + middle + kTail,     // a space after the head
+        kHead + "Done.\n" + kTail,        // punctuation before the tail's line breaks
+        kHead + middle,                   // head only
+        middle + kTail,                   // tail only
+        kHead + kTail,                    // nothing in between
+        middle,                           // no template
+        kHead.substr(0, 10) + middle,     // a partial head is no head
+        "caf\xC3\xA9 \xF0\x9F\x8E\xAF" + kTail,
+    };
+}
+
+void testMatchesWholePrompt(const Model& m) {
+    TemplateTokens cache;
+    CHECK(cache.add(m.vocab, m.model, kHead, true));
+    CHECK(cache.add(m.vocab, m.model, kLongHead, true));
+    CHECK(cache.add(m.vocab, m.model, kTail, false));
+    CHECK(!cache.add(m.vocab, m.model, "", true));
+
+    for (const std::string& prompt : prompts()) {
+        CHECK(cache.tokenize(m.vocab, m.model, prompt) == backend::tokenize(m.model, prompt, true));
+    }
+    TemplateTokenStats stats = cache.stats();
+    CHECK_EQ(stats.prompts, uint64_t(prompts().size()));
+    CHECK_EQ(stats.templated, uint64_t(prompts().size() - 2));
+    CHECK_EQ(stats.templates, size_t(3));
+}
+
+void testTokenBoundaries() {
+    const std::string text = "a.\n\nb\n c\n";
+    CHECK(!isTokenBoundary(text, 0));
+    CHECK(!isTokenBoundary(text, 3));   // inside a run of line breaks
+    CHECK(isTokenBoundary(text, 4));
+    CHECK(!isTokenBoundary(text, 6));   // before a space
+    CHECK(!isTokenBoundary(text, 9));   // at the end
+}
+
+void testAfterLineBreak(const Model& m) {
+    // The piece a whole prompt has for the text after a token boundary
+    for (const std::string text : {"hello", "### Input:\n", "[/INST]", "x", "{\"a\":1}\n\n"}) {
+        CHECK(isTokenBoundary("line\n" + text, 5));
+        std::vector<Token> whole = backend::tokenize(m.model, "line\n" + text, true);
+        std::vector<Token> head = backend::tokenize(m.model, "line\n", true);
+        std::vector<Token> piece = tokenizeAfterLineBreak(m.model, text);
+        head.insert(head.end(), piece.begin(), piece.end());
+        CHECK(head == whole);
+    }
+}
+
+std::string tempPath(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+void testSaveAndLoad(const Model& m, const Model& other) {
+    std::string path = tempPath("llamacore-template-tokens");
+    TemplateTokens written;
+    CHECK(!written.save(path, m.vocab));  // nothing to save
+    written.add(m.vocab, m.model, kHead, true);
+    written.add(m.vocab, m.model, kTail, false);
+    CHECK(written.save(path, m.vocab));
+
+    TemplateTokens read;
+    CHECK(read.load(path, m.vocab));
+    CHECK_EQ(read.stats().templates, size_t(2));
+    for (const std::string& prompt : prompts()) {
+        CHECK(read.tokenize(m.vocab, m.model, prompt) == written.tokenize(m.vocab, m.model, prompt));
+    }
+    CHECK_EQ(read.stats().templated, uint64_t(prompts().size() - 2));
+
+    // Another vocabulary's file adds nothing
+    TemplateTokens foreign;
+    CHECK(m.vocab != other.vocab);
+    CHECK(!foreign.load(path, other.vocab));
+    CHECK(!foreign.load(tempPath("llamacore-no-such-file"), m.vocab));
+    CHECK_EQ(foreign.stats().templates, size_t(0));
+    std::remove(path.c_str());
+}
+
+std::string readFile(const std::string& path) {
+    std::string data;
+    FILE* in = std::fopen(path.c_str(), "rb");
+    for (int c; in != nullptr && (c = std::fgetc(in)) != EOF;) {
+        data.push_back(static_cast<char>(c));
+    }
+    if (in != nullptr) {
+        std::fclose(in);
+    }
+    return data;
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    FILE* out = std::fopen(path.c_str(), "wb");
+    std::fwrite(data.data(), 1, data.size(), out);
+    std::fclose(out);
+}
+
+void testCorruptFiles(const Model& m) {
+    std::string path = tempPath("llamacore-template-tokens-corrupt");
+    TemplateTokens written;
+    written.add(m.vocab, m.model, kHead, true);
+    written.add(m.vocab, m.model, kTail, false);
+    CHECK(written.save(path, m.vocab));
+    const std::string good = readFile(path);
+    CHECK(good.size() > 64);
+
+    // Header is 24 bytes, each entry record 32 more before its text
+    std::vector<std::string> corrupt = {
+        good.substr(0, good.size() - 1),  // truncated tokens
+        good.substr(0, 30),               // truncated entry record
+        good + "x",                       // trailing bytes
+        "garbage",
+    };
+    std::string badMagic = good;
+    badMagic[0] = 'X';
+    corrupt.push_back(badMagic);
+    std::string badVersion = good;
+    badVersion[8] = 1;
+    corrupt.push_back(badVersion);
+    std::string badText = good;
+    badText[24 + 32] ^= 0x20;  // first template's text no longer matches its hash
+    corrupt.push_back(badText);
+    std::string badCut = good;
+    badCut[24 + 20] += 1;  // first template's cut no longer at a token boundary
+    corrupt.push_back(badCut);
+
+    for (const std::string& data : corrupt) {
+        writeFile(path, data);
+        TemplateTokens read;
+        CHECK(!read.load(path, m.vocab));
+        CHECK_EQ(read.stats().templates, size_t(0));
+    }
+    std::remove(path.c_str());
+}
+
+} // namespace
+
+int main() {
+    initBackend();
+    Model bpe = load("/test/vocab.gguf");
+    Model spm = load("/test/vocab.spm.gguf");
+    CHECK(backend::tokenize(spm.model, "x", false).size() == 2);
+    testTokenBoundaries();
+    for (const Model* m : {&bpe, &spm}) {
+        testMatchesWholePrompt(*m);
+        testAfterLineBreak(*m);
+        testCorruptFiles(*m);
+    }
+    testSaveAndLoad(bpe, spm);
+    testSaveAndLoad(spm, bpe);
+    backend::freeModel(bpe.model);
+    backend::freeModel(spm.model);
+    return test::checkResult();
+}
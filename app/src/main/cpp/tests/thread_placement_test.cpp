@@ -0,0 +1,116 @@
+/**
+ * thread_placement_test.cpp - CPU sets and decode thread counts from
+ * fixture core frequencies
+ */
+
+#include "thread_placement.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+using namespace llamacore;
+
+namespace {
+
+// cpuinfo_max_freq in kHz, per core, of common phone layouts
+const std::vector<long> kThreeClusters = {1800000, 1800000, 1800000, 1800000, 2400000, 2400000, 2400000, 3000000};
+const std::vector<long> kTwoTwoFour = {2000000, 2000000, 2000000, 2000000, 2850000, 2850000, 3050000, 3050000};
+const std::vector<long> kBigLittle = {1700000, 1700000, 1700000, 1700000, 2800000, 2800000, 2800000, 2800000};
+const std::vector<long> kUniform = {2000000, 2000000, 2000000, 2000000};
+const std::vector<long> kUnknown = {0, 0, 0, 0, 0, 0};
+
+const std::vector<int> kUpperFour = {4, 5, 6, 7};
+
+std::filesystem::path writeFixture(const std::vector<std::string>& contents) {
+    std::filesystem::path root = std::filesystem::temp_directory_path() /
+                                 ("llamacore-cpus-" + std::to_string(std::rand()));
+    for (size_t cpu = 0; cpu < contents.size(); ++cpu) {
+        if (contents[cpu].empty()) {
+            continue;  // no cpufreq for this core
+        }
+        std::filesystem::path dir = root / ("cpu" + std::to_string(cpu)) / "cpufreq";
+        std::filesystem::create_directories(dir);
+        FILE* file = std::fopen((dir / "cpuinfo_max_freq").c_str(), "w");
+        std::fputs(contents[cpu].c_str(), file);
+        std::fclose(file);
+    }
+    return root;
+}
+
+void testReadsFrequencies() {
+    std::filesystem::path root = writeFixture({"1800000\n", "1800000\n", "3000000\n", "", "garbage\n"});
+    std::vector<long> frequencies = cpuMaxFrequencies(root.string(), 6);
+    CHECK(frequencies == std::vector<long>({1800000, 1800000, 3000000, 0, 0, 0}));
+    CHECK(performanceCores(frequencies) == std::vector<int>({2}));
+    std::filesystem::remove_all(root);
+
+    CHECK(cpuMaxFrequencies("/nonexistent", 3) == std::vector<long>(3, 0));
+}
+
+void testPerformanceCoresDropOnlyTheSlowestCluster() {
+    // The prime core alone would be one decode thread
+    CHECK(performanceCores(kThreeClusters) == kUpperFour);
+    CHECK(performanceCores(kTwoTwoFour) == kUpperFour);
+    CHECK(performanceCores(kBigLittle) == kUpperFour);
+    CHECK(performanceCores(kUniform).empty());
+    CHECK(performanceCores(kUnknown).empty());
+    CHECK(performanceCores({}).empty());
+
+    // A core without cpufreq is in no cluster
+    CHECK(performanceCores({1800000, 0, 1800000, 2400000}) == std::vector<int>({3}));
+}
+
+void testParseCpuSet() {
+    bool ok = false;
+    CHECK(parseCpuSet("0-3,6", &ok) == std::vector<int>({0, 1, 2, 3, 6}));
+    CHECK(ok);
+    CHECK(parseCpuSet("6,2,2-3", &ok) == std::vector<int>({2, 3, 6}));
+    CHECK(ok);
+    CHECK(parseCpuSet("", &ok).empty());
+    CHECK(ok);
+    for (const char* bad : {"3-1", "a", "1-", "-1", "1-2x", "1,,2"}) {
+        CHECK(parseCpuSet(bad, &ok).empty());
+        CHECK(!ok);
+    }
+
+    CHECK(parseCpuSet("performance", kThreeClusters, &ok) == kUpperFour);
+    CHECK(ok);
+    CHECK(parseCpuSet("performance", kUniform, &ok).empty());
+    CHECK(ok);
+    CHECK_EQ(formatCpuSet(parseCpuSet("0-3,5,7-8")), std::string("0-3,5,7-8"));
+}
+
+void testResolveThreadCount() {
+    ThreadPlacement any;
+    ThreadPlacement performance;
+    performance.cpus = parseCpuSet("performance", kThreeClusters);
+
+    // Default: one thread per performance core, else per online core
+    CHECK_EQ(resolveThreadCount(0, any, kThreeClusters), 4);
+    CHECK_EQ(resolveThreadCount(0, performance, kThreeClusters), 4);
+    CHECK_EQ(resolveThreadCount(-1, any, kUniform), 4);
+    CHECK_EQ(resolveThreadCount(0, any, kUnknown), 6);
+
+    // Explicit counts stand, but not beyond the cores of a set
+    CHECK_EQ(resolveThreadCount(6, any, kThreeClusters), 6);
+    CHECK_EQ(resolveThreadCount(6, performance, kThreeClusters), 4);
+    ThreadPlacement two;
+    two.cpus = {6, 7};
+    CHECK_EQ(resolveThreadCount(0, two, kThreeClusters), 2);
+    CHECK_EQ(resolveThreadCount(1, two, kThreeClusters), 1);
+}
+
+} // namespace
+
+int main() {
+    testReadsFrequencies();
+    testPerformanceCoresDropOnlyTheSlowestCluster();
+    testParseCpuSet();
+    testResolveThreadCount();
+    return test::checkResult();
+}
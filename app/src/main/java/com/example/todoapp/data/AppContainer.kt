@@ -55,6 +55,6 @@ class AppDataContainer(private val context: Context) : AppContainer {
     }
     
     override val localAssistantRepository: LocalAssistantRepository by lazy {
-        LocalAssistantRepository(context, modelManager)
+        LocalAssistantRepository(context, modelManager, settingsDataStore)
     }
 }
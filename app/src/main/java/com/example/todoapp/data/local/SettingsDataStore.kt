@@ -37,7 +37,8 @@ data class AppSettings(
     val useLocalAssistant: Boolean = true,      // Default to local AI
     val modelQuality: ModelQuality = ModelQuality.FAST,  // Default to fast (1B)
     val maxTokens: Int = 128,                   // Limit output length
-    val generationTimeoutSeconds: Int = 30      // Abort after timeout
+    val generationTimeoutSeconds: Int = 30,     // Abort after timeout
+    val autotuneModel: Boolean = false          // Probe threads/batch size on first load
 )
 
 class SettingsDataStore(private val context: Context) {
@@ -58,6 +59,7 @@ class SettingsDataStore(private val context: Context) {
         private val MODEL_QUALITY = stringPreferencesKey("model_quality")
         private val MAX_TOKENS = intPreferencesKey("max_tokens")
         private val GENERATION_TIMEOUT = intPreferencesKey("generation_timeout")
+        private val AUTOTUNE_MODEL = booleanPreferencesKey("autotune_model")
     }
     
     val settings: Flow<AppSettings> = context.dataStore.data.map { preferences ->
@@ -76,7 +78,8 @@ class SettingsDataStore(private val context: Context) {
             useLocalAssistant = preferences[USE_LOCAL_ASSISTANT] ?: true,
             modelQuality = ModelQuality.valueOf(preferences[MODEL_QUALITY] ?: ModelQuality.FAST.name),
             maxTokens = preferences[MAX_TOKENS] ?: 128,
-            generationTimeoutSeconds = preferences[GENERATION_TIMEOUT] ?: 30
+            generationTimeoutSeconds = preferences[GENERATION_TIMEOUT] ?: 30,
+            autotuneModel = preferences[AUTOTUNE_MODEL] ?: false
         )
     }
     
@@ -136,6 +139,10 @@ class SettingsDataStore(private val context: Context) {
         context.dataStore.edit { it[GENERATION_TIMEOUT] = seconds }
     }
     
+    suspend fun updateAutotuneModel(enabled: Boolean) {
+        context.dataStore.edit { it[AUTOTUNE_MODEL] = enabled }
+    }
+    
     suspend fun clearAllData() {
         context.dataStore.edit { it.clear() }
     }
@@ -0,0 +1,112 @@
+package com.example.todoapp.llm
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * ActionRecord - Decoder for the binary action records written by the
+ * native layer (core/action_record.h)
+ *
+ * The native side parses the model's reply with JsonResponseParser's rules
+ * and fills a 32 byte header followed by the UTF-8 strings, so an
+ * AssistantAction is built here without a JSON string or org.json.
+ */
+object ActionRecord {
+
+    // Header size and field offsets of ActionRecordHeader
+    const val HEADER_BYTES = 32
+    private const val STATUS = 0
+    private const val ACTION = 1
+    private const val FLAGS = 2
+    private const val DURATION_MONTHS = 4
+    private const val DAILY_MINUTES = 8
+    private const val MINUTES = 12
+    private const val MESSAGE_BYTES = 16
+
+    // Record status
+    private const val STATUS_INVALID = 0
+
+    // Record flags
+    private const val FLAG_HAS_GOAL_TITLE = 1
+    private const val FLAG_TRUNCATED = 2
+
+    // Action types, as ActionType in action_record.h (0 is reply)
+    private const val ACTION_CREATE_GOAL = 1
+    private const val ACTION_CREATE_TASK = 2
+    private const val ACTION_COMPLETE_TASK = 3
+    private const val ACTION_DELETE_GOAL = 4
+    private const val ACTION_DELETE_TASK = 5
+    private const val ACTION_SHOW_PROGRESS = 6
+
+    /**
+     * A decoded record
+     *
+     * @param action The action, null where JsonResponseParser.parse would
+     *               return null
+     * @param unparsed The raw reply when action is null, else empty
+     * @param truncated Strings were cut to fit the record buffer
+     */
+    class Decoded(val action: AssistantAction?, val unparsed: String, val truncated: Boolean)
+
+    /**
+     * Direct buffer for LlamaNative.pollAction, in the native byte order
+     */
+    fun allocate(capacity: Int): ByteBuffer =
+        ByteBuffer.allocateDirect(maxOf(capacity, HEADER_BYTES)).order(ByteOrder.nativeOrder())
+
+    /**
+     * Decode the record at the start of a buffer from allocate
+     *
+     * @param length Record bytes, as returned by pollAction
+     */
+    fun decode(buffer: ByteBuffer, length: Int): Decoded {
+        require(length >= HEADER_BYTES) { "Action record of $length bytes" }
+        val lengths = IntArray(4) { buffer.getInt(MESSAGE_BYTES + it * 4) }
+        var offset = HEADER_BYTES
+        val strings = Array(4) { i ->
+            require(lengths[i] in 0..length - offset) { "Action record strings overrun $length bytes" }
+            val text = buffer.utf8(offset, lengths[i])
+            offset += lengths[i]
+            text
+        }
+        val (message, title, dueDate, goalTitle) = strings
+
+        val flags = buffer.get(FLAGS).toInt()
+        val truncated = (flags and FLAG_TRUNCATED) != 0
+        if (buffer.get(STATUS).toInt() == STATUS_INVALID) {
+            return Decoded(null, message, truncated)
+        }
+        val action = when (buffer.get(ACTION).toInt()) {
+            ACTION_CREATE_GOAL -> AssistantAction.CreateGoal(
+                message = message,
+                goalTitle = title,
+                durationMonths = buffer.getInt(DURATION_MONTHS),
+                dailyMinutes = buffer.getInt(DAILY_MINUTES)
+            )
+            ACTION_CREATE_TASK -> AssistantAction.CreateTask(
+                message = message,
+                taskTitle = title,
+                dueDate = dueDate,
+                minutes = buffer.getInt(MINUTES),
+                goalTitle = if ((flags and FLAG_HAS_GOAL_TITLE) != 0) goalTitle else null
+            )
+            ACTION_COMPLETE_TASK -> AssistantAction.CompleteTask(message, title)
+            ACTION_DELETE_GOAL -> AssistantAction.DeleteGoal(message, title)
+            ACTION_DELETE_TASK -> AssistantAction.DeleteTask(message, title)
+            ACTION_SHOW_PROGRESS -> AssistantAction.ShowProgress(message)
+            else -> AssistantAction.Reply(message)
+        }
+        return Decoded(action, "", truncated)
+    }
+
+    private fun ByteBuffer.utf8(offset: Int, length: Int): String {
+        if (length == 0) {
+            return ""
+        }
+        val bytes = ByteArray(length)
+        val view = duplicate()
+        view.position(offset)
+        view.get(bytes)
+        return String(bytes, Charsets.UTF_8)
+    }
+}
@@ -14,6 +14,9 @@ object JsonResponseParser {
     
     private const val TAG = "JsonResponseParser"
     
+    // Per-thread result array for LlamaNative.scanAction
+    private val scanBounds = ThreadLocal.withInitial { IntArray(2) }
+    
     /**
      * Parse LLM response into an AssistantAction
      * 
@@ -22,7 +25,10 @@ object JsonResponseParser {
      */
     fun parse(response: String): AssistantAction? {
         // Try to extract JSON if response contains extra text
-        val jsonStr = extractJson(response)
+        val jsonStr = extractJson(response) ?: run {
+            Log.w(TAG, "No well-formed JSON object in response")
+            return null
+        }
         
         return try {
             val json = JSONObject(jsonStr)
@@ -49,35 +55,64 @@ object JsonResponseParser {
     
     /**
      * Extract JSON object from a response that may contain extra text
+     * 
+     * Uses the native scanner when the library is loaded, which also
+     * checks the object is well-formed
+     * 
+     * @return The object, null if the native scanner found none
      */
-    private fun extractJson(response: String): String {
+    private fun extractJson(response: String): String? {
+        if (LlamaNative.isLibraryLoaded) {
+            val bounds = scanBounds.get()!!
+            return when (LlamaNative.scanAction(response, bounds)) {
+                LlamaNative.SCAN_VALID, LlamaNative.SCAN_OFF_SCHEMA -> response.substring(bounds[0], bounds[1])
+                else -> null
+            }
+        }
+        return extractJsonBraces(response)
+    }
+    
+    /**
+     * extractJson by brace counting, without the native library
+     * 
+     * Like scanAction, takes the object at the first brace and skips
+     * braces inside strings
+     */
+    private fun extractJsonBraces(response: String): String {
         val trimmed = response.trim()
+        val jsonStart = trimmed.indexOf('{')
+        if (jsonStart < 0) {
+            // Return as-is, let JSONObject throw exception
+            return trimmed
+        }
         
-        // If already starts with {, assume it's JSON
-        if (trimmed.startsWith("{")) {
-            // Find matching closing brace
-            var depth = 0
-            var endIndex = -1
-            for (i in trimmed.indices) {
-                when (trimmed[i]) {
-                    '{' -> depth++
-                    '}' -> {
-                        depth--
-                        if (depth == 0) {
-                            endIndex = i
-                            break
-                        }
+        // Find matching closing brace
+        var depth = 0
+        var inString = false
+        var escaped = false
+        for (i in jsonStart until trimmed.length) {
+            val c = trimmed[i]
+            when {
+                escaped -> escaped = false
+                inString -> when (c) {
+                    '\\' -> escaped = true
+                    '"' -> inString = false
+                }
+                c == '"' -> inString = true
+                c == '{' -> depth++
+                c == '}' -> {
+                    depth--
+                    if (depth == 0) {
+                        return trimmed.substring(jsonStart, i + 1)
                     }
                 }
             }
-            return if (endIndex > 0) trimmed.substring(0, endIndex + 1) else trimmed
         }
         
-        // Try to find JSON in the response
-        val jsonStart = trimmed.indexOf('{')
+        // Unbalanced: take up to the last closing brace
         val jsonEnd = trimmed.lastIndexOf('}')
         
-        return if (jsonStart >= 0 && jsonEnd > jsonStart) {
+        return if (jsonEnd > jsonStart) {
             trimmed.substring(jsonStart, jsonEnd + 1)
         } else {
             // Return as-is, let JSONObject throw exception
@@ -149,8 +184,11 @@ object JsonResponseParser {
      * Check if a string appears to be valid JSON
      */
     fun isValidJson(str: String): Boolean {
+        if (LlamaNative.isLibraryLoaded) {
+            return LlamaNative.scanAction(str, scanBounds.get()!!) >= LlamaNative.SCAN_OFF_SCHEMA
+        }
         return try {
-            JSONObject(extractJson(str))
+            JSONObject(extractJsonBraces(str))
             true
         } catch (e: JSONException) {
             false
@@ -90,6 +90,12 @@ class LlamaInference {
     private var modelPath: String? = null
     private var currentThreads: Int = DEFAULT_THREADS
     private var currentContextSize: Int = DEFAULT_CONTEXT_SIZE
+
+    // Native context handle owned by this instance, 0 when none is loaded.
+    // Weights are shared with other handles on the same file, so this does
+    // not double memory next to LocalAssistantRepository.
+    @Volatile
+    private var handle: Long = 0L
     
     /**
      * Initialize the llama.cpp backend
@@ -116,13 +122,31 @@ class LlamaInference {
      * Load a GGUF model file
      * 
      * @param modelPath Path to the .gguf model file
-     * @param threads Number of threads for inference (default: 4)
+     * @param threads Number of threads for inference (default: 4), at most
+     *                one per core of cpuSet
      * @param contextSize Maximum context size in tokens (default: 2048)
+     * @param cpuSet Cores the decode threads are pinned to (default: any
+     *               core), see LlamaNative.initModelWithPlacement
+     * @param priority Decode thread priority (default: normal)
+     * @param kvType KV cache element type, one of LlamaNative.KV_CACHE_
+     *               (default: f16); quantized caches take a half or a
+     *               quarter of the memory per token of context
+     * @param autotuneDir If set, pick threads and batch size by measurement,
+     *                    cached in this directory (threads is then ignored)
+     * @param memoryBudgetBytes Memory the load may allocate besides the
+     *                          mapped weights (default: no limit);
+     *                          contextSize and kvType are reduced to fit, and
+     *                          loading fails if the model cannot
      */
     suspend fun loadModel(
         modelPath: String,
         threads: Int = DEFAULT_THREADS,
-        contextSize: Int = DEFAULT_CONTEXT_SIZE
+        contextSize: Int = DEFAULT_CONTEXT_SIZE,
+        cpuSet: String = LlamaNative.CPU_SET_ANY,
+        priority: Int = LlamaNative.PRIORITY_NORMAL,
+        kvType: Int = LlamaNative.KV_CACHE_F16,
+        autotuneDir: String? = null,
+        memoryBudgetBytes: Long = 0L
     ): Result<Unit> = withContext(Dispatchers.IO) {
         try {
             // Ensure initialized
@@ -133,8 +157,13 @@ class LlamaInference {
             
             _state.value = InferenceState.LOADING
             
-            val success = nativeLoadModel(modelPath, threads, contextSize)
-            if (success) {
+            // Load before releasing the old handle so a reload of the same
+            // file keeps sharing its weights
+            val newHandle = nativeLoadModel(modelPath, threads, contextSize, cpuSet, priority, kvType, autotuneDir, memoryBudgetBytes)
+            if (newHandle != 0L) {
+                LlamaNative.registerPromptTemplates(newHandle)
+                releaseHandle()
+                handle = newHandle
                 this@LlamaInference.modelPath = modelPath
                 this@LlamaInference.currentThreads = threads
                 this@LlamaInference.currentContextSize = contextSize
@@ -176,7 +205,7 @@ class LlamaInference {
             
             _isGenerating.value = true
             
-            val response = nativeGenerate(prompt, maxTokens, temperature, topP)
+            val response = nativeGenerate(handle, prompt, maxTokens, temperature, topP)
             
             _isGenerating.value = false
             
@@ -196,7 +225,11 @@ class LlamaInference {
      * @param prompt Input prompt
      * @param maxTokens Maximum tokens to generate
      * @param temperature Sampling temperature
-     * @param onToken Callback for each generated token
+     * @param onToken Receives the response text as it is decoded: the first
+     *                token immediately, then a few tokens per call. Invoked on
+     *                the native scheduler's worker thread between decode
+     *                passes, with no native lock held. Keep it short: the
+     *                next pass of every generation on this model waits for it.
      * @return Final generated text
      */
     suspend fun generateStreaming(
@@ -220,7 +253,7 @@ class LlamaInference {
                 }
             }
             
-            val response = nativeGenerateWithCallback(prompt, maxTokens, temperature, callback)
+            val response = nativeGenerateWithCallback(handle, prompt, maxTokens, temperature, callback)
             
             _isGenerating.value = false
             Result.success(response)
@@ -236,7 +269,7 @@ class LlamaInference {
      * Unload the current model
      */
     fun unloadModel() {
-        nativeUnloadModel()
+        releaseHandle()
         modelPath = null
         _state.value = InferenceState.INITIALIZED
         Log.i(TAG, "Model unloaded")
@@ -246,21 +279,23 @@ class LlamaInference {
      * Check if a model is currently loaded
      */
     fun isModelLoaded(): Boolean {
-        return nativeIsModelLoaded()
+        return nativeIsModelLoaded(handle)
     }
     
     /**
      * Get information about the loaded model
      */
     fun getModelInfo(): String {
-        return nativeGetModelInfo()
+        return nativeGetModelInfo(handle)
     }
     
     /**
      * Clean up all resources
      */
     fun cleanup() {
-        nativeCleanup()
+        val released = handle
+        handle = 0L
+        nativeCleanup(released)
         modelPath = null
         _state.value = InferenceState.UNINITIALIZED
         Log.i(TAG, "Cleanup complete")
@@ -270,16 +305,27 @@ class LlamaInference {
      * Get the path of the currently loaded model
      */
     fun getLoadedModelPath(): String? = modelPath
+
+    /**
+     * Free this instance's native context, if any
+     */
+    private fun releaseHandle() {
+        val released = handle
+        handle = 0L
+        if (released != 0L) {
+            nativeUnloadModel(released)
+        }
+    }
     
     // Native method declarations
     private external fun nativeInit(): Boolean
-    private external fun nativeLoadModel(modelPath: String, nThreads: Int, nCtx: Int): Boolean
-    private external fun nativeGenerate(prompt: String, maxTokens: Int, temperature: Float, topP: Float): String
-    private external fun nativeGenerateWithCallback(prompt: String, maxTokens: Int, temperature: Float, callback: TokenCallback): String
-    private external fun nativeUnloadModel()
-    private external fun nativeCleanup()
-    private external fun nativeIsModelLoaded(): Boolean
-    private external fun nativeGetModelInfo(): String
+    private external fun nativeLoadModel(modelPath: String, nThreads: Int, nCtx: Int, cpuSet: String, priority: Int, kvType: Int, tuneDir: String?, memoryBudgetBytes: Long): Long
+    private external fun nativeGenerate(handle: Long, prompt: String, maxTokens: Int, temperature: Float, topP: Float): String
+    private external fun nativeGenerateWithCallback(handle: Long, prompt: String, maxTokens: Int, temperature: Float, callback: TokenCallback): String
+    private external fun nativeUnloadModel(handle: Long)
+    private external fun nativeCleanup(handle: Long)
+    private external fun nativeIsModelLoaded(handle: Long): Boolean
+    private external fun nativeGetModelInfo(handle: Long): String
 }
 
 /**
@@ -295,6 +341,9 @@ enum class InferenceState {
 
 /**
  * Callback interface for streaming token generation
+ *
+ * Called from native code with consecutive chunks of the response; chunks
+ * never split a character. Throwing from onToken stops generation.
  */
 interface TokenCallback {
     fun onToken(token: String)
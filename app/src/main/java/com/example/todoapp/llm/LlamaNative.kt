@@ -1,6 +1,14 @@
 package com.example.todoapp.llm
 
 import android.util.Log
+import java.nio.ByteBuffer
+import java.nio.CharBuffer
+import java.nio.charset.CharsetEncoder
+import java.nio.charset.CodingErrorAction
+import java.util.concurrent.ConcurrentHashMap
+import kotlin.coroutines.resume
+import kotlinx.coroutines.CancellableContinuation
+import kotlinx.coroutines.suspendCancellableCoroutine
 
 /**
  * LlamaNative - Kotlin bridge to native llama.cpp JNI functions
@@ -23,6 +31,42 @@ object LlamaNative {
     
     private const val TAG = "LlamaNative"
     
+    // Starting size of the per-thread prompt buffer; grows on demand
+    private const val INITIAL_PROMPT_BUFFER_BYTES = 16 * 1024
+    
+    // Per-thread action record buffer; a reply of maxTokens = 256 fills
+    // a few KiB at most, longer strings are cut (ActionRecord.Decoded.truncated)
+    private const val RECORD_BUFFER_BYTES = 16 * 1024
+    
+    // warmStart results
+    const val WARM_START_RESTORED = 0
+    const val WARM_START_REBUILT = 1
+    const val WARM_START_EVALUATED = 2
+    const val WARM_START_FAILED = 3
+    
+    // CPU sets for initModelWithPlacement: any core, or the big cores
+    const val CPU_SET_ANY = ""
+    const val CPU_SET_PERFORMANCE = "performance"
+    
+    // Decode thread priorities for initModelWithPlacement
+    const val PRIORITY_LOW = 0
+    const val PRIORITY_NORMAL = 1
+    const val PRIORITY_HIGH = 2
+    const val PRIORITY_REALTIME = 3
+    
+    // KV cache element types for initModelWithOptions. q8_0 roughly halves
+    // the cache of f16 with near-identical output; q4_0 quarters it at a
+    // small accuracy cost
+    const val KV_CACHE_F16 = 0
+    const val KV_CACHE_Q8_0 = 1
+    const val KV_CACHE_Q4_0 = 2
+    
+    // scanAction results
+    const val SCAN_NO_OBJECT = 0
+    const val SCAN_MALFORMED = 1
+    const val SCAN_OFF_SCHEMA = 2
+    const val SCAN_VALID = 3
+    
     /**
      * Flag indicating if the native library was loaded successfully
      */
@@ -48,35 +92,383 @@ object LlamaNative {
      */
     external fun initModel(modelPath: String): Long
     
+    /**
+     * Initialize a model with explicit inference settings
+     * 
+     * @param modelPath Absolute path to the .gguf model file
+     * @param nThreads Number of decode threads
+     * @param nCtx Context size in tokens
+     * @return Context handle (Long), 0 if initialization failed
+     */
+    external fun initModelWithParams(modelPath: String, nThreads: Int, nCtx: Int): Long
+    
+    /**
+     * Initialize a model whose persistent decode threads are pinned to a CPU
+     * set and run at a given priority
+     * 
+     * Decode speed follows the slowest thread of each step, so keeping the
+     * threads on the big cores and ahead of background work cuts per-token
+     * jitter. Model info reports the placement and step time percentiles.
+     * 
+     * @param modelPath Absolute path to the .gguf model file
+     * @param nThreads Number of decode threads, <= 0 for one per core of the set
+     * @param nCtx Context size in tokens
+     * @param cpuSet CPU_SET_ANY, CPU_SET_PERFORMANCE, or a list such as "4-7"
+     * @param priority One of the PRIORITY_ constants; a priority the process
+     *                 may not take is skipped
+     * @return Context handle (Long), 0 if initialization failed
+     */
+    external fun initModelWithPlacement(
+        modelPath: String,
+        nThreads: Int,
+        nCtx: Int,
+        cpuSet: String,
+        priority: Int
+    ): Long
+    
+    /**
+     * initModelWithPlacement with thread/batch autotuning and a memory budget
+     * 
+     * With tuneDir, the first load runs short probes at several thread
+     * counts and batch sizes, which takes a few seconds, and stores the
+     * fastest in a tune file next to the model. Later loads reuse it until
+     * the model file, the CPU, the placement or the KV cache type changes.
+     * Model info reports the choice under "autotune".
+     * 
+     * With a memory budget, the context length, KV cache precision and batch
+     * size are reduced until the memory the load allocates fits, and the
+     * load fails rather than risk an OOM kill if nothing does. The weights
+     * are mmap'd from the model file, pages the kernel can drop and read
+     * back, so they are not charged to the budget. Model info reports the
+     * plan and the estimated and measured RSS under "memory".
+     * 
+     * @param nThreads Used only when tuneDir is null
+     * @param nCtx Context size in tokens, the most the budget may allow
+     * @param kvType One of the KV_CACHE_ constants, the most precise type
+     *               the budget may allow
+     * @param tuneDir Directory for tune files (ModelManager.getModelsDirectory),
+     *                null to skip tuning
+     * @param memoryBudgetBytes Memory the load may allocate besides the
+     *                          mapped weights, 0 for no limit
+     * @return Context handle (Long), 0 if initialization failed
+     */
+    external fun initModelWithOptions(
+        modelPath: String,
+        nThreads: Int,
+        nCtx: Int,
+        cpuSet: String,
+        priority: Int,
+        kvType: Int,
+        tuneDir: String?,
+        memoryBudgetBytes: Long
+    ): Long
+    
+    /**
+     * Load the evaluated KV state of a static prompt prefix into a context
+     * 
+     * The state is restored from a snapshot file in sessionDir when it still
+     * matches the model file and prefix; otherwise the prefix is evaluated
+     * and the snapshot rewritten for the next launch. The prefix is also
+     * pinned, see setPinnedPrefix.
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param sessionDir Directory holding snapshot files
+     * @param prefix Text every later prompt starts with
+     * @return One of the WARM_START_* codes
+     */
+    external fun warmStart(ctxPtr: Long, sessionDir: String, prefix: String): Int
+    
+    /**
+     * Set the prompt head that survives context shifting
+     * 
+     * When a prompt, or the conversation it continues, outgrows the context,
+     * the oldest tokens after this prefix are evicted in blocks and the rest
+     * shifted down in the KV cache, so long sessions keep a constant cost per
+     * turn instead of failing. Without a pinned prefix only the first token
+     * is kept. Model info counts shifts under "promptCache".
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param prefix Text prompts start with, e.g. PromptTemplates.SIMPLE_PROMPT_PREFIX
+     * @return true if set
+     */
+    external fun setPinnedPrefix(ctxPtr: Long, prefix: String): Boolean
+    
+    /**
+     * Keep the tokens of a static prompt piece for the model's vocabulary
+     * 
+     * Prompts starting with a registered head or ending with a registered
+     * tail reuse its tokens, so only the text in between is tokenized per
+     * request. Templates are shared by every model with the same tokenizer.
+     * Model info counts them under "templateTokens".
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param text Template text, e.g. PromptTemplates.SIMPLE_PROMPT_PREFIX
+     * @param head true for prompt heads, false for tails
+     * @return true if the template is kept
+     */
+    external fun registerTemplate(ctxPtr: Long, text: String, head: Boolean): Boolean
+    
+    /**
+     * Write the registered template tokens to a file
+     * 
+     * Shipped next to the model as "<model path>.tokens", it is loaded by
+     * initModel, which then has every template tokenized already.
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param path Output file
+     * @return true if written
+     */
+    external fun saveTemplateTokens(ctxPtr: Long, path: String): Boolean
+    
+    /**
+     * Set the text around prompts assembled by generateFromContextAsync:
+     * head + context + input + user message + tail. The head and tail are
+     * registered as templates as well.
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @return true if set
+     */
+    external fun setPromptFormat(ctxPtr: Long, head: String, input: String, tail: String): Boolean
+    
+    /**
+     * Register the static heads and tails of PromptTemplates
+     * 
+     * @param ctxPtr Context handle from initModel
+     */
+    fun registerPromptTemplates(ctxPtr: Long) {
+        PromptTemplates.templateHeads().forEach { registerTemplate(ctxPtr, it, true) }
+        PromptTemplates.templateTails().forEach { registerTemplate(ctxPtr, it, false) }
+    }
+    
+    /**
+     * Attach a smaller model with the same vocabulary as a speculative
+     * decoding draft
+     * 
+     * The draft guesses a few tokens ahead and the model verifies them in
+     * one batched pass, so output is unchanged but most tokens cost a draft
+     * step instead of a full model step. Acceptance and speedup show up in
+     * LlamaInference.getModelInfo under "speculative".
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param draftPath Path to the draft .gguf file, empty to detach
+     * @param draftTokens Guesses verified per pass, <= 0 for the default
+     * @return true if attached; false if it failed to load or its
+     *         vocabulary differs
+     */
+    external fun attachDraftModel(ctxPtr: Long, draftPath: String, draftTokens: Int): Boolean
+    
+    /**
+     * Enable or disable prompt lookup speculative decoding
+     * 
+     * Guesses the next tokens by matching the last few against the prompt
+     * and output so far, which pays off when the reply echoes prompt text
+     * such as goal and task titles. Needs no second model; output is
+     * unchanged. Tried before a draft model when both are enabled.
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param draftTokens Guesses verified per pass, 0 to disable, -1 for
+     *                    the default
+     * @return false if the handle is invalid
+     */
+    external fun setPromptLookup(ctxPtr: Long, draftTokens: Int): Boolean
+    
     /**
      * Generate text from a prompt
      * 
      * @param ctxPtr Context handle from initModel
      * @param prompt Input prompt text (should follow JSON-output template)
      * @param maxTokens Maximum tokens to generate
-     * @return Generated text (expected to be JSON)
+     * @return One JSON action object; decoding is constrained to the action
+     *         schema and stops when the object closes
      */
     external fun generate(ctxPtr: Long, prompt: String, maxTokens: Int): String
     
+    /**
+     * Generate text from a UTF-8 prompt in a direct ByteBuffer
+     * 
+     * The native side reads the bytes in place, with no per-call copy.
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param prompt Direct buffer holding the UTF-8 prompt starting at index 0
+     * @param length Number of prompt bytes
+     * @param maxTokens Maximum tokens to generate
+     * @return One JSON action object; decoding is constrained to the action
+     *         schema and stops when the object closes
+     */
+    external fun generateFromBuffer(ctxPtr: Long, prompt: ByteBuffer, length: Int, maxTokens: Int): String
+    
+    /**
+     * Generate text from a UTF-8 prompt in a byte array region
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param prompt Array holding the UTF-8 prompt
+     * @param offset Index of the first prompt byte
+     * @param length Number of prompt bytes
+     * @param maxTokens Maximum tokens to generate
+     * @return One JSON action object; decoding is constrained to the action
+     *         schema and stops when the object closes
+     */
+    external fun generateFromBytes(ctxPtr: Long, prompt: ByteArray, offset: Int, length: Int, maxTokens: Int): String
+    
+    /**
+     * Queue a generation without waiting for it
+     * 
+     * Output is constrained like generate. When the reply is ready the
+     * native side calls onGenerateDone and poll returns it; generateAsync
+     * wraps this for coroutines.
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param prompt Input prompt text
+     * @param maxTokens Maximum tokens to generate
+     * @return Request ID, 0 if the handle is invalid
+     */
+    external fun submitGenerate(ctxPtr: Long, prompt: String, maxTokens: Int): Long
+    
+    /**
+     * Queue a generation on a prompt assembled natively from goal and task
+     * fields; generateFromContextAsync packs them
+     * 
+     * @param ctxPtr Context handle from initModel
+     * @param strings Direct buffer of UTF-8 strings, the user message first
+     * @param length Number of valid bytes in strings
+     * @param messageLength Bytes of the user message
+     * @param goals 5 ints per goal: title offset and length, daily minutes,
+     *              end date offset and length
+     * @param tasks 4 ints per task: title offset and length, completed (0/1),
+     *              minutes
+     * @param maxTokens Maximum tokens to generate
+     * @return Request ID, 0 if the handle is invalid, no format is set or
+     *         the fields are malformed
+     */
+    external fun submitGenerateFromContext(
+        ctxPtr: Long,
+        strings: ByteBuffer,
+        length: Int,
+        messageLength: Int,
+        goals: IntArray,
+        tasks: IntArray,
+        maxTokens: Int
+    ): Long
+    
+    /**
+     * Collect the reply of a submitted request
+     * 
+     * @param requestId ID from submitGenerate
+     * @return The reply once finished (a "Generation cancelled" reply if it
+     *         was cancelled), null while it is running or if the ID is
+     *         unknown or already polled
+     */
+    external fun poll(requestId: Long): String?
+    
+    /**
+     * Collect the reply of a submitted request as an action record
+     * 
+     * The reply is parsed natively by JsonResponseParser's rules and
+     * written to record for ActionRecord.decode; strings travel as plain
+     * UTF-8, so emoji survive, and no JSON string is built or parsed here.
+     * 
+     * @param requestId ID from submitGenerate
+     * @param record Direct buffer from ActionRecord.allocate
+     * @return Record bytes once finished, 0 while it is running or if the
+     *         ID is unknown or already polled
+     */
+    external fun pollAction(requestId: Long, record: ByteBuffer): Int
+    
+    /**
+     * Stop a submitted request at its next token boundary
+     * 
+     * @param requestId ID from submitGenerate
+     * @return false if the request is unknown or already finished
+     */
+    external fun cancel(requestId: Long): Boolean
+    
+    /**
+     * Locate the action object in a reply and validate it
+     * 
+     * The reply is indexed SIMD-wise for its structural characters
+     * (simdjson's stage 1) and only those are walked to check the JSON and
+     * the action schema, so malformed output is turned away in
+     * microseconds without building a JSONObject.
+     * 
+     * @param text Model reply
+     * @param bounds Receives the object's start and end (exclusive) indices
+     *               when it is well-formed; needs 2 elements
+     * @return SCAN_NO_OBJECT, SCAN_MALFORMED, SCAN_OFF_SCHEMA (well-formed
+     *         JSON with other keys or types than the schema's) or SCAN_VALID
+     */
+    external fun scanAction(text: String, bounds: IntArray): Int
+    
     /**
      * Free model resources
      * 
+     * Requests still running on the context are cancelled.
+     * 
      * @param ctxPtr Context handle to free
      */
     external fun freeModel(ctxPtr: Long)
     
     /**
      * Safe wrapper for initModel that catches native errors
+     * 
+     * @param sessionDir If set with sessionPrefix, warm the new context from
+     *                   the prefix snapshot kept in this directory
+     * @param sessionPrefix Static text every prompt starts with
+     * @param draftModelPath Optional speculative decoding draft model
+     * @param promptLookup Enable prompt lookup speculative decoding
+     * @param cpuSet Cores for the decode threads, see initModelWithPlacement
+     *               (default: any core)
+     * @param priority Decode thread priority (default: normal)
+     * @param kvType KV cache element type, one of the KV_CACHE_ constants
+     * @param autotuneDir If set, tune threads and batch size for the model
+     *                    and keep the result there (threads is then ignored)
+     * @param memoryBudgetBytes Memory the load may allocate besides the
+     *                          mapped weights, 0 for no limit
      */
-    fun initModelSafe(modelPath: String): Result<Long> {
+    fun initModelSafe(
+        modelPath: String,
+        threads: Int = LlamaInference.DEFAULT_THREADS,
+        contextSize: Int = LlamaInference.DEFAULT_CONTEXT_SIZE,
+        cpuSet: String = CPU_SET_ANY,
+        priority: Int = PRIORITY_NORMAL,
+        kvType: Int = KV_CACHE_F16,
+        autotuneDir: String? = null,
+        memoryBudgetBytes: Long = 0L,
+        sessionDir: String? = null,
+        sessionPrefix: String? = null,
+        draftModelPath: String? = null,
+        promptLookup: Boolean = false
+    ): Result<Long> {
         return try {
             if (!isLibraryLoaded) {
                 return Result.failure(NativeLibraryException("Native library not loaded"))
             }
-            val handle = initModel(modelPath)
+            val handle = initModelWithOptions(
+                modelPath, threads, contextSize, cpuSet, priority, kvType, autotuneDir, memoryBudgetBytes
+            )
             if (handle == 0L) {
                 Result.failure(ModelLoadException("Failed to load model: $modelPath"))
             } else {
+                // Before the warm start, which then tokenizes from the cache
+                registerPromptTemplates(handle)
+                setPromptFormat(
+                    handle,
+                    PromptTemplates.SIMPLE_PROMPT_PREFIX,
+                    PromptTemplates.SIMPLE_PROMPT_INPUT,
+                    PromptTemplates.SIMPLE_PROMPT_SUFFIX
+                )
+                if (sessionDir != null && sessionPrefix != null) {
+                    // A failed warm start only costs speed; prompts still evaluate in full
+                    val status = warmStart(handle, sessionDir, sessionPrefix)
+                    Log.i(TAG, "Prefix warm start status: $status")
+                }
+                if (draftModelPath != null) {
+                    // Without a draft the model just decodes one token per pass
+                    val attached = attachDraftModel(handle, draftModelPath, 0)
+                    Log.i(TAG, "Draft model $draftModelPath attached: $attached")
+                }
+                if (promptLookup) {
+                    setPromptLookup(handle, -1)
+                }
                 Result.success(handle)
             }
         } catch (e: Exception) {
@@ -85,8 +477,64 @@ object LlamaNative {
         }
     }
     
+    /**
+     * Reusable direct buffer plus encoder, one per calling thread, so
+     * generateSafe encodes the prompt straight into native-visible memory
+     */
+    private class PromptBuffer {
+        private val encoder: CharsetEncoder = Charsets.UTF_8.newEncoder()
+            .onMalformedInput(CodingErrorAction.REPLACE)
+            .onUnmappableCharacter(CodingErrorAction.REPLACE)
+        
+        var buffer: ByteBuffer = ByteBuffer.allocateDirect(INITIAL_PROMPT_BUFFER_BYTES)
+            private set
+        
+        /**
+         * Encode the prompt into the buffer
+         * 
+         * @return Number of UTF-8 bytes written
+         */
+        fun encode(prompt: String): Int {
+            buffer.clear()
+            return append(prompt)
+        }
+        
+        /**
+         * Encode text after what the buffer already holds, growing it if needed
+         * 
+         * @return Number of UTF-8 bytes written
+         */
+        fun append(text: String): Int {
+            val maxBytes = (text.length * encoder.maxBytesPerChar()).toInt()
+            if (buffer.remaining() < maxBytes) {
+                val grown = ByteBuffer.allocateDirect(maxOf(buffer.position() + maxBytes, buffer.capacity() * 2))
+                buffer.flip()
+                grown.put(buffer)
+                buffer = grown
+            }
+            val start = buffer.position()
+            encoder.reset()
+            encoder.encode(CharBuffer.wrap(text), buffer, true)
+            encoder.flush(buffer)
+            return buffer.position() - start
+        }
+        
+        /**
+         * Append text and store its offset and length at fields[index]
+         */
+        fun appendField(text: String, fields: IntArray, index: Int) {
+            fields[index] = buffer.position()
+            fields[index + 1] = append(text)
+        }
+    }
+    
+    private val promptBuffers = ThreadLocal.withInitial { PromptBuffer() }
+    
     /**
      * Safe wrapper for generate that catches native errors
+     * 
+     * Passes the prompt through a reusable direct buffer (generateFromBuffer)
+     * instead of a Java string, avoiding per-call JNI string copies.
      */
     fun generateSafe(ctxPtr: Long, prompt: String, maxTokens: Int = 256): Result<String> {
         return try {
@@ -96,7 +544,9 @@ object LlamaNative {
             if (ctxPtr == 0L) {
                 return Result.failure(InvalidContextException("Invalid context handle"))
             }
-            val response = generate(ctxPtr, prompt, maxTokens)
+            val promptBuffer = promptBuffers.get()!!
+            val length = promptBuffer.encode(prompt)
+            val response = generateFromBuffer(ctxPtr, promptBuffer.buffer, length, maxTokens)
             Result.success(response)
         } catch (e: Exception) {
             Log.e(TAG, "Error in generate: ${e.message}")
@@ -104,6 +554,168 @@ object LlamaNative {
         }
     }
     
+    private val recordBuffers = ThreadLocal.withInitial { ActionRecord.allocate(RECORD_BUFFER_BYTES) }
+    
+    /**
+     * A coroutine suspended on a request, and how to collect its reply
+     */
+    private class Waiter<T : Any>(
+        private val continuation: CancellableContinuation<T>,
+        private val collect: (Long) -> T?
+    ) {
+        /**
+         * Resume with the reply if it is ready; only one collect gets it
+         */
+        fun deliver(requestId: Long) {
+            val reply = collect(requestId) ?: return
+            waiters.remove(requestId)
+            continuation.resume(reply)
+        }
+    }
+    
+    // Coroutines suspended in awaitRequest, by request ID
+    private val waiters = ConcurrentHashMap<Long, Waiter<*>>()
+    
+    /**
+     * Generate without blocking the calling thread
+     * 
+     * The request is queued natively and the coroutine suspends until its
+     * reply is ready, so no thread is parked while it decodes. Cancelling
+     * the coroutine cancels the request at its next token boundary.
+     */
+    suspend fun generateAsync(ctxPtr: Long, prompt: String, maxTokens: Int = 256): Result<String> =
+        awaitRequest(ctxPtr, ::poll) { submitGenerate(ctxPtr, prompt, maxTokens) }
+    
+    /**
+     * generateAsync on the buildSimplePrompt prompt for these arguments,
+     * assembled natively
+     * 
+     * The fields go to native code packed in the calling thread's direct
+     * buffer; it formats them in the format set by setPromptFormat and takes
+     * the tokens of the fixed text and of every goal and task entry seen
+     * before from a cache, so a turn only tokenizes its user message and
+     * whatever context changed.
+     */
+    suspend fun generateFromContextAsync(
+        ctxPtr: Long,
+        userMessage: String,
+        goals: List<GoalContext>,
+        tasks: List<TaskContext>,
+        maxTokens: Int = 256
+    ): Result<String> = awaitRequest(ctxPtr, ::poll) {
+        submitContext(ctxPtr, userMessage, goals, tasks, maxTokens)
+    }
+    
+    /**
+     * generateFromContextAsync with the reply parsed natively and returned
+     * as an action record (pollAction), mapped straight to an AssistantAction
+     */
+    suspend fun generateActionFromContextAsync(
+        ctxPtr: Long,
+        userMessage: String,
+        goals: List<GoalContext>,
+        tasks: List<TaskContext>,
+        maxTokens: Int = 256
+    ): Result<ActionRecord.Decoded> = awaitRequest(ctxPtr, ::collectAction) {
+        submitContext(ctxPtr, userMessage, goals, tasks, maxTokens)
+    }
+    
+    /**
+     * Pack the fields into the calling thread's prompt buffer and submit
+     * them to submitGenerateFromContext
+     */
+    private fun submitContext(
+        ctxPtr: Long,
+        userMessage: String,
+        goals: List<GoalContext>,
+        tasks: List<TaskContext>,
+        maxTokens: Int
+    ): Long {
+        val promptBuffer = promptBuffers.get()!!
+        val messageLength = promptBuffer.encode(userMessage)
+        val shownGoals = goals.take(PromptTemplates.MAX_CONTEXT_ITEMS)
+        val shownTasks = tasks.take(PromptTemplates.MAX_CONTEXT_ITEMS)
+        val goalFields = IntArray(shownGoals.size * 5)
+        shownGoals.forEachIndexed { i, goal ->
+            promptBuffer.appendField(goal.title, goalFields, i * 5)
+            goalFields[i * 5 + 2] = goal.dailyMinutes
+            promptBuffer.appendField(goal.endDate, goalFields, i * 5 + 3)
+        }
+        val taskFields = IntArray(shownTasks.size * 4)
+        shownTasks.forEachIndexed { i, task ->
+            promptBuffer.appendField(task.title, taskFields, i * 4)
+            taskFields[i * 4 + 2] = if (task.isCompleted) 1 else 0
+            taskFields[i * 4 + 3] = task.minutes
+        }
+        return submitGenerateFromContext(
+            ctxPtr, promptBuffer.buffer, promptBuffer.buffer.position(), messageLength,
+            goalFields, taskFields, maxTokens
+        )
+    }
+    
+    /**
+     * Poll a request's action record into the calling thread's record
+     * buffer and decode it, null while it is not ready
+     */
+    private fun collectAction(requestId: Long): ActionRecord.Decoded? {
+        val record = recordBuffers.get()!!
+        val length = pollAction(requestId, record)
+        return if (length > 0) ActionRecord.decode(record, length) else null
+    }
+    
+    /**
+     * Submit a request and suspend until its reply is delivered
+     * 
+     * @param collect Polls the reply, null while it is not ready
+     * @param submit Queues the request, returning its ID or 0 if rejected
+     */
+    private suspend fun <T : Any> awaitRequest(
+        ctxPtr: Long,
+        collect: (Long) -> T?,
+        submit: () -> Long
+    ): Result<T> {
+        if (!isLibraryLoaded) {
+            return Result.failure(NativeLibraryException("Native library not loaded"))
+        }
+        if (ctxPtr == 0L) {
+            return Result.failure(InvalidContextException("Invalid context handle"))
+        }
+        val requestId = try {
+            submit()
+        } catch (e: Exception) {
+            Log.e(TAG, "Error in submitGenerate: ${e.message}")
+            return Result.failure(e)
+        }
+        if (requestId == 0L) {
+            return Result.failure(InvalidContextException("Invalid context handle"))
+        }
+        val response = suspendCancellableCoroutine<T> { continuation ->
+            waiters[requestId] = Waiter(continuation, collect)
+            // Stays registered so the cancelled reply is still polled and dropped
+            continuation.invokeOnCancellation { cancel(requestId) }
+            // The reply may have been ready before the waiter was registered
+            deliver(requestId)
+        }
+        return Result.success(response)
+    }
+    
+    /**
+     * Called from a native worker thread once a submitted request's reply
+     * can be polled
+     */
+    @JvmStatic
+    private fun onGenerateDone(requestId: Long) {
+        deliver(requestId)
+    }
+    
+    /**
+     * Hand a finished reply to its waiting coroutine. Requests without a
+     * waiter yet are left for awaitRequest to deliver after registering.
+     */
+    private fun deliver(requestId: Long) {
+        waiters[requestId]?.deliver(requestId)
+    }
+    
     /**
      * Safe wrapper for freeModel that catches native errors
      */
@@ -1,8 +1,12 @@
 package com.example.todoapp.llm
 
+import android.app.ActivityManager
 import android.content.Context
 import android.util.Log
+import com.example.todoapp.data.local.SettingsDataStore
+import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.flow.first
 import kotlinx.coroutines.sync.Mutex
 import kotlinx.coroutines.sync.withLock
 import kotlinx.coroutines.withContext
@@ -14,11 +18,14 @@ import kotlinx.coroutines.withContext
  * a clean API for generating responses. Uses JSON-first prompt templates
  * and falls back to deterministic parsing when needed.
  * 
- * Thread-safe: All model operations are protected by a mutex.
+ * Thread-safe: Loading and freeing the model are serialized by a mutex.
+ * Generation runs outside it, so concurrent calls reach the native layer
+ * together and are batched into shared decode passes there.
  */
 class LocalAssistantRepository(
     private val context: Context,
-    private val modelManager: ModelManager
+    private val modelManager: ModelManager,
+    private val settingsDataStore: SettingsDataStore
 ) {
     
     companion object {
@@ -71,7 +78,7 @@ class LocalAssistantRepository(
                 
                 // Load new model
                 Log.i(TAG, "Loading model: $modelPath")
-                val result = LlamaNative.initModelSafe(modelPath)
+                val result = loadModel(modelPath)
                 
                 return@withContext result.fold(
                     onSuccess = { handle ->
@@ -107,86 +114,125 @@ class LocalAssistantRepository(
         tasks: List<TaskContext> = emptyList(),
         maxTokens: Int = DEFAULT_MAX_TOKENS
     ): Result<AssistantAction> = withContext(Dispatchers.IO) {
-        mutex.withLock {
-            try {
-                // Check model status
+        try {
+            // Check model status, loading it first if needed. A handle freed
+            // concurrently makes the native call fail cleanly.
+            val handle = mutex.withLock {
                 if (contextPtr == 0L) {
-                    // Try to initialize model first
-                    val initResult = withContext(Dispatchers.IO) { 
-                        // Temporarily release lock for init
-                        mutex.withLock {
-                            initializeModelInternal()
-                        }
-                    }
-                    if (initResult.isFailure) {
-                        // Fall back to deterministic parser
-                        Log.w(TAG, "Model not loaded, using deterministic parser")
-                        val deterministicAction = DeterministicParser.parse(userMessage)
-                        if (deterministicAction != null) {
-                            return@withContext Result.success(deterministicAction)
-                        }
-                        return@withContext Result.failure(
-                            LocalAssistantException("Model not loaded and no command pattern matched")
-                        )
-                    }
+                    initializeModelInternal()
                 }
-                
-                // Build prompt
-                val prompt = PromptTemplates.buildSimplePrompt(
-                    userMessage = userMessage,
-                    goals = goals,
-                    tasks = tasks
+                contextPtr
+            }
+            if (handle == 0L) {
+                // Fall back to deterministic parser
+                Log.w(TAG, "Model not loaded, using deterministic parser")
+                val deterministicAction = DeterministicParser.parse(userMessage)
+                if (deterministicAction != null) {
+                    return@withContext Result.success(deterministicAction)
+                }
+                return@withContext Result.failure(
+                    LocalAssistantException("Model not loaded and no command pattern matched")
                 )
-                
-                Log.d(TAG, "Generating response for: $userMessage")
-                
-                // Generate response
-                val generateResult = LlamaNative.generateSafe(contextPtr, prompt, maxTokens)
-                
-                return@withContext generateResult.fold(
-                    onSuccess = { response ->
-                        Log.d(TAG, "Raw response: $response")
-                        
-                        // Try to parse JSON response
-                        val action = JsonResponseParser.parse(response)
-                        if (action != null) {
-                            Log.i(TAG, "Parsed action: ${action::class.simpleName}")
-                            Result.success(action)
-                        } else {
-                            // Try deterministic parser as fallback
-                            Log.w(TAG, "JSON parsing failed, trying deterministic parser")
-                            val deterministicAction = DeterministicParser.parse(userMessage)
-                            if (deterministicAction != null) {
-                                Result.success(deterministicAction)
-                            } else {
-                                // Return raw response as reply
-                                Result.success(AssistantAction.Reply(response))
-                            }
-                        }
-                    },
-                    onFailure = { error ->
-                        Log.e(TAG, "Generation failed: ${error.message}")
-                        
-                        // Try deterministic parser
+            }
+            
+            Log.d(TAG, "Generating response for: $userMessage")
+            
+            // Generate response on the buildSimplePrompt prompt, assembled
+            // natively from the fields; the coroutine suspends rather than
+            // holding an IO thread while the native side decodes. The reply
+            // comes back parsed, as an action record.
+            val generateResult = LlamaNative.generateActionFromContextAsync(handle, userMessage, goals, tasks, maxTokens)
+            
+            return@withContext generateResult.fold(
+                onSuccess = { decoded ->
+                    if (decoded.truncated) {
+                        Log.w(TAG, "Action record truncated to fit its buffer")
+                    }
+                    val action = decoded.action
+                    if (action != null) {
+                        Log.i(TAG, "Parsed action: ${action::class.simpleName}")
+                        Result.success(action)
+                    } else {
+                        // Try deterministic parser as fallback
+                        Log.w(TAG, "JSON parsing failed, trying deterministic parser")
                         val deterministicAction = DeterministicParser.parse(userMessage)
                         if (deterministicAction != null) {
                             Result.success(deterministicAction)
                         } else {
-                            Result.failure(error)
+                            // Return raw response as reply
+                            Result.success(AssistantAction.Reply(decoded.unparsed))
                         }
                     }
-                )
-            } catch (e: Exception) {
-                Log.e(TAG, "Error in generate: ${e.message}")
-                Result.failure(e)
-            }
+                },
+                onFailure = { error ->
+                    Log.e(TAG, "Generation failed: ${error.message}")
+                    
+                    // Try deterministic parser
+                    val deterministicAction = DeterministicParser.parse(userMessage)
+                    if (deterministicAction != null) {
+                        Result.success(deterministicAction)
+                    } else {
+                        Result.failure(error)
+                    }
+                }
+            )
+        } catch (e: CancellationException) {
+            // Cancelling the caller cancelled the native request too
+            throw e
+        } catch (e: Exception) {
+            Log.e(TAG, "Error in generate: ${e.message}")
+            Result.failure(e)
         }
     }
     
+    /**
+     * Memory the KV cache and compute buffers may take without pushing the
+     * system into its low memory state. The mmap'd weights are not charged
+     * against it, so page cache counted in availMem is not spent twice.
+     * 
+     * At or below the threshold there is nothing to plan against: the load
+     * goes ahead unbudgeted rather than being refused outright, since the
+     * foreground app is the last the low memory killer picks.
+     */
+    private fun memoryBudgetBytes(): Long {
+        val activityManager = context.getSystemService(Context.ACTIVITY_SERVICE) as ActivityManager
+        val info = ActivityManager.MemoryInfo()
+        activityManager.getMemoryInfo(info)
+        val spare = info.availMem - info.threshold
+        if (spare <= 0L) {
+            Log.w(TAG, "Device at its low memory threshold, loading without a memory budget")
+            return 0L
+        }
+        return spare
+    }
+    
+    /**
+     * Load a model with the assistant's settings (caller must hold lock)
+     * 
+     * The assistant is the app's foreground workload, so its decode threads
+     * opt in to the big cores at high priority. Autotuning is opt-in
+     * (AppSettings.autotuneModel): its probes add seconds to the first load
+     * of each model, ahead of the first reply.
+     */
+    private suspend fun loadModel(modelPath: String): Result<Long> {
+        val autotune = settingsDataStore.settings.first().autotuneModel
+        return LlamaNative.initModelSafe(
+            modelPath,
+            cpuSet = LlamaNative.CPU_SET_PERFORMANCE,
+            priority = LlamaNative.PRIORITY_HIGH,
+            sessionDir = modelManager.getModelsDirectory().absolutePath,
+            sessionPrefix = PromptTemplates.SIMPLE_PROMPT_PREFIX,
+            draftModelPath = modelManager.getSelectedDraftModelPath(),
+            promptLookup = true,
+            autotuneDir = if (autotune) modelManager.getModelsDirectory().absolutePath else null,
+            memoryBudgetBytes = memoryBudgetBytes()
+        )
+    }
+    
     /**
      * Internal initialize without lock (caller must hold lock)
      */
-    private fun initializeModelInternal(): Result<Unit> {
+    private suspend fun initializeModelInternal(): Result<Unit> {
         if (!LlamaNative.isLibraryLoaded) {
             return Result.failure(LocalAssistantException("Native library not available"))
         }
@@ -203,7 +249,7 @@ class LocalAssistantRepository(
             contextPtr = 0L
         }
         
-        return LlamaNative.initModelSafe(modelPath).fold(
+        return loadModel(modelPath).fold(
             onSuccess = { handle ->
                 contextPtr = handle
                 currentModelPath = modelPath
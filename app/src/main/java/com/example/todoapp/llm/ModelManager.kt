@@ -71,7 +71,8 @@ class ModelManager(private val context: Context) {
                 sizeBytes = 2_000 * 1024 * 1024L, // ~2 GB
                 downloadUrl = "https://huggingface.co/bartowski/Llama-3.2-3B-Instruct-GGUF/resolve/main/Llama-3.2-3B-Instruct-Q4_K_M.gguf",
                 fileName = "Llama-3.2-3B-Instruct-Q4_K_M.gguf",
-                parameters = "3B"
+                parameters = "3B",
+                draftModelId = "llama-3.2-1b-q4"
             )
         )
     }
@@ -267,6 +268,9 @@ class ModelManager(private val context: Context) {
             false
         }
         
+        // Prefix KV snapshot written by LlamaNative.warmStart
+        File(getModelsDirectory(), "${modelInfo.fileName}.session").delete()
+        
         refreshInstalledModels()
         
         // Clear selection if deleted model was selected
@@ -295,6 +299,16 @@ class ModelManager(private val context: Context) {
         return installed?.file?.absolutePath
     }
     
+    /**
+     * Get the file path of the selected model's draft model, if installed
+     */
+    fun getSelectedDraftModelPath(): String? {
+        val selectedId = _selectedModelId.value ?: return null
+        val draftId = getModelInfo(selectedId)?.draftModelId ?: return null
+        val installed = _installedModels.value.find { it.info.id == draftId }
+        return installed?.file?.absolutePath
+    }
+    
     /**
      * Get model info by ID
      */
@@ -320,7 +334,13 @@ data class ModelInfo(
     val sizeBytes: Long,
     val downloadUrl: String,
     val fileName: String,
-    val parameters: String
+    val parameters: String,
+    /**
+     * Smaller model with the same tokenizer, used as the speculative
+     * decoding draft when it is installed too. TinyLlama uses the Llama 2
+     * vocabulary, so it cannot draft for the Llama 3.2 models.
+     */
+    val draftModelId: String? = null
 )
 
 /**
@@ -48,6 +48,55 @@ create_goal data: goalTitle, durationMonths, dailyMinutes
 create_task data: taskTitle, dueDate, minutes
 Output JSON only, no other text."""
 
+    /**
+     * Text every buildSimplePrompt prompt starts with. Its evaluated KV state
+     * is kept on disk by the native layer (LlamaNative.warmStart), so only
+     * the context and user message are evaluated per request.
+     */
+    const val SIMPLE_PROMPT_PREFIX = "### Instruction:\n$SYSTEM_INSTRUCTION_COMPACT\n"
+
+    /**
+     * Text every buildSimplePrompt prompt ends with
+     */
+    const val SIMPLE_PROMPT_SUFFIX = "\n\n### Response (JSON only):\n"
+
+    /**
+     * Text between the context and the user message in buildSimplePrompt
+     */
+    const val SIMPLE_PROMPT_INPUT = "\n\n### Input:\n"
+
+    /**
+     * Goals and tasks listed in a prompt's context, each
+     */
+    const val MAX_CONTEXT_ITEMS = 5
+
+    /**
+     * Fixed heads of the prompt formats below, plus the example prompts.
+     * The native layer keeps their tokens (LlamaNative.registerPromptTemplates),
+     * so only the context and user message are tokenized per request.
+     */
+    fun templateHeads(): List<String> = listOf(
+        SIMPLE_PROMPT_PREFIX,
+        "<|system|>\n$SYSTEM_INSTRUCTION\n",
+        "<|system|>\n$SYSTEM_INSTRUCTION_COMPACT\n",
+        "[INST] <<SYS>>\n$SYSTEM_INSTRUCTION_COMPACT\n",
+        "<|im_start|>system\n$SYSTEM_INSTRUCTION_COMPACT\n",
+        exampleCreateGoal(),
+        exampleAddTask(),
+        exampleCompleteTask(),
+        exampleGeneralQuery()
+    )
+
+    /**
+     * Fixed tails of the prompt formats below
+     */
+    fun templateTails(): List<String> = listOf(
+        SIMPLE_PROMPT_SUFFIX,
+        "\n</s>\n<|assistant|>\n",
+        " [/INST]",
+        "\n<|im_end|>\n<|im_start|>assistant\n"
+    )
+
     /**
      * Build a complete prompt for the LLM
      * 
@@ -126,15 +175,7 @@ $userMessage
     ): String {
         val context = buildContext(goals, tasks)
         
-        return """### Instruction:
-$SYSTEM_INSTRUCTION_COMPACT
-$context
-
-### Input:
-$userMessage
-
-### Response (JSON only):
-"""
+        return """$SIMPLE_PROMPT_PREFIX$context$SIMPLE_PROMPT_INPUT$userMessage$SIMPLE_PROMPT_SUFFIX"""
     }
     
     /**
@@ -145,7 +186,7 @@ $userMessage
         
         if (goals.isNotEmpty()) {
             sb.append("\nContext - Goals: ")
-            goals.take(5).forEachIndexed { index, goal ->
+            goals.take(MAX_CONTEXT_ITEMS).forEachIndexed { index, goal ->
                 if (index > 0) sb.append("; ")
                 sb.append("${goal.title}|${goal.dailyMinutes}min|ends:${goal.endDate}")
             }
@@ -153,7 +194,7 @@ $userMessage
         
         if (tasks.isNotEmpty()) {
             sb.append("\nContext - Today's Tasks: ")
-            tasks.take(5).forEachIndexed { index, task ->
+            tasks.take(MAX_CONTEXT_ITEMS).forEachIndexed { index, task ->
                 if (index > 0) sb.append("; ")
                 val status = if (task.isCompleted) "✓" else "○"
                 sb.append("$status${task.title}")
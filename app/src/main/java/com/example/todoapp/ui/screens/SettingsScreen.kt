@@ -184,6 +184,17 @@ fun SettingsScreen(
                 
                 Divider(modifier = Modifier.padding(horizontal = 16.dp))
                 
+                SettingsToggleItem(
+                    icon = Icons.Outlined.Timer,
+                    title = "Tune for This Device",
+                    subtitle = "Measure the fastest settings on first load (takes a few seconds)",
+                    checked = settings.autotuneModel,
+                    onCheckedChange = { viewModel.toggleAutotuneModel(it) },
+                    enabled = settings.aiAssistantEnabled
+                )
+                
+                Divider(modifier = Modifier.padding(horizontal = 16.dp))
+                
                 SettingsClickableItem(
                     icon = Icons.Outlined.Tune,
                     title = "AI Settings",
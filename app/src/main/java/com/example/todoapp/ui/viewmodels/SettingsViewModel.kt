@@ -186,6 +186,12 @@ class SettingsViewModel(
         }
     }
     
+    fun toggleAutotuneModel(enabled: Boolean) {
+        viewModelScope.launch {
+            settingsDataStore.updateAutotuneModel(enabled)
+        }
+    }
+    
     fun hasModelInstalled(): Boolean {
         return _uiState.value.installedModels.isNotEmpty()
     }
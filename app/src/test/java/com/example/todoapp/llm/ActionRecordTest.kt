@@ -0,0 +1,144 @@
+package com.example.todoapp.llm
+
+import org.junit.Assert.*
+import org.junit.Test
+import java.nio.ByteBuffer
+
+/**
+ * Unit tests for ActionRecord
+ *
+ * Records are laid out here as writeActionRecord (core/action_record.h)
+ * writes them: a 32 byte header followed by the message, title, due date
+ * and goal title
+ */
+class ActionRecordTest {
+
+    private fun record(
+        action: Int,
+        message: String = "",
+        title: String = "",
+        dueDate: String = "",
+        goalTitle: String = "",
+        status: Int = 1,
+        flags: Int = 0,
+        durationMonths: Int = 0,
+        dailyMinutes: Int = 0,
+        minutes: Int = 0
+    ): Pair<ByteBuffer, Int> {
+        val strings = listOf(message, title, dueDate, goalTitle).map { it.toByteArray(Charsets.UTF_8) }
+        val length = ActionRecord.HEADER_BYTES + strings.sumOf { it.size }
+        val buffer = ActionRecord.allocate(length)
+        buffer.put(0, status.toByte())
+        buffer.put(1, action.toByte())
+        buffer.put(2, flags.toByte())
+        buffer.putInt(4, durationMonths)
+        buffer.putInt(8, dailyMinutes)
+        buffer.putInt(12, minutes)
+        var offset = ActionRecord.HEADER_BYTES
+        strings.forEachIndexed { i, bytes ->
+            buffer.putInt(16 + i * 4, bytes.size)
+            bytes.forEach { buffer.put(offset++, it) }
+        }
+        return buffer to length
+    }
+
+    // =====================================================================
+    // ACTION TESTS
+    // =====================================================================
+
+    @Test
+    fun `decode create goal`() {
+        val (buffer, length) = record(
+            action = 1, message = "Goal created!", title = "Learn Python", durationMonths = 6, dailyMinutes = 45
+        )
+
+        val decoded = ActionRecord.decode(buffer, length)
+
+        assertEquals(AssistantAction.CreateGoal("Goal created!", "Learn Python", 6, 45), decoded.action)
+        assertEquals("", decoded.unparsed)
+        assertFalse(decoded.truncated)
+    }
+
+    @Test
+    fun `decode create task with goal title`() {
+        val (buffer, length) = record(
+            action = 2, message = "Added", title = "Read", dueDate = "tomorrow", goalTitle = "Books",
+            flags = 1, minutes = 20
+        )
+
+        val decoded = ActionRecord.decode(buffer, length)
+
+        assertEquals(AssistantAction.CreateTask("Added", "Read", "tomorrow", 20, "Books"), decoded.action)
+    }
+
+    @Test
+    fun `decode create task without goal title flag`() {
+        val (buffer, length) = record(action = 2, message = "Added", title = "Read", dueDate = "today", minutes = 30)
+
+        val action = ActionRecord.decode(buffer, length).action as AssistantAction.CreateTask
+
+        assertNull(action.goalTitle)
+    }
+
+    @Test
+    fun `decode remaining action types`() {
+        val expected = mapOf(
+            0 to AssistantAction.Reply("Hi"),
+            3 to AssistantAction.CompleteTask("Hi", "Run"),
+            4 to AssistantAction.DeleteGoal("Hi", "Run"),
+            5 to AssistantAction.DeleteTask("Hi", "Run"),
+            6 to AssistantAction.ShowProgress("Hi"),
+            42 to AssistantAction.Reply("Hi")
+        )
+        for ((type, action) in expected) {
+            val (buffer, length) = record(action = type, message = "Hi", title = "Run")
+            assertEquals(action, ActionRecord.decode(buffer, length).action)
+        }
+    }
+
+    // =====================================================================
+    // STRING AND ERROR TESTS
+    // =====================================================================
+
+    @Test
+    fun `decode four byte characters`() {
+        val (buffer, length) = record(action = 0, message = "Go 🏃 café")
+
+        assertEquals(AssistantAction.Reply("Go 🏃 café"), ActionRecord.decode(buffer, length).action)
+    }
+
+    @Test
+    fun `invalid record keeps the raw reply`() {
+        val (buffer, length) = record(action = 0, message = "not json at all", status = 0)
+
+        val decoded = ActionRecord.decode(buffer, length)
+
+        assertNull(decoded.action)
+        assertEquals("not json at all", decoded.unparsed)
+    }
+
+    @Test
+    fun `truncated flag is reported`() {
+        val (buffer, length) = record(action = 0, message = "cut", flags = 2)
+
+        assertTrue(ActionRecord.decode(buffer, length).truncated)
+    }
+
+    @Test
+    fun `record shorter than its header is rejected`() {
+        val buffer = ActionRecord.allocate(0)
+
+        assertThrows(IllegalArgumentException::class.java) {
+            ActionRecord.decode(buffer, ActionRecord.HEADER_BYTES - 1)
+        }
+    }
+
+    @Test
+    fun `strings overrunning the record are rejected`() {
+        val (buffer, length) = record(action = 0, message = "Hello")
+
+        assertThrows(IllegalArgumentException::class.java) {
+            ActionRecord.decode(buffer, length - 1)
+        }
+    }
+}
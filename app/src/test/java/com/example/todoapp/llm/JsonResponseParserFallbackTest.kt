@@ -0,0 +1,89 @@
+package com.example.todoapp.llm
+
+import org.junit.Assert.*
+import org.junit.Assume.assumeFalse
+import org.junit.Before
+import org.junit.Test
+
+/**
+ * Unit tests for JsonResponseParser without the native library
+ *
+ * Object extraction then falls back from LlamaNative.scanAction to brace
+ * counting in Kotlin, which must find the same object
+ */
+class JsonResponseParserFallbackTest {
+
+    @Before
+    fun requireFallback() {
+        assumeFalse(LlamaNative.isLibraryLoaded)
+    }
+
+    // =====================================================================
+    // BRACES IN STRINGS
+    // =====================================================================
+
+    @Test
+    fun `braces inside the message do not end the object`() {
+        val json = """{"action":"reply","message":"Use } and { freely }","data":{}}"""
+
+        val action = JsonResponseParser.parse(json)
+
+        assertEquals(AssistantAction.Reply("Use } and { freely }"), action)
+    }
+
+    @Test
+    fun `escaped quote does not end the string`() {
+        val json = """{"action":"reply","message":"He said \"}\" twice","data":{}}"""
+
+        val action = JsonResponseParser.parse(json)
+
+        assertEquals(AssistantAction.Reply("He said \"}\" twice"), action)
+    }
+
+    @Test
+    fun `escaped backslash before closing quote ends the string`() {
+        val json = """{"action":"delete_task","message":"C:\\","data":{"title":"}"}} trailing }"""
+
+        val action = JsonResponseParser.parse(json)
+
+        assertEquals(AssistantAction.DeleteTask("C:\\", "}"), action)
+    }
+
+    @Test
+    fun `braces in nested data titles`() {
+        val json = """Okay: {"action":"create_task","message":"Added","data":{"title":"Fix {bug}","due_date":"today","minutes":15}}"""
+
+        val action = JsonResponseParser.parse(json) as AssistantAction.CreateTask
+
+        assertEquals("Fix {bug}", action.taskTitle)
+        assertEquals(15, action.minutes)
+    }
+
+    // =====================================================================
+    // OBJECT SELECTION
+    // =====================================================================
+
+    @Test
+    fun `first of several objects is taken`() {
+        val response = """Sure {"action":"show_progress","message":"A","data":{}} or {"action":"reply","message":"B","data":{}}"""
+
+        val action = JsonResponseParser.parse(response)
+
+        assertEquals(AssistantAction.ShowProgress("A"), action)
+    }
+
+    @Test
+    fun `unbalanced object falls back to a reply`() {
+        val response = """{"action":"reply","message":"oops"""
+
+        assertNull(JsonResponseParser.parse(response))
+        assertEquals(AssistantAction.Reply(response), JsonResponseParser.parseResponse(response))
+    }
+
+    @Test
+    fun `isValidJson matches object extraction`() {
+        assertTrue(JsonResponseParser.isValidJson("""Note: {"message":"a } b"}"""))
+        assertFalse(JsonResponseParser.isValidJson("no json here"))
+        assertFalse(JsonResponseParser.isValidJson("""{"message":"never closed}"""))
+    }
+}